@@ -0,0 +1,197 @@
+#include "AssetIO.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// One open, one size query and reads straight into the final buffer.
+	bool readWholeFile(const std::string& path, std::vector<unsigned char>& bytes)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		bool ok = GetFileSizeEx(file, &size) && size.QuadPart > 0;
+		if (ok)
+		{
+			bytes.resize((size_t)size.QuadPart);
+			size_t done = 0;
+			while (ok && done < bytes.size())
+			{
+				DWORD chunk = 0;
+				const DWORD want = (DWORD)std::min<size_t>(bytes.size() - done, 1u << 30);
+				ok = ReadFile(file, bytes.data() + done, want, &chunk, nullptr) && chunk > 0;
+				done += chunk;
+			}
+		}
+		CloseHandle(file);
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+		if (ok)
+		{
+			bytes.resize((size_t)st.st_size);
+			size_t done = 0;
+			while (ok && done < bytes.size())
+			{
+				const ssize_t chunk = ::read(fd, bytes.data() + done, bytes.size() - done);
+				ok = chunk > 0;
+				done += ok ? (size_t)chunk : 0;
+			}
+		}
+		::close(fd);
+#endif
+		if (!ok)
+			bytes.clear();
+		return ok;
+	}
+}
+
+AssetIO::AssetIO(const AssetIOParams& params)
+	: mParams(params)
+	, mThreads(std::max(1u, params.threads))
+{
+}
+
+AssetIO::~AssetIO()
+{
+	for (auto& slot : mSlots)
+	{
+		if (slot.second->done.valid())
+			slot.second->done.wait();
+	}
+}
+
+AssetIO& AssetIO::shared()
+{
+	static AssetIO instance;
+	return instance;
+}
+
+AssetIO::Request AssetIO::read(const std::string& path)
+{
+	std::unique_ptr<Slot> slot(new Slot);
+	slot->path = path;
+	slot->submitted = Clock::now();
+	Slot* raw = slot.get();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	++mStats.requests;
+	mStats.peakInFlight = std::max(mStats.peakInFlight, ++mInFlight);
+	raw->done = mThreads.submit([this, raw]() { mRead(*raw); }).share();
+	const Request request = mNextRequest++;
+	mSlots[request] = std::move(slot);
+	return request;
+}
+
+void AssetIO::mRead(Slot& slot)
+{
+	AssetBuffer& buffer = slot.buffer;
+	uint64_t size = 0, modifiedTime = 0;
+	bool ok;
+	if (MappedFile::stat(slot.path, size, modifiedTime) && size >= mParams.mapThreshold)
+	{
+		ok = buffer.mMapping.open(slot.path);
+		if (ok)
+		{
+			// Start readahead for the whole file, then fault in one byte per
+			// page so the mapping is resident before a decoder touches it.
+			buffer.mMapping.prefetch(0, buffer.size());
+			const unsigned char* data = buffer.mMapping.data();
+			unsigned char sink = 0;
+			for (size_t offset = 0; offset < buffer.size(); offset += 4096)
+				sink ^= ((const volatile unsigned char*)data)[offset];
+			(void)sink;
+		}
+	}
+	else
+	{
+		ok = readWholeFile(slot.path, buffer.mBytes);
+	}
+
+	const double latency = std::chrono::duration<double, std::milli>(Clock::now() - slot.submitted).count();
+	std::lock_guard<std::mutex> lock(mMutex);
+	slot.latencyMs = latency;
+	--mInFlight;
+	++mStats.completed;
+	if (!ok)
+	{
+		++mStats.failed;
+		return;
+	}
+	mStats.mapped += buffer.mapped() ? 1 : 0;
+	mStats.bytesRead += buffer.size();
+	mStats.totalLatencyMs += latency;
+	mStats.maxLatencyMs = std::max(mStats.maxLatencyMs, latency);
+}
+
+AssetIO::Slot& AssetIO::mSlot(Request request) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return *mSlots.at(request);
+}
+
+const AssetBuffer& AssetIO::wait(Request request)
+{
+	Slot& slot = mSlot(request);
+	slot.done.wait();
+	return slot.buffer;
+}
+
+void AssetIO::release(Request request)
+{
+	Slot& slot = mSlot(request);
+	slot.done.wait();
+	// Each request gets its own slot, so releasing it frees the slot as well as
+	// the contents rather than leaving the map to grow with every read.
+	std::unique_ptr<Slot> released;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto found = mSlots.find(request);
+		released = std::move(found->second);
+		mSlots.erase(found);
+	}
+}
+
+double AssetIO::latencyMs(Request request) const
+{
+	Slot& slot = mSlot(request);
+	std::lock_guard<std::mutex> lock(mMutex);
+	return slot.latencyMs;
+}
+
+AssetIO::Stats AssetIO::stats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void AssetIO::printStats(std::ostream& out) const
+{
+	const Stats s = stats();
+	const size_t succeeded = s.completed - s.failed;
+	out << std::fixed << std::setprecision(2)
+		<< "Asset I/O: " << s.completed << " of " << s.requests << " reads done (" << s.failed << " failed, " << s.mapped << " mapped), "
+		<< s.bytesRead / 1024 << " KB, latency avg " << (succeeded ? s.totalLatencyMs / succeeded : 0.0) << " ms max "
+		<< s.maxLatencyMs << " ms, " << s.peakInFlight << " in flight at peak on " << mThreads.size() << " threads" << std::endl;
+	out.unsetf(std::ios::floatfield);
+}
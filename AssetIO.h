@@ -0,0 +1,105 @@
+#pragma once
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct AssetIOParams
+{
+	// Blocking reads run on threads of their own so they never hold up the
+	// decode pool; each one is a request the disk is working on.
+	unsigned threads = 16;
+	// Files at least this big are mapped instead of read, and their pages are
+	// faulted in by the I/O thread so decoders never wait on the disk.
+	size_t mapThreshold = 256 << 10;
+};
+
+// File contents handed to decoders. Small files are read straight into an
+// owned buffer, large ones are a view of a MappedFile; neither copies again.
+class AssetBuffer
+{
+public:
+	const unsigned char* data() const { return mMapping.isOpen() ? mMapping.data() : mBytes.data(); }
+	size_t size() const { return mMapping.isOpen() ? mMapping.size() : mBytes.size(); }
+	bool valid() const { return size() != 0; }
+	bool mapped() const { return mMapping.isOpen(); }
+
+private:
+	friend class AssetIO;
+	MappedFile mMapping;
+	std::vector<unsigned char> mBytes;
+};
+
+// Asynchronous whole-file reads. read() queues a request and returns at once,
+// so a caller can put a whole batch in flight before waiting on the first.
+// Each request records its latency from submission to completion.
+class AssetIO
+{
+public:
+	typedef size_t Request;
+
+	struct Stats
+	{
+		size_t requests = 0;
+		size_t completed = 0;
+		size_t failed = 0;
+		size_t mapped = 0;
+		size_t bytesRead = 0;
+		size_t peakInFlight = 0;
+		double totalLatencyMs = 0;
+		double maxLatencyMs = 0;
+	};
+
+	explicit AssetIO(const AssetIOParams& params = AssetIOParams());
+	~AssetIO();
+
+	AssetIO(AssetIO const&) = delete;
+	void operator=(AssetIO const&) = delete;
+
+	static AssetIO& shared();
+
+	// Thread safe.
+	Request read(const std::string& path);
+
+	// Blocks until the request completes. The buffer is empty if the file
+	// could not be read, and stays valid until release().
+	const AssetBuffer& wait(Request request);
+	// Waits for the request and forgets it; its id is not valid afterwards.
+	void release(Request request);
+
+	// Milliseconds from read() to the data being in memory, 0 until complete.
+	double latencyMs(Request request) const;
+
+	Stats stats() const;
+	void printStats(std::ostream& out) const;
+
+private:
+	struct Slot
+	{
+		std::string path;
+		AssetBuffer buffer;
+		std::chrono::steady_clock::time_point submitted;
+		double latencyMs = 0;
+		std::shared_future<void> done;
+	};
+
+	void mRead(Slot& slot);
+	Slot& mSlot(Request request) const;
+
+private:
+	AssetIOParams mParams;
+	ThreadPool mThreads;
+	mutable std::mutex mMutex;
+	std::unordered_map<Request, std::unique_ptr<Slot>> mSlots; // requests not yet released
+	Request mNextRequest = 0;
+	size_t mInFlight = 0;
+	Stats mStats;
+};
@@ -0,0 +1,2040 @@
+#include "Benchmarks.h"
+#include "AssetIO.h"
+#include "BlockCompressor.h"
+#include "GltfModel.h"
+#include "HalfFloat.h"
+#include "IndexBuffer.h"
+#include "Json.h"
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+#include "MeshContainer.h"
+#include "MeshCodec.h"
+#include "MeshCooker.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "MipGenerator.h"
+#include "OffsetAllocator.h"
+#include "Simd.h"
+#include "TangentGenerator.h"
+#include "TexelRepack.h"
+#include "TextureContainer.h"
+#include "TextureLoader.h"
+#include "TexturePacker.h"
+#include "VertexLayout.h"
+#include "ThreadPool.h"
+#include "VirtualTexture.h"
+#include "stb_image.h"
+#include "glm/glm.hpp"
+#include "glm/gtx/transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Best of several runs, in milliseconds.
+	template <class F>
+	double timeMs(F&& fn, int runs = 5)
+	{
+		double best = 1e30;
+		for (int i = 0; i < runs; ++i)
+		{
+			auto start = Clock::now();
+			fn();
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		return best;
+	}
+
+	// Set by any self check that fails, so runBenchmarks can report it in its exit code.
+	bool gCheckFailed = false;
+
+	// Records the outcome of a self check and returns it, for use inline in the output.
+	bool check(bool ok)
+	{
+		if (!ok)
+			gCheckFailed = true;
+		return ok;
+	}
+
+	struct TestImage
+	{
+		std::string path;
+		int width = 0, height = 0, channels = 0;
+		std::vector<unsigned char> pixels;
+	};
+
+	const char* const kTextureAssets[] = {
+		"textures/green_grass.jpg",
+		"textures/green_grass_normalmap.png"
+	};
+
+	bool loadImage(const char* path, int desiredChannels, TestImage& image)
+	{
+		int nchannels = 0;
+		stbi_uc* data = stbi_load(path, &image.width, &image.height, &nchannels, desiredChannels);
+		if (!data)
+		{
+			std::cout << "  cannot load " << path << ": " << stbi_failure_reason() << std::endl;
+			return false;
+		}
+		image.path = path;
+		image.channels = desiredChannels ? desiredChannels : nchannels;
+		image.pixels.assign(data, data + (size_t)image.width * image.height * image.channels);
+		stbi_image_free(data);
+		return true;
+	}
+
+	bool readFile(const char* path, std::vector<unsigned char>& bytes)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+		bytes.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read((char*)bytes.data(), bytes.size());
+		return (bool)file;
+	}
+
+	int maxAbsDiff(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+	{
+		if (a.size() != b.size())
+			return 256;
+		int diff = 0;
+		for (size_t i = 0; i < a.size(); ++i)
+			diff = std::max(diff, std::abs(a[i] - b[i]));
+		return diff;
+	}
+
+	void benchMips()
+	{
+		const MipFilter filters[] = { MipFilter::Linear, MipFilter::Srgb, MipFilter::NormalMap };
+		const char* filterNames[] = { "linear", "srgb", "normal" };
+		const SimdLevel best = detectSimdLevel();
+
+		for (const char* path : kTextureAssets)
+		{
+			TestImage image;
+			if (!loadImage(path, 4, image))
+				continue;
+			const double mpix = (double)image.width * image.height / 1e6;
+			std::cout << "  " << path << " " << image.width << "x" << image.height << std::endl;
+
+			for (int f = 0; f < 3; ++f)
+			{
+				MipChain reference = MipGenerator::build(image.pixels.data(), image.width, image.height, 4, filters[f], nullptr, SIMD_SCALAR);
+				for (int level = SIMD_SCALAR; level <= best; ++level)
+				{
+					MipChain chain;
+					double ms = timeMs([&]() {
+						chain = MipGenerator::build(image.pixels.data(), image.width, image.height, 4, filters[f], nullptr, (SimdLevel)level);
+					});
+					std::cout << "    " << std::setw(7) << filterNames[f] << std::setw(8) << simdLevelName((SimdLevel)level)
+						<< std::setw(10) << std::fixed << std::setprecision(1) << mpix / (ms / 1000.0) << " MPix/s"
+						<< "  max diff vs scalar " << maxAbsDiff(chain.data, reference.data) << std::endl;
+				}
+				double ms = timeMs([&]() {
+					MipGenerator::build(image.pixels.data(), image.width, image.height, 4, filters[f], &ThreadPool::shared(), best);
+				});
+				std::cout << "    " << std::setw(7) << filterNames[f] << std::setw(8) << "pool"
+					<< std::setw(10) << mpix / (ms / 1000.0) << " MPix/s  (" << ThreadPool::shared().size() << " threads)" << std::endl;
+			}
+		}
+	}
+
+	// PSNR over the channels set in channelMask (bit 0 = R).
+	double psnr(const unsigned char* a, const unsigned char* b, size_t pixels, int channelMask)
+	{
+		double sse = 0;
+		size_t samples = 0;
+		for (size_t i = 0; i < pixels; ++i)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				if (!(channelMask & (1 << c)))
+					continue;
+				double d = (double)a[i * 4 + c] - b[i * 4 + c];
+				sse += d * d;
+				++samples;
+			}
+		}
+		if (sse == 0)
+			return 99.0;
+		return 10.0 * std::log10(255.0 * 255.0 / (sse / samples));
+	}
+
+	void benchBlockCompression()
+	{
+		struct Case
+		{
+			const char* path;
+			BlockFormat format;
+			const char* name;
+			int channelMask;
+		};
+		const Case cases[] = {
+			{ kTextureAssets[0], BlockFormat::BC1, "BC1", 0x7 },
+			{ kTextureAssets[0], BlockFormat::BC3, "BC3", 0xf },
+			{ kTextureAssets[1], BlockFormat::BC3, "BC3", 0xf },
+			{ kTextureAssets[1], BlockFormat::BC5, "BC5", 0x3 },
+		};
+
+		for (const Case& test : cases)
+		{
+			TestImage image;
+			if (!loadImage(test.path, 4, image))
+				continue;
+			const double mpix = (double)image.width * image.height / 1e6;
+			const size_t bytes = BlockCompressor::imageBytes(test.format, image.width, image.height);
+			std::vector<unsigned char> reference(bytes), blocks(bytes);
+			std::vector<unsigned char> decoded(image.pixels.size());
+			std::cout << "  " << test.name << " " << test.path << std::endl;
+
+			BlockCompressor::compress(image.pixels.data(), image.width, image.height, test.format, reference.data(), nullptr, SIMD_SCALAR);
+			for (int level = SIMD_SCALAR; level <= std::min<int>(detectSimdLevel(), SIMD_SSE2); ++level)
+			{
+				double ms = timeMs([&]() {
+					BlockCompressor::compress(image.pixels.data(), image.width, image.height, test.format, blocks.data(), nullptr, (SimdLevel)level);
+				});
+				std::cout << "    " << std::setw(8) << simdLevelName((SimdLevel)level) << std::setw(10) << std::fixed << std::setprecision(1)
+					<< mpix / (ms / 1000.0) << " MPix/s  " << (check(blocks == reference) ? "matches scalar" : "DIFFERS from scalar") << std::endl;
+			}
+			double ms = timeMs([&]() {
+				BlockCompressor::compress(image.pixels.data(), image.width, image.height, test.format, blocks.data(), &ThreadPool::shared());
+			});
+			std::cout << "    " << std::setw(8) << "pool" << std::setw(10) << mpix / (ms / 1000.0) << " MPix/s  ("
+				<< ThreadPool::shared().size() << " threads)" << std::endl;
+
+			ms = timeMs([&]() {
+				BlockCompressor::decompress(blocks.data(), image.width, image.height, test.format, decoded.data());
+			});
+			std::cout << "    " << std::setw(8) << "decode" << std::setw(10) << mpix / (ms / 1000.0) << " MPix/s  PSNR "
+				<< std::setprecision(2) << psnr(image.pixels.data(), decoded.data(), (size_t)image.width * image.height, test.channelMask)
+				<< " dB, " << bytes / 1024 << " KB vs " << image.pixels.size() / 1024 << " KB" << std::endl;
+		}
+	}
+
+	// Restart interval from the DRI segment, 0 if the file has none.
+	int jpegRestartInterval(const std::vector<unsigned char>& bytes)
+	{
+		size_t pos = 2;
+		while (pos + 4 <= bytes.size() && bytes[pos] == 0xff)
+		{
+			const int marker = bytes[pos + 1];
+			if (marker == 0xdd && pos + 6 <= bytes.size())
+				return (bytes[pos + 4] << 8) | bytes[pos + 5];
+			if (marker == 0xda)
+				break;
+			pos += 2 + (((size_t)bytes[pos + 2] << 8) | bytes[pos + 3]);
+		}
+		return 0;
+	}
+
+	// Decodes the JPEG assets with each kernel level stb_image allows, then
+	// with restart intervals spread over the pool. Only files with restart
+	// markers (DRI) can use the pool; the others decode serially.
+	void benchJpeg()
+	{
+		const SimdLevel best = detectSimdLevel();
+		for (const char* path : kTextureAssets)
+		{
+			std::vector<unsigned char> bytes;
+			if (!readFile(path, bytes) || bytes.size() < 4 || bytes[0] != 0xff || bytes[1] != 0xd8)
+				continue;
+
+			int width = 0, height = 0;
+			auto decode = [&](std::vector<unsigned char>& pixels) {
+				int nchannels = 0;
+				stbi_uc* data = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &nchannels, 4);
+				pixels.assign(data, data ? data + (size_t)width * height * 4 : data);
+				stbi_image_free(data);
+			};
+
+			std::vector<unsigned char> reference, pixels;
+			setJpegDecodePool(nullptr);
+			stbi_set_simd_limit(SIMD_SCALAR);
+			decode(reference);
+			if (reference.empty())
+			{
+				std::cout << "  cannot decode " << path << ": " << stbi_failure_reason() << std::endl;
+				continue;
+			}
+			const double mpix = (double)width * height / 1e6;
+			const int restartInterval = jpegRestartInterval(bytes);
+			std::cout << "  " << path << " " << width << "x" << height << ", restart interval " << restartInterval << std::endl;
+
+			for (int level = SIMD_SCALAR; level <= best; ++level)
+			{
+				stbi_set_simd_limit(level);
+				double ms = timeMs([&]() { decode(pixels); });
+				std::cout << "    " << std::setw(8) << simdLevelName((SimdLevel)level) << std::setw(10) << std::fixed << std::setprecision(1)
+					<< mpix / (ms / 1000.0) << " MPix/s  max diff vs scalar " << maxAbsDiff(pixels, reference) << std::endl;
+			}
+
+			setJpegDecodePool(&ThreadPool::shared());
+			double ms = timeMs([&]() { decode(pixels); });
+			std::cout << "    " << std::setw(8) << "pool" << std::setw(10) << mpix / (ms / 1000.0) << " MPix/s  max diff vs scalar "
+				<< maxAbsDiff(pixels, reference) << (restartInterval ? "" : " (no restart markers, serial)") << std::endl;
+			setJpegDecodePool(nullptr);
+		}
+		stbi_set_simd_limit(SIMD_AVX2);
+	}
+
+	// Concatenated IDAT payloads, i.e. the zlib stream of a PNG.
+	bool pngZlibStream(const std::vector<unsigned char>& bytes, std::vector<unsigned char>& stream)
+	{
+		stream.clear();
+		for (size_t pos = 8; pos + 12 <= bytes.size();)
+		{
+			const size_t length = (size_t)bytes[pos] << 24 | bytes[pos + 1] << 16 | bytes[pos + 2] << 8 | bytes[pos + 3];
+			if (length > bytes.size() - pos - 12)
+				return false;
+			if (memcmp(&bytes[pos + 4], "IDAT", 4) == 0)
+				stream.insert(stream.end(), bytes.begin() + pos + 8, bytes.begin() + pos + 8 + length);
+			pos += length + 12;
+		}
+		return !stream.empty();
+	}
+
+	// Decodes each PNG asset with the original inflate and row filters (simd
+	// limit 0) and with the multi-symbol inflate and SSE2 filters, reporting
+	// decoded megabytes per second for the inflate alone and the full decode.
+	void benchPng()
+	{
+		const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		for (const char* path : kTextureAssets)
+		{
+			std::vector<unsigned char> bytes, stream;
+			if (!readFile(path, bytes) || bytes.size() < 8 || memcmp(bytes.data(), signature, 8) != 0 || !pngZlibStream(bytes, stream))
+				continue;
+			std::cout << "  " << path << ", " << bytes.size() / 1024 << " KB" << std::endl;
+
+			for (int desired : { 0, 4 })
+			{
+				int width = 0, height = 0, channels = 0;
+				auto decode = [&](std::vector<unsigned char>& pixels) {
+					stbi_uc* data = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &channels, desired);
+					const int outChannels = desired ? desired : channels;
+					pixels.assign(data, data ? data + (size_t)width * height * outChannels : data);
+					stbi_image_free(data);
+				};
+
+				std::vector<unsigned char> reference, pixels;
+				stbi_set_simd_limit(0);
+				decode(reference);
+				if (reference.empty())
+				{
+					std::cout << "  cannot decode " << path << ": " << stbi_failure_reason() << std::endl;
+					break;
+				}
+				std::cout << "    " << (desired ? "converted to " : "native ") << (desired ? desired : channels) << " channels" << std::endl;
+
+				for (int limit : { 0, (int)SIMD_AVX2 })
+				{
+					stbi_set_simd_limit(limit);
+					int inflated = 0;
+					const double inflateMs = timeMs([&]() {
+						char* data = stbi_zlib_decode_malloc((const char*)stream.data(), (int)stream.size(), &inflated);
+						free(data);
+					});
+					const double decodeMs = timeMs([&]() { decode(pixels); });
+					std::cout << "    " << std::setw(8) << (limit ? "fast" : "original") << std::fixed << std::setprecision(1)
+						<< std::setw(10) << inflated / 1e6 / (inflateMs / 1000.0) << " MB/s inflate"
+						<< std::setw(10) << pixels.size() / 1e6 / (decodeMs / 1000.0) << " MB/s decode"
+						<< "  max diff " << maxAbsDiff(pixels, reference) << std::endl;
+				}
+			}
+		}
+		stbi_set_simd_limit(SIMD_AVX2);
+	}
+
+	// Writes the chain for each asset as a cooked container, then times how
+	// long opening it takes (header and index only) against a full read of the
+	// mapped levels, and checks every level round-trips.
+	void benchContainer()
+	{
+		for (size_t asset = 0; asset < sizeof(kTextureAssets) / sizeof(kTextureAssets[0]); ++asset)
+		{
+			TestImage image;
+			if (!loadImage(kTextureAssets[asset], 4, image))
+				continue;
+			const MipFilter filter = asset == 1 ? MipFilter::NormalMap : MipFilter::Srgb;
+			const MipChain chain = MipGenerator::build(image.pixels.data(), image.width, image.height, 4, filter, &ThreadPool::shared());
+			const CompressedChain blocks = BlockCompressor::compress(chain, asset == 1 ? BlockFormat::BC5 : BlockFormat::BC1, &ThreadPool::shared());
+			std::cout << "  " << image.path << std::endl;
+
+			struct Case
+			{
+				const char* name;
+				bool blocks;
+				Supercompression supercompression;
+			};
+			const Case cases[] = {
+				{ "rgba8", false, Supercompression::None },
+				{ "rgba8+stb", false, Supercompression::Stb },
+				{ "bc", true, Supercompression::None },
+				{ "bc+stb", true, Supercompression::Stb },
+			};
+			for (const Case& test : cases)
+			{
+				const std::string path = image.path + ".bench.otex";
+				const auto start = Clock::now();
+				const bool written = test.blocks
+					? TextureContainer::write(path, blocks, test.supercompression, 0, 0)
+					: TextureContainer::write(path, chain, test.supercompression, 0, 0);
+				const double writeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				if (!written)
+				{
+					std::cout << "    cannot write " << path << std::endl;
+					continue;
+				}
+
+				TextureContainer container;
+				const double openMs = timeMs([&]() { container.open(path); });
+				size_t fileBytes = 0;
+				bool same = container.isOpen();
+				std::vector<unsigned char> scratch;
+				for (size_t i = 0; same && i < container.levelCount(); ++i)
+				{
+					const TextureContainer::Level& level = container.level(i);
+					fileBytes += level.size;
+					const unsigned char* expected = test.blocks ? blocks.levelData(i) : chain.levelData(i);
+					const unsigned char* texels = container.levelTexels(i, scratch);
+					same = texels && memcmp(texels, expected, level.uncompressedSize) == 0;
+				}
+				std::cout << "    " << std::setw(10) << std::left << test.name << std::right << std::fixed << std::setprecision(2)
+					<< " write " << std::setw(8) << writeMs << " ms  open " << std::setw(6) << openMs << " ms  "
+					<< std::setw(6) << fileBytes / 1024 << " KB  " << (check(same) ? "round-trips" : "DIFFERS") << std::endl;
+				container.close();
+				std::remove(path.c_str());
+			}
+		}
+	}
+
+	// Feedback a 1/8 resolution pass over a 1280x720 view would write for a
+	// camera flying low over a floor carrying the virtual texture repeat times.
+	void synthesizeFeedback(const VirtualLayout& layout, float cameraZ, float repeat, std::vector<uint32_t>& feedback)
+	{
+		const int width = 160, height = 90, scale = 8;
+		const glm::vec3 eye(0.f, 2.f, cameraZ);
+		const float tanHalfFov = 0.5f;
+		const float aspect = 1280.f / 720.f;
+		feedback.assign((size_t)width * height, kNoPage);
+		auto groundUv = [&](float px, float py, glm::vec2& uv) {
+			const glm::vec3 dir(((px / 1280.f) * 2.f - 1.f) * tanHalfFov * aspect, (1.f - (py / 720.f) * 2.f) * tanHalfFov - 0.3f, -1.f);
+			if (dir.y >= 0.f)
+				return false;
+			const float t = -eye.y / dir.y;
+			uv = glm::vec2(eye.x + dir.x * t, eye.z + dir.z * t) / 1000.f * repeat;
+			return true;
+		};
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const float px = x * scale + 0.5f, py = y * scale + 0.5f;
+				glm::vec2 uv, uvX, uvY;
+				if (!groundUv(px, py, uv) || !groundUv(px + 1.f, py, uvX) || !groundUv(px, py + 1.f, uvY))
+					continue;
+				const glm::vec2 dx = (uvX - uv) * (float)layout.width, dy = (uvY - uv) * (float)layout.height;
+				const float lod = 0.5f * std::log2(std::max(glm::dot(dx, dx), glm::dot(dy, dy)));
+				const int level = std::min(std::max((int)lod, 0), layout.levelCount - 1);
+				const glm::vec2 wrapped = uv - glm::floor(uv);
+				const int pageX = std::min((int)(wrapped.x * layout.pagesX(level)), layout.pagesX(level) - 1);
+				const int pageY = std::min((int)(wrapped.y * layout.pagesY(level)), layout.pagesY(level) - 1);
+				feedback[(size_t)y * width + x] = packPage(level, pageX, pageY);
+			}
+		}
+	}
+
+	// Runs the CPU half of the virtual texture (feedback reduction, request
+	// prioritization, tile cache and page table rebuild) over a 64K x 64K
+	// texture as the camera moves, with every requested tile arriving at once.
+	void benchVirtualTexture()
+	{
+		const VirtualLayout layout(65536, 65536, 128);
+		const int slotsPerRow = 32, loadsPerFrame = 32, frames = 200;
+		TileCache cache(slotsPerRow * slotsPerRow);
+		PageTable pageTable(layout, slotsPerRow);
+		uint32_t evicted = kNoPage;
+		const int root = cache.allocate(packPage(layout.levelCount - 1, 0, 0), 1, evicted);
+		cache.pin(root);
+		cache.markReady(root);
+
+		std::vector<uint32_t> feedback;
+		std::vector<PageRequest> requests;
+		double reduceMs = 0, scheduleMs = 0, rebuildMs = 0;
+		size_t requested = 0, hits = 0, loads = 0, evictions = 0, stillMissing = 0;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			const uint64_t frameId = (uint64_t)frame + 2;
+			synthesizeFeedback(layout, -frame * 0.25f, 4.f, feedback);
+
+			auto start = Clock::now();
+			FeedbackAnalyzer::reduce(feedback.data(), feedback.size(), layout, requests);
+			auto mid = Clock::now();
+			reduceMs += std::chrono::duration<double, std::milli>(mid - start).count();
+
+			requested += requests.size();
+			size_t missing = 0;
+			for (const PageRequest& request : requests)
+			{
+				const int slot = cache.find(request.page);
+				if (slot >= 0)
+				{
+					cache.touch(slot, frameId);
+					++hits;
+				}
+				else
+				{
+					requests[missing++] = request;
+				}
+			}
+			requests.resize(missing);
+			FeedbackAnalyzer::prioritize(requests, layout, [&](uint32_t page) {
+				const int slot = cache.find(page);
+				if (slot < 0)
+					return false;
+				cache.touch(slot, frameId);
+				return true;
+			});
+			int issued = 0;
+			for (const PageRequest& request : requests)
+			{
+				if (issued == loadsPerFrame)
+					break;
+				const int slot = cache.allocate(request.page, frameId, evicted);
+				if (slot < 0)
+					break;
+				evictions += evicted != kNoPage;
+				cache.markReady(slot);
+				++issued;
+			}
+			loads += issued;
+			stillMissing += requests.size() - issued;
+			auto end = Clock::now();
+			scheduleMs += std::chrono::duration<double, std::milli>(end - mid).count();
+
+			pageTable.rebuild(cache);
+			rebuildMs += std::chrono::duration<double, std::milli>(Clock::now() - end).count();
+		}
+
+		std::cout << "  " << layout.width << "x" << layout.height << ", " << layout.levelCount << " levels, " << cache.slotCount()
+			<< " slots, 160x90 feedback, " << frames << " frames" << std::endl;
+		std::cout << std::fixed << std::setprecision(3)
+			<< "    per frame: reduce " << reduceMs / frames << " ms, prioritize + cache " << scheduleMs / frames
+			<< " ms, page table rebuild " << rebuildMs / frames << " ms" << std::endl;
+		std::cout << std::setprecision(1)
+			<< "    per frame: " << (double)requested / frames << " pages requested, " << 100.0 * hits / std::max<size_t>(requested, 1)
+			<< "% resident, " << (double)loads / frames << " loaded, " << (double)evictions / frames << " evicted, "
+			<< (double)stillMissing / frames << " left waiting" << std::endl;
+	}
+
+	// Packs a synthetic material library (many small textures plus a few that
+	// fill whole layers), checks every packed level against its source, and
+	// counts the texture binds a scene of randomly ordered draws needs with
+	// one texture per material against one array per group.
+	void benchAtlas()
+	{
+		std::srand(7);
+		const int sizes[] = { 32, 64, 128, 256, 512 };
+		std::vector<MipChain> chains;
+		std::vector<CompressedChain> blocks;
+		chains.reserve(200);
+		blocks.reserve(200);
+		std::vector<TexturePacker::Input> inputs;
+		for (int i = 0; i < 160; ++i)
+		{
+			const bool large = i % 20 == 0;
+			const int width = large ? 2048 : sizes[std::rand() % 5], height = large ? 2048 : sizes[std::rand() % 5];
+			std::vector<unsigned char> pixels((size_t)width * height * 4);
+			for (size_t p = 0; p < pixels.size(); ++p)
+				pixels[p] = (unsigned char)(i * 37 + (p / 4 % width) * 3 + (p / 4 / width) * 5 + p % 4 * 50);
+			chains.push_back(MipGenerator::build(pixels.data(), width, height, 4, MipFilter::Linear, &ThreadPool::shared()));
+
+			TexturePacker::Input input;
+			input.name = "material" + std::to_string(i);
+			if (i % 2)
+			{
+				blocks.push_back(BlockCompressor::compress(chains.back(), BlockFormat::BC1, &ThreadPool::shared()));
+				input.blocks = &blocks.back();
+			}
+			else
+			{
+				input.chain = &chains.back();
+			}
+			inputs.push_back(input);
+		}
+
+		PackedTextureSet set;
+		const double packMs = timeMs([&]() { set = TexturePacker::pack(inputs); }, 3);
+		size_t bytes = 0;
+		for (const PackedArray& array : set.arrays)
+		{
+			bytes += array.data.size();
+			std::cout << "    " << (array.atlas ? "atlas " : "layers") << " " << array.width() << "x" << array.height() << " x"
+				<< array.layers << ", " << array.levels.size() << " levels, " << (array.format == TexelFormat::BC1 ? "BC1" : "RGBA8") << std::endl;
+		}
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			const PackedTexture& texture = set.textures[i];
+			const PackedArray& array = set.arrays[texture.array];
+			const bool compressed = inputs[i].blocks != nullptr;
+			const std::vector<MipLevel>& levels = compressed ? blocks[i / 2].levels : chains[i].levels;
+			const unsigned char* data = compressed ? blocks[i / 2].data.data() : chains[i].data.data();
+			const TexelBlock block = texelBlock(array.format);
+			for (size_t level = 0; level < array.levels.size(); ++level)
+			{
+				const int columns = (levels[level].width + block.size - 1) / block.size;
+				const int rows = (levels[level].height + block.size - 1) / block.size;
+				const int layerColumns = (array.levels[level].width + block.size - 1) / block.size;
+				const unsigned char* layer = array.layerData(level, texture.layer);
+				for (int row = 0; row < rows; ++row)
+				{
+					const size_t dst = ((size_t)((texture.y >> level) / block.size + row) * layerColumns + (texture.x >> level) / block.size) * block.bytes;
+					if (memcmp(layer + dst, data + levels[level].offset + (size_t)row * columns * block.bytes, columns * block.bytes) != 0)
+						++mismatches;
+				}
+			}
+		}
+
+		const std::string path = "textures/bench.opak";
+		PackedTextureSet loaded;
+		const bool roundTrip = set.write(path) && loaded.read(path) && loaded.arrays.size() == set.arrays.size() &&
+			loaded.textures.size() == set.textures.size() && loaded.arrays.back().data == set.arrays.back().data &&
+			loaded.textures.back().uvRect == set.textures.back().uvRect;
+		std::remove(path.c_str());
+
+		const int draws = 2000;
+		size_t bindsBefore = 0, bindsAfter = 0;
+		size_t lastMaterial = ~(size_t)0;
+		int lastArray = -1;
+		for (int draw = 0; draw < draws; ++draw)
+		{
+			const size_t material = (size_t)std::rand() % inputs.size();
+			bindsBefore += material != lastMaterial;
+			bindsAfter += set.textures[material].array != lastArray;
+			lastMaterial = material;
+			lastArray = set.textures[material].array;
+		}
+
+		std::cout << "  " << inputs.size() << " textures into " << set.arrays.size() << " arrays, " << bytes / 1048576 << " MB, packed in "
+			<< std::fixed << std::setprecision(1) << packMs << " ms, " << mismatches << " mismatched rows, "
+			<< (check(roundTrip) ? "file round-trips" : "FILE DIFFERS") << std::endl;
+		std::cout << "  " << draws << " draws over random materials: " << bindsBefore << " texture binds per frame, "
+			<< bindsAfter << " switching packed arrays on one unit, " << set.arrays.size() << " with each array on its own unit" << std::endl;
+	}
+
+	void benchRepack()
+	{
+		const int conversions[][2] = { { 4, 2 }, { 4, 1 }, { 3, 4 }, { 1, 4 }, { 2, 4 } };
+		const size_t pixels = 2048 * 2048 + 7; // odd count so the scalar tails run too
+		const SimdLevel best = detectSimdLevel();
+		std::vector<unsigned char> src(pixels * 4);
+		uint32_t state = 12345;
+		for (unsigned char& byte : src)
+		{
+			state = state * 1664525u + 1013904223u;
+			byte = (unsigned char)(state >> 24);
+		}
+
+		for (const auto& conversion : conversions)
+		{
+			const int from = conversion[0], to = conversion[1];
+			std::vector<unsigned char> reference(pixels * to), dst(pixels * to);
+			TexelRepack::repack(src.data(), from, reference.data(), to, pixels, SIMD_SCALAR);
+			for (int level = SIMD_SCALAR; level <= best; ++level)
+			{
+				double ms = timeMs([&]() { TexelRepack::repack(src.data(), from, dst.data(), to, pixels, (SimdLevel)level); });
+				std::cout << "  " << from << " -> " << to << " channels" << std::setw(8) << simdLevelName((SimdLevel)level)
+					<< std::setw(10) << std::fixed << std::setprecision(1) << pixels / 1e6 / (ms / 1000.0) << " MPix/s"
+					<< (check(dst == reference) ? "" : "  DIFFERS FROM SCALAR") << std::endl;
+			}
+		}
+	}
+
+	void benchHalf()
+	{
+		// Every 61st float bit pattern: all exponents, both signs, denormals,
+		// infinities and NaNs.
+		std::vector<float> values;
+		for (uint64_t bits = 0; bits < 0x100000000ull; bits += 61)
+		{
+			const uint32_t u = (uint32_t)bits;
+			float f;
+			memcpy(&f, &u, 4);
+			values.push_back(f);
+		}
+		values.resize(values.size() / 8 * 8);
+		const size_t count = values.size();
+		const SimdLevel best = detectSimdLevel();
+
+		// Throughput is measured on HDR-like pixels, radiance spread over many
+		// exponents with a sprinkling of negatives and denormals.
+		const size_t pixels = 2048 * 2048;
+		std::vector<float> image(pixels * 4);
+		uint32_t state = 987654321;
+		for (float& channel : image)
+		{
+			state = state * 1664525u + 1013904223u;
+			channel = std::ldexp((state >> 8) / 16777216.f, (int)(state % 40) - 24) * (state % 97 == 0 ? -1.f : 1.f);
+		}
+
+		std::vector<uint16_t> reference(count), halves(count), imageHalves(pixels * 4);
+		HalfFloat::fromFloat(values.data(), reference.data(), count, SIMD_SCALAR);
+		for (int level = SIMD_SCALAR; level <= best; ++level)
+		{
+			HalfFloat::fromFloat(values.data(), halves.data(), count, (SimdLevel)level);
+			size_t mismatches = 0;
+			for (size_t i = 0; i < count; ++i)
+				mismatches += halves[i] != reference[i] && !std::isnan(values[i]);
+			double ms = timeMs([&]() { HalfFloat::fromFloat(image.data(), imageHalves.data(), image.size(), (SimdLevel)level); });
+			std::cout << "  float -> half      " << std::setw(8) << (level == SIMD_AVX2 ? "F16C" : simdLevelName((SimdLevel)level))
+				<< std::setw(10) << std::fixed << std::setprecision(1) << image.size() / 1e6 / (ms / 1000.0) << " M/s  "
+				<< mismatches << " non-NaN mismatches vs scalar over " << count << " bit patterns" << std::endl;
+		}
+
+		std::vector<uint32_t> packedReference(count / 4), packed(count / 4), imagePacked(pixels);
+		HalfFloat::packR11G11B10F(values.data(), 4, packedReference.data(), count / 4, SIMD_SCALAR);
+		for (int level = SIMD_SCALAR; level <= std::min(best, SIMD_SSE2); ++level)
+		{
+			HalfFloat::packR11G11B10F(values.data(), 4, packed.data(), count / 4, (SimdLevel)level);
+			double ms = timeMs([&]() { HalfFloat::packR11G11B10F(image.data(), 4, imagePacked.data(), pixels, (SimdLevel)level); });
+			std::cout << "  RGBA -> R11G11B10F " << std::setw(8) << simdLevelName((SimdLevel)level)
+				<< std::setw(10) << pixels / 1e6 / (ms / 1000.0) << " MPix/s  "
+				<< (check(packed == packedReference) ? "matches scalar" : "DIFFERS FROM SCALAR") << std::endl;
+		}
+
+		// Round trips: every half must survive half -> float -> half, and float
+		// -> packed -> float must stay within half an ulp of the target mantissa
+		// over the formats' normal range.
+		size_t halfFailures = 0;
+		for (uint32_t bits = 0; bits < 65536; ++bits)
+		{
+			const uint16_t half = (uint16_t)bits;
+			float f;
+			uint16_t back;
+			HalfFloat::toFloat(&half, &f, 1);
+			HalfFloat::fromFloat(&f, &back, 1, SIMD_SCALAR);
+			halfFailures += back != half && !std::isnan(f);
+		}
+		double halfError = 0, smallError[3] = { 0, 0, 0 };
+		for (int i = 0; i < 1000000; ++i)
+		{
+			float rgba[4];
+			for (float& channel : rgba)
+			{
+				state = state * 1664525u + 1013904223u;
+				channel = std::ldexp(1.f + (state >> 8) / 16777216.f, (int)(state % 29) - 14); // [2^-14, 2^15)
+			}
+			uint16_t half;
+			float back;
+			HalfFloat::fromFloat(rgba, &half, 1, SIMD_SCALAR);
+			HalfFloat::toFloat(&half, &back, 1);
+			halfError = std::max(halfError, (double)std::fabs(back - rgba[0]) / rgba[0]);
+			uint32_t packedPixel;
+			float rgb[3];
+			HalfFloat::packR11G11B10F(rgba, 4, &packedPixel, 1, SIMD_SCALAR);
+			HalfFloat::unpackR11G11B10F(&packedPixel, rgb, 1);
+			for (int c = 0; c < 3; ++c)
+				smallError[c] = std::max(smallError[c], (double)std::fabs(rgb[c] - rgba[c]) / rgba[c]);
+		}
+		const bool accurate = halfFailures == 0 && halfError <= std::ldexp(1.0, -11) &&
+			smallError[0] <= std::ldexp(1.0, -7) && smallError[1] <= std::ldexp(1.0, -7) && smallError[2] <= std::ldexp(1.0, -6);
+		std::cout << std::setprecision(6) << "  round trip: " << halfFailures << " of 65536 halves changed, max relative error half "
+			<< halfError << ", R11G11B10F " << smallError[0] << "/" << smallError[1] << "/" << smallError[2]
+			<< (check(accurate) ? "  ok" : "  FAILED") << std::endl;
+	}
+
+	bool makeDirectory(const std::string& path)
+	{
+#ifdef _WIN32
+		return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+
+	void removeDirectory(const std::string& path)
+	{
+#ifdef _WIN32
+		_rmdir(path.c_str());
+#else
+		rmdir(path.c_str());
+#endif
+	}
+
+	// Drops a file from the page cache so the next read goes to the disk.
+	// Windows has no per-file equivalent, so its passes are always warm.
+	bool evictFile(const std::string& path)
+	{
+#ifdef _WIN32
+		(void)path;
+		return false;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		// Dirty pages stay cached, so freshly written files are flushed first.
+		const bool evicted = fsync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+		::close(fd);
+		return evicted;
+#endif
+	}
+
+	void benchAssetIO()
+	{
+		// Thousands of small images with a large one every 50th, which AssetIO
+		// maps instead of reading.
+		const std::string directory = "textures/bench_io";
+		const int fileCount = 4000;
+		if (!makeDirectory(directory))
+		{
+			std::cout << "  cannot create " << directory << std::endl;
+			return;
+		}
+		std::vector<std::string> paths;
+		size_t totalBytes = 0;
+		uint32_t state = 24680;
+		for (int i = 0; i < fileCount; ++i)
+		{
+			const int size = i % 50 == 0 ? 512 : 64;
+			std::vector<unsigned char> pixels((size_t)size * size * 3);
+			for (unsigned char& byte : pixels)
+			{
+				state = state * 1664525u + 1013904223u;
+				byte = (unsigned char)(state >> 24);
+			}
+			paths.push_back(directory + "/" + std::to_string(i) + ".ppm");
+			std::ofstream file(paths.back(), std::ios::binary);
+			file << "P6\n" << size << " " << size << "\n255\n";
+			file.write((const char*)pixels.data(), pixels.size());
+			totalBytes += (size_t)file.tellp();
+		}
+
+		bool cold = true;
+		auto evictAll = [&]() {
+			for (const std::string& path : paths)
+				cold = evictFile(path) && cold;
+		};
+
+		ThreadPool& pool = ThreadPool::shared();
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			const bool evict = pass == 0;
+			if (evict)
+				evictAll();
+			size_t decoded = 0;
+			auto start = Clock::now();
+			for (const std::string& path : paths)
+			{
+				int width, height, channels;
+				stbi_uc* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+				decoded += data != nullptr;
+				stbi_image_free(data);
+			}
+			const double baselineMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			if (evict)
+				evictAll();
+			AssetIO io;
+			std::vector<size_t> ioDecoded(paths.size(), 0);
+			start = Clock::now();
+			std::vector<AssetIO::Request> requests;
+			for (const std::string& path : paths)
+				requests.push_back(io.read(path));
+			pool.parallelFor(requests.size(), 16, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i)
+				{
+					const AssetBuffer& buffer = io.wait(requests[i]);
+					int width, height, channels;
+					stbi_uc* data = stbi_load_from_memory(buffer.data(), (int)buffer.size(), &width, &height, &channels, 0);
+					ioDecoded[i] = data != nullptr;
+					stbi_image_free(data);
+					io.release(requests[i]);
+				}
+			});
+			const double ioMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			const AssetIO::Stats stats = io.stats();
+			const size_t ioCount = std::count(ioDecoded.begin(), ioDecoded.end(), (size_t)1);
+
+			const char* label = !evict ? "warm" : cold ? "cold" : "warm*";
+			std::cout << std::fixed << std::setprecision(0)
+				<< "  " << label << " stbi_load  " << std::setw(8) << fileCount / (baselineMs / 1000.0) << " files/s "
+				<< std::setw(6) << totalBytes / 1048576.0 / (baselineMs / 1000.0) << " MB/s  " << decoded << " decoded" << std::endl;
+			std::cout << "  " << label << " AssetIO    " << std::setw(8) << fileCount / (ioMs / 1000.0) << " files/s "
+				<< std::setw(6) << totalBytes / 1048576.0 / (ioMs / 1000.0) << " MB/s  " << ioCount << " decoded, "
+				<< stats.mapped << " mapped, latency avg " << std::setprecision(2) << stats.totalLatencyMs / std::max<size_t>(1, stats.completed - stats.failed)
+				<< " ms max " << stats.maxLatencyMs << " ms, " << stats.peakInFlight << " in flight at peak" << std::endl;
+		}
+		if (!cold)
+			std::cout << "  * the page cache could not be dropped here, so the first pass is warm too" << std::endl;
+
+		for (const std::string& path : paths)
+			std::remove(path.c_str());
+		removeDirectory(directory);
+	}
+
+	// A torus of rings x segments vertices about 20 units across, far from the
+	// origin so positions need their full precision. The outer half mirrors
+	// its UVs, which flips the tangent sign there.
+	VertexStreams makeTorus(int rings, int segments)
+	{
+		const float pi = 3.14159265f, major = 8.f, minor = 2.f;
+		const glm::vec3 center(120.f, -40.f, 75.f);
+		VertexStreams streams;
+		for (int ring = 0; ring < rings; ++ring)
+		{
+			const float u = (float)ring / (rings - 1), theta = u * 2.f * pi;
+			for (int segment = 0; segment < segments; ++segment)
+			{
+				const float v = (float)segment / (segments - 1), phi = v * 2.f * pi;
+				const glm::vec3 normal(std::cos(theta) * std::cos(phi), std::sin(theta) * std::cos(phi), std::sin(phi));
+				const glm::vec3 tangent(-std::sin(theta), std::cos(theta), 0.f);
+				const bool mirrored = v < 0.5f;
+				streams.positions.push_back(center + glm::vec3(std::cos(theta), std::sin(theta), 0.f) * major + normal * minor);
+				streams.normals.push_back(normal);
+				streams.tangents.push_back(glm::vec4(tangent, mirrored ? -1.f : 1.f));
+				streams.texCoords.push_back(glm::vec2(mirrored ? 1.f - u : u, v));
+			}
+		}
+		return streams;
+	}
+
+	// makeTorus' triangles, counter-clockwise seen from outside, row by row.
+	std::vector<uint32_t> makeTorusIndices(int rings, int segments)
+	{
+		std::vector<uint32_t> indices;
+		for (int ring = 0; ring + 1 < rings; ++ring)
+		{
+			for (int segment = 0; segment + 1 < segments; ++segment)
+			{
+				const uint32_t a = ring * segments + segment, b = a + 1, c = a + segments + 1, d = a + segments;
+				const uint32_t quad[] = { a, d, c, a, c, b };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+		return indices;
+	}
+
+	void benchVertexLayout()
+	{
+		const VertexStreams torus = makeTorus(512, 256);
+		const VertexLayout layouts[] = {
+			VertexLayout::floats(),
+			VertexLayout::compact(VertexEncoding::Half3),
+			VertexLayout::compact(VertexEncoding::Snorm16x3)
+		};
+		std::cout << "  " << torus.count() << " vertices, bounds diagonal about 28 units, 120 units from the origin" << std::endl;
+		for (const VertexLayout& layout : layouts)
+		{
+			PackedVertices packed;
+			const double ms = timeMs([&]() { packed = VertexPacker::pack(torus, layout); }, 3);
+			const VertexQuantizationError error = VertexPacker::measure(torus, packed);
+			std::cout << "  " << layout.describe() << std::endl << std::fixed << std::setprecision(1)
+				<< "    " << std::setw(6) << packed.data.size() / 1024.0 << " KB, packed in " << ms << " ms; max error: position "
+				<< std::setprecision(6) << error.position << " (" << error.positionRelative * 100.0 << "% of diagonal), uv "
+				<< error.texCoord << ", normal " << std::setprecision(3) << error.normalDegrees << " deg, tangent "
+				<< error.tangentDegrees << " deg, " << error.tangentSignFlips << " sign flips" << std::endl;
+		}
+	}
+
+	// A grid of side x side vertices written as an OBJ with v/vt/vn faces,
+	// every vertex shared by up to six triangles, as quads so the importer
+	// also has to triangulate.
+	void writeGridObj(const std::string& path, int side)
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return;
+		fprintf(file, "# %d x %d grid\no grid\n", side, side);
+		for (int y = 0; y < side; ++y)
+		{
+			for (int x = 0; x < side; ++x)
+				fprintf(file, "v %.6f %.6f %.6f\n", x * 0.01f, std::sin(x * 0.05f) * std::cos(y * 0.05f), y * 0.01f);
+		}
+		for (int y = 0; y < side; ++y)
+		{
+			for (int x = 0; x < side; ++x)
+				fprintf(file, "vt %.6f %.6f\n", (float)x / (side - 1), (float)y / (side - 1));
+		}
+		fprintf(file, "vn 0 1 0\n");
+		for (int y = 0; y + 1 < side; ++y)
+		{
+			for (int x = 0; x + 1 < side; ++x)
+			{
+				const int a = y * side + x + 1, b = a + 1, c = a + side + 1, d = a + side;
+				fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, b, b, c, c, d, d);
+			}
+		}
+		fclose(file);
+	}
+
+	// The same grid as a binary little endian PLY with triangle faces.
+	void writeGridPly(const std::string& path, int side)
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return;
+		const int triangles = (side - 1) * (side - 1) * 2;
+		fprintf(file, "ply\nformat binary_little_endian 1.0\nelement vertex %d\nproperty float x\nproperty float y\n"
+			"property float z\nproperty float u\nproperty float v\nelement face %d\nproperty list uchar int vertex_indices\n"
+			"end_header\n", side * side, triangles);
+		for (int y = 0; y < side; ++y)
+		{
+			for (int x = 0; x < side; ++x)
+			{
+				const float vertex[5] = { x * 0.01f, std::sin(x * 0.05f) * std::cos(y * 0.05f), y * 0.01f,
+					(float)x / (side - 1), (float)y / (side - 1) };
+				fwrite(vertex, sizeof(vertex), 1, file);
+			}
+		}
+		for (int y = 0; y + 1 < side; ++y)
+		{
+			for (int x = 0; x + 1 < side; ++x)
+			{
+				const int a = y * side + x, b = a + 1, c = a + side + 1, d = a + side;
+				const int faces[2][3] = { { a, b, c }, { a, c, d } };
+				for (const auto& face : faces)
+				{
+					const unsigned char count = 3;
+					fwrite(&count, 1, 1, file);
+					fwrite(face, sizeof(face), 1, file);
+				}
+			}
+		}
+		fclose(file);
+	}
+
+	void benchMeshImport()
+	{
+		const int side = 708; // about a million triangles
+		const std::string obj = "bench_mesh.obj", ply = "bench_mesh.ply";
+		writeGridObj(obj, side);
+		writeGridPly(ply, side);
+
+		MeshImporter importer;
+		std::cout << "  " << side << " x " << side << " grid, " << ThreadPool::shared().size() << " pool threads" << std::endl;
+		const char* paths[] = { obj.c_str(), ply.c_str() };
+		for (const char* path : paths)
+		{
+			// Stage times are those of the fastest of three loads.
+			Mesh mesh;
+			MeshImporter::Stats stats;
+			double ms = 1e30;
+			for (int run = 0; run < 3; ++run)
+			{
+				auto start = Clock::now();
+				if (!importer.load(path, mesh))
+					break;
+				const double runMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				if (runMs < ms)
+				{
+					ms = runMs;
+					stats = importer.stats();
+				}
+			}
+			if (mesh.indices.empty())
+			{
+				std::cout << "  " << path << ": failed to load" << std::endl;
+				continue;
+			}
+			// Every grid vertex is one vertex after deduplication, and the
+			// quad corners come back in the order they were written.
+			const bool exact = stats.vertices == (size_t)side * side &&
+				std::abs(mesh.streams.positions[mesh.indices[1]].x - 0.01f) < 1e-6f &&
+				std::abs(mesh.streams.texCoords[mesh.indices[2]].y - 1.f / (side - 1)) < 1e-6f;
+			std::cout << std::fixed << std::setprecision(1)
+				<< "  " << std::setw(15) << std::left << path << std::right << std::setw(7) << stats.fileBytes / 1048576.0 << " MB in "
+				<< ms << " ms: " << std::setw(6) << stats.fileBytes / 1048576.0 / (ms / 1000.0) << " MB/s, "
+				<< stats.triangles / (ms / 1000.0) / 1e6 << "M triangles/s; " << stats.triangles << " triangles, "
+				<< stats.vertices << " vertices from " << stats.corners << " corners" << (check(exact) ? "" : " MISMATCH") << std::endl
+				<< "    parse " << stats.parseMs << " ms, merge " << stats.mergeMs << " ms, dedup " << stats.dedupMs
+				<< " ms, normals " << stats.normalsMs << " ms, " << stats.chunks << " chunks" << std::endl;
+			const PackedVertices packed = MeshImporter::pack(mesh);
+			std::cout << "    packed " << packed.layout.describe() << std::endl;
+		}
+		std::remove(obj.c_str());
+		std::remove(ply.c_str());
+	}
+
+	// Peak resident set since the last reset, via Linux's clear_refs; other
+	// systems cannot reset the peak, so they report nothing.
+	bool resetPeakRss()
+	{
+#ifdef _WIN32
+		return false;
+#else
+		FILE* file = fopen("/proc/self/clear_refs", "w");
+		if (!file)
+			return false;
+		const bool reset = fputs("5", file) >= 0;
+		return fclose(file) == 0 && reset;
+#endif
+	}
+
+	size_t rssField(const char* field)
+	{
+		size_t kb = 0;
+#ifndef _WIN32
+		FILE* file = fopen("/proc/self/status", "r");
+		if (!file)
+			return 0;
+		char line[256];
+		const size_t length = strlen(field);
+		while (fgets(line, sizeof(line), file))
+		{
+			if (strncmp(line, field, length) == 0)
+				kb = (size_t)strtoull(line + length, nullptr, 10);
+		}
+		fclose(file);
+#else
+		(void)field;
+#endif
+		return kb << 10;
+	}
+
+	// Tori written as a .glb: half with one view per attribute, half with the
+	// attributes interleaved in a single strided view, all under one parent
+	// node, with two materials.
+	void writeTorusGlb(const std::string& path, int meshCount, int rings, int segments)
+	{
+		const VertexStreams torus = makeTorus(rings, segments);
+		const std::vector<uint32_t> indices = makeTorusIndices(rings, segments);
+		const size_t vertices = torus.count();
+		glm::vec3 low(1e30f), high(-1e30f);
+		for (const glm::vec3& p : torus.positions)
+		{
+			low = glm::min(low, p);
+			high = glm::max(high, p);
+		}
+
+		std::vector<unsigned char> binary;
+		std::string views, accessors, meshes, nodes, children;
+		int viewCount = 0, accessorCount = 0;
+		auto addView = [&](const void* data, size_t bytes, size_t stride, int target) {
+			while (binary.size() % 4)
+				binary.push_back(0);
+			views += std::string(viewCount ? "," : "") + "{\"buffer\":0,\"byteOffset\":" + std::to_string(binary.size()) +
+				",\"byteLength\":" + std::to_string(bytes) + (stride ? ",\"byteStride\":" + std::to_string(stride) : "") +
+				",\"target\":" + std::to_string(target) + "}";
+			binary.insert(binary.end(), (const unsigned char*)data, (const unsigned char*)data + bytes);
+			return viewCount++;
+		};
+		auto addAccessor = [&](int view, size_t offset, size_t count, int componentType, const char* type, const std::string& extra) {
+			accessors += std::string(accessorCount ? "," : "") + "{\"bufferView\":" + std::to_string(view) + ",\"byteOffset\":" +
+				std::to_string(offset) + ",\"count\":" + std::to_string(count) + ",\"componentType\":" + std::to_string(componentType) +
+				",\"type\":\"" + type + "\"" + extra + "}";
+			return accessorCount++;
+		};
+		const std::string bounds = ",\"min\":[" + std::to_string(low.x) + "," + std::to_string(low.y) + "," + std::to_string(low.z) +
+			"],\"max\":[" + std::to_string(high.x) + "," + std::to_string(high.y) + "," + std::to_string(high.z) + "]";
+		for (int mesh = 0; mesh < meshCount; ++mesh)
+		{
+			int position, texCoord, normal, tangent;
+			if (mesh % 2 == 0)
+			{
+				position = addAccessor(addView(torus.positions.data(), vertices * 12, 0, 34962), 0, vertices, 5126, "VEC3", bounds);
+				texCoord = addAccessor(addView(torus.texCoords.data(), vertices * 8, 0, 34962), 0, vertices, 5126, "VEC2", "");
+				normal = addAccessor(addView(torus.normals.data(), vertices * 12, 0, 34962), 0, vertices, 5126, "VEC3", "");
+				tangent = addAccessor(addView(torus.tangents.data(), vertices * 16, 0, 34962), 0, vertices, 5126, "VEC4", "");
+			}
+			else
+			{
+				std::vector<float> interleaved;
+				interleaved.reserve(vertices * 12);
+				for (size_t v = 0; v < vertices; ++v)
+				{
+					const float vertex[12] = { torus.positions[v].x, torus.positions[v].y, torus.positions[v].z,
+						torus.normals[v].x, torus.normals[v].y, torus.normals[v].z, torus.texCoords[v].x, torus.texCoords[v].y,
+						torus.tangents[v].x, torus.tangents[v].y, torus.tangents[v].z, torus.tangents[v].w };
+					interleaved.insert(interleaved.end(), vertex, vertex + 12);
+				}
+				const int view = addView(interleaved.data(), interleaved.size() * 4, 48, 34962);
+				position = addAccessor(view, 0, vertices, 5126, "VEC3", bounds);
+				normal = addAccessor(view, 12, vertices, 5126, "VEC3", "");
+				texCoord = addAccessor(view, 24, vertices, 5126, "VEC2", "");
+				tangent = addAccessor(view, 32, vertices, 5126, "VEC4", "");
+			}
+			const int index = addAccessor(addView(indices.data(), indices.size() * 4, 0, 34963), 0, indices.size(), 5125, "SCALAR", "");
+			meshes += std::string(mesh ? "," : "") + "{\"primitives\":[{\"attributes\":{\"POSITION\":" + std::to_string(position) +
+				",\"TEXCOORD_0\":" + std::to_string(texCoord) + ",\"NORMAL\":" + std::to_string(normal) + ",\"TANGENT\":" +
+				std::to_string(tangent) + "},\"indices\":" + std::to_string(index) + ",\"material\":" + std::to_string(mesh % 2) + "}]}";
+			nodes += ",{\"mesh\":" + std::to_string(mesh) + ",\"translation\":[" + std::to_string(mesh * 30) + ",0,0]}";
+			children += std::string(mesh ? "," : "") + std::to_string(mesh + 1);
+		}
+		while (binary.size() % 4)
+			binary.push_back(0);
+
+		std::string json = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"children\":[" +
+			children + "],\"rotation\":[0,0.7071068,0,0.7071068]}" + nodes + "],\"meshes\":[" + meshes + "],\"materials\":["
+			"{\"pbrMetallicRoughness\":{\"baseColorFactor\":[0.8,0.2,0.1,1],\"metallicFactor\":0,\"roughnessFactor\":0.5}},"
+			"{\"pbrMetallicRoughness\":{\"metallicFactor\":1,\"roughnessFactor\":0.2}}],\"accessors\":[" + accessors +
+			"],\"bufferViews\":[" + views + "],\"buffers\":[{\"byteLength\":" + std::to_string(binary.size()) + "}]}";
+		while (json.size() % 4)
+			json += ' ';
+
+		std::ofstream file(path, std::ios::binary);
+		auto write32 = [&](uint32_t value) { file.write((const char*)&value, 4); };
+		write32(0x46546C67);
+		write32(2);
+		write32((uint32_t)(12 + 8 + json.size() + 8 + binary.size()));
+		write32((uint32_t)json.size());
+		write32(0x4E4F534A);
+		file.write(json.data(), json.size());
+		write32((uint32_t)binary.size());
+		write32(0x004E4942);
+		file.write((const char*)binary.data(), binary.size());
+	}
+
+	// What a load hands to GL. The loaders only read the bytes an upload would
+	// copy, see readForUpload, so peak RSS counts what the loader itself
+	// holds rather than driver memory: heap copies, and the file pages it
+	// maps, which mappedBytes gives as RssFile before the mapping closes.
+	struct GlbLoad
+	{
+		size_t glBytes = 0;
+		volatile uint64_t uploaded = 0; // sum of the words read, kept so they are read
+		size_t mappedBytes = 0;
+	};
+
+	// Reads every 8 bytes of data, as glBufferSubData would to copy it into
+	// driver memory, without keeping a copy.
+	uint64_t readForUpload(const void* data, size_t size)
+	{
+		uint64_t sum = 0;
+		for (size_t i = 0; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			memcpy(&word, (const unsigned char*)data + i, 8);
+			sum += word;
+		}
+		return sum;
+	}
+
+	// How the renderer used to get geometry to GL: read the file into memory,
+	// copy every accessor into its own std::vector as mSetupBuffers built
+	// them, then hand each to glBufferData. Returns the sum of all position
+	// coordinates.
+	double loadGlbNaive(const std::string& path, GlbLoad& load)
+	{
+		std::vector<unsigned char> file;
+		readFile(path.c_str(), file);
+		uint32_t jsonBytes;
+		memcpy(&jsonBytes, file.data() + 12, 4);
+		const unsigned char* binary = file.data() + 20 + jsonBytes + 8;
+		JsonValue json;
+		std::string error;
+		JsonValue::parse((const char*)file.data() + 20, jsonBytes, json, error);
+
+		auto upload = [&](const void* data, size_t bytes) {
+			load.uploaded += readForUpload(data, bytes);
+			load.glBytes += bytes;
+		};
+		auto read = [&](int index, size_t elementBytes, void* out) {
+			const JsonValue& accessor = json["accessors"][index];
+			const JsonValue& view = json["bufferViews"][accessor["bufferView"].integer()];
+			const size_t stride = view.has("byteStride") ? (size_t)view["byteStride"].number() : elementBytes;
+			const unsigned char* data = binary + (size_t)view["byteOffset"].number() + (size_t)accessor["byteOffset"].number();
+			for (size_t i = 0; i < (size_t)accessor["count"].number(); ++i)
+				memcpy((unsigned char*)out + i * elementBytes, data + i * stride, elementBytes);
+		};
+		double checksum = 0;
+		for (const JsonValue& mesh : json["meshes"].items())
+		{
+			const JsonValue& primitive = mesh["primitives"][0];
+			const JsonValue& attributes = primitive["attributes"];
+			const size_t count = (size_t)json["accessors"][attributes["POSITION"].integer()]["count"].number();
+			std::vector<glm::vec3> positions(count), normals(count);
+			std::vector<glm::vec2> texCoords(count);
+			std::vector<glm::vec4> tangents(count);
+			std::vector<uint32_t> indices((size_t)json["accessors"][primitive["indices"].integer()]["count"].number());
+			read(attributes["POSITION"].integer(), sizeof(glm::vec3), positions.data());
+			read(attributes["NORMAL"].integer(), sizeof(glm::vec3), normals.data());
+			read(attributes["TEXCOORD_0"].integer(), sizeof(glm::vec2), texCoords.data());
+			read(attributes["TANGENT"].integer(), sizeof(glm::vec4), tangents.data());
+			read(primitive["indices"].integer(), 4, indices.data());
+			for (const glm::vec3& position : positions)
+				checksum += position.x + position.y + position.z;
+
+			upload(positions.data(), count * sizeof(glm::vec3));
+			upload(normals.data(), count * sizeof(glm::vec3));
+			upload(texCoords.data(), count * sizeof(glm::vec2));
+			upload(tangents.data(), count * sizeof(glm::vec4));
+			upload(indices.data(), indices.size() * 4);
+		}
+		load.mappedBytes = rssField("RssFile:");
+		return checksum;
+	}
+
+	// GltfModel::upload() without a GL context: the same view ranges, read in
+	// place in the mapping where glNamedBufferSubData would copy them from.
+	double loadGlbZeroCopy(const std::string& path, GlbLoad& load)
+	{
+		GltfModel model;
+		GltfLoadParams params;
+		params.textures = false;
+		if (!model.load(path, params))
+			return 0;
+		for (const GltfBufferView& view : model.bufferViews())
+		{
+			if (!view.geometry)
+				continue;
+			load.uploaded += readForUpload(view.data, view.size);
+			load.glBytes += (view.size + 15) & ~(size_t)15;
+		}
+		double checksum = 0;
+		for (const GltfPrimitive& primitive : model.primitives())
+		{
+			const GltfAccessor& accessor = model.accessors()[primitive.attributes[(int)VertexSemantic::Position]];
+			const GltfBufferView& view = model.bufferViews()[accessor.view];
+			for (size_t i = 0; i < accessor.count; ++i)
+			{
+				float position[3];
+				memcpy(position, view.data + accessor.offset + i * accessor.stride(view), 12);
+				checksum += position[0] + position[1] + position[2];
+			}
+		}
+		load.mappedBytes = rssField("RssFile:");
+		return checksum;
+	}
+
+	void benchGltf()
+	{
+		const std::string path = "bench_model.glb";
+		const int meshCount = 6;
+		writeTorusGlb(path, meshCount, 512, 256);
+		{
+			GltfModel model;
+			GltfLoadParams params;
+			params.textures = false;
+			if (!model.load(path, params))
+			{
+				std::cout << "  cannot load " << path << std::endl;
+				std::remove(path.c_str());
+				return;
+			}
+			std::cout << "  ";
+			model.printStats(std::cout);
+		}
+
+		struct Variant
+		{
+			const char* name;
+			double (*load)(const std::string&, GlbLoad&);
+		};
+		const Variant variants[] = { { "naive", loadGlbNaive }, { "zero-copy", loadGlbZeroCopy } };
+		double checksums[2] = { 0, 0 };
+		for (int v = 0; v < 2; ++v)
+		{
+			// The file is in the page cache for both. Mapped pages are counted
+			// in peak RSS, but are clean and shared with the page cache, so
+			// the heap's share, which the kernel cannot reclaim, is shown too.
+			GlbLoad load;
+			const double ms = timeMs([&]() { load = GlbLoad(); checksums[v] = variants[v].load(path, load); }, 3);
+			const size_t before = rssField("VmRSS:"), fileBefore = rssField("RssFile:");
+			const bool tracked = resetPeakRss();
+			load = GlbLoad();
+			variants[v].load(path, load);
+			const size_t peak = rssField("VmHWM:");
+			std::cout << std::fixed << std::setprecision(1) << "  " << std::setw(10) << std::left << variants[v].name << std::right
+				<< std::setw(8) << ms << " ms, " << std::setw(6) << load.glBytes / 1048576.0 << " MB for GL, peak RSS ";
+			if (tracked && peak >= before)
+			{
+				const size_t mapped = load.mappedBytes > fileBefore ? load.mappedBytes - fileBefore : 0;
+				const size_t grown = peak - before;
+				std::cout << "+" << grown / 1048576.0 << " MB (heap +" << (grown > mapped ? grown - mapped : 0) / 1048576.0
+					<< " MB, mapped file +" << mapped / 1048576.0 << " MB)" << std::endl;
+			}
+			else
+				std::cout << "n/a" << std::endl;
+		}
+		std::cout << "  position checksums " << (check(checksums[0] == checksums[1]) ? "match" : "DIFFER") << std::endl;
+		std::remove(path.c_str());
+	}
+
+	void benchMeshOptimizer()
+	{
+		// Triangles shuffled, as exporters that sort by material or group
+		// often leave them, then put back in order by each pass.
+		const int rings = 256, segments = 128;
+		const VertexStreams torus = makeTorus(rings, segments);
+		std::vector<uint32_t> shuffled = makeTorusIndices(rings, segments);
+		std::vector<uint32_t> order(shuffled.size() / 3);
+		for (size_t t = 0; t < order.size(); ++t)
+			order[t] = (uint32_t)t;
+		std::shuffle(order.begin(), order.end(), std::mt19937(17));
+		{
+			std::vector<uint32_t> reordered;
+			for (uint32_t t : order)
+				reordered.insert(reordered.end(), shuffled.begin() + t * 3, shuffled.begin() + t * 3 + 3);
+			shuffled.swap(reordered);
+		}
+		const size_t vertexBytes = sizeof(glm::vec3) * 2 + sizeof(glm::vec2) + sizeof(glm::vec4);
+		std::cout << "  torus, " << shuffled.size() / 3 << " triangles, " << torus.count() << " vertices of " << vertexBytes
+			<< " bytes; FIFO of 16 vertices, 16 KB vertex fetch cache" << std::endl;
+
+		auto report = [&](const char* name, double ms, const std::vector<uint32_t>& indices) {
+			const VertexCacheStats cache = MeshOptimizer::analyzeVertexCache(indices, torus.count());
+			const OverdrawStats overdraw = MeshOptimizer::analyzeOverdraw(indices, torus.positions);
+			const VertexFetchStats fetch = MeshOptimizer::analyzeVertexFetch(indices, torus.count(), vertexBytes);
+			std::cout << std::fixed << std::setprecision(3) << "  " << std::setw(22) << std::left << name << std::right
+				<< " ACMR " << cache.acmr << ", ATVR " << cache.atvr << ", overdraw " << overdraw.overdraw
+				<< ", overfetch " << fetch.overfetch << std::setprecision(1);
+			if (ms > 0)
+				std::cout << " in " << ms << " ms";
+			std::cout << std::endl;
+		};
+		report("rows", 0, makeTorusIndices(rings, segments));
+		report("shuffled", 0, shuffled);
+
+		MeshOptimizeParams params;
+		std::vector<uint32_t> tipsify, forsyth;
+		double ms = timeMs([&] {
+			tipsify = shuffled;
+			MeshOptimizer::optimizeVertexCache(tipsify, torus.count(), params);
+		});
+		report("Tipsify", ms, tipsify);
+
+		params.algorithm = VertexCacheAlgorithm::Forsyth;
+		ms = timeMs([&] {
+			forsyth = shuffled;
+			MeshOptimizer::optimizeVertexCache(forsyth, torus.count(), params);
+		}, 3);
+		report("Forsyth", ms, forsyth);
+
+		params.algorithm = VertexCacheAlgorithm::Tipsify;
+		std::vector<uint32_t> overdraw;
+		ms = timeMs([&] {
+			overdraw = tipsify;
+			MeshOptimizer::optimizeOverdraw(overdraw, torus.positions, params);
+		});
+		report("Tipsify + overdraw", ms, overdraw);
+
+		// Renumbering moves vertices, so the fetch pass is measured on a copy
+		// of the whole mesh.
+		Mesh mesh;
+		ms = timeMs([&] {
+			mesh.streams = torus;
+			mesh.indices = overdraw;
+			MeshOptimizer::optimizeVertexFetch(mesh.indices, mesh.streams);
+		});
+		const VertexCacheStats cache = MeshOptimizer::analyzeVertexCache(mesh.indices, mesh.streams.count());
+		const VertexFetchStats fetch = MeshOptimizer::analyzeVertexFetch(mesh.indices, mesh.streams.count(), vertexBytes);
+		const OverdrawStats drawn = MeshOptimizer::analyzeOverdraw(mesh.indices, mesh.streams.positions);
+		std::cout << std::fixed << std::setprecision(3) << "  " << std::setw(22) << std::left << "+ vertex fetch" << std::right
+			<< " ACMR " << cache.acmr << ", ATVR " << cache.atvr << ", overdraw " << drawn.overdraw << ", overfetch "
+			<< fetch.overfetch << std::setprecision(1) << " in " << ms << " ms" << std::endl;
+	}
+
+	void benchMeshlets()
+	{
+		const int rings = 1024, segments = 256;
+		Mesh mesh;
+		mesh.streams = makeTorus(rings, segments);
+		mesh.indices = makeTorusIndices(rings, segments);
+		MeshOptimizer::optimize(mesh);
+		MeshletMesh meshlets;
+		const double buildMs = timeMs([&] { meshlets = MeshletBuilder::build(mesh); }, 3);
+		size_t vertices = 0, conesThatCull = 0;
+		for (const Meshlet& meshlet : meshlets.meshlets)
+		{
+			vertices += meshlet.vertexCount;
+			conesThatCull += meshlet.coneCutoff < 1.f;
+		}
+		std::cout << std::fixed << std::setprecision(1) << "  torus, " << mesh.triangleCount() << " triangles: "
+			<< meshlets.meshlets.size() << " meshlets in " << buildMs << " ms, " << mesh.triangleCount() / (double)meshlets.meshlets.size()
+			<< " triangles and " << vertices / (double)meshlets.meshlets.size() << " vertices each, "
+			<< 100.0 * conesThatCull / meshlets.meshlets.size() << "% with a usable normal cone" << std::endl;
+
+		// A camera circling the torus, at three distances: the whole torus in
+		// view, about half of it, and close enough that most is off screen.
+		const glm::vec3 center(120.f, -40.f, 75.f);
+		const glm::mat4 projection = glm::perspective(glm::radians(30.f), 4.f / 3.f, 0.1f, 1000.f);
+		const float distances[] = { 60.f, 30.f, 12.f };
+		const int views = 64;
+		MeshletCuller culler(meshlets);
+		std::vector<uint32_t> indices;
+		for (float distance : distances)
+		{
+			for (int level = SIMD_SCALAR; level <= std::min<int>(detectSimdLevel(), SIMD_SSE2); ++level)
+			{
+				double cullMs = 0, compactMs = 0, culled = 0, backfacing = 0, outside = 0;
+				for (int view = 0; view < views; ++view)
+				{
+					const float angle = view * 6.2831853f / views;
+					const glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.4f, std::sin(angle)) * distance;
+					culler.cull(glm::mat4(1.f), glm::lookAt(eye, center, glm::vec3(0.f, 1.f, 0.f)), projection, indices, (SimdLevel)level);
+					const MeshletCullStats& stats = culler.stats();
+					cullMs += stats.cullMs;
+					compactMs += stats.compactMs;
+					culled += stats.culledRatio();
+					backfacing += stats.backfacingTriangles / (double)stats.triangles;
+					outside += stats.outsideTriangles / (double)stats.triangles;
+				}
+				std::cout << "  distance " << std::setw(4) << distance << std::setw(8) << simdLevelName((SimdLevel)level)
+					<< ": " << std::setw(5) << 100.0 * culled / views << "% of triangles culled (" << 100.0 * backfacing / views
+					<< "% back facing, " << 100.0 * outside / views << "% outside), test " << std::setprecision(3) << cullMs / views
+					<< " ms, compact " << compactMs / views << " ms per frame" << std::setprecision(1) << std::endl;
+			}
+		}
+	}
+
+	void benchLods()
+	{
+		const int rings = 1024, segments = 512;
+		Mesh mesh;
+		mesh.streams = makeTorus(rings, segments);
+		mesh.indices = makeTorusIndices(rings, segments);
+		MeshOptimizer::optimize(mesh);
+		MeshLods lods;
+		const double ms = timeMs([&] { lods = MeshSimplifier::buildLods(mesh); }, 1);
+		std::cout << std::fixed << std::setprecision(1) << "  torus, " << mesh.triangleCount() << " triangles: "
+			<< lods.levels.size() << " levels in " << ms << " ms, " << mesh.triangleCount() / (ms * 1000.0)
+			<< " M triangles/s" << std::endl;
+
+		// The torus is analytic, so each level's real error is the distance of
+		// its triangles' centroids from the surface: the reported error bounds
+		// the vertices' deviation, which the centroids, between vertices, can
+		// exceed on a curved surface.
+		const glm::vec3 center(120.f, -40.f, 75.f);
+		for (size_t level = 0; level < lods.levels.size(); ++level)
+		{
+			const MeshLod& lod = lods.levels[level];
+			double maxDeviation = 0, sumSquares = 0;
+			for (size_t i = lod.indexOffset; i < lod.indexOffset + lod.indexCount; i += 3)
+			{
+				const glm::vec3 p = (mesh.streams.positions[lods.indices[i]] + mesh.streams.positions[lods.indices[i + 1]]
+					+ mesh.streams.positions[lods.indices[i + 2]]) / 3.f - center;
+				const float ring = std::sqrt(p.x * p.x + p.y * p.y) - 8.f;
+				const double deviation = std::fabs(std::sqrt(ring * ring + p.z * p.z) - 2.f);
+				maxDeviation = std::max(maxDeviation, deviation);
+				sumSquares += deviation * deviation;
+			}
+			std::cout << std::setprecision(4) << "  LOD " << level << ": " << std::setw(8) << lod.indexCount / 3
+				<< " triangles, error " << lod.error << ", centroid deviation max " << maxDeviation << " RMS "
+				<< std::sqrt(sumSquares / (lod.indexCount / 3)) << std::endl;
+		}
+
+		const glm::mat4 projection = glm::perspective(glm::radians(30.f), 4.f / 3.f, 0.1f, 1000.f);
+		std::cout << "  selected at 1 pixel, 768 pixels high:";
+		for (float distance : { 15.f, 30.f, 60.f, 120.f, 240.f, 480.f })
+		{
+			const glm::mat4 view = glm::lookAt(center + glm::vec3(0.f, 0.f, distance), center, glm::vec3(0.f, 1.f, 0.f));
+			std::cout << std::setprecision(0) << " " << distance << " -> " << lods.select(glm::mat4(1.f), view, projection, 768.f);
+		}
+		std::cout << std::setprecision(1) << std::endl;
+	}
+
+	void benchTangents()
+	{
+		const int rings = 2048, segments = 1024;
+		Mesh torus;
+		torus.streams = makeTorus(rings, segments);
+		torus.indices = makeTorusIndices(rings, segments);
+		torus.streams.tangents.clear();
+		std::cout << "  torus, " << torus.triangleCount() << " triangles, " << ThreadPool::shared().size() << " worker threads"
+			<< std::endl;
+
+		TangentGenerator generator;
+		Mesh reference;
+		for (int level = SIMD_SCALAR; level <= std::min<int>(detectSimdLevel(), SIMD_SSE2); ++level)
+		{
+			// Best of three; the copy of the torus stays out of the timing.
+			Mesh mesh;
+			TangentGenerator::Stats stats;
+			stats.totalMs = 1e30;
+			for (int run = 0; run < 3; ++run)
+			{
+				mesh = torus;
+				generator.generate(mesh, (SimdLevel)level);
+				if (generator.stats().totalMs < stats.totalMs)
+					stats = generator.stats();
+			}
+			std::cout << std::fixed << std::setprecision(1) << "  " << std::setw(6) << simdLevelName((SimdLevel)level) << ": "
+				<< stats.totalMs << " ms (corners " << stats.cornersMs << ", vertices " << stats.verticesMs << "), "
+				<< stats.triangles / (stats.totalMs * 1000.0) << " M triangles/s, " << stats.splitVertices
+				<< " vertices split" << std::endl;
+			if (level == SIMD_SCALAR)
+			{
+				reference = mesh;
+				continue;
+			}
+			// The SSE2 kernel approximates acos; everything else rounds alike.
+			float largest = 0.f;
+			for (size_t v = 0; v < mesh.streams.count(); ++v)
+				largest = std::max(largest, glm::length(mesh.streams.tangents[v] - reference.streams.tangents[v]));
+			std::cout << std::scientific << std::setprecision(2) << "          largest difference from scalar " << largest
+				<< std::fixed << std::endl;
+		}
+
+		// Against the analytic tangent, dP/du: the outer half's mirrored U
+		// turns it around and makes the bitangent sign -1. The two rows where
+		// the mirroring starts have no analytic value and are skipped.
+		double largestDegrees = 0;
+		size_t wrongSigns = 0, compared = 0;
+		for (int ring = 0; ring < rings; ++ring)
+		{
+			for (int segment = 0; segment < segments; ++segment)
+			{
+				if (segment == segments / 2 - 1 || segment == segments / 2)
+					continue;
+				const float theta = (float)ring / (rings - 1) * 6.2831853f;
+				const bool mirrored = (float)segment / (segments - 1) < 0.5f;
+				const glm::vec3 expected = glm::vec3(-std::sin(theta), std::cos(theta), 0.f) * (mirrored ? -1.f : 1.f);
+				const glm::vec4& tangent = reference.streams.tangents[(size_t)ring * segments + segment];
+				largestDegrees = std::max(largestDegrees,
+					(double)glm::degrees(std::atan2(glm::length(glm::cross(glm::vec3(tangent), expected)), glm::dot(glm::vec3(tangent), expected))));
+				wrongSigns += tangent.w != (mirrored ? -1.f : 1.f);
+				++compared;
+			}
+		}
+		std::cout << std::setprecision(3) << "  against the analytic frame: largest error " << largestDegrees << " deg, "
+			<< wrongSigns << " of " << compared << " bitangent signs wrong" << std::setprecision(1) << std::endl;
+	}
+
+	void benchMeshCache()
+	{
+		const int side = 512;
+		const std::string obj = "bench_cache.obj", cooked = MeshCooker::cookedPath(obj);
+		writeGridObj(obj, side);
+		std::remove(cooked.c_str());
+
+		// What a launch without the cache pays before any processing.
+		MeshImporter importer;
+		Mesh imported;
+		const double importMs = timeMs([&] { importer.load(obj, imported); }, 3);
+
+		MeshCooker cooker;
+		MeshContainer container;
+		cooker.load(obj, container);
+		const MeshCooker::Stats cold = cooker.stats();
+		std::cout << std::fixed << std::setprecision(1) << "  " << side << " x " << side << " grid, " << imported.triangleCount()
+			<< " triangles: " << cold.sourceBytes / 1048576.0 << " MB OBJ cooked into " << cold.containerBytes / 1048576.0
+			<< " MB in " << cold.cookMs << " ms; the import alone takes " << importMs << " ms" << std::endl;
+		std::cout << "  " << container.submesh(0).lods.levels.size() << " levels, " << container.indexCount() << " indices of "
+			<< container.indexBytes() << " bytes, " << container.layout().describe() << std::endl;
+
+		// A warm launch up to the upload: check, map, read the tables and copy
+		// the meshlets the CPU culls with. The payloads stay untouched.
+		size_t meshlets = 0;
+		const double warmMs = timeMs([&] {
+			cooker.load(obj, container);
+			meshlets = 0;
+			for (size_t level = 0; level < container.submesh(0).lods.levels.size(); ++level)
+				meshlets += container.meshlets(0, level).meshlets.size();
+		});
+		std::cout << "  warm: " << (cooker.stats().cooked ? "cooked again, " : "") << warmMs << " ms with " << meshlets
+			<< " meshlets copied out, " << importMs / warmMs << "x faster than importing" << std::endl;
+
+		// Same bytes, newer time: the hash keeps the container.
+		std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+		writeGridObj(obj, side);
+		cooker.load(obj, container);
+		std::cout << "  rewritten with the same bytes: " << (cooker.stats().hashChecked ? "hashed, " : "")
+			<< (cooker.stats().cooked ? "cooked again" : "kept") << " in " << cooker.stats().checkMs << " ms" << std::endl;
+		cooker.load(obj, container);
+		const bool skippedHash = !cooker.stats().hashChecked && !cooker.stats().cooked;
+		std::cout << "  and loaded again: " << (check(skippedHash) ? "kept without hashing" : "HASHED AGAIN") << " in "
+			<< cooker.stats().checkMs << " ms" << std::endl;
+
+		// Different parameters and different bytes both cook again.
+		MeshCookParams params;
+		params.meshlet.maxTriangles = 64;
+		cooker.load(obj, container, params);
+		std::cout << "  other meshlet parameters: " << (cooker.stats().cooked ? "cooked again" : "kept") << std::endl;
+		FILE* file = fopen(obj.c_str(), "ab");
+		if (file)
+		{
+			fprintf(file, "# edited\n");
+			fclose(file);
+		}
+		cooker.load(obj, container, params);
+		std::cout << "  edited source: " << (cooker.stats().hashChecked ? "hashed, " : "")
+			<< (cooker.stats().cooked ? "cooked again" : "kept") << std::endl;
+
+		container.close();
+		std::remove(obj.c_str());
+		std::remove(cooked.c_str());
+	}
+
+	// Whether decoded triangles are the original ones, each possibly rotated.
+	bool sameTriangles(const std::vector<uint32_t>& original, const std::vector<uint32_t>& decoded)
+	{
+		if (original.size() != decoded.size())
+			return false;
+		for (size_t i = 0; i < original.size(); i += 3)
+		{
+			bool found = false;
+			for (size_t r = 0; r < 3 && !found; ++r)
+			{
+				found = decoded[i] == original[i + r] && decoded[i + 1] == original[i + (r + 1) % 3] &&
+					decoded[i + 2] == original[i + (r + 2) % 3];
+			}
+			if (!found)
+				return false;
+		}
+		return true;
+	}
+
+	void benchMeshCodec()
+	{
+		const int rings = 1024, segments = 512;
+		Mesh mesh;
+		mesh.streams = makeTorus(rings, segments);
+		mesh.indices = makeTorusIndices(rings, segments);
+		MeshOptimizer::optimize(mesh);
+		const PackedVertices packed = MeshImporter::pack(mesh);
+		const size_t stride = packed.layout.stride(), vertexBytes = packed.data.size();
+		std::cout << std::fixed << std::setprecision(1) << "  torus, " << packed.count << " vertices, " << packed.layout.describe()
+			<< ", " << mesh.triangleCount() << " triangles after MeshOptimizer" << std::endl;
+
+		std::vector<unsigned char> vertices;
+		const double vertexEncodeMs = timeMs([&] { vertices = MeshCodec::encodeVertices(packed.data.data(), packed.count, stride); }, 3);
+		std::cout << "  vertices: " << vertexBytes / 1024 << " KB to " << vertices.size() / 1024 << " KB, "
+			<< 100.0 * vertices.size() / vertexBytes << "%, encoded in " << vertexEncodeMs << " ms" << std::endl;
+		std::vector<unsigned char> decoded(vertexBytes);
+		for (int level = SIMD_SCALAR; level <= detectSimdLevel(); ++level)
+		{
+			bool ok = false;
+			const double ms = timeMs([&] {
+				ok = MeshCodec::decodeVertices(decoded.data(), packed.count, stride, vertices.data(), vertices.size(), (SimdLevel)level);
+			}, 20);
+			ok = ok && decoded == packed.data;
+			std::cout << "  " << std::setw(8) << simdLevelName((SimdLevel)level) << " decode: " << std::setprecision(3) << ms
+				<< " ms, " << vertexBytes / ms / 1e6 << " GB/s" << std::setprecision(1) << (check(ok) ? "" : ", ROUND TRIP FAILED") << std::endl;
+		}
+		// What the decoders are up against: copying the uncompressed bytes.
+		const double copyMs = timeMs([&] { memcpy(decoded.data(), packed.data.data(), vertexBytes); }, 20);
+		std::cout << "    " << std::setw(8) << "memcpy" << ": " << std::setprecision(3) << copyMs << " ms, " << vertexBytes / copyMs / 1e6
+			<< " GB/s" << std::setprecision(1) << std::endl;
+
+		// Stored as the container would with a single chunk: 16 bits only when
+		// the vertices allow.
+		const size_t indexBytes = packed.count <= kMaxShortIndexVertices ? 2 : 4, rawIndexBytes = mesh.indices.size() * indexBytes;
+		std::vector<unsigned char> indices;
+		const double indexEncodeMs = timeMs([&] { indices = MeshCodec::encodeIndices(mesh.indices.data(), mesh.indices.size()); }, 3);
+		std::vector<uint32_t> decodedIndices(mesh.indices.size());
+		bool ok = false;
+		const double indexDecodeMs = timeMs([&] {
+			ok = MeshCodec::decodeIndices(decodedIndices.data(), decodedIndices.size(), 4, packed.count, indices.data(), indices.size());
+		}, 20);
+		ok = ok && sameTriangles(mesh.indices, decodedIndices);
+		std::cout << std::setprecision(2) << "  indices: " << rawIndexBytes / 1024 << " KB to " << indices.size() / 1024 << " KB, "
+			<< std::setprecision(1) << 100.0 * indices.size() / rawIndexBytes << "%, " << std::setprecision(2)
+			<< indices.size() / (double)mesh.triangleCount() << " bytes per triangle, encoded in " << std::setprecision(1)
+			<< indexEncodeMs << " ms, decoded in " << std::setprecision(3) << indexDecodeMs << " ms ("
+			<< mesh.triangleCount() / indexDecodeMs / 1e3 << " M triangles/s)" << std::setprecision(1)
+			<< (check(ok) ? "" : ", ROUND TRIP FAILED") << std::endl;
+
+		// The order MeshOptimizer leaves is what the codecs lean on.
+		Mesh shuffled = mesh;
+		std::mt19937 rng(7);
+		std::vector<uint32_t> order(packed.count);
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = (uint32_t)i;
+		std::shuffle(order.begin(), order.end(), rng);
+		for (uint32_t& index : shuffled.indices)
+			index = order[index];
+		const std::vector<unsigned char> shuffledIndices = MeshCodec::encodeIndices(shuffled.indices.data(), shuffled.indices.size());
+		std::cout << std::setprecision(2) << "  indices with the vertices shuffled: " << shuffledIndices.size() / (double)mesh.triangleCount()
+			<< " bytes per triangle" << std::setprecision(1) << std::endl;
+	}
+
+	// Triangles rotated to start at their smallest vertex, in sorted order.
+	std::vector<glm::uvec3> sortedTriangles(const std::vector<uint32_t>& indices)
+	{
+		std::vector<glm::uvec3> triangles;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			glm::uvec3 t(indices[i], indices[i + 1], indices[i + 2]);
+			while (t.x > t.y || t.x > t.z)
+				t = glm::uvec3(t.y, t.z, t.x);
+			triangles.push_back(t);
+		}
+		std::sort(triangles.begin(), triangles.end(), [](const glm::uvec3& a, const glm::uvec3& b) {
+			return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+		});
+		return triangles;
+	}
+
+	// Packs each torus's indices as 32 bits, 16 bit chunks and 16 bit strips.
+	// Benchmarks run before the renderer creates a window, without a GL
+	// context, so draw time is not measured here. The bench reports what
+	// index format changes on the GPU side instead: index bytes fetched per
+	// triangle, and the post-transform cache misses (ACMR) the strips cost.
+	void benchIndexPacking()
+	{
+		struct Case
+		{
+			const char* name;
+			int rings, segments;
+			bool optimize;
+		};
+		const Case cases[] = {
+			{ "small torus, row order", 256, 128, false },
+			{ "small torus, optimized", 256, 128, true },
+			{ "large torus, row order", 1024, 512, false },
+			{ "large torus, optimized", 1024, 512, true },
+		};
+		std::cout << std::fixed;
+		for (const Case& c : cases)
+		{
+			Mesh mesh;
+			mesh.streams = makeTorus(c.rings, c.segments);
+			mesh.indices = makeTorusIndices(c.rings, c.segments);
+			if (c.optimize)
+				MeshOptimizer::optimize(mesh);
+			const size_t vertexCount = mesh.streams.count(), triangles = mesh.triangleCount();
+			const size_t wideBytes = mesh.indices.size() * sizeof(uint32_t);
+			std::cout << std::setprecision(1) << "  " << c.name << ", " << vertexCount << " vertices, " << triangles
+				<< " triangles: 32 bit list " << wideBytes / 1024 << " KB, ACMR "
+				<< std::setprecision(3) << MeshOptimizer::analyzeVertexCache(mesh.indices, vertexCount).acmr << std::endl;
+
+			for (int strips = 0; strips < 2; ++strips)
+			{
+				IndexPackParams params;
+				params.strips = strips != 0;
+				PackedIndices packedIndices;
+				const double ms = timeMs([&] { packedIndices = IndexPacker::pack(mesh.indices, vertexCount, params); }, 3);
+				// Strips draw the same triangles with their winding, in the
+				// order they were strung together.
+				const std::vector<uint32_t> unpacked = IndexPacker::unpack(packedIndices);
+				const bool ok = packedIndices.mode == GL_TRIANGLE_STRIP ? sortedTriangles(unpacked) == sortedTriangles(mesh.indices)
+					: sameTriangles(mesh.indices, unpacked);
+				std::cout << std::setprecision(1) << "    " << std::setw(6) << (params.strips ? "strips" : "list") << ": "
+					<< packedIndices.data.size() / 1024 << " KB, " << 100.0 * packedIndices.data.size() / wideBytes << "%, "
+					<< packedIndices.indexBytes * 8 << " bit " << (packedIndices.mode == GL_TRIANGLE_STRIP ? "strips" : "list") << " in "
+					<< packedIndices.chunks.size() << " draw(s), " << std::setprecision(2)
+					<< packedIndices.data.size() / (double)std::max<size_t>(triangles, 1) << " index bytes fetched per triangle, ACMR "
+					<< std::setprecision(3) << MeshOptimizer::analyzeVertexCache(unpacked, vertexCount).acmr << "; packed in "
+					<< std::setprecision(1) << ms << " ms" << (check(ok) ? "" : ", ROUND TRIP FAILED") << std::endl;
+			}
+		}
+
+		// A cooked container chooses for all levels at once.
+		for (int side : { 128, 512 })
+		{
+			const std::string obj = "bench_indices.obj", cooked = MeshCooker::cookedPath(obj);
+			writeGridObj(obj, side);
+			std::remove(cooked.c_str());
+			MeshCooker cooker;
+			MeshContainer container;
+			if (cooker.load(obj, container) && container.submeshCount() > 0)
+			{
+				size_t chunks = 0;
+				for (const std::vector<IndexChunk>& level : container.submesh(0).chunks)
+					chunks += level.size();
+				std::cout << "  cooked " << side << " x " << side << " grid, " << container.vertexCount() << " vertices: "
+					<< container.indexCount() * container.indexBytes() / 1024 << " KB of " << container.indexBytes() * 8 << " bit indices in "
+					<< chunks << " draws over " << container.submesh(0).lods.levels.size() << " levels, "
+					<< container.indexCount() * sizeof(uint32_t) / 1024 << " KB at 32 bits" << std::endl;
+			}
+			container.close();
+			std::remove(obj.c_str());
+			std::remove(cooked.c_str());
+		}
+	}
+
+	// Whether the allocations are inside the space and apart, and account for
+	// everything the allocator does not report free.
+	bool allocationsConsistent(const OffsetAllocator& allocator, const std::vector<OffsetAllocator::Allocation>& live)
+	{
+		std::vector<std::pair<uint32_t, uint32_t>> ranges;
+		uint64_t used = 0;
+		for (const OffsetAllocator::Allocation& allocation : live)
+		{
+			ranges.push_back({ allocation.offset, allocator.allocationSize(allocation) });
+			used += ranges.back().second;
+		}
+		std::sort(ranges.begin(), ranges.end());
+		for (size_t i = 0; i < ranges.size(); ++i)
+		{
+			const uint64_t end = (uint64_t)ranges[i].first + ranges[i].second;
+			if (ranges[i].second == 0 || end > allocator.size() || (i + 1 < ranges.size() && end > ranges[i + 1].first))
+				return false;
+		}
+		const OffsetAllocator::Report report = allocator.report();
+		return report.allocations == live.size() && used + report.freeSpace == allocator.size();
+	}
+
+	void benchGeometryArena()
+	{
+		// GeometryArena's allocator on its own, in vertices: meshes of 100 to
+		// 50000 vertices added until the space is full, then removed and added
+		// at random as streaming would.
+		const uint32_t size = 1 << 22;
+		OffsetAllocator allocator(size);
+		std::mt19937 rng(11);
+		std::uniform_real_distribution<double> logSize(std::log(100.0), std::log(50000.0));
+		auto meshSize = [&] { return (uint32_t)std::exp(logSize(rng)); };
+		std::vector<OffsetAllocator::Allocation> live;
+		for (;;)
+		{
+			const OffsetAllocator::Allocation allocation = allocator.allocate(meshSize());
+			if (allocation.offset == OffsetAllocator::kNoSpace)
+				break;
+			live.push_back(allocation);
+		}
+		OffsetAllocator::Report report = allocator.report();
+		std::cout << std::fixed << std::setprecision(1) << "  filled with " << live.size() << " meshes, " << 100.0 * report.freeSpace / size
+			<< "% left free" << std::endl;
+
+		const int operations = 200000;
+		size_t failed = 0;
+		bool consistent = true;
+		const auto start = Clock::now();
+		for (int i = 0; i < operations; ++i)
+		{
+			if (i % 2 == 0)
+			{
+				const size_t victim = rng() % live.size();
+				allocator.free(live[victim]);
+				live[victim] = live.back();
+				live.pop_back();
+			}
+			else
+			{
+				const OffsetAllocator::Allocation allocation = allocator.allocate(meshSize());
+				if (allocation.offset == OffsetAllocator::kNoSpace)
+					++failed;
+				else
+					live.push_back(allocation);
+			}
+		}
+		const double churnMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		consistent = allocationsConsistent(allocator, live);
+		report = allocator.report();
+		std::cout << std::setprecision(1) << "  " << operations << " random frees and allocations: " << churnMs * 1e6 / operations
+			<< " ns each, " << failed << " allocations did not fit" << (check(consistent) ? "" : ", ALLOCATIONS OVERLAP") << std::endl;
+		std::cout << std::setprecision(3) << "  after churn: " << live.size() << " meshes, " << report.freeSpace << " free in "
+			<< report.freeRegions << " regions, largest " << report.largestFree << ", fragmentation " << report.fragmentation() << std::endl;
+
+		// What GeometryArena::defragment() does: every mesh allocated afresh in
+		// offset order, so the free space ends up in one region.
+		std::sort(live.begin(), live.end(),
+			[](const OffsetAllocator::Allocation& a, const OffsetAllocator::Allocation& b) { return a.offset < b.offset; });
+		OffsetAllocator packed(size);
+		std::vector<OffsetAllocator::Allocation> packedLive;
+		uint64_t moved = 0;
+		const double packMs = timeMs([&] {
+			packed.reset(size);
+			packedLive.clear();
+			moved = 0;
+			for (const OffsetAllocator::Allocation& allocation : live)
+			{
+				packedLive.push_back(packed.allocate(allocator.allocationSize(allocation)));
+				if (packedLive.back().offset != allocation.offset)
+					moved += allocator.allocationSize(allocation);
+			}
+		}, 3);
+		consistent = allocationsConsistent(packed, packedLive);
+		report = packed.report();
+		std::cout << "  defragmented in " << std::setprecision(2) << packMs << " ms: " << 100.0 * moved / size
+			<< "% of the space moved, " << report.freeRegions << " free region, largest " << report.largestFree << ", fragmentation "
+			<< std::setprecision(3) << report.fragmentation() << (check(consistent) ? "" : ", ALLOCATIONS OVERLAP") << std::setprecision(1) << std::endl;
+
+		// Fill a nearly full space exactly: the fallback to the bin below keeps
+		// the last few requests from failing on rounding alone.
+		OffsetAllocator exact(1000003);
+		std::vector<OffsetAllocator::Allocation> pieces;
+		for (uint32_t left = exact.size(); left > 0;)
+		{
+			const uint32_t piece = std::min(left, 4099u);
+			pieces.push_back(exact.allocate(piece));
+			if (pieces.back().offset == OffsetAllocator::kNoSpace)
+				break;
+			left -= piece;
+		}
+		std::cout << "  exact fill of " << exact.size() << ": " << exact.report().freeSpace << " left free"
+			<< (check(allocationsConsistent(exact, pieces)) ? "" : ", ALLOCATIONS OVERLAP") << std::endl;
+	}
+
+	struct Benchmark
+	{
+		const char* name;
+		const char* description;
+		void (*run)();
+	};
+
+	const Benchmark kBenchmarks[] = {
+		{ "mips", "CPU mip chain generation, scalar vs SIMD", benchMips },
+		{ "bc", "BC1/BC3/BC5 block compression throughput and PSNR", benchBlockCompression },
+		{ "jpeg", "stb_image JPEG decode, scalar vs SSE2 vs AVX2 kernels and parallel restarts", benchJpeg },
+		{ "png", "stb_image PNG inflate and decode, original vs multi-symbol inflate and SSE2 filters", benchPng },
+		{ "repack", "8-bit channel repacking for usage driven formats, scalar vs SIMD", benchRepack },
+		{ "half", "float to half and R11G11B10F conversion throughput and round-trip accuracy", benchHalf },
+		{ "io", "thousands of small image reads, sequential stbi_load vs batched AssetIO, cold and warm", benchAssetIO },
+		{ "container", "cooked texture container write, open and round-trip", benchContainer },
+		{ "atlas", "texture array and atlas packing, and binds per frame before and after", benchAtlas },
+		{ "vertex", "interleaved vertex layouts: bytes per vertex and quantization error", benchVertexLayout },
+		{ "mesh", "multi-threaded OBJ and PLY import with vertex deduplication", benchMeshImport },
+		{ "gltf", "zero-copy .glb loading vs reading accessors into vectors: time and peak RSS", benchGltf },
+		{ "meshopt", "vertex cache, overdraw and vertex fetch reordering: ACMR, ATVR, overdraw and overfetch", benchMeshOptimizer },
+		{ "meshlet", "meshlet building and SIMD frustum and normal cone culling: triangles culled per frame", benchMeshlets },
+		{ "lod", "quadric error simplification into a LOD chain: time, error per level and selection by distance", benchLods },
+		{ "tangent", "MikkTSpace style tangent generation, scalar vs SSE2: throughput and error against an analytic frame", benchTangents },
+		{ "meshcache", "cooked .omesh containers: cook time, warm load and invalidation", benchMeshCache },
+		{ "meshcodec", "vertex and index buffer compression: ratio and decode throughput, scalar vs SIMD", benchMeshCodec },
+		{ "indices", "16 bit index selection, base vertex chunks and strips: index bytes per triangle and ACMR", benchIndexPacking },
+		{ "arena", "geometry arena offset allocator: allocation cost, fragmentation and defragmentation, CPU only", benchGeometryArena },
+		{ "vt", "virtual texture feedback reduction, tile cache and page table", benchVirtualTexture },
+	};
+}
+
+int runBenchmarks(int argc, char** argv)
+{
+	std::vector<std::string> names(argv, argv + argc);
+	if (names.size() == 1 && names[0] == "list")
+	{
+		for (const Benchmark& bench : kBenchmarks)
+			std::cout << std::setw(12) << std::left << bench.name << bench.description << std::endl;
+		return 0;
+	}
+
+	std::cout << "SIMD level: " << simdLevelName(detectSimdLevel()) << std::endl;
+	int ran = 0;
+	for (const Benchmark& bench : kBenchmarks)
+	{
+		if (!names.empty() && std::find(names.begin(), names.end(), bench.name) == names.end())
+			continue;
+		std::cout << "[" << bench.name << "] " << bench.description << std::endl;
+		bench.run();
+		++ran;
+	}
+	if (ran == 0)
+	{
+		std::cout << "No benchmark matched; use --bench list" << std::endl;
+		return 1;
+	}
+	if (gCheckFailed)
+	{
+		std::cout << "Some self checks FAILED" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// CPU benchmarks and self checks, run with "main_exec --bench [name ...]".
+// None of them need a GL context, so they also run on machines without a GPU.
+// With no names every benchmark runs; "--bench list" prints the available ones.
+// Returns nonzero when no benchmark matched or any self check failed.
+int runBenchmarks(int argc, char** argv);
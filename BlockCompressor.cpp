@@ -0,0 +1,528 @@
+#include "BlockCompressor.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// Palette order along the c1 -> c0 axis is 1, 3, 2, 0; k counts how many
+	// midpoints a pixel lies past.
+	const int kColorIndexForStep[4] = { 1, 3, 2, 0 };
+
+	// Weight of c0, in thirds, for each colour index.
+	const int kColorWeight[4] = { 3, 0, 2, 1 };
+
+	inline int quantize(int value, int maxValue)
+	{
+		return (value * maxValue + 127) / 255;
+	}
+
+	inline int to565(const int rgb[3])
+	{
+		return (quantize(rgb[0], 31) << 11) | (quantize(rgb[1], 63) << 5) | quantize(rgb[2], 31);
+	}
+
+	inline void from565(int c, int rgb[3])
+	{
+		int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	inline void write16(unsigned char* out, int v)
+	{
+		out[0] = (unsigned char)(v & 0xff);
+		out[1] = (unsigned char)((v >> 8) & 0xff);
+	}
+
+	// Copies a 4x4 block of RGBA pixels, replicating the edge for partial blocks.
+	void loadBlock(const unsigned char* rgba, int width, int height, int bx, int by, unsigned char block[64])
+	{
+		for (int y = 0; y < 4; ++y)
+		{
+			const int sy = std::min(by * 4 + y, height - 1);
+			for (int x = 0; x < 4; ++x)
+			{
+				const int sx = std::min(bx * 4 + x, width - 1);
+				memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+			}
+		}
+	}
+
+	// Dominant direction of the block's colours, from a few power iterations on
+	// the covariance matrix, scaled to fit 16-bit SIMD multiplies.
+	bool principalAxis(const unsigned char block[64], int axis[3])
+	{
+		int sum[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < 3; ++c)
+				sum[c] += block[i * 4 + c];
+
+		float cov[6] = { 0, 0, 0, 0, 0, 0 };
+		for (int i = 0; i < 16; ++i)
+		{
+			float d[3];
+			for (int c = 0; c < 3; ++c)
+				d[c] = block[i * 4 + c] - sum[c] / 16.f;
+			cov[0] += d[0] * d[0];
+			cov[1] += d[0] * d[1];
+			cov[2] += d[0] * d[2];
+			cov[3] += d[1] * d[1];
+			cov[4] += d[1] * d[2];
+			cov[5] += d[2] * d[2];
+		}
+
+		float v[3] = { 1.f, 1.f, 1.f };
+		float scale = 0.f;
+		for (int iter = 0; iter < 4; ++iter)
+		{
+			float r = v[0] * cov[0] + v[1] * cov[1] + v[2] * cov[2];
+			float g = v[0] * cov[1] + v[1] * cov[3] + v[2] * cov[4];
+			float b = v[0] * cov[2] + v[1] * cov[4] + v[2] * cov[5];
+			scale = std::max(std::max(std::abs(r), std::abs(g)), std::abs(b));
+			if (scale == 0.f)
+				return false;
+			v[0] = r / scale;
+			v[1] = g / scale;
+			v[2] = b / scale;
+		}
+		for (int c = 0; c < 3; ++c)
+			axis[c] = (int)(v[c] * 511.f);
+		return axis[0] != 0 || axis[1] != 0 || axis[2] != 0;
+	}
+
+	void projectScalar(const unsigned char block[64], const int axis[3], int dots[16])
+	{
+		for (int i = 0; i < 16; ++i)
+			dots[i] = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+	}
+
+	struct ColorAxis
+	{
+		int dir[3];
+		int thresholds[3]; // doubled midpoints between neighbouring palette stops
+	};
+
+	void makeAxis(int c0, int c1, ColorAxis& axis)
+	{
+		int p[4][3];
+		from565(c0, p[0]);
+		from565(c1, p[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+			p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+			axis.dir[c] = p[0][c] - p[1][c];
+		}
+		int stops[4];
+		for (int i = 0; i < 4; ++i)
+			stops[i] = p[i][0] * axis.dir[0] + p[i][1] * axis.dir[1] + p[i][2] * axis.dir[2];
+		axis.thresholds[0] = stops[1] + stops[3];
+		axis.thresholds[1] = stops[3] + stops[2];
+		axis.thresholds[2] = stops[2] + stops[0];
+	}
+
+	void selectColorIndicesScalar(const unsigned char block[64], const ColorAxis& axis, int indices[16])
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			const unsigned char* px = block + i * 4;
+			int d = 2 * (px[0] * axis.dir[0] + px[1] * axis.dir[1] + px[2] * axis.dir[2]);
+			int k = (d >= axis.thresholds[0]) + (d >= axis.thresholds[1]) + (d >= axis.thresholds[2]);
+			indices[i] = kColorIndexForStep[k];
+		}
+	}
+
+	// Quantizes 16 values of one channel to BC4 indices against [mn, mx].
+	void selectAlphaIndicesScalar(const int values[16], int mn, int mx, int indices[16])
+	{
+		const int range = mx - mn;
+		for (int i = 0; i < 16; ++i)
+		{
+			const int v = (values[i] - mn) * 14;
+			int t = 0;
+			for (int j = 1; j <= 7; ++j)
+				t += v >= (2 * j - 1) * range;
+			indices[i] = t == 7 ? 0 : t == 0 ? 1 : 8 - t;
+		}
+	}
+
+#ifdef SIMD_X86
+	inline __m128i dot4Sse2(const unsigned char* pixels, __m128i dir)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i px = _mm_loadu_si128((const __m128i*)pixels);
+		__m128 lo = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(px, zero), dir));
+		__m128 hi = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(px, zero), dir));
+		return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))));
+	}
+
+	inline __m128i axisSse2(const int axis[3])
+	{
+		return _mm_setr_epi16((short)axis[0], (short)axis[1], (short)axis[2], 0,
+			(short)axis[0], (short)axis[1], (short)axis[2], 0);
+	}
+
+	void projectSse2(const unsigned char block[64], const int axis[3], int dots[16])
+	{
+		const __m128i dir = axisSse2(axis);
+		for (int i = 0; i < 4; ++i)
+			_mm_storeu_si128((__m128i*)(dots + i * 4), dot4Sse2(block + i * 16, dir));
+	}
+
+	void selectColorIndicesSse2(const unsigned char block[64], const ColorAxis& axis, int indices[16])
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i dir = axisSse2(axis.dir);
+		const __m128i t0 = _mm_set1_epi32(axis.thresholds[0] - 1);
+		const __m128i t1 = _mm_set1_epi32(axis.thresholds[1] - 1);
+		const __m128i t2 = _mm_set1_epi32(axis.thresholds[2] - 1);
+		alignas(16) int steps[16];
+		for (int i = 0; i < 4; ++i)
+		{
+			__m128i dot = _mm_slli_epi32(dot4Sse2(block + i * 16, dir), 1);
+			__m128i k = _mm_add_epi32(_mm_add_epi32(_mm_cmpgt_epi32(dot, t0), _mm_cmpgt_epi32(dot, t1)), _mm_cmpgt_epi32(dot, t2));
+			_mm_store_si128((__m128i*)(steps + i * 4), _mm_sub_epi32(zero, k));
+		}
+		for (int i = 0; i < 16; ++i)
+			indices[i] = kColorIndexForStep[steps[i]];
+	}
+
+	void selectAlphaIndicesSse2(const int values[16], int mn, int mx, int indices[16])
+	{
+		const int range = mx - mn;
+		const __m128i base = _mm_set1_epi16((short)mn);
+		const __m128i fourteen = _mm_set1_epi16(14);
+		__m128i v0 = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)values), _mm_loadu_si128((const __m128i*)(values + 4)));
+		__m128i v1 = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(values + 8)), _mm_loadu_si128((const __m128i*)(values + 12)));
+		v0 = _mm_mullo_epi16(_mm_sub_epi16(v0, base), fourteen);
+		v1 = _mm_mullo_epi16(_mm_sub_epi16(v1, base), fourteen);
+		__m128i t0 = _mm_setzero_si128(), t1 = _mm_setzero_si128();
+		for (int j = 1; j <= 7; ++j)
+		{
+			__m128i threshold = _mm_set1_epi16((short)((2 * j - 1) * range - 1));
+			t0 = _mm_sub_epi16(t0, _mm_cmpgt_epi16(v0, threshold));
+			t1 = _mm_sub_epi16(t1, _mm_cmpgt_epi16(v1, threshold));
+		}
+		alignas(16) short t[16];
+		_mm_store_si128((__m128i*)t, t0);
+		_mm_store_si128((__m128i*)(t + 8), t1);
+		for (int i = 0; i < 16; ++i)
+			indices[i] = t[i] == 7 ? 0 : t[i] == 0 ? 1 : 8 - t[i];
+	}
+#endif
+
+	void project(const unsigned char block[64], const int axis[3], int dots[16], SimdLevel level)
+	{
+#ifdef SIMD_X86
+		if (level >= SIMD_SSE2)
+			return projectSse2(block, axis, dots);
+#endif
+		projectScalar(block, axis, dots);
+	}
+
+	void selectColorIndices(const unsigned char block[64], int c0, int c1, int indices[16], SimdLevel level)
+	{
+		ColorAxis axis;
+		makeAxis(c0, c1, axis);
+#ifdef SIMD_X86
+		if (level >= SIMD_SSE2)
+			return selectColorIndicesSse2(block, axis, indices);
+#endif
+		selectColorIndicesScalar(block, axis, indices);
+	}
+
+	// Least squares fit of both endpoints to the current index assignment.
+	bool refineEndpoints(const unsigned char block[64], const int indices[16], int& c0, int& c1)
+	{
+		int aa = 0, bb = 0, ab = 0;
+		int ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; ++i)
+		{
+			const int a = kColorWeight[indices[i]], b = 3 - a;
+			aa += a * a;
+			bb += b * b;
+			ab += a * b;
+			for (int c = 0; c < 3; ++c)
+			{
+				ax[c] += a * block[i * 4 + c];
+				bx[c] += b * block[i * 4 + c];
+			}
+		}
+		const int det = aa * bb - ab * ab;
+		if (det == 0)
+			return false;
+
+		int e0[3], e1[3];
+		const float scale = 3.f / det;
+		for (int c = 0; c < 3; ++c)
+		{
+			float v0 = (float)(ax[c] * bb - bx[c] * ab) * scale;
+			float v1 = (float)(bx[c] * aa - ax[c] * ab) * scale;
+			e0[c] = std::min(255, std::max(0, (int)(v0 + 0.5f)));
+			e1[c] = std::min(255, std::max(0, (int)(v1 + 0.5f)));
+		}
+		int n0 = to565(e0), n1 = to565(e1);
+		if (n0 == n1 || (n0 == c0 && n1 == c1))
+			return false;
+		c0 = n0;
+		c1 = n1;
+		return true;
+	}
+
+	void encodeColorBlock(const unsigned char block[64], unsigned char out[8], SimdLevel level)
+	{
+		// Endpoints start at the extreme pixels along the principal axis.
+		int axis[3];
+		int first = 0, last = 0;
+		if (principalAxis(block, axis))
+		{
+			int dots[16];
+			project(block, axis, dots, level);
+			for (int i = 1; i < 16; ++i)
+			{
+				if (dots[i] < dots[first])
+					first = i;
+				if (dots[i] > dots[last])
+					last = i;
+			}
+		}
+		int hi[3], lo[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			hi[c] = block[last * 4 + c];
+			lo[c] = block[first * 4 + c];
+		}
+
+		int c0 = to565(hi), c1 = to565(lo);
+		int indices[16] = {};
+		if (c0 != c1)
+		{
+			selectColorIndices(block, c0, c1, indices, level);
+			if (refineEndpoints(block, indices, c0, c1))
+				selectColorIndices(block, c0, c1, indices, level);
+		}
+
+		// Four colour mode requires c0 > c1; swapping the endpoints swaps 0/1 and 2/3.
+		unsigned int bits = 0;
+		const int flip = c0 < c1 ? 1 : 0;
+		if (flip)
+			std::swap(c0, c1);
+		for (int i = 0; i < 16; ++i)
+			bits |= (unsigned int)(indices[i] ^ flip) << (2 * i);
+
+		write16(out, c0);
+		write16(out + 2, c1);
+		memcpy(out + 4, &bits, 4);
+	}
+
+	void encodeChannelBlock(const unsigned char block[64], int channel, unsigned char out[8], SimdLevel level)
+	{
+		int values[16];
+		int mn = 255, mx = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			values[i] = block[i * 4 + channel];
+			mn = std::min(mn, values[i]);
+			mx = std::max(mx, values[i]);
+		}
+		out[0] = (unsigned char)mx;
+		out[1] = (unsigned char)mn;
+
+		int indices[16] = {};
+		if (mx != mn)
+		{
+#ifdef SIMD_X86
+			if (level >= SIMD_SSE2)
+				selectAlphaIndicesSse2(values, mn, mx, indices);
+			else
+#endif
+				selectAlphaIndicesScalar(values, mn, mx, indices);
+		}
+
+		unsigned long long bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= (unsigned long long)indices[i] << (3 * i);
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (unsigned char)((bits >> (8 * i)) & 0xff);
+	}
+
+	void encodeBlock(const unsigned char block[64], BlockFormat format, unsigned char* out, SimdLevel level)
+	{
+		switch (format)
+		{
+		case BlockFormat::BC1:
+			encodeColorBlock(block, out, level);
+			break;
+		case BlockFormat::BC3:
+			encodeChannelBlock(block, 3, out, level);
+			encodeColorBlock(block, out + 8, level);
+			break;
+		case BlockFormat::BC5:
+			encodeChannelBlock(block, 0, out, level);
+			encodeChannelBlock(block, 1, out + 8, level);
+			break;
+		}
+	}
+
+	void decodeColorBlock(const unsigned char* in, unsigned char block[64], bool allowPunchThrough)
+	{
+		const int c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+		int p[4][4];
+		from565(c0, p[0]);
+		from565(c1, p[1]);
+		p[0][3] = p[1][3] = p[2][3] = p[3][3] = 255;
+		const bool fourColor = c0 > c1 || !allowPunchThrough;
+		for (int c = 0; c < 3; ++c)
+		{
+			if (fourColor)
+			{
+				p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+				p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+			}
+			else
+			{
+				p[2][c] = (p[0][c] + p[1][c]) / 2;
+				p[3][c] = 0;
+			}
+		}
+		if (!fourColor)
+			p[3][3] = 0;
+
+		unsigned int bits;
+		memcpy(&bits, in + 4, 4);
+		for (int i = 0; i < 16; ++i)
+		{
+			const int* color = p[(bits >> (2 * i)) & 3];
+			for (int c = 0; c < 4; ++c)
+				block[i * 4 + c] = (unsigned char)color[c];
+		}
+	}
+
+	void decodeChannelBlock(const unsigned char* in, unsigned char block[64], int channel)
+	{
+		const int a0 = in[0], a1 = in[1];
+		int palette[8] = { a0, a1 };
+		if (a0 > a1)
+		{
+			for (int k = 2; k < 8; ++k)
+				palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		}
+		else
+		{
+			for (int k = 2; k < 6; ++k)
+				palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		unsigned long long bits = 0;
+		for (int i = 0; i < 6; ++i)
+			bits |= (unsigned long long)in[2 + i] << (8 * i);
+		for (int i = 0; i < 16; ++i)
+			block[i * 4 + channel] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+	}
+}
+
+size_t CompressedChain::levelBytes(size_t level) const
+{
+	return BlockCompressor::imageBytes(format, levels[level].width, levels[level].height);
+}
+
+size_t BlockCompressor::blockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t BlockCompressor::imageBytes(BlockFormat format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void BlockCompressor::compress(const unsigned char* rgba, int width, int height, BlockFormat format,
+	unsigned char* blocks, ThreadPool* pool, SimdLevel level)
+{
+	const int blocksX = (width + 3) / 4;
+	const int blocksY = (height + 3) / 4;
+	const size_t stride = blockBytes(format);
+	auto rows = [&](size_t begin, size_t end)
+	{
+		unsigned char block[64];
+		for (size_t by = begin; by < end; ++by)
+		{
+			unsigned char* out = blocks + by * blocksX * stride;
+			for (int bx = 0; bx < blocksX; ++bx, out += stride)
+			{
+				loadBlock(rgba, width, height, bx, (int)by, block);
+				encodeBlock(block, format, out, level);
+			}
+		}
+	};
+	if (pool)
+		pool->parallelFor(blocksY, std::max(1, 1024 / blocksX), rows);
+	else
+		rows(0, blocksY);
+}
+
+CompressedChain BlockCompressor::compress(const MipChain& chain, BlockFormat format, ThreadPool* pool, SimdLevel level)
+{
+	CompressedChain result;
+	result.format = format;
+	result.levels = chain.levels;
+	size_t offset = 0;
+	for (size_t i = 0; i < result.levels.size(); ++i)
+	{
+		result.levels[i].offset = offset;
+		offset += result.levelBytes(i);
+	}
+	result.data.resize(offset);
+
+	for (size_t i = 0; i < result.levels.size(); ++i)
+	{
+		const MipLevel& mip = result.levels[i];
+		compress(chain.levelData(i), mip.width, mip.height, format, result.data.data() + mip.offset, pool, level);
+	}
+	return result;
+}
+
+void BlockCompressor::decompress(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* rgba)
+{
+	const int blocksX = (width + 3) / 4;
+	const int blocksY = (height + 3) / 4;
+	const size_t stride = blockBytes(format);
+	unsigned char block[64];
+	for (int by = 0; by < blocksY; ++by)
+	{
+		for (int bx = 0; bx < blocksX; ++bx, blocks += stride)
+		{
+			switch (format)
+			{
+			case BlockFormat::BC1:
+				decodeColorBlock(blocks, block, true);
+				break;
+			case BlockFormat::BC3:
+				decodeColorBlock(blocks + 8, block, false);
+				decodeChannelBlock(blocks, block, 3);
+				break;
+			case BlockFormat::BC5:
+				for (int i = 0; i < 16; ++i)
+				{
+					block[i * 4 + 2] = 0;
+					block[i * 4 + 3] = 255;
+				}
+				decodeChannelBlock(blocks, block, 0);
+				decodeChannelBlock(blocks + 8, block, 1);
+				break;
+			}
+
+			for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+			{
+				const int count = std::min(4, width - bx * 4);
+				memcpy(rgba + ((size_t)(by * 4 + y) * width + bx * 4) * 4, block + y * 16, count * 4);
+			}
+		}
+	}
+}
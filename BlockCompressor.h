@@ -0,0 +1,48 @@
+#pragma once
+#include "MipGenerator.h"
+#include "Simd.h"
+
+#include <vector>
+
+class ThreadPool;
+
+enum class BlockFormat
+{
+	BC1, // opaque RGB, 8 bytes per 4x4 block
+	BC3, // RGB plus interpolated alpha, 16 bytes per block
+	BC5  // two independent channels (normal map X/Y), 16 bytes per block
+};
+
+// Block compressed mip chain. MipLevel::offset indexes into data as for MipChain.
+struct CompressedChain
+{
+	BlockFormat format = BlockFormat::BC1;
+	std::vector<MipLevel> levels;
+	std::vector<unsigned char> data;
+
+	size_t levelBytes(size_t level) const;
+	const unsigned char* levelData(size_t level) const { return data.data() + levels[level].offset; }
+};
+
+// CPU BCn encoder and decoder working on RGBA8 pixels. Colour endpoints start
+// at the extreme pixels along the block's principal axis and get one least
+// squares refinement. Projection, index selection and alpha quantization have
+// SSE2 kernels that produce the same blocks as the scalar path. Images are
+// compressed in bands of block rows on the thread pool.
+class BlockCompressor
+{
+public:
+	static size_t blockBytes(BlockFormat format);
+	static size_t imageBytes(BlockFormat format, int width, int height);
+
+	static void compress(const unsigned char* rgba, int width, int height, BlockFormat format,
+		unsigned char* blocks, ThreadPool* pool, SimdLevel level = detectSimdLevel());
+
+	// Compresses every level of a 4 channel chain.
+	static CompressedChain compress(const MipChain& chain, BlockFormat format,
+		ThreadPool* pool, SimdLevel level = detectSimdLevel());
+
+	// Expands blocks back to RGBA8. BC5 writes its channels to R and G with
+	// B = 0 and A = 255.
+	static void decompress(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* rgba);
+};
@@ -0,0 +1,280 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+	const size_t kMaxUnits = 0xffffffff;
+
+	size_t indexWords(size_t indexCount, size_t indexBytes)
+	{
+		return (indexCount * indexBytes + 3) / 4;
+	}
+
+	size_t grownCapacity(size_t capacity, size_t need)
+	{
+		return std::max(capacity * 2, capacity + need);
+	}
+
+	GLuint createBuffer(size_t bytes)
+	{
+		GLuint buffer = 0;
+		glCreateBuffers(1, &buffer);
+		glNamedBufferStorage(buffer, (GLsizeiptr)std::max<size_t>(bytes, 4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		return buffer;
+	}
+}
+
+bool GeometryArena::create(const VertexLayout& layout, const GeometryArenaParams& params)
+{
+	release();
+	if (layout.attributes().empty() || params.vertexCapacity > kMaxUnits || params.indexCapacity / 4 > kMaxUnits)
+	{
+		std::cerr << "GeometryArena: needs a vertex layout and capacities below 4G units" << std::endl;
+		return false;
+	}
+	mLayout = layout;
+	mVertexSpace.reset((uint32_t)std::max<size_t>(params.vertexCapacity, 1));
+	mIndexSpace.reset((uint32_t)std::max<size_t>(indexWords(params.indexCapacity, 1), 1));
+
+	mVertexBuffer = createBuffer(mVertexSpace.size() * mLayout.stride());
+	mIndexBuffer = createBuffer(mIndexSpace.size() * 4);
+	glCreateVertexArrays(1, &mVertexArray);
+	glBindVertexArray(mVertexArray);
+	mLayout.apply(mVertexBuffer);
+	glVertexArrayElementBuffer(mVertexArray, mIndexBuffer);
+	glBindVertexArray(0);
+	return true;
+}
+
+void GeometryArena::release()
+{
+	if (mVertexArray)
+	{
+		glDeleteVertexArrays(1, &mVertexArray);
+		glDeleteBuffers(1, &mVertexBuffer);
+		glDeleteBuffers(1, &mIndexBuffer);
+	}
+	mVertexArray = mVertexBuffer = mIndexBuffer = 0;
+	mLayout = VertexLayout();
+	mVertexSpace.reset(0);
+	mIndexSpace.reset(0);
+	mMeshes.clear();
+	mFreeHandles.clear();
+	mGrows = mDefragments = mMovedBytes = 0;
+}
+
+GeometryArena::Handle GeometryArena::add(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount,
+	size_t indexBytes)
+{
+	if (!isCreated() || (indexBytes != 2 && indexBytes != 4) || vertexCount > kMaxUnits || indexWords(indexCount, indexBytes) > kMaxUnits)
+		return kInvalid;
+	const size_t words = indexWords(indexCount, indexBytes);
+
+	Mesh mesh;
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		mesh.vertices = mVertexSpace.allocate((uint32_t)vertexCount);
+		mesh.indices = mIndexSpace.allocate((uint32_t)words);
+		const bool vertexFits = mesh.vertices.offset != OffsetAllocator::kNoSpace;
+		const bool indexFits = mesh.indices.offset != OffsetAllocator::kNoSpace;
+		if (vertexFits && indexFits)
+			break;
+		mVertexSpace.free(mesh.vertices);
+		mIndexSpace.free(mesh.indices);
+		mesh.vertices = mesh.indices = OffsetAllocator::Allocation();
+		if (attempt > 0 || !mGrow(vertexFits ? 0 : std::max<size_t>(vertexCount, 1), indexFits ? 0 : std::max<size_t>(words, 1)))
+		{
+			std::cerr << "GeometryArena: no room for " << vertexCount << " vertices and " << indexCount << " indices" << std::endl;
+			return kInvalid;
+		}
+	}
+
+	const size_t stride = mLayout.stride();
+	if (vertexCount > 0)
+		glNamedBufferSubData(mVertexBuffer, (GLintptr)(mesh.vertices.offset * stride), (GLsizeiptr)(vertexCount * stride), vertices);
+	if (indexCount > 0)
+		glNamedBufferSubData(mIndexBuffer, (GLintptr)mesh.indices.offset * 4, (GLsizeiptr)(indexCount * indexBytes), indices);
+	mesh.range.baseVertex = mesh.vertices.offset;
+	mesh.range.vertexCount = (uint32_t)vertexCount;
+	mesh.range.firstIndex = (size_t)mesh.indices.offset * 4 / indexBytes;
+	mesh.range.indexCount = indexCount;
+	mesh.range.indexBytes = indexBytes;
+	mesh.live = true;
+
+	if (!mFreeHandles.empty())
+	{
+		const Handle handle = mFreeHandles.back();
+		mFreeHandles.pop_back();
+		mMeshes[handle] = mesh;
+		return handle;
+	}
+	mMeshes.push_back(mesh);
+	return mMeshes.size() - 1;
+}
+
+void GeometryArena::remove(Handle handle)
+{
+	if (handle >= mMeshes.size() || !mMeshes[handle].live)
+		return;
+	Mesh& mesh = mMeshes[handle];
+	mVertexSpace.free(mesh.vertices);
+	mIndexSpace.free(mesh.indices);
+	mesh = Mesh();
+	mFreeHandles.push_back(handle);
+}
+
+void GeometryArena::draw(Handle handle, GLenum mode) const
+{
+	const Range& mesh = range(handle);
+	glDrawElementsBaseVertex(mode, (GLsizei)mesh.indexCount, mesh.indexType(), (const void*)(mesh.firstIndex * mesh.indexBytes),
+		(GLint)mesh.baseVertex);
+}
+
+void GeometryArena::draw(Handle handle, GLenum mode, const std::vector<IndexChunk>& chunks) const
+{
+	const Range& mesh = range(handle);
+	for (const IndexChunk& chunk : chunks)
+	{
+		if (chunk.indexCount == 0)
+			continue;
+		glDrawElementsBaseVertex(mode, (GLsizei)chunk.indexCount, mesh.indexType(),
+			(const void*)((mesh.firstIndex + chunk.indexOffset) * mesh.indexBytes), (GLint)(mesh.baseVertex + chunk.baseVertex));
+	}
+}
+
+bool GeometryArena::defragment()
+{
+	if (!isCreated())
+		return false;
+
+	// Allocating every mesh afresh from empty allocators, in offset order,
+	// packs them to the front without changing which comes first.
+	std::vector<Handle> byVertex, byIndex;
+	for (Handle handle = 0; handle < mMeshes.size(); ++handle)
+	{
+		if (mMeshes[handle].live)
+			byVertex.push_back(handle);
+	}
+	byIndex = byVertex;
+	std::sort(byVertex.begin(), byVertex.end(), [&](Handle a, Handle b) { return mMeshes[a].vertices.offset < mMeshes[b].vertices.offset; });
+	std::sort(byIndex.begin(), byIndex.end(), [&](Handle a, Handle b) { return mMeshes[a].indices.offset < mMeshes[b].indices.offset; });
+	OffsetAllocator vertexSpace(mVertexSpace.size()), indexSpace(mIndexSpace.size());
+	std::vector<OffsetAllocator::Allocation> vertices(mMeshes.size()), indices(mMeshes.size());
+	bool moved = false;
+	for (Handle handle : byVertex)
+	{
+		vertices[handle] = vertexSpace.allocate(mVertexSpace.allocationSize(mMeshes[handle].vertices));
+		moved = moved || vertices[handle].offset != mMeshes[handle].vertices.offset;
+	}
+	for (Handle handle : byIndex)
+	{
+		indices[handle] = indexSpace.allocate(mIndexSpace.allocationSize(mMeshes[handle].indices));
+		moved = moved || indices[handle].offset != mMeshes[handle].indices.offset;
+	}
+	if (!moved)
+		return false;
+
+	// Ranges in one buffer may not overlap when copied, so the packed meshes
+	// go into new buffers.
+	const size_t stride = mLayout.stride();
+	const GLuint vertexBuffer = createBuffer(mVertexSpace.size() * stride), indexBuffer = createBuffer(mIndexSpace.size() * 4);
+	for (Handle handle : byVertex)
+	{
+		Mesh& mesh = mMeshes[handle];
+		const size_t bytes = mVertexSpace.allocationSize(mesh.vertices) * stride, wordBytes = mIndexSpace.allocationSize(mesh.indices) * 4;
+		glCopyNamedBufferSubData(mVertexBuffer, vertexBuffer, (GLintptr)(mesh.vertices.offset * stride),
+			(GLintptr)(vertices[handle].offset * stride), (GLsizeiptr)bytes);
+		glCopyNamedBufferSubData(mIndexBuffer, indexBuffer, (GLintptr)mesh.indices.offset * 4, (GLintptr)indices[handle].offset * 4,
+			(GLsizeiptr)wordBytes);
+		mMovedBytes += (vertices[handle].offset != mesh.vertices.offset ? bytes : 0) +
+			(indices[handle].offset != mesh.indices.offset ? wordBytes : 0);
+		mesh.vertices = vertices[handle];
+		mesh.indices = indices[handle];
+		mesh.range.baseVertex = mesh.vertices.offset;
+		mesh.range.firstIndex = (size_t)mesh.indices.offset * 4 / mesh.range.indexBytes;
+	}
+	glDeleteBuffers(1, &mVertexBuffer);
+	glDeleteBuffers(1, &mIndexBuffer);
+	mSetBuffers(vertexBuffer, indexBuffer);
+	mVertexSpace = vertexSpace;
+	mIndexSpace = indexSpace;
+	++mDefragments;
+	return true;
+}
+
+GeometryArena::Stats GeometryArena::stats() const
+{
+	Stats stats;
+	const size_t stride = mLayout.stride();
+	const OffsetAllocator::Report vertices = mVertexSpace.report(), indices = mIndexSpace.report();
+	stats.meshes = vertices.allocations;
+	stats.vertexCapacityBytes = (size_t)vertices.size * stride;
+	stats.vertexUsedBytes = (size_t)(vertices.size - vertices.freeSpace) * stride;
+	stats.indexCapacityBytes = (size_t)indices.size * 4;
+	stats.indexUsedBytes = (size_t)(indices.size - indices.freeSpace) * 4;
+	stats.vertexFreeRegions = vertices.freeRegions;
+	stats.largestFreeVertexBytes = (size_t)vertices.largestFree * stride;
+	stats.indexFreeRegions = indices.freeRegions;
+	stats.largestFreeIndexBytes = (size_t)indices.largestFree * 4;
+	stats.vertexFragmentation = vertices.fragmentation();
+	stats.indexFragmentation = indices.fragmentation();
+	stats.grows = mGrows;
+	stats.defragments = mDefragments;
+	stats.movedBytes = mMovedBytes;
+	return stats;
+}
+
+void GeometryArena::printStats(std::ostream& out) const
+{
+	const Stats s = stats();
+	out << std::fixed << std::setprecision(2)
+		<< "Geometry arena: " << s.meshes << " meshes; vertices " << s.vertexUsedBytes / 1024 << " of " << s.vertexCapacityBytes / 1024
+		<< " KB, " << s.vertexFreeRegions << " free regions, largest " << s.largestFreeVertexBytes / 1024 << " KB, fragmentation "
+		<< s.vertexFragmentation << "; indices " << s.indexUsedBytes / 1024 << " of " << s.indexCapacityBytes / 1024 << " KB, "
+		<< s.indexFreeRegions << " free regions, largest " << s.largestFreeIndexBytes / 1024 << " KB, fragmentation "
+		<< s.indexFragmentation << "; grown " << s.grows << " times, defragmented " << s.defragments << " times ("
+		<< s.movedBytes / 1024 << " KB moved)" << std::endl;
+	out.unsetf(std::ios::floatfield);
+}
+
+bool GeometryArena::mGrow(size_t vertexCount, size_t indexWords)
+{
+	// Growing adds to the region at the end, so it is then large enough.
+	const OffsetAllocator::Report vertices = mVertexSpace.report(), indices = mIndexSpace.report();
+	const size_t vertexCapacity = vertexCount ? grownCapacity(vertices.size, vertexCount) : vertices.size;
+	const size_t indexCapacity = indexWords ? grownCapacity(indices.size, indexWords) : indices.size;
+	if (vertexCapacity > kMaxUnits || indexCapacity > kMaxUnits)
+		return false;
+
+	// Immutable storage cannot be resized: copy into larger buffers.
+	const size_t stride = mLayout.stride();
+	GLuint vertexBuffer = mVertexBuffer, indexBuffer = mIndexBuffer;
+	if (vertexCapacity != vertices.size)
+	{
+		vertexBuffer = createBuffer(vertexCapacity * stride);
+		glCopyNamedBufferSubData(mVertexBuffer, vertexBuffer, 0, 0, (GLsizeiptr)(vertices.size * stride));
+		glDeleteBuffers(1, &mVertexBuffer);
+		mVertexSpace.grow((uint32_t)vertexCapacity);
+	}
+	if (indexCapacity != indices.size)
+	{
+		indexBuffer = createBuffer(indexCapacity * 4);
+		glCopyNamedBufferSubData(mIndexBuffer, indexBuffer, 0, 0, (GLsizeiptr)indices.size * 4);
+		glDeleteBuffers(1, &mIndexBuffer);
+		mIndexSpace.grow((uint32_t)indexCapacity);
+	}
+	mSetBuffers(vertexBuffer, indexBuffer);
+	++mGrows;
+	return true;
+}
+
+void GeometryArena::mSetBuffers(GLuint vertexBuffer, GLuint indexBuffer)
+{
+	mVertexBuffer = vertexBuffer;
+	mIndexBuffer = indexBuffer;
+	glVertexArrayVertexBuffer(mVertexArray, 0, mVertexBuffer, 0, (GLsizei)mLayout.stride());
+	glVertexArrayElementBuffer(mVertexArray, mIndexBuffer);
+}
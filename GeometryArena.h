@@ -0,0 +1,115 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "IndexBuffer.h"
+#include "OffsetAllocator.h"
+#include "VertexLayout.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+struct GeometryArenaParams
+{
+	// Starting capacities. An arena that runs out grows into buffers twice
+	// the size, or as large as the mesh needs, copied on the GPU.
+	size_t vertexCapacity = 1 << 16; // vertices
+	size_t indexCapacity = 1 << 20;  // bytes
+};
+
+// Vertices of one layout and the indices of many meshes, in one immutable
+// vertex and one immutable index buffer behind one vertex array. A mesh is a
+// range of each, addressed by its base vertex and first index, so drawing
+// another mesh switches neither vertex arrays nor buffers. OffsetAllocator
+// hands out the space, vertices by the vertex and indices by the 4 byte
+// word, so 16 and 32 bit indices share the buffer. Handles stay valid while
+// defragment() moves the ranges; callers look up range() when they draw.
+class GeometryArena
+{
+public:
+	typedef size_t Handle;
+	static const Handle kInvalid = ~(size_t)0;
+
+	struct Range
+	{
+		uint32_t baseVertex = 0, vertexCount = 0;
+		size_t firstIndex = 0, indexCount = 0; // in indices of indexBytes
+		size_t indexBytes = 4;
+
+		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+		GLenum indexType() const { return indexBytes == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+	};
+
+	struct Stats
+	{
+		size_t meshes = 0;
+		size_t vertexCapacityBytes = 0, vertexUsedBytes = 0;
+		size_t indexCapacityBytes = 0, indexUsedBytes = 0;
+		// Free space by region, see OffsetAllocator::Report.
+		size_t vertexFreeRegions = 0, largestFreeVertexBytes = 0;
+		size_t indexFreeRegions = 0, largestFreeIndexBytes = 0;
+		float vertexFragmentation = 0.f, indexFragmentation = 0.f;
+		// Since create().
+		size_t grows = 0, defragments = 0, movedBytes = 0;
+	};
+
+	GeometryArena() = default;
+
+	GeometryArena(GeometryArena const&) = delete;
+	void operator=(GeometryArena const&) = delete;
+
+	// GL thread only. Creates the buffers and the vertex array for layout.
+	bool create(const VertexLayout& layout, const GeometryArenaParams& params = GeometryArenaParams());
+
+	// GL thread only. Frees the GL objects; every handle becomes invalid.
+	void release();
+
+	bool isCreated() const { return mVertexArray != 0; }
+	const VertexLayout& layout() const { return mLayout; }
+
+	// GL thread only. Copies vertexCount vertices of the layout's stride and
+	// indexCount indices of indexBytes (2 or 4) in, growing the buffers if
+	// they are full. Index values are relative to the mesh's first vertex.
+	Handle add(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount, size_t indexBytes);
+
+	// Gives the mesh's space back. The handle stays invalid afterwards.
+	void remove(Handle handle);
+
+	const Range& range(Handle handle) const { return mMeshes[handle].range; }
+	GLuint vertexArray() const { return mVertexArray; }
+	GLuint indexBuffer() const { return mIndexBuffer; }
+
+	// GL thread only, with vertexArray() bound. Draws the mesh's indices, or
+	// the chunks of them, offsets relative to its first index and base
+	// vertices to its base vertex.
+	void draw(Handle handle, GLenum mode = GL_TRIANGLES) const;
+	void draw(Handle handle, GLenum mode, const std::vector<IndexChunk>& chunks) const;
+
+	// GL thread only. Packs every mesh to the front of new buffers of the
+	// same capacity, in the order they are in now, so all free space ends up
+	// in one region at the end. False if nothing had to move.
+	bool defragment();
+
+	Stats stats() const;
+	void printStats(std::ostream& out) const;
+
+private:
+	struct Mesh
+	{
+		Range range;
+		OffsetAllocator::Allocation vertices, indices;
+		bool live = false;
+	};
+
+	// Grows the buffers by at least the vertices and index words asked for,
+	// 0 for a buffer that has room.
+	bool mGrow(size_t vertexCount, size_t indexWords);
+	void mSetBuffers(GLuint vertexBuffer, GLuint indexBuffer);
+
+private:
+	VertexLayout mLayout;
+	GLuint mVertexArray = 0, mVertexBuffer = 0, mIndexBuffer = 0;
+	OffsetAllocator mVertexSpace, mIndexSpace; // vertices, 4 byte words
+	std::vector<Mesh> mMeshes;
+	std::vector<Handle> mFreeHandles;
+	size_t mGrows = 0, mDefragments = 0, mMovedBytes = 0;
+};
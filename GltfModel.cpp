@@ -0,0 +1,663 @@
+#include "GltfModel.h"
+#include "Json.h"
+#include "TextureCache.h"
+#include "TextureContainer.h"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/gtx/transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double elapsedMs(Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	}
+
+	const uint32_t kGlbMagic = 0x46546C67; // "glTF"
+	const uint32_t kChunkJson = 0x4E4F534A;
+	const uint32_t kChunkBinary = 0x004E4942;
+
+	// Views start 16 byte aligned in the GL buffer, more than any attribute or
+	// index type needs.
+	size_t align16(size_t value)
+	{
+		return (value + 15) & ~(size_t)15;
+	}
+
+	uint32_t readU32(const unsigned char* p)
+	{
+		return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+	}
+
+	size_t componentBytes(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE: return 1;
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT: return 2;
+		case GL_UNSIGNED_INT:
+		case GL_FLOAT: return 4;
+		default: return 0;
+		}
+	}
+
+	int typeComponents(const std::string& type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		return 0; // matrices are only used by skins
+	}
+
+	float number(const JsonValue& value, size_t index, float fallback)
+	{
+		return (float)value[index].number(fallback);
+	}
+
+	glm::mat4 nodeTransform(const JsonValue& node)
+	{
+		const JsonValue& matrix = node["matrix"];
+		if (matrix.size() == 16)
+		{
+			glm::mat4 result;
+			for (int i = 0; i < 16; ++i)
+				result[i / 4][i % 4] = number(matrix, i, 0.f); // column major, as glm
+			return result;
+		}
+		const JsonValue& t = node["translation"];
+		const JsonValue& r = node["rotation"];
+		const JsonValue& s = node["scale"];
+		const glm::quat rotation(number(r, 3, 1.f), number(r, 0, 0.f), number(r, 1, 0.f), number(r, 2, 0.f));
+		return glm::translate(glm::vec3(number(t, 0, 0.f), number(t, 1, 0.f), number(t, 2, 0.f))) * glm::mat4_cast(rotation) *
+			glm::scale(glm::vec3(number(s, 0, 1.f), number(s, 1, 1.f), number(s, 2, 1.f)));
+	}
+
+	TextureSampling samplerSampling(const JsonValue& sampler)
+	{
+		// Unset filters are up to the implementation; these are what the
+		// renderer uses for its own textures.
+		TextureSampling sampling;
+		sampling.minFilter = sampler["minFilter"].integer(GL_LINEAR_MIPMAP_LINEAR);
+		sampling.magFilter = sampler["magFilter"].integer(GL_LINEAR);
+		// TextureSampling has one wrap mode for both axes.
+		sampling.wrap = sampler["wrapS"].integer(GL_REPEAT);
+		return sampling;
+	}
+}
+
+size_t GltfAccessor::elementBytes() const
+{
+	return componentBytes(componentType) * components;
+}
+
+bool GltfModel::load(const std::string& path, const GltfLoadParams& params)
+{
+	const auto start = Clock::now();
+	mLoader.reset();
+	mParams = params;
+	mViews.clear();
+	mAccessors.clear();
+	mMaterials.clear();
+	mPrimitives.clear();
+	mMeshes.clear();
+	mInstances.clear();
+	mImages.clear();
+	mStats = Stats();
+
+	if (!mFile.open(path))
+	{
+		std::cerr << "GltfModel: cannot open " << path << std::endl;
+		return false;
+	}
+	const unsigned char* data = mFile.data();
+	const size_t size = mFile.size();
+	mStats.fileBytes = size;
+	if (size < 20 || readU32(data) != kGlbMagic || readU32(data + 4) != 2 || readU32(data + 8) > size)
+	{
+		std::cerr << "GltfModel: " << path << " is not a binary glTF 2.0 file" << std::endl;
+		mFile.close();
+		return false;
+	}
+	const size_t length = readU32(data + 8);
+	const size_t jsonBytes = readU32(data + 12);
+	if (readU32(data + 16) != kChunkJson || 20 + jsonBytes > length)
+	{
+		std::cerr << "GltfModel: " << path << " has no JSON chunk" << std::endl;
+		mFile.close();
+		return false;
+	}
+	const unsigned char* binary = nullptr;
+	size_t binaryBytes = 0;
+	const size_t binaryChunk = 20 + ((jsonBytes + 3) & ~(size_t)3);
+	if (binaryChunk + 8 <= length && readU32(data + binaryChunk + 4) == kChunkBinary)
+	{
+		binaryBytes = std::min<size_t>(readU32(data + binaryChunk), length - binaryChunk - 8);
+		binary = data + binaryChunk + 8;
+	}
+	mStats.jsonBytes = jsonBytes;
+	mStats.binaryBytes = binaryBytes;
+
+	JsonValue json;
+	std::string error;
+	if (!JsonValue::parse((const char*)data + 20, jsonBytes, json, error))
+	{
+		std::cerr << "GltfModel: " << path << ": " << error << std::endl;
+		mFile.close();
+		return false;
+	}
+	if (json["asset"]["version"].string().compare(0, 2, "2.") != 0)
+	{
+		std::cerr << "GltfModel: " << path << " is glTF " << json["asset"]["version"].string() << ", not 2.x" << std::endl;
+		mFile.close();
+		return false;
+	}
+	// Quantized attributes need nothing beyond what the vertex arrays already
+	// do; any other required extension changes what the file means.
+	for (const JsonValue& extension : json["extensionsRequired"].items())
+	{
+		if (extension.string() != "KHR_mesh_quantization")
+		{
+			std::cerr << "GltfModel: " << path << " requires unsupported extension " << extension.string() << std::endl;
+			mFile.close();
+			return false;
+		}
+	}
+
+	// Only the binary chunk is loaded; buffers with a uri leave their views
+	// without data.
+	const JsonValue& buffers = json["buffers"];
+	for (const JsonValue& view : json["bufferViews"].items())
+	{
+		GltfBufferView result;
+		const int buffer = view["buffer"].integer(-1);
+		const size_t offset = (size_t)view["byteOffset"].number(0);
+		result.size = (size_t)view["byteLength"].number(0);
+		result.stride = (size_t)view["byteStride"].number(0);
+		if (buffer == 0 && binary && !buffers[0].has("uri") && offset + result.size <= binaryBytes)
+			result.data = binary + offset;
+		mViews.push_back(result);
+	}
+	for (const JsonValue& accessor : json["accessors"].items())
+	{
+		mAccessors.emplace_back();
+		if (!mParseAccessor(accessor, mAccessors.back()))
+			mAccessors.back().view = -1;
+	}
+	mParseMaterials(json);
+	mParseMeshes(json);
+	mParseNodes(json);
+	mStats.parseMs = elapsedMs(start);
+
+	if (params.textures)
+	{
+		const auto decodeStart = Clock::now();
+		const size_t slash = path.find_last_of("/\\");
+		mDecodeImages(json, slash == std::string::npos ? std::string() : path.substr(0, slash + 1));
+		mStats.decodeMs = elapsedMs(decodeStart);
+	}
+
+	mStats.meshes = mMeshes.size();
+	mStats.instances = mInstances.size();
+	for (const GltfInstance& instance : mInstances)
+	{
+		const GltfMesh& mesh = mMeshes[instance.mesh];
+		for (size_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+		{
+			const GltfPrimitive& primitive = mPrimitives[p];
+			if (primitive.attributes[0] < 0)
+				continue;
+			const size_t count = primitive.indices >= 0 ? mAccessors[primitive.indices].count : mAccessors[primitive.attributes[0]].count;
+			if (primitive.mode == GL_TRIANGLES)
+				mStats.triangles += count / 3;
+			else if ((primitive.mode == GL_TRIANGLE_STRIP || primitive.mode == GL_TRIANGLE_FAN) && count >= 3)
+				mStats.triangles += count - 2;
+		}
+	}
+	return true;
+}
+
+bool GltfModel::mParseAccessor(const JsonValue& json, GltfAccessor& accessor)
+{
+	accessor.offset = (size_t)json["byteOffset"].number(0);
+	accessor.count = (size_t)json["count"].number(0);
+	accessor.components = typeComponents(json["type"].string());
+	accessor.componentType = (GLenum)json["componentType"].integer(0);
+	accessor.normalized = json["normalized"].boolean(false);
+	if (json.has("sparse") || !json.has("bufferView"))
+		return false;
+	accessor.view = json["bufferView"].integer(-1);
+	if (accessor.view < 0 || (size_t)accessor.view >= mViews.size() || !accessor.components || !componentBytes(accessor.componentType))
+		return false;
+
+	// Every element has to lie inside the view, and the view inside the file.
+	const GltfBufferView& view = mViews[accessor.view];
+	const size_t bytes = accessor.count ? accessor.offset + accessor.stride(view) * (accessor.count - 1) + accessor.elementBytes() : 0;
+	return view.data && bytes <= view.size && accessor.offset % componentBytes(accessor.componentType) == 0;
+}
+
+const unsigned char* GltfModel::mAccessorData(const GltfAccessor& accessor) const
+{
+	return mViews[accessor.view].data + accessor.offset;
+}
+
+void GltfModel::mParseMaterials(const JsonValue& json)
+{
+	for (const JsonValue& source : json["materials"].items())
+	{
+		GltfMaterial material;
+		material.name = source["name"].string();
+		const JsonValue& pbr = source["pbrMetallicRoughness"];
+		const JsonValue& base = pbr["baseColorFactor"];
+		material.baseColor = glm::vec4(number(base, 0, 1.f), number(base, 1, 1.f), number(base, 2, 1.f), number(base, 3, 1.f));
+		material.metallic = glm::clamp((float)pbr["metallicFactor"].number(1), 0.f, 1.f);
+		material.roughness = glm::clamp((float)pbr["roughnessFactor"].number(1), 0.f, 1.f);
+		const JsonValue& emissive = source["emissiveFactor"];
+		material.emissive = glm::vec3(number(emissive, 0, 0.f), number(emissive, 1, 0.f), number(emissive, 2, 0.f));
+		material.doubleSided = source["doubleSided"].boolean(false);
+
+		// Blinn-Phong with exponent n has about the width of a GGX lobe with
+		// alpha = roughness^2 when n = 2 / alpha^2 - 2.
+		const glm::vec3 color(material.baseColor);
+		const float alpha = std::max(material.roughness * material.roughness, 0.03f);
+		material.Kd = color * (1.f - material.metallic);
+		material.Ks = glm::mix(glm::vec3(0.04f), color, material.metallic);
+		material.shininess = glm::clamp(2.f / (alpha * alpha) - 2.f, 1.f, 1024.f);
+		material.Ka = color * 0.1f + material.emissive;
+
+		// Texture indices are resolved to images in mDecodeImages.
+		material.diffuseImage = pbr["baseColorTexture"]["index"].integer(-1);
+		material.normalImage = source["normalTexture"]["index"].integer(-1);
+		mMaterials.push_back(material);
+	}
+}
+
+void GltfModel::mParseMeshes(const JsonValue& json)
+{
+	const char* const kAttributes[] = { "POSITION", "TEXCOORD_0", "NORMAL", "TANGENT" };
+	for (const JsonValue& source : json["meshes"].items())
+	{
+		GltfMesh mesh;
+		mesh.name = source["name"].string();
+		mesh.firstPrimitive = mPrimitives.size();
+		for (const JsonValue& sourcePrimitive : source["primitives"].items())
+		{
+			GltfPrimitive primitive;
+			primitive.mode = (GLenum)sourcePrimitive["mode"].integer(GL_TRIANGLES);
+			primitive.material = sourcePrimitive["material"].integer(-1);
+			if (primitive.material >= (int)mMaterials.size())
+				primitive.material = -1;
+
+			// Attributes and indices have to be valid accessors the vertex
+			// arrays can read, with one element per vertex.
+			bool valid = primitive.mode <= GL_TRIANGLE_FAN;
+			size_t vertices = 0;
+			for (int semantic = 0; semantic < 4 && valid; ++semantic)
+			{
+				const JsonValue& index = sourcePrimitive["attributes"][kAttributes[semantic]];
+				if (index.isNull())
+					continue;
+				const int accessor = index.integer(-1);
+				valid = accessor >= 0 && (size_t)accessor < mAccessors.size() && mAccessors[accessor].view >= 0 &&
+					mAccessors[accessor].componentType != GL_UNSIGNED_INT && (vertices == 0 || mAccessors[accessor].count == vertices);
+				if (valid)
+				{
+					primitive.attributes[semantic] = accessor;
+					vertices = mAccessors[accessor].count;
+				}
+			}
+			valid = valid && primitive.attributes[0] >= 0;
+			if (valid && sourcePrimitive.has("indices"))
+			{
+				const int accessor = sourcePrimitive["indices"].integer(-1);
+				valid = accessor >= 0 && (size_t)accessor < mAccessors.size() && mAccessors[accessor].view >= 0 &&
+					mAccessors[accessor].components == 1 && mAccessors[accessor].componentType != GL_FLOAT &&
+					mAccessors[accessor].componentType != GL_BYTE && mAccessors[accessor].componentType != GL_SHORT;
+				if (valid)
+				{
+					// An index past the vertices would read outside the
+					// attributes on the GPU. The upload touches the same pages.
+					const GltfAccessor& indices = mAccessors[accessor];
+					const unsigned char* data = mAccessorData(indices);
+					const size_t stride = indices.stride(mViews[indices.view]);
+					uint32_t largest = 0;
+					for (size_t i = 0; i < indices.count; ++i, data += stride)
+					{
+						uint32_t index = indices.componentType == GL_UNSIGNED_BYTE ? *data : 0;
+						if (indices.componentType == GL_UNSIGNED_SHORT)
+						{
+							uint16_t value;
+							memcpy(&value, data, 2);
+							index = value;
+						}
+						else if (indices.componentType == GL_UNSIGNED_INT)
+						{
+							memcpy(&index, data, 4);
+						}
+						largest = std::max(largest, index);
+					}
+					// Index buffers are read tightly packed.
+					valid = (indices.count == 0 || largest < vertices) && indices.stride(mViews[indices.view]) == indices.elementBytes();
+					primitive.indices = accessor;
+				}
+			}
+			if (!valid)
+			{
+				std::cerr << "GltfModel: skipping primitive " << mPrimitives.size() - mesh.firstPrimitive << " of mesh \""
+					<< mesh.name << "\": unsupported or invalid accessors" << std::endl;
+				primitive.attributes[0] = -1;
+				++mStats.skipped;
+			}
+			else
+			{
+				for (int semantic = 0; semantic < 4; ++semantic)
+				{
+					if (primitive.attributes[semantic] >= 0)
+						mViews[mAccessors[primitive.attributes[semantic]].view].geometry = true;
+				}
+				if (primitive.indices >= 0)
+					mViews[mAccessors[primitive.indices].view].geometry = true;
+
+				const JsonValue& accessor = json["accessors"][primitive.attributes[0]];
+				const JsonValue& low = accessor["min"];
+				const JsonValue& high = accessor["max"];
+				primitive.boundsMin = glm::vec3(number(low, 0, 0.f), number(low, 1, 0.f), number(low, 2, 0.f));
+				primitive.boundsMax = glm::vec3(number(high, 0, 0.f), number(high, 1, 0.f), number(high, 2, 0.f));
+				++mStats.primitives;
+			}
+			mPrimitives.push_back(primitive);
+		}
+		mesh.primitiveCount = mPrimitives.size() - mesh.firstPrimitive;
+		mMeshes.push_back(mesh);
+	}
+}
+
+void GltfModel::mParseNodes(const JsonValue& json)
+{
+	const JsonValue& nodes = json["nodes"];
+	std::vector<int> roots;
+	const JsonValue& scenes = json["scenes"];
+	if (scenes.size())
+	{
+		for (const JsonValue& node : scenes[json["scene"].integer(0)]["nodes"].items())
+			roots.push_back(node.integer(-1));
+	}
+	else
+	{
+		// Without scenes, draw every node that is nobody's child.
+		std::vector<bool> child(nodes.size(), false);
+		for (const JsonValue& node : nodes.items())
+		{
+			for (const JsonValue& index : node["children"].items())
+			{
+				if (index.integer(-1) >= 0 && (size_t)index.integer(-1) < child.size())
+					child[index.integer(-1)] = true;
+			}
+		}
+		for (size_t i = 0; i < child.size(); ++i)
+		{
+			if (!child[i])
+				roots.push_back((int)i);
+		}
+	}
+
+	// Depth first with an explicit stack. The node hierarchy must be a forest,
+	// so a node reached twice ends that branch instead of looping.
+	std::vector<bool> visited(nodes.size(), false);
+	std::vector<std::pair<int, glm::mat4>> stack;
+	for (auto root = roots.rbegin(); root != roots.rend(); ++root)
+		stack.push_back(std::make_pair(*root, glm::mat4(1.f)));
+	while (!stack.empty())
+	{
+		const int index = stack.back().first;
+		const glm::mat4 parent = stack.back().second;
+		stack.pop_back();
+		if (index < 0 || (size_t)index >= nodes.size() || visited[index])
+			continue;
+		visited[index] = true;
+		const JsonValue& node = nodes[index];
+		const glm::mat4 transform = parent * nodeTransform(node);
+		const int mesh = node["mesh"].integer(-1);
+		if (mesh >= 0 && (size_t)mesh < mMeshes.size())
+		{
+			GltfInstance instance;
+			instance.mesh = mesh;
+			instance.transform = transform;
+			mInstances.push_back(instance);
+		}
+		const std::vector<JsonValue>& children = node["children"].items();
+		for (auto child = children.rbegin(); child != children.rend(); ++child)
+			stack.push_back(std::make_pair(child->integer(-1), transform));
+	}
+}
+
+void GltfModel::mDecodeImages(const JsonValue& json, const std::string& directory)
+{
+	// Materials name textures; the images behind them are what get decoded.
+	const JsonValue& textures = json["textures"];
+	const JsonValue& samplers = json["samplers"];
+	const JsonValue& images = json["images"];
+	mImages.resize(images.size());
+	std::vector<bool> used(images.size(), false);
+	auto resolve = [&](int& slot, TextureSampling& sampling, bool normalMap) {
+		const JsonValue& texture = textures[slot];
+		const int image = texture["source"].integer(-1);
+		slot = image >= 0 && (size_t)image < mImages.size() ? image : -1;
+		sampling = samplerSampling(samplers[texture["sampler"].integer(-1)]);
+		if (slot < 0 || used[slot])
+			return;
+		used[slot] = true;
+		mImages[slot].normalMap = normalMap;
+	};
+	for (GltfMaterial& material : mMaterials)
+	{
+		if (material.diffuseImage >= 0)
+			resolve(material.diffuseImage, material.diffuseSampling, false);
+		if (material.normalImage >= 0)
+			resolve(material.normalImage, material.normalSampling, true);
+	}
+
+	TextureLoadParams color;
+	color.mips = true;
+	color.compress = mParams.compressTextures;
+	color.cook = mParams.cookTextures;
+	color.usage = TextureUsage::Color;
+	TextureLoadParams normal = color;
+	normal.usage = TextureUsage::Normal;
+
+	mLoader.reset(new TextureLoader);
+	for (size_t i = 0; i < mImages.size(); ++i)
+	{
+		if (!used[i])
+			continue;
+		const JsonValue& source = images[i];
+		GltfImage& image = mImages[i];
+		image.name = source["name"].string();
+		const TextureLoadParams& params = image.normalMap ? normal : color;
+		const int view = source["bufferView"].integer(-1);
+		const std::string& uri = source["uri"].string();
+		if (view >= 0 && (size_t)view < mViews.size() && mViews[view].data)
+		{
+			if (image.name.empty())
+				image.name = "image " + std::to_string(i);
+			image.ticket = mLoader->request(image.name, mViews[view].data, mViews[view].size, params);
+		}
+		else if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+		{
+			if (image.name.empty())
+				image.name = uri;
+			image.ticket = mLoader->request(directory + uri, params);
+		}
+		else
+		{
+			std::cerr << "GltfModel: image " << i << " " << image.name << " is neither in the binary chunk nor a file" << std::endl;
+			continue;
+		}
+		image.loaded = true;
+	}
+	// Requests run on the pool side by side; wait for all of them here so
+	// load() is done decoding when it returns. An image that fails to decode
+	// is reported by the loader and gets no texture from upload().
+	for (GltfImage& image : mImages)
+	{
+		if (!image.loaded)
+			continue;
+		mLoader->wait(image.ticket);
+		++mStats.images;
+	}
+}
+
+bool GltfModel::upload(TextureStreamer* streamer)
+{
+	if (!mFile.isOpen())
+	{
+		std::cerr << "GltfModel: upload() needs a loaded model that is still mapped" << std::endl;
+		return false;
+	}
+	const auto start = Clock::now();
+
+	size_t bytes = 0;
+	for (GltfBufferView& view : mViews)
+	{
+		if (!view.geometry)
+			continue;
+		view.glOffset = bytes;
+		bytes = align16(bytes + view.size);
+	}
+	if (bytes)
+	{
+		glCreateBuffers(1, &mBuffer);
+		glNamedBufferStorage(mBuffer, (GLsizeiptr)bytes, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		for (const GltfBufferView& view : mViews)
+		{
+			if (view.geometry)
+				glNamedBufferSubData(mBuffer, (GLintptr)view.glOffset, (GLsizeiptr)view.size, view.data);
+		}
+	}
+	mStats.uploadedBytes = bytes;
+
+	for (GltfPrimitive& primitive : mPrimitives)
+	{
+		if (primitive.attributes[0] < 0)
+			continue;
+		glCreateVertexArrays(1, &primitive.vao);
+		for (GLuint semantic = 0; semantic < 4; ++semantic)
+		{
+			if (primitive.attributes[semantic] < 0)
+				continue;
+			// One binding per attribute, at the accessor's place in the view.
+			const GltfAccessor& accessor = mAccessors[primitive.attributes[semantic]];
+			const GltfBufferView& view = mViews[accessor.view];
+			glVertexArrayVertexBuffer(primitive.vao, semantic, mBuffer, (GLintptr)(view.glOffset + accessor.offset),
+				(GLsizei)accessor.stride(view));
+			glVertexArrayAttribFormat(primitive.vao, semantic, accessor.components, accessor.componentType,
+				accessor.normalized ? GL_TRUE : GL_FALSE, 0);
+			glVertexArrayAttribBinding(primitive.vao, semantic, semantic);
+			glEnableVertexArrayAttrib(primitive.vao, semantic);
+		}
+		if (primitive.indices >= 0)
+		{
+			const GltfAccessor& indices = mAccessors[primitive.indices];
+			glVertexArrayElementBuffer(primitive.vao, mBuffer);
+			primitive.indexType = indices.componentType;
+			primitive.indexOffset = mViews[indices.view].glOffset + indices.offset;
+			primitive.count = (GLsizei)indices.count;
+		}
+		else
+		{
+			primitive.count = (GLsizei)mAccessors[primitive.attributes[0]].count;
+		}
+	}
+
+	for (GltfImage& image : mImages)
+	{
+		if (!image.loaded || image.texture)
+			continue;
+		image.texture = mLoader->upload(image.ticket, streamer);
+	}
+	// Textures may be shared through the cache with other users, so sampling
+	// is never set on them; each material slot binds a sampler instead.
+	for (GltfMaterial& material : mMaterials)
+	{
+		material.diffuseSampler = TextureCache::shared().sampler(material.diffuseSampling);
+		material.normalSampler = TextureCache::shared().sampler(material.normalSampling);
+	}
+
+	if (mParams.closeAfterUpload)
+	{
+		// GL has its own copy now; the file's pages can go.
+		mFile.close();
+		for (GltfBufferView& view : mViews)
+			view.data = nullptr;
+	}
+	mStats.uploadMs = elapsedMs(start);
+	return true;
+}
+
+void GltfModel::release()
+{
+	for (GltfPrimitive& primitive : mPrimitives)
+	{
+		if (primitive.vao)
+			glDeleteVertexArrays(1, &primitive.vao);
+		primitive.vao = 0;
+	}
+	for (GltfImage& image : mImages)
+	{
+		if (image.texture)
+			TextureCache::shared().release(image.texture);
+		image.texture = 0;
+	}
+	// The cache owns the samplers.
+	for (GltfMaterial& material : mMaterials)
+		material.diffuseSampler = material.normalSampler = 0;
+	if (mBuffer)
+		glDeleteBuffers(1, &mBuffer);
+	mBuffer = 0;
+}
+
+bool GltfModel::bounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const
+{
+	bool any = false;
+	for (const GltfInstance& instance : mInstances)
+	{
+		const GltfMesh& mesh = mMeshes[instance.mesh];
+		for (size_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+		{
+			const GltfPrimitive& primitive = mPrimitives[p];
+			if (primitive.attributes[0] < 0)
+				continue;
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				const glm::vec3 local((corner & 1 ? primitive.boundsMax : primitive.boundsMin).x,
+					(corner & 2 ? primitive.boundsMax : primitive.boundsMin).y, (corner & 4 ? primitive.boundsMax : primitive.boundsMin).z);
+				const glm::vec3 world(instance.transform * glm::vec4(local, 1.f));
+				boundsMin = any ? glm::min(boundsMin, world) : world;
+				boundsMax = any ? glm::max(boundsMax, world) : world;
+				any = true;
+			}
+		}
+	}
+	return any;
+}
+
+void GltfModel::printStats(std::ostream& out) const
+{
+	out << std::fixed << std::setprecision(2)
+		<< "glTF: " << mStats.fileBytes / 1024 << " KB (" << mStats.jsonBytes / 1024 << " KB JSON), " << mStats.meshes << " meshes, "
+		<< mStats.primitives << " primitives (" << mStats.skipped << " skipped), " << mStats.instances << " instances, "
+		<< mStats.triangles << " triangles, " << mStats.images << " images; parse " << mStats.parseMs << " ms, decode "
+		<< mStats.decodeMs << " ms, upload " << mStats.uploadMs << " ms (" << mStats.uploadedBytes / 1024 << " KB)" << std::endl;
+	out.unsetf(std::ios::floatfield);
+	if (mLoader && mStats.images)
+		mLoader->printTimingReport(out);
+}
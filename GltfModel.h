@@ -0,0 +1,196 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "MappedFile.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "VertexLayout.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+class JsonValue;
+
+struct GltfLoadParams
+{
+	// Load the images materials use through a TextureLoader, base colors with
+	// the Color usage and normal maps with the Normal usage, mipmapped.
+	bool textures = true;
+	// Block compress them, and cook images kept next to the file.
+	bool compressTextures = true;
+	bool cookTextures = true;
+	// After upload(), unmap the file. Keep it mapped to upload() again later.
+	bool closeAfterUpload = true;
+};
+
+// A range of the binary chunk. Views holding vertex or index data are copied
+// into the model's GL buffer as they are, at glOffset.
+struct GltfBufferView
+{
+	const unsigned char* data = nullptr; // inside the mapped file
+	size_t size = 0;
+	size_t stride = 0; // 0 when elements are tightly packed
+	bool geometry = false;
+	size_t glOffset = 0;
+};
+
+struct GltfAccessor
+{
+	int view = -1;
+	size_t offset = 0; // from the start of the view
+	size_t count = 0;
+	int components = 0; // 1 to 4
+	GLenum componentType = 0;
+	bool normalized = false;
+
+	size_t elementBytes() const;
+	// Bytes between consecutive elements, given the view's stride.
+	size_t stride(const GltfBufferView& view) const { return view.stride ? view.stride : elementBytes(); }
+};
+
+// glTF's metallic-roughness parameters mapped onto the Ka, Kd, Ks and
+// shininess that mGlDraw's Blinn-Phong shaders take: metals lose their
+// diffuse term and tint their highlight, roughness becomes the Phong exponent
+// with the same highlight width, and the emissive color goes into ambient.
+// The defaults are glTF's default material.
+struct GltfMaterial
+{
+	std::string name;
+	glm::vec4 baseColor = glm::vec4(1.f);
+	float metallic = 1.f, roughness = 1.f;
+	glm::vec3 emissive = glm::vec3(0.f);
+	glm::vec3 Ka = glm::vec3(0.1f), Kd = glm::vec3(0.f), Ks = glm::vec3(1.f);
+	float shininess = 1.f;
+	int diffuseImage = -1; // texture unit 0, the base color
+	int normalImage = -1;  // texture unit 1, a tangent space normal map
+	// Each slot samples its image through its own glTF sampler, so images
+	// shared between materials can be filtered and wrapped differently.
+	TextureSampling diffuseSampling, normalSampling;
+	GLuint diffuseSampler = 0, normalSampler = 0; // from TextureCache::sampler by upload()
+	bool doubleSided = false;
+};
+
+struct GltfPrimitive
+{
+	GLenum mode = GL_TRIANGLES;
+	int attributes[4] = { -1, -1, -1, -1 }; // accessor per VertexSemantic, -1 if absent
+	int indices = -1;                       // accessor, -1 for non-indexed
+	int material = -1;
+	glm::vec3 boundsMin = glm::vec3(0.f), boundsMax = glm::vec3(0.f);
+
+	// Filled in by upload().
+	GLuint vao = 0;
+	GLsizei count = 0;
+	GLenum indexType = 0;
+	size_t indexOffset = 0; // bytes into the GL buffer
+
+	bool has(VertexSemantic semantic) const { return attributes[(int)semantic] >= 0; }
+};
+
+struct GltfMesh
+{
+	std::string name;
+	size_t firstPrimitive = 0, primitiveCount = 0;
+};
+
+// A node that draws a mesh, with the node's transform composed with all its
+// parents'.
+struct GltfInstance
+{
+	int mesh = -1;
+	glm::mat4 transform = glm::mat4(1.f);
+};
+
+// Decoded once however many materials use it; how it is sampled belongs to
+// each material slot.
+struct GltfImage
+{
+	std::string name;
+	bool normalMap = false;
+	bool loaded = false; // requested from the loader by load()
+	TextureLoader::Ticket ticket = 0;
+	GLuint texture = 0; // a TextureCache reference
+};
+
+// Binary glTF 2.0 (.glb) without intermediate copies. load() maps the file and
+// parses only the JSON chunk; accessors stay pointers into the mapped binary
+// chunk. upload() copies every buffer view holding vertex or index data from
+// the mapping into one GL buffer with glNamedBufferSubData, and each primitive
+// gets a vertex array that reads its attributes straight out of it in the
+// file's own layout and component types, so no per-attribute array is built
+// on the CPU. Nodes are flattened into instances with world transforms.
+// Images embedded in the binary chunk, or next to the file, go through a
+// TextureLoader like any other texture. Sparse accessors, data URIs and external buffers are not
+// supported; primitives that need them are skipped with a warning. Morph
+// targets and skins are ignored, so those meshes draw in their bind pose.
+class GltfModel
+{
+public:
+	struct Stats
+	{
+		size_t fileBytes = 0, jsonBytes = 0, binaryBytes = 0;
+		size_t uploadedBytes = 0; // geometry views copied into the GL buffer
+		size_t meshes = 0, primitives = 0, instances = 0, triangles = 0, images = 0, skipped = 0;
+		double parseMs = 0, decodeMs = 0, uploadMs = 0;
+	};
+
+	GltfModel() = default;
+
+	GltfModel(GltfModel const&) = delete;
+	void operator=(GltfModel const&) = delete;
+
+	// Any thread. Returns false, with the reason on std::cerr, if the file is
+	// not a valid .glb.
+	bool load(const std::string& path, const GltfLoadParams& params = GltfLoadParams());
+
+	// GL thread only. Creates the buffer, vertex arrays and textures; with a
+	// streamer the texels follow over the next frames.
+	bool upload(TextureStreamer* streamer = nullptr);
+
+	// GL thread only. Deletes the GL objects; the parsed model stays. Call it
+	// before the model is loaded again or destroyed.
+	void release();
+
+	const std::vector<GltfBufferView>& bufferViews() const { return mViews; }
+	const std::vector<GltfAccessor>& accessors() const { return mAccessors; }
+	const std::vector<GltfMaterial>& materials() const { return mMaterials; }
+	const std::vector<GltfPrimitive>& primitives() const { return mPrimitives; }
+	const std::vector<GltfMesh>& meshes() const { return mMeshes; }
+	const std::vector<GltfInstance>& instances() const { return mInstances; }
+	const std::vector<GltfImage>& images() const { return mImages; }
+	GLuint buffer() const { return mBuffer; }
+
+	// World space box around every instance, or false if there are none.
+	bool bounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+
+	const Stats& stats() const { return mStats; }
+	void printStats(std::ostream& out) const;
+
+private:
+	bool mParseAccessor(const JsonValue& json, GltfAccessor& accessor);
+	void mParseMaterials(const JsonValue& json);
+	void mParseMeshes(const JsonValue& json);
+	void mParseNodes(const JsonValue& json);
+	void mDecodeImages(const JsonValue& json, const std::string& directory);
+	// Elements of a valid accessor inside the mapped file.
+	const unsigned char* mAccessorData(const GltfAccessor& accessor) const;
+
+private:
+	MappedFile mFile;
+	// After mFile, so it is destroyed first: it may still be decoding images
+	// embedded in the mapping.
+	std::unique_ptr<TextureLoader> mLoader;
+	GltfLoadParams mParams;
+	std::vector<GltfBufferView> mViews;
+	std::vector<GltfAccessor> mAccessors;
+	std::vector<GltfMaterial> mMaterials;
+	std::vector<GltfPrimitive> mPrimitives;
+	std::vector<GltfMesh> mMeshes;
+	std::vector<GltfInstance> mInstances;
+	std::vector<GltfImage> mImages;
+	GLuint mBuffer = 0;
+	Stats mStats;
+};
@@ -0,0 +1,240 @@
+#include "HalfFloat.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	inline uint32_t floatBits(float f)
+	{
+		uint32_t u;
+		memcpy(&u, &f, 4);
+		return u;
+	}
+
+	inline float bitsFloat(uint32_t u)
+	{
+		float f;
+		memcpy(&f, &u, 4);
+		return f;
+	}
+
+	// Rounds the bits of a non-negative float to a float with a 5 bit exponent
+	// biased by 15 and mantissaBits of mantissa, the layout halves and the
+	// R11G11B10F channels share. Finite values past the largest finite one
+	// become infinity, or that largest value when saturating.
+	template <int mantissaBits, bool saturate>
+	uint32_t smallFloat(uint32_t u)
+	{
+		const int shift = 23 - mantissaBits;
+		const uint32_t infinity = 0x1fu << mantissaBits;
+		if (u >= 0x7f800000)
+			return u > 0x7f800000 ? infinity | 1u << (mantissaBits - 1) : infinity;
+		if (u >= (127u + 16) << 23)
+			return saturate ? infinity - 1 : infinity;
+		if (u < 113u << 23)
+		{
+			// Adding a power of two whose last mantissa bit is the smallest
+			// denormal makes the FPU round at exactly that bit.
+			const uint32_t magic = (uint32_t)((127 - 15) + shift + 1) << 23;
+			return floatBits(bitsFloat(u) + bitsFloat(magic)) - magic;
+		}
+		const uint32_t odd = (u >> shift) & 1;
+		u += ((uint32_t)(15 - 127) << 23) + (1u << (shift - 1)) - 1 + odd;
+		const uint32_t result = u >> shift;
+		return saturate && result >= infinity ? infinity - 1 : result;
+	}
+
+	inline uint16_t halfScalar(float f)
+	{
+		const uint32_t u = floatBits(f);
+		const uint32_t sign = u & 0x80000000;
+		return (uint16_t)(smallFloat<10, false>(u ^ sign) | sign >> 16);
+	}
+
+	inline uint32_t unsignedSmallFloat(float f, int mantissaBits)
+	{
+		const uint32_t u = floatBits(f);
+		if (u & 0x80000000)
+			return 0;
+		return mantissaBits == 6 ? smallFloat<6, true>(u) : smallFloat<5, true>(u);
+	}
+
+	inline uint32_t r11g11b10fScalar(const float* rgb)
+	{
+		return unsignedSmallFloat(rgb[0], 6) | unsignedSmallFloat(rgb[1], 6) << 11 | unsignedSmallFloat(rgb[2], 5) << 22;
+	}
+
+	float expandSmallFloat(uint32_t bits, int mantissaBits)
+	{
+		const uint32_t exponent = bits >> mantissaBits & 31;
+		const uint32_t mantissa = bits & ((1u << mantissaBits) - 1);
+		if (exponent == 31)
+			return mantissa ? NAN : INFINITY;
+		if (exponent == 0)
+			return std::ldexp((float)mantissa, -14 - mantissaBits);
+		return std::ldexp(1.f + (float)mantissa / (float)(1u << mantissaBits), (int)exponent - 15);
+	}
+
+#ifdef SIMD_X86
+	// Lane-wise smallFloat on non-negative float bits.
+	template <int mantissaBits, bool saturate>
+	inline __m128i smallFloatSse2(__m128i u)
+	{
+		const int shift = 23 - mantissaBits;
+		const __m128i infinity = _mm_set1_epi32(0x1f << mantissaBits);
+		const __m128i magic = _mm_set1_epi32(((127 - 15) + shift + 1) << 23);
+
+		const __m128i isNan = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f800000));
+		const __m128i isInfinite = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f7fffff));
+		const __m128i overflows = _mm_cmpgt_epi32(u, _mm_set1_epi32(((127 + 16) << 23) - 1));
+		const __m128i isDenormal = _mm_cmplt_epi32(u, _mm_set1_epi32(113 << 23));
+
+		__m128i denormal = _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), _mm_castsi128_ps(magic)));
+		denormal = _mm_sub_epi32(denormal, magic);
+		const __m128i odd = _mm_and_si128(_mm_srli_epi32(u, shift), _mm_set1_epi32(1));
+		__m128i normal = _mm_add_epi32(u, _mm_set1_epi32((int)(((uint32_t)(15 - 127) << 23) + (1u << (shift - 1)) - 1)));
+		normal = _mm_srli_epi32(_mm_add_epi32(normal, odd), shift);
+
+		const __m128i finiteMax = saturate ? _mm_sub_epi32(infinity, _mm_set1_epi32(1)) : infinity;
+		__m128i large = _mm_or_si128(_mm_andnot_si128(isInfinite, finiteMax), _mm_and_si128(isInfinite, infinity));
+		large = _mm_or_si128(large, _mm_and_si128(isNan, _mm_set1_epi32(1 << (mantissaBits - 1))));
+		__m128i result = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+		if (saturate)
+		{
+			const __m128i roundsUp = _mm_cmpgt_epi32(result, _mm_sub_epi32(infinity, _mm_set1_epi32(1)));
+			result = _mm_or_si128(_mm_andnot_si128(roundsUp, result), _mm_and_si128(roundsUp, finiteMax));
+		}
+		return _mm_or_si128(_mm_and_si128(overflows, large), _mm_andnot_si128(overflows, result));
+	}
+
+	inline __m128i halfSse2(__m128 f)
+	{
+		const __m128i u = _mm_castps_si128(f);
+		const __m128i sign = _mm_and_si128(u, _mm_set1_epi32((int)0x80000000));
+		const __m128i half = _mm_or_si128(smallFloatSse2<10, false>(_mm_xor_si128(u, sign)), _mm_srli_epi32(sign, 16));
+		// Sign extend so the signed pack keeps all 16 bits.
+		return _mm_srai_epi32(_mm_slli_epi32(half, 16), 16);
+	}
+
+	size_t fromFloatSse2(const float* src, uint16_t* dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i lo = halfSse2(_mm_loadu_ps(src + i));
+			const __m128i hi = halfSse2(_mm_loadu_ps(src + i + 4));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+		}
+		return i;
+	}
+
+	SIMD_TARGET_F16C size_t fromFloatF16c(const float* src, uint16_t* dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+		return i;
+	}
+
+	// Lanes with the sign bit set, which compare below zero as integers.
+	inline __m128i negativeSse2(__m128 f)
+	{
+		return _mm_cmplt_epi32(_mm_castps_si128(f), _mm_setzero_si128());
+	}
+
+	// Four RGBA pixels at a time, transposed so every channel is one register.
+	size_t packR11G11B10FSse2(const float* src, uint32_t* dst, size_t pixels)
+	{
+		size_t i = 0;
+		for (; i + 4 <= pixels; i += 4)
+		{
+			__m128 r = _mm_loadu_ps(src + i * 4), g = _mm_loadu_ps(src + i * 4 + 4);
+			__m128 b = _mm_loadu_ps(src + i * 4 + 8), a = _mm_loadu_ps(src + i * 4 + 12);
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			const __m128i rBits = _mm_andnot_si128(negativeSse2(r), smallFloatSse2<6, true>(_mm_castps_si128(r)));
+			const __m128i gBits = _mm_andnot_si128(negativeSse2(g), smallFloatSse2<6, true>(_mm_castps_si128(g)));
+			const __m128i bBits = _mm_andnot_si128(negativeSse2(b), smallFloatSse2<5, true>(_mm_castps_si128(b)));
+			const __m128i packed = _mm_or_si128(rBits, _mm_or_si128(_mm_slli_epi32(gBits, 11), _mm_slli_epi32(bBits, 22)));
+			_mm_storeu_si128((__m128i*)(dst + i), packed);
+		}
+		return i;
+	}
+#endif
+}
+
+size_t HdrChain::levelBytes(size_t level) const
+{
+	return (size_t)levels[level].width * levels[level].height * (format == HdrFormat::RGBA16F ? 8 : 4);
+}
+
+void HalfFloat::fromFloat(const float* src, uint16_t* dst, size_t count, SimdLevel level)
+{
+	size_t i = 0;
+#ifdef SIMD_X86
+	if (level >= SIMD_AVX2)
+		i = fromFloatF16c(src, dst, count);
+	else if (level >= SIMD_SSE2)
+		i = fromFloatSse2(src, dst, count);
+#endif
+	for (; i < count; ++i)
+		dst[i] = halfScalar(src[i]);
+}
+
+void HalfFloat::toFloat(const uint16_t* src, float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float magnitude = expandSmallFloat(src[i] & 0x7fff, 10);
+		dst[i] = src[i] & 0x8000 ? -magnitude : magnitude;
+	}
+}
+
+void HalfFloat::packR11G11B10F(const float* src, int channels, uint32_t* dst, size_t pixels, SimdLevel level)
+{
+	size_t i = 0;
+#ifdef SIMD_X86
+	if (channels == 4 && level >= SIMD_SSE2)
+		i = packR11G11B10FSse2(src, dst, pixels);
+#endif
+	for (; i < pixels; ++i)
+		dst[i] = r11g11b10fScalar(src + i * channels);
+}
+
+void HalfFloat::unpackR11G11B10F(const uint32_t* src, float* rgb, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i)
+	{
+		rgb[i * 3] = expandSmallFloat(src[i] & 0x7ff, 6);
+		rgb[i * 3 + 1] = expandSmallFloat(src[i] >> 11 & 0x7ff, 6);
+		rgb[i * 3 + 2] = expandSmallFloat(src[i] >> 22, 5);
+	}
+}
+
+HdrChain HalfFloat::pack(const FloatMipChain& chain, HdrFormat format, ThreadPool* pool, SimdLevel level)
+{
+	// As with TexelRepack, the levels form one run of pixels.
+	const size_t texelBytes = format == HdrFormat::RGBA16F ? 8 : 4;
+	HdrChain result;
+	result.format = format;
+	result.levels = chain.levels;
+	for (MipLevel& mip : result.levels)
+		mip.offset = mip.offset / chain.channels * texelBytes;
+	const size_t pixels = chain.data.size() / chain.channels;
+	result.data.resize(pixels * texelBytes);
+
+	auto band = [&](size_t begin, size_t end) {
+		const float* src = chain.data.data() + begin * chain.channels;
+		unsigned char* dst = result.data.data() + begin * texelBytes;
+		if (format == HdrFormat::RGBA16F)
+			fromFloat(src, (uint16_t*)dst, (end - begin) * 4, level);
+		else
+			packR11G11B10F(src, chain.channels, (uint32_t*)dst, end - begin, level);
+	};
+	if (pool)
+		pool->parallelFor(pixels, 1 << 16, band);
+	else
+		band(0, pixels);
+	return result;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "MipGenerator.h"
+#include "Simd.h"
+
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+enum class HdrFormat
+{
+	RGBA16F,   // four half floats, 8 bytes per texel
+	R11G11B10F // unsigned 11/11/10 bit floats without alpha, 4 bytes per texel
+};
+
+// Float mip chain packed for upload. MipLevel::offset indexes into data as for
+// MipChain.
+struct HdrChain
+{
+	HdrFormat format = HdrFormat::RGBA16F;
+	std::vector<MipLevel> levels;
+	std::vector<unsigned char> data;
+
+	size_t levelBytes(size_t level) const;
+	const unsigned char* levelData(size_t level) const { return data.data() + levels[level].offset; }
+};
+
+// Float to half and to R11G11B10F conversion, rounding to nearest even. The
+// SSE2 kernels are bit exact with the scalar path; at the AVX2 level halves
+// come from F16C, which matches too except for the payload of NaNs. The
+// small floats of R11G11B10F have no sign, so negatives become 0, and values
+// above their range clamp to the largest finite one rather than infinity.
+class HalfFloat
+{
+public:
+	static void fromFloat(const float* src, uint16_t* dst, size_t count, SimdLevel level = detectSimdLevel());
+	static void toFloat(const uint16_t* src, float* dst, size_t count);
+
+	// src holds pixels of channels floats, at least 3; alpha is dropped.
+	static void packR11G11B10F(const float* src, int channels, uint32_t* dst, size_t pixels, SimdLevel level = detectSimdLevel());
+	static void unpackR11G11B10F(const uint32_t* src, float* rgb, size_t pixels);
+
+	// Converts every level of a 4 channel chain, in bands on the pool if one is
+	// given.
+	static HdrChain pack(const FloatMipChain& chain, HdrFormat format, ThreadPool* pool, SimdLevel level = detectSimdLevel());
+};
@@ -0,0 +1,106 @@
+#include "Hash.h"
+
+#include <cstring>
+
+namespace
+{
+	const uint64_t kPrime1 = 11400714785074694791ULL;
+	const uint64_t kPrime2 = 14029467366897019727ULL;
+	const uint64_t kPrime3 = 1609587929392839161ULL;
+	const uint64_t kPrime4 = 9650029242287828579ULL;
+	const uint64_t kPrime5 = 2870177450012600261ULL;
+
+	inline uint64_t rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t read64(const unsigned char* p)
+	{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint32_t read32(const unsigned char* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint64_t round(uint64_t acc, uint64_t input)
+	{
+		acc += input * kPrime2;
+		acc = rotl(acc, 31);
+		return acc * kPrime1;
+	}
+
+	inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+	{
+		acc ^= round(0, val);
+		return acc * kPrime1 + kPrime4;
+	}
+}
+
+uint64_t hash64(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + size;
+	uint64_t h;
+
+	if (size >= 32)
+	{
+		uint64_t v1 = seed + kPrime1 + kPrime2;
+		uint64_t v2 = seed + kPrime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - kPrime1;
+		const unsigned char* limit = end - 32;
+		do
+		{
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	}
+	else
+	{
+		h = seed + kPrime5;
+	}
+
+	h += (uint64_t)size;
+
+	while (p + 8 <= end)
+	{
+		h ^= round(0, read64(p));
+		h = rotl(h, 27) * kPrime1 + kPrime4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= (uint64_t)read32(p) * kPrime1;
+		h = rotl(h, 23) * kPrime2 + kPrime3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		h ^= (*p) * kPrime5;
+		h = rotl(h, 11) * kPrime1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= kPrime2;
+	h ^= h >> 29;
+	h *= kPrime3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit non-cryptographic content hash (XXH64 algorithm). Used to key caches
+// on the bytes of a source asset.
+uint64_t hash64(const void* data, size_t size, uint64_t seed = 0);
@@ -0,0 +1,261 @@
+#include "IndexBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	const size_t kNoTriangle = ~(size_t)0;
+
+	uint32_t readIndex(const PackedIndices& packed, size_t i)
+	{
+		if (packed.indexBytes == 2)
+		{
+			uint16_t index;
+			memcpy(&index, &packed.data[i * 2], 2);
+			return index;
+		}
+		uint32_t index;
+		memcpy(&index, &packed.data[i * 4], 4);
+		return index;
+	}
+
+	void appendIndex(std::vector<unsigned char>& data, size_t indexBytes, uint32_t index)
+	{
+		if (indexBytes == 2)
+		{
+			const uint16_t narrow = (uint16_t)index;
+			data.insert(data.end(), (const unsigned char*)&narrow, (const unsigned char*)&narrow + 2);
+		}
+		else
+			data.insert(data.end(), (const unsigned char*)&index, (const unsigned char*)&index + 4);
+	}
+
+	void appendTriangle(std::vector<uint32_t>& triangles, uint32_t a, uint32_t b, uint32_t c)
+	{
+		if (a == b || b == c || c == a)
+			return;
+		triangles.push_back(a);
+		triangles.push_back(b);
+		triangles.push_back(c);
+	}
+}
+
+void PackedIndices::draw(size_t offset) const
+{
+	for (const IndexChunk& chunk : chunks)
+	{
+		if (chunk.indexCount == 0)
+			continue;
+		glDrawElementsBaseVertex(mode, (GLsizei)chunk.indexCount, type(), (const void*)(offset + chunk.indexOffset * indexBytes),
+			(GLint)chunk.baseVertex);
+	}
+}
+
+PackedIndices IndexPacker::pack(const std::vector<uint32_t>& indices, size_t vertexCount, const IndexPackParams& params)
+{
+	PackedIndices packed;
+	std::vector<IndexChunk> chunks = split(indices, vertexCount, params.split ? params.maxChunks : 1);
+	packed.indexBytes = chunks.empty() ? 4 : 2;
+	if (chunks.empty())
+		chunks.push_back({ 0, indices.size(), 0 });
+	const uint32_t restart = packed.indexBytes == 2 ? 0xffff : 0xffffffff;
+
+	// Each chunk's indices relative to its base vertex, as a list and, if
+	// asked for, as strips; the strips only win if they are shorter overall.
+	std::vector<std::vector<uint32_t>> lists(chunks.size()), strips(chunks.size());
+	size_t listCount = 0, stripCount = 0;
+	for (size_t c = 0; c < chunks.size(); ++c)
+	{
+		const IndexChunk& chunk = chunks[c];
+		uint32_t span = 0;
+		for (size_t i = chunk.indexOffset; i < chunk.indexOffset + chunk.indexCount; ++i)
+		{
+			lists[c].push_back(indices[i] - chunk.baseVertex);
+			span = std::max(span, lists[c].back() + 1);
+		}
+		listCount += lists[c].size();
+		if (params.strips)
+		{
+			strips[c] = stripify(lists[c], span, restart, params.stripLookahead);
+			stripCount += strips[c].size();
+		}
+	}
+	const bool useStrips = params.strips && stripCount < listCount;
+	packed.mode = useStrips ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+
+	for (size_t c = 0; c < chunks.size(); ++c)
+	{
+		const std::vector<uint32_t>& source = useStrips ? strips[c] : lists[c];
+		IndexChunk chunk = chunks[c];
+		chunk.indexOffset = packed.count();
+		chunk.indexCount = source.size();
+		for (uint32_t index : source)
+			appendIndex(packed.data, packed.indexBytes, index);
+		packed.chunks.push_back(chunk);
+	}
+	return packed;
+}
+
+std::vector<IndexChunk> IndexPacker::split(const std::vector<uint32_t>& indices, size_t vertexCount, size_t maxChunks)
+{
+	std::vector<IndexChunk> chunks;
+	if (vertexCount <= kMaxShortIndexVertices)
+	{
+		chunks.push_back({ 0, indices.size(), 0 });
+		return chunks;
+	}
+
+	// Greedy in triangle order: a chunk grows until the next triangle would
+	// stretch its vertex range too far.
+	IndexChunk chunk;
+	uint32_t low = std::numeric_limits<uint32_t>::max(), high = 0;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const uint32_t triangleLow = std::min(indices[i], std::min(indices[i + 1], indices[i + 2]));
+		const uint32_t triangleHigh = std::max(indices[i], std::max(indices[i + 1], indices[i + 2]));
+		if (triangleHigh - triangleLow >= kMaxShortIndexVertices)
+			return std::vector<IndexChunk>();
+		if (chunk.indexCount > 0 &&
+			std::max(high, triangleHigh) - std::min(low, triangleLow) >= kMaxShortIndexVertices)
+		{
+			chunk.baseVertex = low;
+			chunks.push_back(chunk);
+			if (chunks.size() >= maxChunks)
+				return std::vector<IndexChunk>();
+			chunk = IndexChunk();
+			chunk.indexOffset = i;
+			low = triangleLow;
+			high = triangleHigh;
+		}
+		low = std::min(low, triangleLow);
+		high = std::max(high, triangleHigh);
+		chunk.indexCount += 3;
+	}
+	chunk.baseVertex = chunk.indexCount ? low : 0;
+	chunks.push_back(chunk);
+	return chunks;
+}
+
+std::vector<uint32_t> IndexPacker::stripify(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t restart,
+	size_t lookahead)
+{
+	const size_t triangleCount = indices.size() / 3;
+	// Triangles around each vertex, in compressed rows as in MeshOptimizer.
+	std::vector<uint32_t> offsets(vertexCount + 1, 0), around(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		++offsets[indices[i] + 1];
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] += offsets[v];
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		around[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<char> used(triangleCount, 0);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const uint32_t* v = &indices[t * 3];
+		used[t] = v[0] == v[1] || v[1] == v[2] || v[2] == v[0];
+	}
+
+	// An unused triangle with the directed edge from -> to in its winding.
+	auto findTriangle = [&](uint32_t from, uint32_t to, uint32_t& third) -> size_t {
+		for (uint32_t k = offsets[from]; k < offsets[from + 1]; ++k)
+		{
+			const uint32_t t = around[k];
+			if (used[t])
+				continue;
+			const uint32_t* v = &indices[t * 3];
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				if (v[corner] == from && v[(corner + 1) % 3] == to)
+				{
+					third = v[(corner + 2) % 3];
+					return t;
+				}
+			}
+		}
+		return kNoTriangle;
+	};
+
+	// GL draws strip triangle i as (s[i], s[i + 1], s[i + 2]) when i is even
+	// and as (s[i + 1], s[i], s[i + 2]) when it is odd, so a strip grows by a
+	// triangle on the edge its last two vertices form, in alternating
+	// directions.
+	std::vector<uint32_t> strip;
+	strip.reserve(indices.size());
+	size_t next = 0;
+	for (;;)
+	{
+		while (next < triangleCount && used[next])
+			++next;
+		if (next == triangleCount)
+			break;
+		const uint32_t* v = &indices[next * 3];
+		int rotation = 0;
+		uint32_t third;
+		for (int r = 0; r < 3; ++r)
+		{
+			if (findTriangle(v[(r + 2) % 3], v[(r + 1) % 3], third) != kNoTriangle)
+			{
+				rotation = r;
+				break;
+			}
+		}
+		used[next] = 1;
+		if (!strip.empty())
+			strip.push_back(restart);
+		const size_t start = strip.size();
+		for (int corner = 0; corner < 3; ++corner)
+			strip.push_back(v[(rotation + corner) % 3]);
+		for (;;)
+		{
+			const size_t last = strip.size() - 1;
+			const bool odd = (last - start) % 2 == 0; // the next triangle's index is last - start - 1
+			const size_t t = odd ? findTriangle(strip[last], strip[last - 1], third) : findTriangle(strip[last - 1], strip[last], third);
+			if (t == kNoTriangle || (lookahead > 0 && t > next + lookahead))
+				break;
+			used[t] = 1;
+			strip.push_back(third);
+		}
+	}
+	return strip;
+}
+
+std::vector<uint32_t> IndexPacker::unpack(const PackedIndices& packed)
+{
+	std::vector<uint32_t> triangles;
+	const uint32_t restart = packed.indexBytes == 2 ? 0xffff : 0xffffffff;
+	for (const IndexChunk& chunk : packed.chunks)
+	{
+		if (packed.mode == GL_TRIANGLES)
+		{
+			for (size_t i = chunk.indexOffset; i + 2 < chunk.indexOffset + chunk.indexCount; i += 3)
+			{
+				appendTriangle(triangles, readIndex(packed, i) + chunk.baseVertex, readIndex(packed, i + 1) + chunk.baseVertex,
+					readIndex(packed, i + 2) + chunk.baseVertex);
+			}
+			continue;
+		}
+		size_t begin = chunk.indexOffset;
+		const size_t end = chunk.indexOffset + chunk.indexCount;
+		while (begin < end)
+		{
+			size_t stripEnd = begin;
+			while (stripEnd < end && readIndex(packed, stripEnd) != restart)
+				++stripEnd;
+			for (size_t i = begin; i + 2 < stripEnd; ++i)
+			{
+				const uint32_t a = readIndex(packed, i) + chunk.baseVertex, b = readIndex(packed, i + 1) + chunk.baseVertex;
+				const uint32_t c = readIndex(packed, i + 2) + chunk.baseVertex;
+				if ((i - begin) % 2 == 0)
+					appendTriangle(triangles, a, b, c);
+				else
+					appendTriangle(triangles, b, a, c);
+			}
+			begin = stripEnd + 1;
+		}
+	}
+	return triangles;
+}
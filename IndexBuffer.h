@@ -0,0 +1,76 @@
+#pragma once
+#include "gl_core_4_5.h"
+
+#include <cstdint>
+#include <vector>
+
+// 16 bit indices reach vertices 0 to 0xfffe; 0xffff is the restart index
+// GL_PRIMITIVE_RESTART_FIXED_INDEX reserves, which the renderer leaves on.
+const uint32_t kMaxShortIndexVertices = 0xffff;
+
+struct IndexPackParams
+{
+	// Meshes with more vertices than 16 bit indices reach are split into
+	// chunks drawn with a base vertex, unless that takes more than maxChunks
+	// draws; then the indices stay 32 bits.
+	bool split = true;
+	size_t maxChunks = 16;
+	// Triangle strips joined by the restart index, kept only when they come
+	// out shorter than the list. A strip only takes triangles up to
+	// stripLookahead further on in the list than the one it started from,
+	// which keeps it close to the vertex cache order at the price of more
+	// restarts; 0 lets strips run as long as they can.
+	bool strips = false;
+	size_t stripLookahead = 8;
+};
+
+// Indices drawn with one glDrawElementsBaseVertex.
+struct IndexChunk
+{
+	size_t indexOffset = 0, indexCount = 0; // in indices
+	uint32_t baseVertex = 0;
+};
+
+struct PackedIndices
+{
+	GLenum mode = GL_TRIANGLES; // or GL_TRIANGLE_STRIP
+	size_t indexBytes = 4;
+	std::vector<unsigned char> data;
+	std::vector<IndexChunk> chunks;
+
+	size_t count() const { return data.size() / indexBytes; }
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	GLenum type() const { return indexBytes == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
+	// GL thread only. Draws every chunk from the bound vertex array's element
+	// buffer, which holds data starting at byte offset.
+	void draw(size_t offset = 0) const;
+};
+
+// Picks the narrowest index type a triangle list can be drawn with, the way
+// VertexPacker picks attribute encodings: 16 bits when the vertices fit,
+// chunks of 16 bit indices when the order MeshOptimizer leaves keeps each
+// stretch of triangles within 0xffff vertices of each other, 32 bits
+// otherwise. Strips are started in the list's triangle order and grown
+// greedily over shared edges.
+class IndexPacker
+{
+public:
+	static PackedIndices pack(const std::vector<uint32_t>& indices, size_t vertexCount,
+		const IndexPackParams& params = IndexPackParams());
+
+	// Runs of triangles whose vertices span fewer than kMaxShortIndexVertices,
+	// with the smallest vertex as base. Empty if that takes more than
+	// maxChunks; one chunk at base 0 if the vertices already fit.
+	static std::vector<IndexChunk> split(const std::vector<uint32_t>& indices, size_t vertexCount, size_t maxChunks);
+
+	// Strips separated by restart, each triangle with its winding kept.
+	// Degenerate triangles, which draw nothing, are dropped. lookahead as in
+	// IndexPackParams.
+	static std::vector<uint32_t> stripify(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t restart,
+		size_t lookahead = 0);
+
+	// Back to a triangle list of absolute vertex indices, without degenerate
+	// triangles; for checking a pack.
+	static std::vector<uint32_t> unpack(const PackedIndices& packed);
+};
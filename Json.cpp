@@ -0,0 +1,304 @@
+#include "Json.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	const JsonValue kNull;
+
+	// Deeper documents are rejected rather than risking the stack.
+	const int kMaxDepth = 256;
+
+	void appendUtf8(std::string& out, unsigned codePoint)
+	{
+		if (codePoint < 0x80)
+		{
+			out += (char)codePoint;
+		}
+		else if (codePoint < 0x800)
+		{
+			out += (char)(0xC0 | codePoint >> 6);
+			out += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000)
+		{
+			out += (char)(0xE0 | codePoint >> 12);
+			out += (char)(0x80 | (codePoint >> 6 & 0x3F));
+			out += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			out += (char)(0xF0 | codePoint >> 18);
+			out += (char)(0x80 | (codePoint >> 12 & 0x3F));
+			out += (char)(0x80 | (codePoint >> 6 & 0x3F));
+			out += (char)(0x80 | (codePoint & 0x3F));
+		}
+	}
+}
+
+class JsonParser
+{
+public:
+	JsonParser(const char* text, size_t size)
+		: mBegin(text), mPos(text), mEnd(text + size)
+	{
+	}
+
+	bool document(JsonValue& value, std::string& error)
+	{
+		if (!mValue(value, 0))
+		{
+			error = mError + " at byte " + std::to_string(mPos - mBegin);
+			return false;
+		}
+		mSkipSpace();
+		if (mPos != mEnd)
+		{
+			error = "trailing characters at byte " + std::to_string(mPos - mBegin);
+			return false;
+		}
+		return true;
+	}
+
+private:
+	bool mFail(const char* what)
+	{
+		mError = what;
+		return false;
+	}
+
+	void mSkipSpace()
+	{
+		while (mPos < mEnd && (*mPos == ' ' || *mPos == '\t' || *mPos == '\n' || *mPos == '\r'))
+			++mPos;
+	}
+
+	bool mLiteral(const char* word)
+	{
+		const size_t length = strlen(word);
+		if ((size_t)(mEnd - mPos) < length || memcmp(mPos, word, length) != 0)
+			return mFail("unexpected character");
+		mPos += length;
+		return true;
+	}
+
+	bool mHex4(unsigned& value)
+	{
+		if (mEnd - mPos < 4)
+			return mFail("truncated escape");
+		value = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			const char c = *mPos++;
+			value <<= 4;
+			if (c >= '0' && c <= '9') value |= c - '0';
+			else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+			else return mFail("bad unicode escape");
+		}
+		return true;
+	}
+
+	bool mString(std::string& out)
+	{
+		++mPos; // opening quote
+		out.clear();
+		while (true)
+		{
+			const char* run = mPos;
+			while (mPos < mEnd && *mPos != '"' && *mPos != '\\' && (unsigned char)*mPos >= 0x20)
+				++mPos;
+			out.append(run, mPos);
+			if (mPos >= mEnd)
+				return mFail("unterminated string");
+			const char c = *mPos++;
+			if (c == '"')
+				return true;
+			if (c != '\\')
+				return mFail("control character in string");
+			if (mPos >= mEnd)
+				return mFail("unterminated string");
+			switch (*mPos++)
+			{
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+			{
+				unsigned codePoint;
+				if (!mHex4(codePoint))
+					return false;
+				if (codePoint >= 0xD800 && codePoint < 0xDC00)
+				{
+					unsigned low;
+					if (mEnd - mPos < 2 || mPos[0] != '\\' || mPos[1] != 'u')
+						return mFail("unpaired surrogate");
+					mPos += 2;
+					if (!mHex4(low) || low < 0xDC00 || low >= 0xE000)
+						return mFail("unpaired surrogate");
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUtf8(out, codePoint);
+				break;
+			}
+			default:
+				return mFail("bad escape");
+			}
+		}
+	}
+
+	bool mNumber(double& value)
+	{
+		// The text need not be null terminated, so strtod gets a copy.
+		const char* start = mPos;
+		if (mPos < mEnd && *mPos == '-')
+			++mPos;
+		while (mPos < mEnd && ((*mPos >= '0' && *mPos <= '9') || *mPos == '.' || *mPos == 'e' || *mPos == 'E' ||
+			*mPos == '+' || *mPos == '-'))
+			++mPos;
+		char buffer[64];
+		const size_t length = mPos - start;
+		if (length == 0 || length >= sizeof(buffer))
+			return mFail("bad number");
+		memcpy(buffer, start, length);
+		buffer[length] = 0;
+		char* end = nullptr;
+		value = strtod(buffer, &end);
+		if (end != buffer + length)
+			return mFail("bad number");
+		return true;
+	}
+
+	bool mValue(JsonValue& value, int depth)
+	{
+		if (depth > kMaxDepth)
+			return mFail("nested too deeply");
+		mSkipSpace();
+		if (mPos >= mEnd)
+			return mFail("unexpected end");
+		switch (*mPos)
+		{
+		case '{':
+		{
+			value.mType = JsonValue::Type::Object;
+			++mPos;
+			mSkipSpace();
+			if (mPos < mEnd && *mPos == '}')
+			{
+				++mPos;
+				return true;
+			}
+			while (true)
+			{
+				mSkipSpace();
+				if (mPos >= mEnd || *mPos != '"')
+					return mFail("expected member name");
+				value.mMembers.emplace_back();
+				JsonValue::Member& member = value.mMembers.back();
+				if (!mString(member.first))
+					return false;
+				mSkipSpace();
+				if (mPos >= mEnd || *mPos != ':')
+					return mFail("expected ':'");
+				++mPos;
+				if (!mValue(member.second, depth + 1))
+					return false;
+				mSkipSpace();
+				if (mPos < mEnd && *mPos == ',')
+				{
+					++mPos;
+					continue;
+				}
+				if (mPos < mEnd && *mPos == '}')
+				{
+					++mPos;
+					return true;
+				}
+				return mFail("expected ',' or '}'");
+			}
+		}
+		case '[':
+		{
+			value.mType = JsonValue::Type::Array;
+			++mPos;
+			mSkipSpace();
+			if (mPos < mEnd && *mPos == ']')
+			{
+				++mPos;
+				return true;
+			}
+			while (true)
+			{
+				value.mItems.emplace_back();
+				if (!mValue(value.mItems.back(), depth + 1))
+					return false;
+				mSkipSpace();
+				if (mPos < mEnd && *mPos == ',')
+				{
+					++mPos;
+					continue;
+				}
+				if (mPos < mEnd && *mPos == ']')
+				{
+					++mPos;
+					return true;
+				}
+				return mFail("expected ',' or ']'");
+			}
+		}
+		case '"':
+			value.mType = JsonValue::Type::String;
+			return mString(value.mString);
+		case 't':
+			value.mType = JsonValue::Type::Bool;
+			value.mNumber = 1;
+			return mLiteral("true");
+		case 'f':
+			value.mType = JsonValue::Type::Bool;
+			value.mNumber = 0;
+			return mLiteral("false");
+		case 'n':
+			value.mType = JsonValue::Type::Null;
+			return mLiteral("null");
+		default:
+			value.mType = JsonValue::Type::Number;
+			return mNumber(value.mNumber);
+		}
+	}
+
+private:
+	const char* mBegin;
+	const char* mPos;
+	const char* mEnd;
+	std::string mError;
+};
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+	return mType == Type::Array && index < mItems.size() ? mItems[index] : kNull;
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+	// Objects in asset manifests have a handful of members; a scan beats
+	// building an index for each.
+	for (const Member& member : mMembers)
+	{
+		if (member.first == key)
+			return member.second;
+	}
+	return kNull;
+}
+
+bool JsonValue::parse(const char* text, size_t size, JsonValue& value, std::string& error)
+{
+	value = JsonValue();
+	JsonParser parser(text, size);
+	return parser.document(value, error);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A parsed JSON document, enough for asset manifests such as glTF. Lookups
+// never fail: a missing member or out of range element is a null value, and
+// the typed accessors return their fallback for values of another type.
+class JsonValue
+{
+public:
+	enum class Type
+	{
+		Null, Bool, Number, String, Array, Object
+	};
+
+	typedef std::pair<std::string, JsonValue> Member;
+
+	Type type() const { return mType; }
+	bool isNull() const { return mType == Type::Null; }
+	bool isNumber() const { return mType == Type::Number; }
+	bool isString() const { return mType == Type::String; }
+	bool isArray() const { return mType == Type::Array; }
+	bool isObject() const { return mType == Type::Object; }
+
+	bool boolean(bool fallback = false) const { return mType == Type::Bool ? mNumber != 0 : fallback; }
+	double number(double fallback = 0) const { return mType == Type::Number ? mNumber : fallback; }
+	int integer(int fallback = 0) const { return mType == Type::Number ? (int)mNumber : fallback; }
+	const std::string& string() const { return mString; }
+
+	// Elements of an array, members of an object, 0 otherwise.
+	size_t size() const { return mType == Type::Array ? mItems.size() : mMembers.size(); }
+	const JsonValue& operator[](size_t index) const;
+	const JsonValue& operator[](int index) const { return (*this)[(size_t)index]; }
+	const JsonValue& operator[](const char* key) const;
+	bool has(const char* key) const { return !(*this)[key].isNull(); }
+	const std::vector<JsonValue>& items() const { return mItems; }
+	const std::vector<Member>& members() const { return mMembers; }
+
+	// Parses a whole document. On failure returns false and sets error to what
+	// was wrong and where.
+	static bool parse(const char* text, size_t size, JsonValue& value, std::string& error);
+
+private:
+	friend class JsonParser;
+
+	Type mType = Type::Null;
+	double mNumber = 0;
+	std::string mString;
+	std::vector<JsonValue> mItems;
+	std::vector<Member> mMembers;
+};
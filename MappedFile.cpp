@@ -0,0 +1,144 @@
+#include "MappedFile.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(mData, other.mData);
+		std::swap(mSize, other.mSize);
+#ifdef _WIN32
+		std::swap(mFile, other.mFile);
+		std::swap(mMapping, other.mMapping);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	mFile = file;
+	mMapping = mapping;
+	mData = (const unsigned char*)view;
+	mSize = (size_t)size.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	mData = (const unsigned char*)view;
+	mSize = (size_t)st.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (!mData)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(mData);
+	CloseHandle(mMapping);
+	CloseHandle(mFile);
+	mMapping = nullptr;
+	mFile = nullptr;
+#else
+	munmap((void*)mData, mSize);
+#endif
+	mData = nullptr;
+	mSize = 0;
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const
+{
+	if (!mData || offset >= mSize)
+		return;
+	if (size > mSize - offset)
+		size = mSize - offset;
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)(mData + offset);
+	range.NumberOfBytes = size;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+	// madvise needs a page aligned start.
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t begin = offset & ~(page - 1);
+	madvise((void*)(mData + begin), size + (offset - begin), MADV_WILLNEED);
+#endif
+}
+
+bool MappedFile::stat(const std::string& path, uint64_t& size, uint64_t& modifiedTime)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0)
+		return false;
+#else
+	struct ::stat st;
+	if (::stat(path.c_str(), &st) != 0)
+		return false;
+#endif
+	size = (uint64_t)st.st_size;
+	modifiedTime = (uint64_t)st.st_mtime;
+	return true;
+}
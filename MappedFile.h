@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are only read from disk when
+// touched, so callers can validate headers without faulting in the payload.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(MappedFile const&) = delete;
+	void operator=(MappedFile const&) = delete;
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return mData != nullptr; }
+	const unsigned char* data() const { return mData; }
+	size_t size() const { return mSize; }
+
+	// Asks the OS to start reading [offset, offset + size) ahead of use.
+	void prefetch(size_t offset, size_t size) const;
+
+	// Size and last write time of a file without opening it.
+	static bool stat(const std::string& path, uint64_t& size, uint64_t& modifiedTime);
+
+private:
+	const unsigned char* mData = nullptr;
+	size_t mSize = 0;
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#endif
+};
@@ -0,0 +1,858 @@
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// High nibble names the codec, low nibble its version.
+	const unsigned char kVertexHeader = 0xa1;
+	const unsigned char kIndexHeader = 0xe0;
+
+	const size_t kGroup = 32;
+	const size_t kHalf = 16; // lanes in an SSE2 register
+	const size_t kColumn = 4; // byte positions decoded together, one 32 bit lane per vertex
+	const size_t kMaxBlockVertices = 256;
+	const size_t kBlockBytes = 8192; // a block's vertices, so they stay in L1 while each column is written
+
+	enum GroupMode
+	{
+		GroupZero = 0,
+		GroupBits2 = 1,
+		GroupBits4 = 2,
+		GroupBytes = 3
+	};
+
+	// Field bytes of a group in each mode.
+	const size_t kGroupBytes[] = { 0, 8, 16, 32 };
+
+	size_t blockVertices(size_t stride)
+	{
+		return std::max(kGroup, std::min(kMaxBlockVertices, (kBlockBytes / stride) & ~(kGroup - 1)));
+	}
+
+	unsigned char zigzag(unsigned char delta)
+	{
+		return (unsigned char)((delta << 1) ^ (unsigned char)((signed char)delta >> 7));
+	}
+
+	unsigned char unzigzag(unsigned char value)
+	{
+		return (unsigned char)((value >> 1) ^ (unsigned char)-(int)(value & 1));
+	}
+
+	int modeBits(int mode)
+	{
+		return mode == GroupBits2 ? 2 : mode == GroupBits4 ? 4 : mode == GroupBytes ? 8 : 0;
+	}
+
+	int chooseMode(const unsigned char* values)
+	{
+		size_t over2 = 0, over4 = 0;
+		bool zero = true;
+		for (size_t i = 0; i < kGroup; ++i)
+		{
+			zero = zero && values[i] == 0;
+			over2 += values[i] >= 3;
+			over4 += values[i] >= 15;
+		}
+		if (zero)
+			return GroupZero;
+		const size_t bits2 = kGroupBytes[GroupBits2] + over2, bits4 = kGroupBytes[GroupBits4] + over4;
+		if (bits2 <= bits4 && bits2 < kGroup)
+			return GroupBits2;
+		return bits4 < kGroup ? GroupBits4 : GroupBytes;
+	}
+
+	// Fields of bits each, lane i in byte i % bytes at bit (i / bytes) * bits,
+	// so each 32 bit lane of fields, repeated across the group, needs one
+	// shift and a mask. Values that equal or exceed the largest field value
+	// go to escapes, in lane order.
+	void encodeGroup(const unsigned char* values, int mode, std::vector<unsigned char>& out, std::vector<unsigned char>& escapes)
+	{
+		if (mode == GroupZero)
+			return;
+		if (mode == GroupBytes)
+		{
+			out.insert(out.end(), values, values + kGroup);
+			return;
+		}
+		const int bits = modeBits(mode);
+		const unsigned char limit = (unsigned char)((1 << bits) - 1);
+		const size_t bytes = kGroupBytes[mode], first = out.size();
+		out.resize(first + bytes, 0);
+		for (size_t i = 0; i < kGroup; ++i)
+		{
+			out[first + i % bytes] |= (unsigned char)(std::min(values[i], limit) << (i / bytes * bits));
+			if (values[i] >= limit)
+				escapes.push_back(values[i]);
+		}
+	}
+
+	// Field bytes of the four groups a header byte describes.
+	struct HeaderFieldBytes
+	{
+		unsigned short bytes[256];
+
+		HeaderFieldBytes()
+		{
+			for (int header = 0; header < 256; ++header)
+				bytes[header] = (unsigned short)(kGroupBytes[header & 3] + kGroupBytes[(header >> 2) & 3] +
+					kGroupBytes[(header >> 4) & 3] + kGroupBytes[header >> 6]);
+		}
+	};
+	const HeaderFieldBytes kHeaderFieldBytes;
+
+	// A column is four byte positions' groups within a block: a header byte
+	// per group with the four positions' modes, 2 bits each, then every
+	// group's fields, then every group's escapes, each group's in position
+	// and then lane order. Keeping the escapes apart means where a group's
+	// fields start depends only on the headers. False if the headers or
+	// fields run past end.
+	bool splitColumn(const unsigned char* p, const unsigned char* end, size_t groups, const unsigned char*& fields,
+		const unsigned char*& escapes)
+	{
+		if ((size_t)(end - p) < groups)
+			return false;
+		size_t fieldBytes = 0;
+		for (size_t g = 0; g < groups; ++g)
+			fieldBytes += kHeaderFieldBytes.bytes[p[g]];
+		fields = p + groups;
+		if ((size_t)(end - fields) < fieldBytes)
+			return false;
+		escapes = fields + fieldBytes;
+		return true;
+	}
+
+	// One group's zigzagged deltas; false if its escapes run past end.
+	bool decodeGroupScalar(const unsigned char*& fields, const unsigned char*& escapes, const unsigned char* end, int mode,
+		unsigned char* values)
+	{
+		if (mode == GroupZero)
+		{
+			memset(values, 0, kGroup);
+			return true;
+		}
+		if (mode == GroupBytes)
+		{
+			memcpy(values, fields, kGroup);
+			fields += kGroup;
+			return true;
+		}
+		const int bits = modeBits(mode);
+		const unsigned char limit = (unsigned char)((1 << bits) - 1);
+		const size_t bytes = kGroupBytes[mode];
+		for (size_t i = 0; i < kGroup; ++i)
+		{
+			values[i] = (unsigned char)((fields[i % bytes] >> (i / bytes * bits)) & limit);
+			if (values[i] != limit)
+				continue;
+			if (escapes == end)
+				return false;
+			values[i] = *escapes++;
+		}
+		fields += bytes;
+		return true;
+	}
+
+#ifdef SIMD_X86
+	// A group's fields as two registers of 16 lanes, escapes still at the
+	// largest field value. Shifting 16 bit lanes moves neighbouring bytes'
+	// bits in; the masks drop them.
+	SIMD_INLINE void unpackFieldsSse2(const unsigned char* fields, int mode, __m128i* values)
+	{
+		switch (mode)
+		{
+		case GroupBits2:
+		{
+			const __m128i packed = _mm_loadl_epi64((const __m128i*)fields), mask = _mm_set1_epi8(3);
+			values[0] = _mm_unpacklo_epi64(_mm_and_si128(packed, mask), _mm_and_si128(_mm_srli_epi16(packed, 2), mask));
+			values[1] = _mm_unpacklo_epi64(_mm_and_si128(_mm_srli_epi16(packed, 4), mask), _mm_and_si128(_mm_srli_epi16(packed, 6), mask));
+			break;
+		}
+		case GroupBits4:
+		{
+			const __m128i packed = _mm_loadu_si128((const __m128i*)fields), mask = _mm_set1_epi8(15);
+			values[0] = _mm_and_si128(packed, mask);
+			values[1] = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+			break;
+		}
+		case GroupBytes:
+			values[0] = _mm_loadu_si128((const __m128i*)fields);
+			values[1] = _mm_loadu_si128((const __m128i*)(fields + kHalf));
+			break;
+		default:
+			values[0] = values[1] = _mm_setzero_si128();
+		}
+	}
+
+	// Lanes of values holding an escape, as a movemask.
+	SIMD_INLINE int escapeLanes(__m128i values, int mode)
+	{
+		if (mode != GroupBits2 && mode != GroupBits4)
+			return 0;
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(values, _mm_set1_epi8((char)((1 << modeBits(mode)) - 1))));
+	}
+
+	// For value != 0.
+	int lowestBit(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long bit;
+		_BitScanForward(&bit, value);
+		return (int)bit;
+#else
+		return __builtin_ctz(value);
+#endif
+	}
+
+	bool patchEscapesSse2(__m128i& values, int lanes, const unsigned char*& escapes, const unsigned char* end)
+	{
+		alignas(16) unsigned char patched[kHalf];
+		_mm_store_si128((__m128i*)patched, values);
+		for (; lanes; lanes &= lanes - 1)
+		{
+			if (escapes == end)
+				return false;
+			patched[lowestBit((uint32_t)lanes)] = *escapes++;
+		}
+		values = _mm_load_si128((const __m128i*)patched);
+		return true;
+	}
+
+	// The group unpacked and its escapes put in place, as two halves.
+	SIMD_INLINE bool decodeGroupSse2(const unsigned char*& fields, const unsigned char*& escapes, const unsigned char* end, int mode,
+		__m128i* values)
+	{
+		unpackFieldsSse2(fields, mode, values);
+		fields += kGroupBytes[mode];
+		for (int half = 0; half < 2; ++half)
+		{
+			const int lanes = escapeLanes(values[half], mode);
+			if (lanes && !patchEscapesSse2(values[half], lanes, escapes, end))
+				return false;
+		}
+		return true;
+	}
+
+	SIMD_INLINE __m128i unzigzagSse2(__m128i values)
+	{
+		const __m128i half = _mm_and_si128(_mm_srli_epi16(values, 1), _mm_set1_epi8(0x7f));
+		const __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(values, _mm_set1_epi8(1)));
+		return _mm_xor_si128(half, sign);
+	}
+
+	SIMD_INLINE void store32(unsigned char* dst, __m128i value)
+	{
+		const int word = _mm_cvtsi128_si32(value);
+		memcpy(dst, &word, 4);
+	}
+
+	// Four 32 bit lanes, each a vertex's bytes of the column, to consecutive
+	// vertices at out.
+	SIMD_INLINE void storeVertices4(unsigned char* out, size_t stride, __m128i words)
+	{
+		store32(out, words);
+		store32(out + stride, _mm_shuffle_epi32(words, 1));
+		store32(out + stride * 2, _mm_shuffle_epi32(words, 2));
+		store32(out + stride * 3, _mm_shuffle_epi32(words, 3));
+	}
+
+	// Half a group of a column: the four byte positions' zigzagged deltas for
+	// 16 vertices, one position per register. Interleaving them gives each
+	// vertex's four bytes as a 32 bit lane, four vertices to a register, so
+	// the deltas sum across vertices in two steps and go straight to their
+	// place at out. carry holds the previous vertex in every lane and n is
+	// how many of the 16 vertices exist.
+	SIMD_INLINE void storeHalfSse2(const __m128i* values, __m128i& carry, unsigned char* out, size_t stride, size_t n)
+	{
+		const __m128i v0 = unzigzagSse2(values[0]), v1 = unzigzagSse2(values[1]);
+		const __m128i v2 = unzigzagSse2(values[2]), v3 = unzigzagSse2(values[3]);
+		const __m128i t0 = _mm_unpacklo_epi8(v0, v1), t1 = _mm_unpackhi_epi8(v0, v1);
+		const __m128i t2 = _mm_unpacklo_epi8(v2, v3), t3 = _mm_unpackhi_epi8(v2, v3);
+		// Written out rather than looped so the words stay in registers.
+		__m128i w0 = _mm_unpacklo_epi16(t0, t2), w1 = _mm_unpackhi_epi16(t0, t2);
+		__m128i w2 = _mm_unpacklo_epi16(t1, t3), w3 = _mm_unpackhi_epi16(t1, t3);
+		w0 = _mm_add_epi8(w0, _mm_slli_si128(w0, 4));
+		w1 = _mm_add_epi8(w1, _mm_slli_si128(w1, 4));
+		w2 = _mm_add_epi8(w2, _mm_slli_si128(w2, 4));
+		w3 = _mm_add_epi8(w3, _mm_slli_si128(w3, 4));
+		w0 = _mm_add_epi8(w0, _mm_slli_si128(w0, 8));
+		w1 = _mm_add_epi8(w1, _mm_slli_si128(w1, 8));
+		w2 = _mm_add_epi8(w2, _mm_slli_si128(w2, 8));
+		w3 = _mm_add_epi8(w3, _mm_slli_si128(w3, 8));
+		// Each word's total is its last lane; summing them keeps the chain short.
+		const __m128i s0 = _mm_shuffle_epi32(w0, 0xff), s1 = _mm_shuffle_epi32(w1, 0xff);
+		const __m128i s2 = _mm_shuffle_epi32(w2, 0xff), s3 = _mm_shuffle_epi32(w3, 0xff);
+		const __m128i s01 = _mm_add_epi8(s0, s1);
+		w3 = _mm_add_epi8(w3, _mm_add_epi8(carry, _mm_add_epi8(s01, s2)));
+		w2 = _mm_add_epi8(w2, _mm_add_epi8(carry, s01));
+		w1 = _mm_add_epi8(w1, _mm_add_epi8(carry, s0));
+		w0 = _mm_add_epi8(w0, carry);
+		carry = _mm_add_epi8(carry, _mm_add_epi8(s01, _mm_add_epi8(s2, s3)));
+		if (n == kHalf)
+		{
+			storeVertices4(out, stride, w0);
+			storeVertices4(out + 4 * stride, stride, w1);
+			storeVertices4(out + 8 * stride, stride, w2);
+			storeVertices4(out + 12 * stride, stride, w3);
+			return;
+		}
+		alignas(16) unsigned char lanes[kHalf * 4];
+		_mm_store_si128((__m128i*)lanes, w0);
+		_mm_store_si128((__m128i*)lanes + 1, w1);
+		_mm_store_si128((__m128i*)lanes + 2, w2);
+		_mm_store_si128((__m128i*)lanes + 3, w3);
+		for (size_t i = 0; i < n; ++i, out += stride)
+			memcpy(out, lanes + i * 4, 4);
+	}
+
+	// One column of a block into out; last carries the column's previous
+	// vertex in and the block's last out. Padding lanes decode as zero deltas,
+	// so the last group ends on the block's last vertex.
+	bool decodeColumnSse2(const unsigned char*& p, const unsigned char* end, size_t n, size_t stride, unsigned char* out,
+		__m128i& last)
+	{
+		const size_t groups = (n + kGroup - 1) / kGroup;
+		const unsigned char *fields, *escapes;
+		if (!splitColumn(p, end, groups, fields, escapes))
+			return false;
+		__m128i carry = last;
+		for (size_t g = 0; g < groups; ++g)
+		{
+			__m128i values[kColumn][2];
+			for (size_t k = 0; k < kColumn; ++k)
+			{
+				if (!decodeGroupSse2(fields, escapes, end, (p[g] >> (k * 2)) & 3, values[k]))
+					return false;
+			}
+			for (size_t half = 0; half < 2 && g * kGroup + half * kHalf < n; ++half)
+			{
+				const __m128i rows[kColumn] = { values[0][half], values[1][half], values[2][half], values[3][half] };
+				const size_t firstVertex = g * kGroup + half * kHalf;
+				storeHalfSse2(rows, carry, out + firstVertex * stride, stride, std::min(kHalf, n - firstVertex));
+			}
+		}
+		last = carry;
+		p = escapes;
+		return true;
+	}
+
+	// Per mode, the 32 bit lanes of fields each lane of the group reads, the
+	// shift that brings its field to the bottom, the mask that keeps it and
+	// the escape value, in the lanes that can hold one.
+	struct GroupUnpack
+	{
+		struct Mode
+		{
+			alignas(32) uint32_t source[8];
+			uint32_t shift[8];
+			unsigned char mask[kGroup];
+			unsigned char limit[kGroup];
+			unsigned char escapable[kGroup];
+		};
+		Mode modes[4];
+
+		GroupUnpack()
+		{
+			for (int mode = 0; mode < 4; ++mode)
+			{
+				Mode& m = modes[mode];
+				const int bits = modeBits(mode);
+				const bool escapes = mode == GroupBits2 || mode == GroupBits4;
+				const size_t words = std::max<size_t>(kGroupBytes[mode] / 4, 1);
+				for (size_t w = 0; w < 8; ++w)
+				{
+					m.source[w] = (uint32_t)(w % words);
+					m.shift[w] = (uint32_t)(mode == GroupZero ? 0 : w / words * bits);
+				}
+				for (size_t i = 0; i < kGroup; ++i)
+				{
+					m.mask[i] = (unsigned char)((1 << bits) - 1);
+					m.limit[i] = escapes ? m.mask[i] : 0;
+					m.escapable[i] = escapes ? 0xff : 0;
+				}
+			}
+		}
+	};
+	const GroupUnpack kGroupUnpack;
+
+	// For each 8 lane escape mask, shuffles that move the escapes read in
+	// order into the low or the high 8 of 16 lanes, zeroing the others, and
+	// the escape count.
+	struct EscapeShuffles
+	{
+		alignas(16) unsigned char low[256][16];
+		alignas(16) unsigned char high[256][16];
+		unsigned char counts[256];
+
+		EscapeShuffles()
+		{
+			for (int mask = 0; mask < 256; ++mask)
+			{
+				memset(low[mask], 0x80, sizeof(low[mask]));
+				memset(high[mask], 0x80, sizeof(high[mask]));
+				int count = 0;
+				for (int lane = 0; lane < 8; ++lane)
+				{
+					if (!(mask & (1 << lane)))
+						continue;
+					low[mask][lane] = high[mask][lane + 8] = (unsigned char)count++;
+				}
+				counts[mask] = (unsigned char)count;
+			}
+		}
+	};
+	const EscapeShuffles kEscapeShuffles;
+
+	SIMD_INLINE SIMD_TARGET_AVX2 __m256i combine(const unsigned char* low, const unsigned char* high)
+	{
+		return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)low)),
+			_mm_loadu_si128((const __m128i*)high), 1);
+	}
+
+	// decodeGroupSse2 without a branch on the mode or on escapes. Reads 32
+	// bytes at fields and 48 past escapes.
+	SIMD_INLINE SIMD_TARGET_AVX2 __m256i decodeGroupAvx2(const unsigned char*& fields, const unsigned char*& escapes, int mode)
+	{
+		const GroupUnpack::Mode& m = kGroupUnpack.modes[mode];
+		__m256i values = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)fields), _mm256_load_si256((const __m256i*)m.source));
+		values = _mm256_srlv_epi32(values, _mm256_load_si256((const __m256i*)m.shift));
+		values = _mm256_and_si256(values, _mm256_load_si256((const __m256i*)m.mask));
+		fields += kGroupBytes[mode];
+
+		// Each 8 lanes' escapes follow the previous 8's; a shuffle per 8 puts
+		// them in place, two 16 lane shuffles at a time.
+		const __m256i escaped = _mm256_and_si256(_mm256_cmpeq_epi8(values, _mm256_load_si256((const __m256i*)m.limit)),
+			_mm256_load_si256((const __m256i*)m.escapable));
+		const uint32_t lanes = (uint32_t)_mm256_movemask_epi8(escaped);
+		const unsigned m0 = lanes & 0xff, m1 = (lanes >> 8) & 0xff, m2 = (lanes >> 16) & 0xff, m3 = lanes >> 24;
+		const unsigned char* e0 = escapes;
+		const unsigned char* e1 = e0 + kEscapeShuffles.counts[m0];
+		const unsigned char* e2 = e1 + kEscapeShuffles.counts[m1];
+		const unsigned char* e3 = e2 + kEscapeShuffles.counts[m2];
+		escapes = e3 + kEscapeShuffles.counts[m3];
+		const __m256i even = _mm256_shuffle_epi8(combine(e0, e2), combine(kEscapeShuffles.low[m0], kEscapeShuffles.low[m2]));
+		const __m256i odd = _mm256_shuffle_epi8(combine(e1, e3), combine(kEscapeShuffles.high[m1], kEscapeShuffles.high[m3]));
+		return _mm256_or_si256(_mm256_andnot_si256(escaped, values), _mm256_or_si256(even, odd));
+	}
+
+	SIMD_INLINE SIMD_TARGET_AVX2 __m256i unzigzagAvx2(__m256i values)
+	{
+		const __m256i half = _mm256_and_si256(_mm256_srli_epi16(values, 1), _mm256_set1_epi8(0x7f));
+		const __m256i sign = _mm256_sub_epi8(_mm256_setzero_si256(), _mm256_and_si256(values, _mm256_set1_epi8(1)));
+		return _mm256_xor_si256(half, sign);
+	}
+
+	// storeHalfSse2 for a whole group. Interleaving works within 128 bit
+	// lanes, so vertices 0-15 sum and land from the low halves and 16-31 from
+	// the high ones, which then add the low halves' total.
+	SIMD_INLINE SIMD_TARGET_AVX2 void storeGroupAvx2(const __m256i* values, __m128i& carry, unsigned char* out, size_t stride, size_t n)
+	{
+		const __m256i v0 = unzigzagAvx2(values[0]), v1 = unzigzagAvx2(values[1]);
+		const __m256i v2 = unzigzagAvx2(values[2]), v3 = unzigzagAvx2(values[3]);
+		const __m256i t0 = _mm256_unpacklo_epi8(v0, v1), t1 = _mm256_unpackhi_epi8(v0, v1);
+		const __m256i t2 = _mm256_unpacklo_epi8(v2, v3), t3 = _mm256_unpackhi_epi8(v2, v3);
+		// Written out rather than looped so the words stay in registers.
+		__m256i w0 = _mm256_unpacklo_epi16(t0, t2), w1 = _mm256_unpackhi_epi16(t0, t2);
+		__m256i w2 = _mm256_unpacklo_epi16(t1, t3), w3 = _mm256_unpackhi_epi16(t1, t3);
+		w0 = _mm256_add_epi8(w0, _mm256_slli_si256(w0, 4));
+		w1 = _mm256_add_epi8(w1, _mm256_slli_si256(w1, 4));
+		w2 = _mm256_add_epi8(w2, _mm256_slli_si256(w2, 4));
+		w3 = _mm256_add_epi8(w3, _mm256_slli_si256(w3, 4));
+		w0 = _mm256_add_epi8(w0, _mm256_slli_si256(w0, 8));
+		w1 = _mm256_add_epi8(w1, _mm256_slli_si256(w1, 8));
+		w2 = _mm256_add_epi8(w2, _mm256_slli_si256(w2, 8));
+		w3 = _mm256_add_epi8(w3, _mm256_slli_si256(w3, 8));
+		// Each word's total is its last lane; sum them so the chain is two adds deep.
+		const __m256i s0 = _mm256_shuffle_epi32(w0, 0xff), s1 = _mm256_shuffle_epi32(w1, 0xff);
+		const __m256i s2 = _mm256_shuffle_epi32(w2, 0xff), s3 = _mm256_shuffle_epi32(w3, 0xff);
+		const __m256i s01 = _mm256_add_epi8(s0, s1);
+		const __m256i halfTotals = _mm256_add_epi8(s01, _mm256_add_epi8(s2, s3));
+		const __m256i offset = _mm256_add_epi8(_mm256_broadcastsi128_si256(carry), _mm256_permute2x128_si256(halfTotals, halfTotals, 0x08));
+		w3 = _mm256_add_epi8(w3, _mm256_add_epi8(offset, _mm256_add_epi8(s01, s2)));
+		w2 = _mm256_add_epi8(w2, _mm256_add_epi8(offset, s01));
+		w1 = _mm256_add_epi8(w1, _mm256_add_epi8(offset, s0));
+		w0 = _mm256_add_epi8(w0, offset);
+		carry = _mm256_extracti128_si256(_mm256_add_epi8(offset, halfTotals), 1);
+		const __m128i h0 = _mm256_extracti128_si256(w0, 1), h1 = _mm256_extracti128_si256(w1, 1);
+		const __m128i h2 = _mm256_extracti128_si256(w2, 1), h3 = _mm256_extracti128_si256(w3, 1);
+		if (n == kGroup)
+		{
+			storeVertices4(out, stride, _mm256_castsi256_si128(w0));
+			storeVertices4(out + 4 * stride, stride, _mm256_castsi256_si128(w1));
+			storeVertices4(out + 8 * stride, stride, _mm256_castsi256_si128(w2));
+			storeVertices4(out + 12 * stride, stride, _mm256_castsi256_si128(w3));
+			storeVertices4(out + 16 * stride, stride, h0);
+			storeVertices4(out + 20 * stride, stride, h1);
+			storeVertices4(out + 24 * stride, stride, h2);
+			storeVertices4(out + 28 * stride, stride, h3);
+			return;
+		}
+		alignas(16) unsigned char lanes[kGroup * 4];
+		_mm_store_si128((__m128i*)lanes, _mm256_castsi256_si128(w0));
+		_mm_store_si128((__m128i*)lanes + 1, _mm256_castsi256_si128(w1));
+		_mm_store_si128((__m128i*)lanes + 2, _mm256_castsi256_si128(w2));
+		_mm_store_si128((__m128i*)lanes + 3, _mm256_castsi256_si128(w3));
+		_mm_store_si128((__m128i*)lanes + 4, h0);
+		_mm_store_si128((__m128i*)lanes + 5, h1);
+		_mm_store_si128((__m128i*)lanes + 6, h2);
+		_mm_store_si128((__m128i*)lanes + 7, h3);
+		for (size_t i = 0; i < n; ++i, out += stride)
+			memcpy(out, lanes + i * 4, 4);
+	}
+
+	SIMD_TARGET_AVX2 bool decodeColumnAvx2(const unsigned char*& p, const unsigned char* end, size_t n, size_t stride,
+		unsigned char* out, __m128i& last)
+	{
+		const size_t groups = (n + kGroup - 1) / kGroup;
+		const unsigned char *fields, *escapes;
+		if (!splitColumn(p, end, groups, fields, escapes))
+			return false;
+		__m128i carry = last;
+		for (size_t g = 0; g < groups; ++g)
+		{
+			__m256i values[kColumn];
+			const int header = p[g];
+			// A group's four positions take at most 128 field bytes and 128
+			// escapes, and the reads go up to 40 past; fields come first.
+			if (end - escapes >= 168)
+			{
+				values[0] = decodeGroupAvx2(fields, escapes, header & 3);
+				values[1] = decodeGroupAvx2(fields, escapes, (header >> 2) & 3);
+				values[2] = decodeGroupAvx2(fields, escapes, (header >> 4) & 3);
+				values[3] = decodeGroupAvx2(fields, escapes, header >> 6);
+			}
+			else
+			{
+				for (size_t k = 0; k < kColumn; ++k)
+				{
+					__m128i halves[2];
+					if (!decodeGroupSse2(fields, escapes, end, (header >> (k * 2)) & 3, halves))
+						return false;
+					values[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(halves[0]), halves[1], 1);
+				}
+			}
+			storeGroupAvx2(values, carry, out + g * kGroup * stride, stride, std::min(kGroup, n - g * kGroup));
+		}
+		last = carry;
+		p = escapes;
+		return true;
+	}
+#endif
+
+	void pushVarint(std::vector<unsigned char>& out, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back((unsigned char)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((unsigned char)value);
+	}
+
+	bool readVarint(const unsigned char*& p, const unsigned char* end, uint32_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			if (p == end)
+				return false;
+			const unsigned char byte = *p++;
+			value |= (uint32_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	// The state encoder and decoder keep in step. Edges are stored reversed,
+	// as the neighbour across them walks them.
+	struct IndexFifos
+	{
+		uint32_t edges[16][2] = {};
+		uint32_t vertices[16] = {};
+		size_t edgeCount = 0, vertexCount = 0;
+		uint32_t next = 0, last = 0;
+
+		static const int kEdges = 15;    // codes 0-14; 15 means no edge
+		static const int kVertices = 14; // vertex codes 1-14
+
+		const uint32_t* edge(int recency) const { return edges[(edgeCount - 1 - recency) & 15]; }
+		uint32_t vertex(int recency) const { return vertices[(vertexCount - 1 - recency) & 15]; }
+
+		void pushEdge(uint32_t a, uint32_t b)
+		{
+			edges[edgeCount & 15][0] = a;
+			edges[edgeCount & 15][1] = b;
+			++edgeCount;
+		}
+
+		void pushVertex(uint32_t v)
+		{
+			vertices[vertexCount & 15] = v;
+			++vertexCount;
+		}
+
+		// Vertex codes: 0 the next unused vertex, 1-14 the vertex FIFO, 15 an
+		// explicit zigzag delta from the last explicit vertex.
+		int encodeVertex(uint32_t v, std::vector<unsigned char>& extra)
+		{
+			if (v == next)
+			{
+				++next;
+				pushVertex(v);
+				return 0;
+			}
+			for (int i = 0; i < kVertices; ++i)
+			{
+				if (vertex(i) == v)
+					return i + 1;
+			}
+			const int32_t delta = (int32_t)(v - last);
+			pushVarint(extra, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+			last = v;
+			pushVertex(v);
+			return 15;
+		}
+
+		bool decodeVertex(int code, const unsigned char*& p, const unsigned char* end, uint32_t& v)
+		{
+			if (code == 0)
+			{
+				v = next++;
+				pushVertex(v);
+				return true;
+			}
+			if (code < 15)
+			{
+				v = vertex(code - 1);
+				return true;
+			}
+			uint32_t zigzagged;
+			if (!readVarint(p, end, zigzagged))
+				return false;
+			v = last + ((zigzagged >> 1) ^ (0u - (zigzagged & 1)));
+			last = v;
+			pushVertex(v);
+			return true;
+		}
+	};
+
+	void storeIndex(void* dst, size_t i, size_t indexBytes, uint32_t value)
+	{
+		if (indexBytes == 2)
+			((uint16_t*)dst)[i] = (uint16_t)value;
+		else
+			((uint32_t*)dst)[i] = value;
+	}
+}
+
+std::vector<unsigned char> MeshCodec::encodeVertices(const void* vertices, size_t count, size_t stride)
+{
+	std::vector<unsigned char> out;
+	if (stride == 0 || stride > 256 || stride % 4 != 0)
+		return out;
+	out.push_back(kVertexHeader);
+	const unsigned char* src = (const unsigned char*)vertices;
+	const size_t perBlock = blockVertices(stride);
+	std::vector<unsigned char> last(stride, 0), escapes;
+	unsigned char values[kColumn][kMaxBlockVertices];
+	for (size_t first = 0; first < count; first += perBlock)
+	{
+		const size_t n = std::min(perBlock, count - first);
+		const size_t groups = (n + kGroup - 1) / kGroup;
+		for (size_t column = 0; column < stride; column += kColumn)
+		{
+			memset(values, 0, sizeof(values));
+			for (size_t k = 0; k < kColumn; ++k)
+			{
+				for (size_t i = 0; i < n; ++i)
+				{
+					const unsigned char value = src[(first + i) * stride + column + k];
+					values[k][i] = zigzag((unsigned char)(value - last[column + k]));
+					last[column + k] = value;
+				}
+			}
+			const size_t header = out.size();
+			out.resize(header + groups, 0);
+			escapes.clear();
+			for (size_t g = 0; g < groups; ++g)
+			{
+				for (size_t k = 0; k < kColumn; ++k)
+				{
+					const int mode = chooseMode(values[k] + g * kGroup);
+					out[header + g] |= (unsigned char)(mode << (k * 2));
+					encodeGroup(values[k] + g * kGroup, mode, out, escapes);
+				}
+			}
+			out.insert(out.end(), escapes.begin(), escapes.end());
+		}
+	}
+	return out;
+}
+
+bool MeshCodec::decodeVertices(void* dst, size_t count, size_t stride, const unsigned char* data, size_t size, SimdLevel level)
+{
+	if (stride == 0 || stride > 256 || stride % 4 != 0 || size < 1 || data[0] != kVertexHeader)
+		return false;
+	const unsigned char* p = data + 1;
+	const unsigned char* end = data + size;
+	unsigned char* out = (unsigned char*)dst;
+	const size_t perBlock = blockVertices(stride);
+#ifdef SIMD_X86
+	if (level >= SIMD_SSE2)
+	{
+		// Each column's previous vertex, in every lane.
+		__m128i last[256 / kColumn];
+		for (size_t c = 0; c < stride / kColumn; ++c)
+			last[c] = _mm_setzero_si128();
+		for (size_t first = 0; first < count; first += perBlock)
+		{
+			const size_t n = std::min(perBlock, count - first);
+			for (size_t column = 0; column < stride; column += kColumn)
+			{
+				unsigned char* columnOut = out + first * stride + column;
+				const bool decoded = level >= SIMD_AVX2 ? decodeColumnAvx2(p, end, n, stride, columnOut, last[column / kColumn])
+														: decodeColumnSse2(p, end, n, stride, columnOut, last[column / kColumn]);
+				if (!decoded)
+					return false;
+			}
+		}
+		return p == end;
+	}
+#else
+	(void)level;
+#endif
+	unsigned char last[256] = {};
+	unsigned char values[kColumn][kGroup];
+	for (size_t first = 0; first < count; first += perBlock)
+	{
+		const size_t n = std::min(perBlock, count - first);
+		const size_t groups = (n + kGroup - 1) / kGroup;
+		for (size_t column = 0; column < stride; column += kColumn)
+		{
+			const unsigned char *fields, *escapes;
+			if (!splitColumn(p, end, groups, fields, escapes))
+				return false;
+			for (size_t g = 0; g < groups; ++g)
+			{
+				for (size_t k = 0; k < kColumn; ++k)
+				{
+					if (!decodeGroupScalar(fields, escapes, end, (p[g] >> (k * 2)) & 3, values[k]))
+						return false;
+				}
+				for (size_t i = 0; i < kGroup && g * kGroup + i < n; ++i)
+				{
+					unsigned char* vertex = out + (first + g * kGroup + i) * stride + column;
+					for (size_t k = 0; k < kColumn; ++k)
+						vertex[k] = last[column + k] = (unsigned char)(last[column + k] + unzigzag(values[k][i]));
+				}
+			}
+			p = escapes;
+		}
+	}
+	return p == end;
+}
+
+std::vector<unsigned char> MeshCodec::encodeIndices(const uint32_t* indices, size_t count)
+{
+	std::vector<unsigned char> out;
+	if (count % 3 != 0)
+		return out;
+	out.push_back(kIndexHeader);
+	IndexFifos fifos;
+	std::vector<unsigned char> extra;
+	for (size_t t = 0; t < count; t += 3)
+	{
+		const uint32_t triangle[3] = { indices[t], indices[t + 1], indices[t + 2] };
+		int edge = -1, rotation = 0;
+		for (int i = 0; i < IndexFifos::kEdges && edge < 0; ++i)
+		{
+			const uint32_t* candidate = fifos.edge(i);
+			for (int r = 0; r < 3; ++r)
+			{
+				if (candidate[0] == triangle[r] && candidate[1] == triangle[(r + 1) % 3])
+				{
+					edge = i;
+					rotation = r;
+					break;
+				}
+			}
+		}
+
+		extra.clear();
+		if (edge >= 0)
+		{
+			const uint32_t a = triangle[rotation], b = triangle[(rotation + 1) % 3], c = triangle[(rotation + 2) % 3];
+			out.push_back((unsigned char)((edge << 4) | fifos.encodeVertex(c, extra)));
+			fifos.pushEdge(c, b);
+			fifos.pushEdge(a, c);
+		}
+		else
+		{
+			const uint32_t a = triangle[0], b = triangle[1], c = triangle[2];
+			const int codeA = fifos.encodeVertex(a, extra);
+			const int codeB = fifos.encodeVertex(b, extra);
+			const int codeC = fifos.encodeVertex(c, extra);
+			out.push_back((unsigned char)(0xf0 | codeA));
+			out.push_back((unsigned char)((codeB << 4) | codeC));
+			fifos.pushEdge(b, a);
+			fifos.pushEdge(c, b);
+			fifos.pushEdge(a, c);
+		}
+		out.insert(out.end(), extra.begin(), extra.end());
+	}
+	return out;
+}
+
+bool MeshCodec::decodeIndices(void* dst, size_t count, size_t indexBytes, size_t vertexCount, const unsigned char* data,
+	size_t size)
+{
+	if (count % 3 != 0 || (indexBytes != 2 && indexBytes != 4) || size < 1 || data[0] != kIndexHeader)
+		return false;
+	const unsigned char* p = data + 1;
+	const unsigned char* end = data + size;
+	// 16 bit values stop short of 0xffff, the primitive restart index.
+	const uint32_t limit = (uint32_t)std::min<size_t>(vertexCount, indexBytes == 2 ? 0xffff : 0x100000000ull);
+	IndexFifos fifos;
+	for (size_t t = 0; t < count; t += 3)
+	{
+		if (p == end)
+			return false;
+		const unsigned char code = *p++;
+		uint32_t a, b, c;
+		if ((code >> 4) < IndexFifos::kEdges)
+		{
+			const uint32_t* edge = fifos.edge(code >> 4);
+			a = edge[0];
+			b = edge[1];
+			if (!fifos.decodeVertex(code & 15, p, end, c))
+				return false;
+			fifos.pushEdge(c, b);
+			fifos.pushEdge(a, c);
+		}
+		else
+		{
+			if (p == end)
+				return false;
+			const unsigned char codes = *p++;
+			if (!fifos.decodeVertex(code & 15, p, end, a) || !fifos.decodeVertex(codes >> 4, p, end, b) ||
+				!fifos.decodeVertex(codes & 15, p, end, c))
+				return false;
+			fifos.pushEdge(b, a);
+			fifos.pushEdge(c, b);
+			fifos.pushEdge(a, c);
+		}
+		if (a >= limit || b >= limit || c >= limit)
+			return false;
+		storeIndex(dst, t, indexBytes, a);
+		storeIndex(dst, t + 1, indexBytes, b);
+		storeIndex(dst, t + 2, indexBytes, c);
+	}
+	return p == end;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Simd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless compression for packed vertex and index buffers, in the manner of
+// meshoptimizer's codecs: both lean on the order MeshOptimizer leaves behind,
+// where neighbouring vertices are similar and triangles reuse recent edges.
+//
+// Vertices go in blocks of up to 256. Within a block every byte position of
+// the stride is coded as each byte minus the same byte of the vertex before,
+// zigzagged so small differences of either sign are small numbers. Positions
+// are taken four at a time as a column and cut into groups of 32 vertices.
+// Each group has a header byte giving every position's mode: nothing (all
+// zero), 2 or 4 bit fields whose values that do not fit follow as escapes, or
+// 32 plain bytes, whichever is shortest. A column holds its headers, then all
+// its fields, then all its escapes, so each kind is read in order. Decoding
+// with SIMD unpacks a group's four positions, interleaves them so every
+// vertex's four bytes sit in one 32 bit lane, sums the deltas across lanes
+// and stores each lane straight into its vertex; no transposed copy of the
+// block is kept. With AVX2 the fields are unpacked with variable shifts and
+// the escapes put in place with a shuffle. On the bench machine that decodes
+// the sample mesh at 2 to 3 GB/s with AVX2, a third to a quarter of memcpy's
+// speed, and at about half that with SSE2; see --bench meshcodec.
+//
+// Triangles take a byte each when they share one of the 15 most recent edges,
+// which says which edge and where the third vertex comes from: the next
+// vertex not used yet, one of the 14 most recent or an explicit delta. Others
+// take two bytes and up to three deltas. Triangles come back rotated, with
+// their winding kept.
+class MeshCodec
+{
+public:
+	// stride a multiple of 4 up to 256. Empty on bad arguments.
+	static std::vector<unsigned char> encodeVertices(const void* vertices, size_t count, size_t stride);
+	// Decodes exactly count vertices of stride bytes into dst. False if the
+	// data is malformed or does not hold that many.
+	static bool decodeVertices(void* dst, size_t count, size_t stride, const unsigned char* data, size_t size,
+		SimdLevel level = detectSimdLevel());
+
+	// count a multiple of 3.
+	static std::vector<unsigned char> encodeIndices(const uint32_t* indices, size_t count);
+	// Decodes count indices into dst as indexBytes (2 or 4) wide values. False
+	// if the data is malformed or an index is not below vertexCount, or, for
+	// 16 bits, below 0xffff.
+	static bool decodeIndices(void* dst, size_t count, size_t indexBytes, size_t vertexCount, const unsigned char* data,
+		size_t size);
+};
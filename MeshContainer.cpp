@@ -0,0 +1,598 @@
+#include "MeshContainer.h"
+#include "IndexBuffer.h"
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	const char kMagic[8] = { '\xab', 'O', 'M', 'S', 'H', '1', '\xbb', '\n' };
+	const uint32_t kVersion = 4;
+	const uint32_t kFlagMeshlets = 1;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t flags;
+		uint32_t vertexCount;
+		uint32_t vertexStride;
+		uint32_t attributeCount;
+		uint32_t indexBytes;
+		uint32_t submeshCount;
+		uint32_t levelCount; // over all submeshes
+		uint32_t compression;
+		uint32_t chunkCount;
+		float positionOffset[3];
+		float positionScale[3];
+		uint64_t sourceSize;
+		uint64_t sourceTime;
+		uint64_t sourceHash;
+		uint64_t cookKey;
+		uint64_t indexCount;
+		// Payloads, as byte offsets into the file; counts in elements, sizes
+		// in stored bytes.
+		uint64_t vertexOffset, vertexSize;
+		uint64_t indexOffset, indexSize;
+		uint64_t meshletOffset, meshletCount;
+		uint64_t meshletVertexOffset, meshletVertexCount;
+		uint64_t meshletTriangleOffset, meshletTriangleBytes;
+	};
+
+	struct FileAttribute
+	{
+		uint32_t semantic;
+		uint32_t encoding;
+		uint32_t offset;
+	};
+
+	struct FileSubmesh
+	{
+		int32_t material;
+		uint32_t firstLevel, levelCount;
+		float boundsMin[3], boundsMax[3];
+		float center[3], radius;
+	};
+
+	// Meshlet ranges are relative to the payloads' starts.
+	struct FileLevel
+	{
+		uint64_t indexOffset, indexCount;
+		float error;
+		uint32_t firstChunk, chunkCount;
+		uint32_t padding;
+		uint64_t meshletOffset, meshletCount;
+		uint64_t vertexOffset, vertexCount;
+		uint64_t triangleOffset, triangleBytes;
+	};
+
+	// Index ranges are into the whole index payload, like the levels'.
+	struct FileChunk
+	{
+		uint64_t indexOffset, indexCount;
+		uint32_t baseVertex;
+		uint32_t padding;
+	};
+
+	struct FileMeshlet
+	{
+		uint32_t vertexOffset, vertexCount;
+		uint32_t triangleOffset, triangleCount;
+		float center[3], radius;
+		float coneAxis[3], coneCutoff;
+	};
+
+	size_t align16(size_t value)
+	{
+		return (value + 15) & ~(size_t)15;
+	}
+
+	void copy3(float* dst, const glm::vec3& v)
+	{
+		dst[0] = v.x, dst[1] = v.y, dst[2] = v.z;
+	}
+
+	glm::vec3 vec3(const float* src)
+	{
+		return glm::vec3(src[0], src[1], src[2]);
+	}
+
+	// Whether [offset, offset + count * size) lies in a file of fileSize bytes.
+	bool inFile(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize)
+	{
+		return offset <= fileSize && count <= (fileSize - offset) / size;
+	}
+
+	template <class T>
+	void appendBytes(std::vector<unsigned char>& out, const T* data, size_t count)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		out.insert(out.end(), bytes, bytes + sizeof(T) * count);
+	}
+}
+
+bool MeshContainer::open(const std::string& path)
+{
+	close();
+	if (!mFile.open(path))
+		return false;
+
+	const unsigned char* base = mFile.data();
+	const uint64_t fileSize = mFile.size();
+	FileHeader header;
+	if (fileSize < sizeof(header))
+	{
+		close();
+		return false;
+	}
+	memcpy(&header, base, sizeof(header));
+	const size_t tablesEnd = sizeof(header) + sizeof(FileAttribute) * (size_t)header.attributeCount +
+		sizeof(FileSubmesh) * (size_t)header.submeshCount + sizeof(FileLevel) * (size_t)header.levelCount +
+		sizeof(FileChunk) * (size_t)header.chunkCount;
+	const bool meshlets = (header.flags & kFlagMeshlets) != 0;
+	// Plain payloads are exactly their elements; compressed ones only have to
+	// be in the file, and decoding checks the rest.
+	const bool plain = header.compression == (uint32_t)MeshCompression::None;
+	if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || header.attributeCount == 0 ||
+		header.attributeCount > 4 || header.submeshCount > (1u << 20) || header.levelCount > (1u << 24) ||
+		header.chunkCount > (1u << 24) ||
+		(header.indexBytes != 2 && header.indexBytes != 4) || header.vertexStride == 0 || fileSize < tablesEnd ||
+		header.compression > (uint32_t)MeshCompression::Codec ||
+		(plain && (header.vertexSize != (uint64_t)header.vertexCount * header.vertexStride ||
+			header.indexSize != header.indexCount * header.indexBytes)) ||
+		!inFile(header.vertexOffset, header.vertexSize, 1, fileSize) || !inFile(header.indexOffset, header.indexSize, 1, fileSize) ||
+		(meshlets && (!inFile(header.meshletOffset, header.meshletCount, sizeof(FileMeshlet), fileSize) ||
+			!inFile(header.meshletVertexOffset, header.meshletVertexCount, sizeof(uint32_t), fileSize) ||
+			!inFile(header.meshletTriangleOffset, header.meshletTriangleBytes, 1, fileSize))))
+	{
+		close();
+		return false;
+	}
+
+	// The layout has to describe exactly the stride the vertices were packed with.
+	const unsigned char* table = base + sizeof(header);
+	for (uint32_t i = 0; i < header.attributeCount; ++i, table += sizeof(FileAttribute))
+	{
+		FileAttribute attribute;
+		memcpy(&attribute, table, sizeof(attribute));
+		if (attribute.semantic > (uint32_t)VertexSemantic::Tangent || attribute.encoding > (uint32_t)VertexEncoding::Snorm10x3 ||
+			attribute.offset != mLayout.stride())
+		{
+			close();
+			return false;
+		}
+		mLayout.add((VertexSemantic)attribute.semantic, (VertexEncoding)attribute.encoding);
+	}
+	if (mLayout.stride() != header.vertexStride)
+	{
+		close();
+		return false;
+	}
+
+	std::vector<FileSubmesh> submeshes(header.submeshCount);
+	memcpy(submeshes.data(), table, sizeof(FileSubmesh) * submeshes.size());
+	table += sizeof(FileSubmesh) * submeshes.size();
+	std::vector<FileLevel> levels(header.levelCount);
+	memcpy(levels.data(), table, sizeof(FileLevel) * levels.size());
+	table += sizeof(FileLevel) * levels.size();
+	std::vector<FileChunk> chunks(header.chunkCount);
+	memcpy(chunks.data(), table, sizeof(FileChunk) * chunks.size());
+
+	for (const FileSubmesh& source : submeshes)
+	{
+		if (source.firstLevel > header.levelCount || source.levelCount > header.levelCount - source.firstLevel)
+		{
+			close();
+			return false;
+		}
+		Submesh submesh;
+		submesh.material = source.material;
+		submesh.boundsMin = vec3(source.boundsMin);
+		submesh.boundsMax = vec3(source.boundsMax);
+		submesh.lods.center = vec3(source.center);
+		submesh.lods.radius = source.radius;
+		mFirstLevel.push_back(mLevelMeshlets.size());
+		for (uint32_t l = source.firstLevel; l < source.firstLevel + source.levelCount; ++l)
+		{
+			const FileLevel& level = levels[l];
+			if (level.indexOffset > header.indexCount || level.indexCount > header.indexCount - level.indexOffset ||
+				level.indexCount % 3 != 0 || level.firstChunk > header.chunkCount || level.chunkCount > header.chunkCount - level.firstChunk ||
+				(meshlets && (level.meshletOffset > header.meshletCount || level.meshletCount > header.meshletCount - level.meshletOffset ||
+					level.vertexOffset > header.meshletVertexCount || level.vertexCount > header.meshletVertexCount - level.vertexOffset ||
+					level.triangleOffset > header.meshletTriangleBytes || level.triangleBytes > header.meshletTriangleBytes - level.triangleOffset)))
+			{
+				close();
+				return false;
+			}
+			MeshLod lod;
+			lod.indexOffset = (size_t)level.indexOffset;
+			lod.indexCount = (size_t)level.indexCount;
+			lod.error = level.error;
+			submesh.lods.levels.push_back(lod);
+			// The chunks have to stay within the level; what the base vertex
+			// adds to their index values is left to the writer, like the
+			// values themselves.
+			submesh.chunks.emplace_back();
+			for (uint32_t c = level.firstChunk; c < level.firstChunk + level.chunkCount; ++c)
+			{
+				const FileChunk& chunk = chunks[c];
+				if (chunk.indexOffset < level.indexOffset || chunk.indexOffset > level.indexOffset + level.indexCount ||
+					chunk.indexCount > level.indexOffset + level.indexCount - chunk.indexOffset || chunk.indexCount % 3 != 0 ||
+					chunk.baseVertex >= std::max<uint32_t>(header.vertexCount, 1))
+				{
+					close();
+					return false;
+				}
+				submesh.chunks.back().push_back({ (size_t)chunk.indexOffset, (size_t)chunk.indexCount, chunk.baseVertex });
+			}
+			mLevelMeshlets.push_back({ header.meshletOffset + level.meshletOffset * sizeof(FileMeshlet), level.meshletCount,
+				header.meshletVertexOffset + level.vertexOffset * sizeof(uint32_t), level.vertexCount,
+				header.meshletTriangleOffset + level.triangleOffset, level.triangleBytes });
+		}
+		mSubmeshes.push_back(submesh);
+	}
+
+	mVertexCount = header.vertexCount;
+	mIndexCount = (size_t)header.indexCount;
+	mIndexBytes = header.indexBytes;
+	mVertexOffset = (size_t)header.vertexOffset;
+	mIndexOffset = (size_t)header.indexOffset;
+	mVertexSize = (size_t)header.vertexSize;
+	mIndexSize = (size_t)header.indexSize;
+	mCompression = (MeshCompression)header.compression;
+	mPositionOffset = vec3(header.positionOffset);
+	mPositionScale = vec3(header.positionScale);
+	mHasMeshlets = meshlets;
+	mSourceSize = header.sourceSize;
+	mSourceTime = header.sourceTime;
+	mSourceHash = header.sourceHash;
+	mCookKey = header.cookKey;
+	return true;
+}
+
+void MeshContainer::close()
+{
+	mFile.close();
+	mLayout = VertexLayout();
+	mSubmeshes.clear();
+	mLevelMeshlets.clear();
+	mFirstLevel.clear();
+	mHasMeshlets = false;
+	mVertexCount = mIndexCount = 0;
+	mVertexSize = mIndexSize = 0;
+	mCompression = MeshCompression::None;
+}
+
+glm::mat4 MeshContainer::decodeTransform() const
+{
+	PackedVertices vertices;
+	vertices.positionOffset = mPositionOffset;
+	vertices.positionScale = mPositionScale;
+	return vertices.decodeTransform();
+}
+
+MeshletMesh MeshContainer::meshlets(size_t submesh, size_t level) const
+{
+	MeshletMesh mesh;
+	if (!mHasMeshlets || submesh >= mSubmeshes.size() || level >= mSubmeshes[submesh].lods.levels.size())
+		return mesh;
+	const LevelMeshlets& range = mLevelMeshlets[mFirstLevel[submesh] + level];
+	const unsigned char* base = mFile.data();
+	mesh.vertices.resize((size_t)range.vertexCount);
+	memcpy(mesh.vertices.data(), base + range.vertexOffset, sizeof(uint32_t) * mesh.vertices.size());
+	mesh.triangles.assign(base + range.triangleOffset, base + range.triangleOffset + range.triangleBytes);
+	mesh.meshlets.resize((size_t)range.meshletCount);
+	for (size_t i = 0; i < mesh.meshlets.size(); ++i)
+	{
+		FileMeshlet source;
+		memcpy(&source, base + range.meshletOffset + sizeof(FileMeshlet) * i, sizeof(source));
+		// The culler indexes with these, so a bad range drops the level's
+		// meshlets rather than reading past them.
+		if (source.vertexOffset > mesh.vertices.size() || source.vertexCount > mesh.vertices.size() - source.vertexOffset ||
+			source.triangleOffset > mesh.triangles.size() || source.triangleCount > (mesh.triangles.size() - source.triangleOffset) / 3)
+			return MeshletMesh();
+		Meshlet& meshlet = mesh.meshlets[i];
+		meshlet.vertexOffset = source.vertexOffset;
+		meshlet.vertexCount = source.vertexCount;
+		meshlet.triangleOffset = source.triangleOffset;
+		meshlet.triangleCount = source.triangleCount;
+		meshlet.center = vec3(source.center);
+		meshlet.radius = source.radius;
+		meshlet.coneAxis = vec3(source.coneAxis);
+		meshlet.coneCutoff = source.coneCutoff;
+	}
+	for (const Meshlet& meshlet : mesh.meshlets)
+	{
+		for (uint32_t i = meshlet.triangleOffset; i < meshlet.triangleOffset + meshlet.triangleCount * 3; ++i)
+		{
+			if (mesh.triangles[i] >= meshlet.vertexCount)
+				return MeshletMesh();
+		}
+	}
+	for (uint32_t vertex : mesh.vertices)
+	{
+		if (vertex >= mVertexCount)
+			return MeshletMesh();
+	}
+	return mesh;
+}
+
+bool MeshContainer::matchesSource(uint64_t size, uint64_t modifiedTime) const
+{
+	return mSourceSize == size && mSourceTime == modifiedTime;
+}
+
+const unsigned char* MeshContainer::vertexData(std::vector<unsigned char>& scratch) const
+{
+	const unsigned char* stored = mFile.data() + mVertexOffset;
+	if (mCompression == MeshCompression::None)
+		return stored;
+	scratch.resize(mVertexCount * mLayout.stride());
+	if (!MeshCodec::decodeVertices(scratch.data(), mVertexCount, mLayout.stride(), stored, mVertexSize))
+		return nullptr;
+	return scratch.data();
+}
+
+const unsigned char* MeshContainer::indexData(std::vector<unsigned char>& scratch) const
+{
+	const unsigned char* stored = mFile.data() + mIndexOffset;
+	if (mCompression == MeshCompression::None)
+		return stored;
+	scratch.resize(mIndexCount * mIndexBytes);
+	if (!MeshCodec::decodeIndices(scratch.data(), mIndexCount, mIndexBytes, mVertexCount, stored, mIndexSize))
+		return nullptr;
+	return scratch.data();
+}
+
+GLuint MeshContainer::uploadVertices() const
+{
+	if (!isOpen())
+		return 0;
+	std::vector<unsigned char> scratch;
+	const unsigned char* vertices = vertexData(scratch);
+	if (!vertices)
+	{
+		std::cerr << "MeshContainer: the vertex payload does not decode" << std::endl;
+		return 0;
+	}
+	GLuint buffer = 0;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, std::max<GLsizeiptr>((GLsizeiptr)(mVertexCount * mLayout.stride()), 1), vertices, 0);
+	return buffer;
+}
+
+GLuint MeshContainer::uploadIndices() const
+{
+	if (!isOpen())
+		return 0;
+	std::vector<unsigned char> scratch;
+	const unsigned char* indices = indexData(scratch);
+	if (!indices)
+	{
+		std::cerr << "MeshContainer: the index payload does not decode" << std::endl;
+		return 0;
+	}
+	GLuint buffer = 0;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, std::max<GLsizeiptr>((GLsizeiptr)(mIndexCount * mIndexBytes), 1), indices, 0);
+	return buffer;
+}
+
+bool MeshContainer::write(const std::string& path, const CookedMesh& mesh, MeshCompression compression, uint64_t sourceSize,
+	uint64_t sourceTime, uint64_t sourceHash, uint64_t cookKey)
+{
+	const PackedVertices& vertices = mesh.vertices;
+	if (vertices.layout.attributes().empty() || vertices.count > 0xffffffffu)
+		return false;
+
+	FileHeader header = {};
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.vertexCount = (uint32_t)vertices.count;
+	header.vertexStride = (uint32_t)vertices.layout.stride();
+	header.attributeCount = (uint32_t)vertices.layout.attributes().size();
+	header.submeshCount = (uint32_t)mesh.submeshes.size();
+	header.compression = (uint32_t)compression;
+	copy3(header.positionOffset, vertices.positionOffset);
+	copy3(header.positionScale, vertices.positionScale);
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.sourceHash = sourceHash;
+	header.cookKey = cookKey;
+
+	// Every level is split into runs of triangles 16 bit indices reach from a
+	// base vertex; if one of them cannot be, every level stays 32 bits with a
+	// single chunk, as one index type serves the whole payload.
+	std::vector<std::vector<IndexChunk>> levelChunks;
+	header.indexBytes = 2;
+	for (const CookedSubmesh& submesh : mesh.submeshes)
+	{
+		for (const MeshLod& lod : submesh.lods.levels)
+		{
+			if (lod.indexOffset + lod.indexCount > submesh.lods.indices.size())
+				return false;
+			const std::vector<uint32_t> level(submesh.lods.indices.begin() + lod.indexOffset,
+				submesh.lods.indices.begin() + lod.indexOffset + lod.indexCount);
+			levelChunks.push_back(IndexPacker::split(level, vertices.count, IndexPackParams().maxChunks));
+			if (levelChunks.back().empty())
+				header.indexBytes = 4;
+		}
+	}
+	if (header.indexBytes == 4)
+	{
+		for (size_t l = 0; l < levelChunks.size(); ++l)
+			levelChunks[l].clear();
+	}
+
+	// Every submesh's levels go into one index payload, and their meshlets
+	// into one set of meshlet payloads, in submesh then level order.
+	bool meshlets = !mesh.submeshes.empty();
+	for (const CookedSubmesh& submesh : mesh.submeshes)
+		meshlets = meshlets && submesh.meshlets.size() == submesh.lods.levels.size();
+	header.flags = meshlets ? kFlagMeshlets : 0;
+
+	std::vector<FileAttribute> attributes;
+	for (const VertexLayout::Attribute& attribute : vertices.layout.attributes())
+		attributes.push_back({ (uint32_t)attribute.semantic, (uint32_t)attribute.encoding, (uint32_t)attribute.offset });
+	std::vector<FileSubmesh> submeshes;
+	std::vector<FileLevel> levels;
+	std::vector<FileChunk> chunks;
+	std::vector<unsigned char> indices, fileMeshlets, meshletVertices, meshletTriangles;
+	std::vector<uint32_t> wideIndices; // what MeshCodec encodes, relative to each chunk's base
+	for (const CookedSubmesh& submesh : mesh.submeshes)
+	{
+		FileSubmesh entry = {};
+		entry.material = submesh.material;
+		entry.firstLevel = (uint32_t)levels.size();
+		entry.levelCount = (uint32_t)submesh.lods.levels.size();
+		copy3(entry.boundsMin, submesh.boundsMin);
+		copy3(entry.boundsMax, submesh.boundsMax);
+		copy3(entry.center, submesh.lods.center);
+		entry.radius = submesh.lods.radius;
+		submeshes.push_back(entry);
+
+		for (size_t l = 0; l < submesh.lods.levels.size(); ++l)
+		{
+			const MeshLod& lod = submesh.lods.levels[l];
+			std::vector<IndexChunk>& levelChunk = levelChunks[levels.size()];
+			if (levelChunk.empty())
+				levelChunk.push_back({ 0, lod.indexCount, 0 });
+			FileLevel level = {};
+			level.indexOffset = wideIndices.size();
+			level.indexCount = lod.indexCount;
+			level.error = lod.error;
+			level.firstChunk = (uint32_t)chunks.size();
+			level.chunkCount = (uint32_t)levelChunk.size();
+			for (const IndexChunk& chunk : levelChunk)
+			{
+				chunks.push_back({ level.indexOffset + chunk.indexOffset, chunk.indexCount, chunk.baseVertex, 0 });
+				const size_t begin = lod.indexOffset + chunk.indexOffset;
+				for (size_t i = begin; i < begin + chunk.indexCount; ++i)
+				{
+					const uint32_t index = submesh.lods.indices[i];
+					if (index >= vertices.count)
+						return false;
+					wideIndices.push_back(index - chunk.baseVertex);
+					if (header.indexBytes == 2)
+					{
+						const uint16_t narrow = (uint16_t)(index - chunk.baseVertex);
+						appendBytes(indices, &narrow, 1);
+					}
+					else
+						appendBytes(indices, &index, 1);
+				}
+			}
+			if (meshlets)
+			{
+				const MeshletMesh& source = submesh.meshlets[l];
+				level.meshletOffset = fileMeshlets.size() / sizeof(FileMeshlet);
+				level.meshletCount = source.meshlets.size();
+				level.vertexOffset = meshletVertices.size() / sizeof(uint32_t);
+				level.vertexCount = source.vertices.size();
+				level.triangleOffset = meshletTriangles.size();
+				level.triangleBytes = source.triangles.size();
+				for (const Meshlet& meshlet : source.meshlets)
+				{
+					FileMeshlet entry = {};
+					entry.vertexOffset = meshlet.vertexOffset;
+					entry.vertexCount = meshlet.vertexCount;
+					entry.triangleOffset = meshlet.triangleOffset;
+					entry.triangleCount = meshlet.triangleCount;
+					copy3(entry.center, meshlet.center);
+					entry.radius = meshlet.radius;
+					copy3(entry.coneAxis, meshlet.coneAxis);
+					entry.coneCutoff = meshlet.coneCutoff;
+					appendBytes(fileMeshlets, &entry, 1);
+				}
+				appendBytes(meshletVertices, source.vertices.data(), source.vertices.size());
+				appendBytes(meshletTriangles, source.triangles.data(), source.triangles.size());
+			}
+			levels.push_back(level);
+		}
+	}
+	header.levelCount = (uint32_t)levels.size();
+	header.chunkCount = (uint32_t)chunks.size();
+	header.indexCount = wideIndices.size();
+
+	std::vector<unsigned char> encodedVertices;
+	const std::vector<unsigned char>* vertexPayload = &vertices.data;
+	const std::vector<unsigned char>* indexPayload = &indices;
+	if (compression == MeshCompression::Codec)
+	{
+		encodedVertices = MeshCodec::encodeVertices(vertices.data.data(), vertices.count, vertices.layout.stride());
+		indices = MeshCodec::encodeIndices(wideIndices.data(), wideIndices.size());
+		if (encodedVertices.empty() || indices.empty())
+			return false;
+		vertexPayload = &encodedVertices;
+	}
+	header.vertexSize = vertexPayload->size();
+	header.indexSize = indexPayload->size();
+
+	// Payloads in the order the loader touches them: meshlets, then the
+	// buffers that go to the GPU.
+	const size_t tablesEnd = sizeof(header) + sizeof(FileAttribute) * attributes.size() + sizeof(FileSubmesh) * submeshes.size() +
+		sizeof(FileLevel) * levels.size() + sizeof(FileChunk) * chunks.size();
+	const std::vector<unsigned char>* payloads[] = { &fileMeshlets, &meshletVertices, &meshletTriangles, vertexPayload, indexPayload };
+	uint64_t offsets[5];
+	size_t offset = align16(tablesEnd);
+	for (int i = 0; i < 5; ++i)
+	{
+		offsets[i] = offset;
+		offset = align16(offset + payloads[i]->size());
+	}
+	header.meshletOffset = offsets[0];
+	header.meshletCount = fileMeshlets.size() / sizeof(FileMeshlet);
+	header.meshletVertexOffset = offsets[1];
+	header.meshletVertexCount = meshletVertices.size() / sizeof(uint32_t);
+	header.meshletTriangleOffset = offsets[2];
+	header.meshletTriangleBytes = meshletTriangles.size();
+	header.vertexOffset = offsets[3];
+	header.indexOffset = offsets[4];
+
+	// Write to a temporary name first so a crash never leaves a truncated
+	// container that passes header validation.
+	const std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)attributes.data(), sizeof(FileAttribute) * attributes.size());
+		file.write((const char*)submeshes.data(), sizeof(FileSubmesh) * submeshes.size());
+		file.write((const char*)levels.data(), sizeof(FileLevel) * levels.size());
+		file.write((const char*)chunks.data(), sizeof(FileChunk) * chunks.size());
+		const char padding[16] = {};
+		size_t written = tablesEnd;
+		for (int i = 0; i < 5; ++i)
+		{
+			file.write(padding, (std::streamsize)(offsets[i] - written));
+			file.write((const char*)payloads[i]->data(), (std::streamsize)payloads[i]->size());
+			written = (size_t)offsets[i] + payloads[i]->size();
+		}
+		if (!file)
+			return false;
+	}
+	std::remove(path.c_str());
+	return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+bool MeshContainer::updateSource(const std::string& path, uint64_t sourceSize, uint64_t sourceTime)
+{
+	// Only two fields change, so a torn write at worst leaves a size or time
+	// that does not match and the next load hashes the source again.
+	std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+	FileHeader header;
+	if (!file || !file.read((char*)&header, sizeof(header)))
+		return false;
+	if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion)
+		return false;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	file.seekp(0);
+	file.write((const char*)&header, sizeof(header));
+	return (bool)file.flush();
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "IndexBuffer.h"
+#include "MappedFile.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "VertexLayout.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A processed mesh as it is cooked: packed vertices shared by submeshes, each
+// with its levels of detail and, optionally, one MeshletMesh per level.
+struct CookedSubmesh
+{
+	int material = -1;
+	glm::vec3 boundsMin = glm::vec3(0.f), boundsMax = glm::vec3(0.f);
+	MeshLods lods;                     // levels index lods.indices
+	std::vector<MeshletMesh> meshlets; // empty, or one per level
+};
+
+struct CookedMesh
+{
+	PackedVertices vertices;
+	std::vector<CookedSubmesh> submeshes;
+};
+
+enum class MeshCompression : uint32_t
+{
+	None = 0,
+	Codec = 1 // MeshCodec, vertex and index payloads
+};
+
+// Cooked mesh file (.omesh): a fixed header, the vertex layout, submesh, level
+// and index chunk tables, meshlet tables and the vertex and index payloads,
+// 16 byte aligned. Indices are 16 bits when every level splits into a few
+// chunks that reach their vertices from a base vertex, see IndexPacker, and
+// 32 bits with one chunk per level otherwise. Loading maps the
+// file and validates the tables only; the payloads are first touched by the
+// upload, which hands pointers into the mapping straight to
+// glNamedBufferStorage when they are stored plainly, or decodes them into a
+// scratch buffer first when they are compressed. Plain index values are left
+// as the writer checked them, decoded ones are checked by MeshCodec; meshlets,
+// which the CPU reads, are checked as they are copied out.
+//
+// open() rejects other versions of the format. Whether a container is still
+// current for its source is up to the caller, see MeshCooker: the header
+// records the source's size, time and hash64, and a cook key for the
+// parameters that shaped the contents.
+class MeshContainer
+{
+public:
+	struct Submesh
+	{
+		int material = -1;
+		glm::vec3 boundsMin = glm::vec3(0.f), boundsMax = glm::vec3(0.f);
+		// Index offsets and counts are into the file's whole index payload,
+		// which is what uploadIndices() puts in its buffer. lods.indices stays
+		// empty.
+		MeshLods lods;
+		// Per level, the draws that make it up: index values are relative to
+		// each chunk's base vertex.
+		std::vector<std::vector<IndexChunk>> chunks;
+	};
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return mFile.isOpen(); }
+	size_t fileSize() const { return mFile.size(); }
+	MeshCompression compression() const { return mCompression; }
+
+	const VertexLayout& layout() const { return mLayout; }
+	size_t vertexCount() const { return mVertexCount; }
+	size_t indexCount() const { return mIndexCount; }
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	GLenum indexType() const { return mIndexBytes == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+	size_t indexBytes() const { return mIndexBytes; }
+	// PackedVertices::decodeTransform() of the cooked vertices.
+	glm::mat4 decodeTransform() const;
+
+	size_t submeshCount() const { return mSubmeshes.size(); }
+	const Submesh& submesh(size_t index) const { return mSubmeshes[index]; }
+	bool hasMeshlets() const { return mHasMeshlets; }
+	// Copies a level's meshlets out of the mapping; empty without meshlets.
+	MeshletMesh meshlets(size_t submesh, size_t level) const;
+
+	// True if the container was cooked from a source with this size and time.
+	bool matchesSource(uint64_t size, uint64_t modifiedTime) const;
+	uint64_t sourceHash() const { return mSourceHash; }
+	uint64_t cookKey() const { return mCookKey; }
+
+	// Bytes the vertex and index payloads take in the file.
+	size_t storedVertexBytes() const { return mVertexSize; }
+	size_t storedIndexBytes() const { return mIndexSize; }
+
+	// Return the vertices, vertexCount() of layout().stride() bytes, and the
+	// indices, indexCount() of indexBytes(), pointing into the mapping when
+	// stored plainly or into scratch after decoding. Null if the payload does
+	// not decode.
+	const unsigned char* vertexData(std::vector<unsigned char>& scratch) const;
+	const unsigned char* indexData(std::vector<unsigned char>& scratch) const;
+
+	// GL thread only. Immutable buffers holding the vertices and the indices.
+	// 0 if the payload does not decode.
+	GLuint uploadVertices() const;
+	GLuint uploadIndices() const;
+
+	static bool write(const std::string& path, const CookedMesh& mesh, MeshCompression compression, uint64_t sourceSize,
+		uint64_t sourceTime, uint64_t sourceHash, uint64_t cookKey);
+	// Records a new size and time for the source of the container at path,
+	// for a source whose bytes still hash the same. Rewrites the header in
+	// place, so the container must not be open.
+	static bool updateSource(const std::string& path, uint64_t sourceSize, uint64_t sourceTime);
+
+private:
+	struct LevelMeshlets
+	{
+		uint64_t meshletOffset, meshletCount;
+		uint64_t vertexOffset, vertexCount;
+		uint64_t triangleOffset, triangleBytes;
+	};
+
+	MappedFile mFile;
+	VertexLayout mLayout;
+	size_t mVertexCount = 0, mIndexCount = 0, mIndexBytes = 4;
+	size_t mVertexOffset = 0, mIndexOffset = 0; // into the mapping
+	size_t mVertexSize = 0, mIndexSize = 0;     // stored bytes
+	MeshCompression mCompression = MeshCompression::None;
+	glm::vec3 mPositionOffset = glm::vec3(0.f), mPositionScale = glm::vec3(1.f);
+	std::vector<Submesh> mSubmeshes;
+	bool mHasMeshlets = false;
+	std::vector<LevelMeshlets> mLevelMeshlets; // per level of every submesh, in order
+	std::vector<size_t> mFirstLevel;           // per submesh, into mLevelMeshlets
+	uint64_t mSourceSize = 0, mSourceTime = 0, mSourceHash = 0, mCookKey = 0;
+};
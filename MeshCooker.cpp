@@ -0,0 +1,154 @@
+#include "MeshCooker.h"
+#include "Hash.h"
+#include "MappedFile.h"
+#include "TangentGenerator.h"
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Bump when a processing step changes its output for the same parameters.
+	const uint32_t kCookerVersion = 1;
+
+	double msSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// hash64 of a file's bytes, or 0 if it cannot be read.
+	uint64_t hashFile(const std::string& path)
+	{
+		MappedFile file;
+		if (!file.open(path))
+			return 0;
+		file.prefetch(0, file.size());
+		return hash64(file.data(), file.size());
+	}
+}
+
+MeshCooker::MeshCooker(ThreadPool& pool)
+	: mPool(pool)
+{
+}
+
+uint64_t MeshCooker::cookKey(const MeshCookParams& params)
+{
+	// Every field as a double, so the key does not depend on struct padding.
+	const SimplifyParams& simplify = params.lods.simplify;
+	const double fields[] = { (double)kCookerVersion, (double)params.import.deduplicate, (double)params.import.generateNormals,
+		(double)params.tangents, (double)params.optimize.algorithm, (double)params.optimize.cacheSize,
+		(double)params.optimize.overdrawThreshold, (double)simplify.lockBorders, (double)simplify.texCoordWeight,
+		(double)simplify.normalWeight, (double)simplify.maxError, (double)params.lods.maxLevels, (double)params.lods.ratio,
+		(double)params.lods.minTriangles, (double)params.meshlets, (double)params.meshlet.maxVertices,
+		(double)params.meshlet.maxTriangles, (double)params.meshlet.coneWeight, (double)params.position,
+		(double)params.compression };
+	return hash64(fields, sizeof(fields));
+}
+
+bool MeshCooker::load(const std::string& path, MeshContainer& container, const MeshCookParams& params)
+{
+	mStats = Stats();
+	const auto start = Clock::now();
+	const std::string containerPath = cookedPath(path);
+	const uint64_t key = cookKey(params);
+	uint64_t sourceSize = 0, sourceTime = 0, sourceHash = 0;
+	const bool haveSource = MappedFile::stat(path, sourceSize, sourceTime);
+	mStats.sourceBytes = (size_t)sourceSize;
+
+	bool current = container.open(containerPath) && container.cookKey() == key;
+	if (current && haveSource && !container.matchesSource(sourceSize, sourceTime))
+	{
+		// Touched, copied or checked out again: only the bytes tell.
+		sourceHash = hashFile(path);
+		mStats.hashChecked = true;
+		current = sourceHash != 0 && sourceHash == container.sourceHash();
+		if (current)
+		{
+			// Record the new size and time so the next load skips the hash.
+			container.close();
+			if (!MeshContainer::updateSource(containerPath, sourceSize, sourceTime))
+				std::cerr << "MeshCooker: cannot update the source time in " << containerPath << std::endl;
+			current = container.open(containerPath) && container.cookKey() == key;
+		}
+	}
+	mStats.checkMs = msSince(start);
+	if (current)
+	{
+		mStats.containerBytes = container.fileSize();
+		return true;
+	}
+	container.close();
+	if (!haveSource)
+	{
+		std::cerr << "MeshCooker: cannot find " << path << std::endl;
+		return false;
+	}
+
+	const auto cookStart = Clock::now();
+	if (!sourceHash)
+		sourceHash = hashFile(path);
+	if (!mCook(path, params, sourceSize, sourceTime, sourceHash))
+		return false;
+	mStats.cooked = true;
+	mStats.cookMs = msSince(cookStart);
+
+	const auto openStart = Clock::now();
+	if (!container.open(containerPath))
+	{
+		std::cerr << "MeshCooker: cannot open " << containerPath << " after writing it" << std::endl;
+		return false;
+	}
+	mStats.openMs = msSince(openStart);
+	mStats.containerBytes = container.fileSize();
+	return true;
+}
+
+bool MeshCooker::mCook(const std::string& path, const MeshCookParams& params, uint64_t sourceSize, uint64_t sourceTime,
+	uint64_t sourceHash)
+{
+	MeshImporter importer(mPool);
+	Mesh mesh;
+	if (!importer.load(path, mesh, params.import))
+		return false;
+	if (params.tangents && !mesh.streams.texCoords.empty() && !mesh.streams.normals.empty())
+	{
+		TangentGenerator tangents(mPool);
+		tangents.generate(mesh);
+	}
+	MeshOptimizer::optimize(mesh, params.optimize);
+
+	CookedMesh cooked;
+	cooked.submeshes.resize(1);
+	CookedSubmesh& submesh = cooked.submeshes[0];
+	submesh.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	submesh.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+	for (const glm::vec3& position : mesh.streams.positions)
+	{
+		submesh.boundsMin = glm::min(submesh.boundsMin, position);
+		submesh.boundsMax = glm::max(submesh.boundsMax, position);
+	}
+	submesh.lods = MeshSimplifier::buildLods(mesh, params.lods);
+	if (params.meshlets)
+	{
+		for (const MeshLod& lod : submesh.lods.levels)
+		{
+			const std::vector<uint32_t> indices(submesh.lods.indices.begin() + lod.indexOffset,
+				submesh.lods.indices.begin() + lod.indexOffset + lod.indexCount);
+			submesh.meshlets.push_back(MeshletBuilder::build(indices, mesh.streams.positions, params.meshlet));
+		}
+	}
+	cooked.vertices = MeshImporter::pack(mesh, params.position);
+
+	const std::string containerPath = cookedPath(path);
+	if (!MeshContainer::write(containerPath, cooked, params.compression, sourceSize, sourceTime, sourceHash, cookKey(params)))
+	{
+		std::cerr << "MeshCooker: could not write " << containerPath << std::endl;
+		return false;
+	}
+	return true;
+}
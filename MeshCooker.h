@@ -0,0 +1,66 @@
+#pragma once
+#include "MeshContainer.h"
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <string>
+
+struct MeshCookParams
+{
+	MeshImportParams import;
+	bool tangents = true; // for meshes with texture coordinates
+	MeshOptimizeParams optimize;
+	LodParams lods;
+	bool meshlets = true;
+	MeshletParams meshlet;
+	VertexEncoding position = VertexEncoding::Snorm16x3;
+	MeshCompression compression = MeshCompression::Codec;
+};
+
+// Turns an OBJ or PLY file into a MeshContainer next to it, <path>.omesh, and
+// opens that on later runs instead: import, tangents, MeshOptimizer, a LOD
+// chain, meshlets per level and compression all happen once. A container is
+// reused when its cook key matches the parameters and the source has the size
+// and time it was cooked from; a source whose time changed but whose bytes
+// hash the same is still a match, and the container is updated with the new
+// size and time so later loads need no hash. A missing source leaves whatever
+// container there is.
+class MeshCooker
+{
+public:
+	struct Stats
+	{
+		bool cooked = false;      // the container was (re)written
+		bool hashChecked = false; // size or time differed and the source was hashed
+		size_t sourceBytes = 0, containerBytes = 0;
+		double checkMs = 0, cookMs = 0, openMs = 0;
+	};
+
+	explicit MeshCooker(ThreadPool& pool = ThreadPool::shared());
+
+	MeshCooker(MeshCooker const&) = delete;
+	void operator=(MeshCooker const&) = delete;
+
+	// Opens the current container for path, cooking it first if needed.
+	// Returns false, with the reason on std::cerr, if neither works.
+	bool load(const std::string& path, MeshContainer& container, const MeshCookParams& params = MeshCookParams());
+
+	// Of the last load.
+	const Stats& stats() const { return mStats; }
+
+	static std::string cookedPath(const std::string& path) { return path + ".omesh"; }
+	// hash64 of everything in params and of the cooker's own version.
+	static uint64_t cookKey(const MeshCookParams& params);
+
+private:
+	bool mCook(const std::string& path, const MeshCookParams& params, uint64_t sourceSize, uint64_t sourceTime,
+		uint64_t sourceHash);
+
+private:
+	ThreadPool& mPool;
+	Stats mStats;
+};
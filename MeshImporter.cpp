@@ -0,0 +1,1033 @@
+#include "MeshImporter.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double elapsedMs(Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	}
+
+	const int32_t kMissing = -1;
+	// Negative OBJ indices count back from the element read last, so until a
+	// chunk knows how many elements came before it they are kept chunk local
+	// and offset by this bias, far below any other stored value.
+	const int32_t kRelativeBias = 1 << 30;
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline const char* skipSpaces(const char* p, const char* end)
+	{
+		while (p < end && isSpace(*p))
+			++p;
+		return p;
+	}
+
+	inline const char* lineEnd(const char* p, const char* end)
+	{
+		const char* found = (const char*)memchr(p, '\n', end - p);
+		return found ? found : end;
+	}
+
+	// Decimal floats as OBJ and PLY write them. The first 19 significant
+	// digits are kept exactly and scaled once, which rounds to within an ulp of
+	// the nearest float and runs several times faster than strtod.
+	bool parseFloat(const char*& p, const char* end, float& value)
+	{
+		static const double kPowers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		const char* s = skipSpaces(p, end);
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+			negative = *s++ == '-';
+		uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false;
+		for (; s < end && isDigit(*s); ++s, any = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*s - '0');
+				digits += mantissa != 0;
+			}
+			else
+			{
+				++exponent;
+			}
+		}
+		if (s < end && *s == '.')
+		{
+			for (++s; s < end && isDigit(*s); ++s, any = true)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*s - '0');
+					digits += mantissa != 0;
+					--exponent;
+				}
+			}
+		}
+		if (!any)
+			return false;
+		if (s + 1 < end && (*s == 'e' || *s == 'E'))
+		{
+			const char* e = s + 1;
+			bool negativeExponent = false;
+			if (*e == '-' || *e == '+')
+				negativeExponent = *e++ == '-';
+			if (e < end && isDigit(*e))
+			{
+				int written = 0;
+				for (; e < end && isDigit(*e); ++e)
+					written = std::min(written * 10 + (*e - '0'), 100000);
+				exponent += negativeExponent ? -written : written;
+				s = e;
+			}
+		}
+
+		double result = (double)mantissa;
+		if (exponent >= -22 && exponent <= 22)
+			result = exponent < 0 ? result / kPowers[-exponent] : result * kPowers[exponent];
+		else
+			result *= std::pow(10.0, exponent);
+		value = (float)(negative ? -result : result);
+		p = s;
+		return true;
+	}
+
+	bool parseInt(const char*& p, const char* end, int64_t& value)
+	{
+		const char* s = skipSpaces(p, end);
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+			negative = *s++ == '-';
+		if (s >= end || !isDigit(*s))
+			return false;
+		int64_t result = 0;
+		for (; s < end && isDigit(*s); ++s)
+			result = std::min<int64_t>(result * 10 + (*s - '0'), INT32_MAX);
+		value = negative ? -result : result;
+		p = s;
+		return true;
+	}
+
+	// Corner indices are (position, texcoord, normal) triples.
+	inline uint64_t cornerHash(const int32_t* corner)
+	{
+		uint64_t h = (uint64_t)(uint32_t)corner[0] * 0x9E3779B97F4A7C15ull;
+		h ^= ((uint64_t)(uint32_t)corner[1] << 32 | (uint32_t)corner[2]) * 0xC2B2AE3D27D4EB4Full;
+		h ^= h >> 29;
+		h *= 0xBF58476D1CE4E5B9ull;
+		return h ^ h >> 32;
+	}
+
+	size_t nextPowerOfTwo(size_t value)
+	{
+		size_t power = 1;
+		while (power < value)
+			power <<= 1;
+		return power;
+	}
+
+	struct ObjChunk
+	{
+		std::vector<glm::vec3> positions, normals;
+		std::vector<glm::vec2> texCoords;
+		std::vector<int32_t> corners;
+		size_t skippedLines = 0;
+	};
+
+	// OBJ indices are 1 based; 0 is not a valid index.
+	inline bool objIndex(int64_t index, size_t localCount, int32_t& stored)
+	{
+		if (index > 0)
+			stored = (int32_t)(index - 1);
+		else if (index < 0)
+			stored = (int32_t)((int64_t)localCount + index) - kRelativeBias;
+		else
+			return false;
+		return true;
+	}
+
+	bool parseObjFace(const char* p, const char* end, ObjChunk& chunk, std::vector<int32_t>& polygon)
+	{
+		polygon.clear();
+		for (p = skipSpaces(p, end); p < end; p = skipSpaces(p, end))
+		{
+			int32_t corner[3] = { kMissing, kMissing, kMissing };
+			int64_t index;
+			if (!parseInt(p, end, index) || !objIndex(index, chunk.positions.size(), corner[0]))
+				return false;
+			if (p < end && *p == '/')
+			{
+				++p;
+				if (p < end && *p != '/' && (!parseInt(p, end, index) || !objIndex(index, chunk.texCoords.size(), corner[1])))
+					return false;
+				if (p < end && *p == '/')
+				{
+					++p;
+					if (!parseInt(p, end, index) || !objIndex(index, chunk.normals.size(), corner[2]))
+						return false;
+				}
+			}
+			if (p < end && !isSpace(*p))
+				return false;
+			polygon.insert(polygon.end(), corner, corner + 3);
+		}
+		const size_t count = polygon.size() / 3;
+		if (count < 3)
+			return false;
+		for (size_t i = 1; i + 1 < count; ++i)
+		{
+			chunk.corners.insert(chunk.corners.end(), polygon.begin(), polygon.begin() + 3);
+			chunk.corners.insert(chunk.corners.end(), polygon.begin() + i * 3, polygon.begin() + i * 3 + 6);
+		}
+		return true;
+	}
+
+	void parseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+	{
+		std::vector<int32_t> polygon;
+		while (p < end)
+		{
+			const char* line = skipSpaces(p, end);
+			const char* stop = lineEnd(line, end);
+			p = stop + 1;
+			const size_t length = stop - line;
+			bool ok = true;
+			if (length > 2 && line[0] == 'v' && isSpace(line[1]))
+			{
+				glm::vec3 v;
+				const char* s = line + 2;
+				ok = parseFloat(s, stop, v.x) && parseFloat(s, stop, v.y) && parseFloat(s, stop, v.z);
+				if (ok)
+					chunk.positions.push_back(v);
+			}
+			else if (length > 3 && line[0] == 'v' && line[1] == 't' && isSpace(line[2]))
+			{
+				glm::vec2 t(0.f);
+				const char* s = line + 3;
+				ok = parseFloat(s, stop, t.x);
+				parseFloat(s, stop, t.y);
+				if (ok)
+					chunk.texCoords.push_back(t);
+			}
+			else if (length > 3 && line[0] == 'v' && line[1] == 'n' && isSpace(line[2]))
+			{
+				glm::vec3 n;
+				const char* s = line + 3;
+				ok = parseFloat(s, stop, n.x) && parseFloat(s, stop, n.y) && parseFloat(s, stop, n.z);
+				if (ok)
+					chunk.normals.push_back(n);
+			}
+			else if (length > 2 && line[0] == 'f' && isSpace(line[1]))
+			{
+				ok = parseObjFace(line + 2, stop, chunk, polygon);
+			}
+			// Comments, groups, materials, lines and points are skipped.
+			chunk.skippedLines += !ok;
+		}
+	}
+
+	// Turns a chunk local relative index into an absolute one and checks it.
+	inline bool resolve(int32_t& index, size_t base, size_t total, bool required)
+	{
+		if (index < -(kRelativeBias >> 1))
+			index = (int32_t)(index + kRelativeBias + (int64_t)base);
+		else if (index == kMissing)
+			return !required;
+		return index >= 0 && (size_t)index < total;
+	}
+
+	enum class PlyType
+	{
+		Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid
+	};
+
+	PlyType plyType(const std::string& name)
+	{
+		if (name == "char" || name == "int8") return PlyType::Int8;
+		if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+		if (name == "short" || name == "int16") return PlyType::Int16;
+		if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+		if (name == "int" || name == "int32") return PlyType::Int32;
+		if (name == "uint" || name == "uint32") return PlyType::UInt32;
+		if (name == "float" || name == "float32") return PlyType::Float32;
+		if (name == "double" || name == "float64") return PlyType::Float64;
+		return PlyType::Invalid;
+	}
+
+	size_t plyTypeBytes(PlyType type)
+	{
+		switch (type)
+		{
+		case PlyType::Int8:
+		case PlyType::UInt8: return 1;
+		case PlyType::Int16:
+		case PlyType::UInt16: return 2;
+		case PlyType::Float64: return 8;
+		default: return 4;
+		}
+	}
+
+	double readPly(PlyType type, const unsigned char* p, bool bigEndian)
+	{
+		unsigned char bytes[8];
+		const size_t size = plyTypeBytes(type);
+		for (size_t i = 0; i < size; ++i)
+			bytes[i] = p[bigEndian ? size - 1 - i : i];
+		switch (type)
+		{
+		case PlyType::Int8: return (int8_t)bytes[0];
+		case PlyType::UInt8: return bytes[0];
+		case PlyType::Int16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+		case PlyType::UInt16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+		case PlyType::Int32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+		case PlyType::UInt32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+		case PlyType::Float32: { float v; memcpy(&v, bytes, 4); return v; }
+		default: { double v; memcpy(&v, bytes, 8); return v; }
+		}
+	}
+
+	struct PlyProperty
+	{
+		std::string name;
+		PlyType type = PlyType::Invalid;
+		bool list = false;
+		PlyType countType = PlyType::Invalid;
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		size_t count = 0;
+		std::vector<PlyProperty> properties;
+
+		bool hasList() const
+		{
+			for (const PlyProperty& property : properties)
+			{
+				if (property.list)
+					return true;
+			}
+			return false;
+		}
+
+		size_t fixedBytes() const
+		{
+			size_t bytes = 0;
+			for (const PlyProperty& property : properties)
+				bytes += plyTypeBytes(property.type);
+			return bytes;
+		}
+	};
+
+	// Which vertex property feeds which attribute component, -1 for none.
+	struct PlyVertexMap
+	{
+		int position[3] = { -1, -1, -1 };
+		int normal[3] = { -1, -1, -1 };
+		int texCoord[2] = { -1, -1 };
+
+		explicit PlyVertexMap(const PlyElement& vertex)
+		{
+			for (size_t i = 0; i < vertex.properties.size(); ++i)
+			{
+				const std::string& name = vertex.properties[i].name;
+				const int index = (int)i;
+				if (name == "x") position[0] = index;
+				else if (name == "y") position[1] = index;
+				else if (name == "z") position[2] = index;
+				else if (name == "nx") normal[0] = index;
+				else if (name == "ny") normal[1] = index;
+				else if (name == "nz") normal[2] = index;
+				else if (name == "u" || name == "s" || name == "texture_u" || name == "texture_s") texCoord[0] = index;
+				else if (name == "v" || name == "t" || name == "texture_v" || name == "texture_t") texCoord[1] = index;
+			}
+		}
+
+		bool hasNormals() const { return normal[0] >= 0 && normal[1] >= 0 && normal[2] >= 0; }
+		bool hasTexCoords() const { return texCoord[0] >= 0 && texCoord[1] >= 0; }
+
+		void store(const double* values, size_t vertex, VertexStreams& streams) const
+		{
+			streams.positions[vertex] = glm::vec3((float)values[position[0]], (float)values[position[1]], (float)values[position[2]]);
+			if (hasNormals())
+				streams.normals[vertex] = glm::vec3((float)values[normal[0]], (float)values[normal[1]], (float)values[normal[2]]);
+			if (hasTexCoords())
+				streams.texCoords[vertex] = glm::vec2((float)values[texCoord[0]], (float)values[texCoord[1]]);
+		}
+	};
+
+	bool isFaceIndexList(const PlyProperty& property)
+	{
+		return property.list && (property.name == "vertex_indices" || property.name == "vertex_index");
+	}
+
+	void fanTriangulate(const std::vector<uint32_t>& polygon, std::vector<uint32_t>& indices)
+	{
+		for (size_t i = 1; i + 1 < polygon.size(); ++i)
+		{
+			indices.push_back(polygon[0]);
+			indices.push_back(polygon[i]);
+			indices.push_back(polygon[i + 1]);
+		}
+	}
+}
+
+MeshImporter::MeshImporter(ThreadPool& pool)
+	: mPool(pool)
+{
+}
+
+bool MeshImporter::load(const std::string& path, Mesh& mesh, const MeshImportParams& params)
+{
+	const size_t dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+	if (extension != "obj" && extension != "ply")
+	{
+		std::cerr << "MeshImporter: unsupported file type " << path << std::endl;
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(path))
+	{
+		std::cerr << "MeshImporter: cannot open " << path << std::endl;
+		return false;
+	}
+	file.prefetch(0, file.size());
+	const char* data = (const char*)file.data();
+	const bool loaded = extension == "obj" ? loadObj(data, file.size(), mesh, params) : loadPly(data, file.size(), mesh, params);
+	if (!loaded)
+		std::cerr << "MeshImporter: failed to load " << path << std::endl;
+	return loaded;
+}
+
+std::vector<std::pair<size_t, size_t>> MeshImporter::mSplitLines(const char* data, size_t begin, size_t end, size_t chunkBytes) const
+{
+	std::vector<std::pair<size_t, size_t>> ranges;
+	while (begin < end)
+	{
+		size_t split = std::min(end, begin + std::max<size_t>(chunkBytes, 1));
+		if (split < end)
+		{
+			const char* newline = (const char*)memchr(data + split, '\n', end - split);
+			split = newline ? (size_t)(newline - data) + 1 : end;
+		}
+		ranges.push_back(std::make_pair(begin, split));
+		begin = split;
+	}
+	return ranges;
+}
+
+bool MeshImporter::loadObj(const char* data, size_t size, Mesh& mesh, const MeshImportParams& params)
+{
+	mStats = Stats();
+	mStats.fileBytes = size;
+	mesh = Mesh();
+	const auto start = Clock::now();
+
+	auto stepStart = Clock::now();
+	const auto ranges = mSplitLines(data, 0, size, params.chunkBytes);
+	std::vector<ObjChunk> chunks(ranges.size());
+	mPool.parallelFor(ranges.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			parseObjChunk(data + ranges[i].first, data + ranges[i].second, chunks[i]);
+	});
+	mStats.chunks = chunks.size();
+	mStats.parseMs = elapsedMs(stepStart);
+
+	// Each chunk's elements start where the previous chunks' end, which is all
+	// relative indices need to become absolute.
+	stepStart = Clock::now();
+	std::vector<size_t> positionBase(chunks.size() + 1, 0), texCoordBase(chunks.size() + 1, 0);
+	std::vector<size_t> normalBase(chunks.size() + 1, 0), cornerBase(chunks.size() + 1, 0);
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+		texCoordBase[i + 1] = texCoordBase[i] + chunks[i].texCoords.size();
+		normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+		cornerBase[i + 1] = cornerBase[i] + chunks[i].corners.size();
+		mStats.skippedLines += chunks[i].skippedLines;
+	}
+	std::vector<glm::vec3> positions(positionBase.back()), normals(normalBase.back());
+	std::vector<glm::vec2> texCoords(texCoordBase.back());
+	std::vector<int32_t> corners(cornerBase.back());
+	std::atomic<size_t> badCorners(0);
+	mPool.parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+		{
+			ObjChunk& chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionBase[i]);
+			std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + texCoordBase[i]);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalBase[i]);
+			size_t bad = 0;
+			for (size_t c = 0; c < chunk.corners.size(); c += 3)
+			{
+				int32_t* corner = &chunk.corners[c];
+				bad += !resolve(corner[0], positionBase[i], positions.size(), true);
+				bad += !resolve(corner[1], texCoordBase[i], texCoords.size(), false);
+				bad += !resolve(corner[2], normalBase[i], normals.size(), false);
+			}
+			std::copy(chunk.corners.begin(), chunk.corners.end(), corners.begin() + cornerBase[i]);
+			badCorners += bad;
+			chunk = ObjChunk();
+		}
+	});
+	chunks.clear();
+	mStats.mergeMs = elapsedMs(stepStart);
+	if (badCorners)
+	{
+		std::cerr << "MeshImporter: " << badCorners << " face indices out of range" << std::endl;
+		return false;
+	}
+	if (corners.empty())
+	{
+		std::cerr << "MeshImporter: no faces" << std::endl;
+		return false;
+	}
+
+	stepStart = Clock::now();
+	std::vector<int32_t> vertexPositions;
+	mDeduplicate(corners, positions, texCoords, normals, params.deduplicate, mesh, vertexPositions);
+	mStats.corners = corners.size() / 3;
+	mStats.dedupMs = elapsedMs(stepStart);
+
+	if (mesh.streams.normals.empty() && params.generateNormals)
+	{
+		stepStart = Clock::now();
+		mGenerateNormals(mesh, vertexPositions, positions.size());
+		mStats.normalsMs = elapsedMs(stepStart);
+	}
+	mStats.vertices = mesh.streams.count();
+	mStats.triangles = mesh.triangleCount();
+	mStats.totalMs = elapsedMs(start);
+	return true;
+}
+
+void MeshImporter::mDeduplicate(const std::vector<int32_t>& corners, const std::vector<glm::vec3>& positions,
+	const std::vector<glm::vec2>& texCoords, const std::vector<glm::vec3>& normals, bool deduplicate, Mesh& mesh,
+	std::vector<int32_t>& vertexPositions)
+{
+	const size_t count = corners.size() / 3;
+	const size_t kBlock = 1 << 16;
+	const size_t blocks = (count + kBlock - 1) / kBlock;
+
+	// owner[i] is the first corner with the same indices as corner i.
+	std::vector<uint32_t> owner(count);
+	std::vector<uint32_t> scratch(count);
+	if (!deduplicate)
+	{
+		for (size_t i = 0; i < count; ++i)
+			owner[i] = (uint32_t)i;
+	}
+	else
+	{
+		// Partition corner numbers by the top bits of their hash. Keeping each
+		// block's corners in order keeps each partition in corner order, so
+		// the first corner a partition sees for a key is the first overall.
+		// Enough partitions to balance the pool and to keep each table small
+		// enough to stay in cache.
+		int shardBits = 2;
+		while (((size_t)1 << shardBits) < std::max<size_t>(mPool.size() * 4, count >> 14) && shardBits < 12)
+			++shardBits;
+		const size_t shards = (size_t)1 << shardBits;
+		auto shardOf = [&](size_t corner) { return (size_t)(cornerHash(&corners[corner * 3]) >> (64 - shardBits)); };
+
+		std::vector<size_t> offsets(blocks * shards, 0);
+		mPool.parallelFor(blocks, 1, [&](size_t begin, size_t end) {
+			for (size_t b = begin; b < end; ++b)
+			{
+				for (size_t i = b * kBlock; i < std::min(count, (b + 1) * kBlock); ++i)
+					++offsets[b * shards + shardOf(i)];
+			}
+		});
+		std::vector<size_t> shardBegin(shards + 1, 0);
+		size_t running = 0;
+		for (size_t s = 0; s < shards; ++s)
+		{
+			shardBegin[s] = running;
+			for (size_t b = 0; b < blocks; ++b)
+			{
+				const size_t blockCount = offsets[b * shards + s];
+				offsets[b * shards + s] = running;
+				running += blockCount;
+			}
+		}
+		shardBegin[shards] = running;
+		std::vector<uint32_t>& order = scratch;
+		mPool.parallelFor(blocks, 1, [&](size_t begin, size_t end) {
+			for (size_t b = begin; b < end; ++b)
+			{
+				size_t* next = &offsets[b * shards];
+				for (size_t i = b * kBlock; i < std::min(count, (b + 1) * kBlock); ++i)
+					order[next[shardOf(i)]++] = (uint32_t)i;
+			}
+		});
+
+		struct Slot
+		{
+			int32_t position, texCoord, normal;
+			uint32_t first;
+		};
+		mPool.parallelFor(shards, 1, [&](size_t begin, size_t end) {
+			std::vector<Slot> table;
+			for (size_t s = begin; s < end; ++s)
+			{
+				const size_t size = nextPowerOfTwo(std::max<size_t>(16, (shardBegin[s + 1] - shardBegin[s]) * 2));
+				const size_t mask = size - 1;
+				table.assign(size, Slot{ -1, -1, -1, 0 });
+				for (size_t k = shardBegin[s]; k < shardBegin[s + 1]; ++k)
+				{
+					const uint32_t i = order[k];
+					const int32_t* corner = &corners[(size_t)i * 3];
+					size_t slot = cornerHash(corner) & mask;
+					while (true)
+					{
+						Slot& entry = table[slot];
+						if (entry.position < 0)
+						{
+							entry = Slot{ corner[0], corner[1], corner[2], i };
+							owner[i] = i;
+							break;
+						}
+						if (entry.position == corner[0] && entry.texCoord == corner[1] && entry.normal == corner[2])
+						{
+							owner[i] = entry.first;
+							break;
+						}
+						slot = (slot + 1) & mask;
+					}
+				}
+			}
+		});
+	}
+
+	// Number the first corners in corner order, which is the order vertices
+	// are first used in.
+	std::vector<size_t> blockVertices(blocks + 1, 0);
+	mPool.parallelFor(blocks, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b)
+		{
+			for (size_t i = b * kBlock; i < std::min(count, (b + 1) * kBlock); ++i)
+				blockVertices[b + 1] += owner[i] == i;
+		}
+	});
+	for (size_t b = 0; b < blocks; ++b)
+		blockVertices[b + 1] += blockVertices[b];
+	const size_t vertexCount = blockVertices[blocks];
+
+	VertexStreams& streams = mesh.streams;
+	streams.positions.resize(vertexCount);
+	if (!texCoords.empty())
+		streams.texCoords.resize(vertexCount);
+	if (!normals.empty())
+		streams.normals.resize(vertexCount);
+	vertexPositions.resize(vertexCount);
+	std::vector<uint32_t>& vertexOf = scratch;
+	mPool.parallelFor(blocks, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b)
+		{
+			size_t vertex = blockVertices[b];
+			for (size_t i = b * kBlock; i < std::min(count, (b + 1) * kBlock); ++i)
+			{
+				if (owner[i] != i)
+					continue;
+				const int32_t* corner = &corners[i * 3];
+				streams.positions[vertex] = positions[corner[0]];
+				if (!texCoords.empty())
+					streams.texCoords[vertex] = corner[1] >= 0 ? texCoords[corner[1]] : glm::vec2(0.f);
+				if (!normals.empty())
+					streams.normals[vertex] = corner[2] >= 0 ? normals[corner[2]] : glm::vec3(0.f, 0.f, 1.f);
+				vertexPositions[vertex] = corner[0];
+				vertexOf[i] = (uint32_t)vertex++;
+			}
+		}
+	});
+
+	mesh.indices.resize(count);
+	mPool.parallelFor(count, kBlock, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			mesh.indices[i] = vertexOf[owner[i]];
+	});
+}
+
+void MeshImporter::mGenerateNormals(Mesh& mesh, const std::vector<int32_t>& vertexPositions, size_t positionCount)
+{
+	// Accumulated per source position rather than per vertex, so vertices
+	// split only by a texture seam still share one smooth normal. The sum is a
+	// single pass over the triangles; only the normalization is parallel.
+	const VertexStreams& streams = mesh.streams;
+	std::vector<glm::vec3> sums(positionCount, glm::vec3(0.f));
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+		const glm::vec3 area = glm::cross(streams.positions[b] - streams.positions[a], streams.positions[c] - streams.positions[a]);
+		sums[vertexPositions[a]] += area;
+		sums[vertexPositions[b]] += area;
+		sums[vertexPositions[c]] += area;
+	}
+	mesh.streams.normals.resize(streams.count());
+	mPool.parallelFor(streams.count(), 1 << 16, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; ++v)
+		{
+			const glm::vec3& sum = sums[vertexPositions[v]];
+			const float length = glm::length(sum);
+			mesh.streams.normals[v] = length > 0.f ? sum / length : glm::vec3(0.f, 0.f, 1.f);
+		}
+	});
+}
+
+bool MeshImporter::loadPly(const char* data, size_t size, Mesh& mesh, const MeshImportParams& params)
+{
+	mStats = Stats();
+	mStats.fileBytes = size;
+	mesh = Mesh();
+	const auto start = Clock::now();
+
+	// Header: one keyword line at a time up to end_header.
+	const char* end = data + size;
+	const char* p = data;
+	std::vector<PlyElement> elements;
+	bool ascii = false, bigEndian = false, header = false, sawFormat = false;
+	if (size < 4 || memcmp(data, "ply", 3) != 0)
+	{
+		std::cerr << "MeshImporter: not a PLY file" << std::endl;
+		return false;
+	}
+	while (p < end && !header)
+	{
+		const char* stop = lineEnd(p, end);
+		std::string line(p, stop);
+		p = stop + 1;
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		std::vector<std::string> words;
+		for (size_t i = 0; i < line.size();)
+		{
+			const size_t next = line.find(' ', i);
+			const size_t wordEnd = next == std::string::npos ? line.size() : next;
+			if (wordEnd > i)
+				words.push_back(line.substr(i, wordEnd - i));
+			i = wordEnd + 1;
+		}
+		if (words.empty())
+			continue;
+		if (words[0] == "format" && words.size() >= 2)
+		{
+			sawFormat = true;
+			ascii = words[1] == "ascii";
+			bigEndian = words[1] == "binary_big_endian";
+			if (!ascii && !bigEndian && words[1] != "binary_little_endian")
+				sawFormat = false;
+		}
+		else if (words[0] == "element" && words.size() >= 3)
+		{
+			PlyElement element;
+			element.name = words[1];
+			element.count = (size_t)std::stoull(words[2]);
+			elements.push_back(element);
+		}
+		else if (words[0] == "property" && !elements.empty())
+		{
+			PlyProperty property;
+			if (words.size() >= 5 && words[1] == "list")
+			{
+				property.list = true;
+				property.countType = plyType(words[2]);
+				property.type = plyType(words[3]);
+				property.name = words[4];
+			}
+			else if (words.size() >= 3)
+			{
+				property.type = plyType(words[1]);
+				property.name = words[2];
+			}
+			if (property.type == PlyType::Invalid || (property.list && property.countType == PlyType::Invalid))
+			{
+				std::cerr << "MeshImporter: unknown PLY property type in \"" << line << "\"" << std::endl;
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+		else if (words[0] == "end_header")
+		{
+			header = true;
+		}
+	}
+	if (!header || !sawFormat)
+	{
+		std::cerr << "MeshImporter: PLY header is incomplete or has an unknown format" << std::endl;
+		return false;
+	}
+
+	const PlyElement* vertexElement = nullptr;
+	const PlyElement* faceElement = nullptr;
+	for (const PlyElement& element : elements)
+	{
+		if (element.name == "vertex")
+			vertexElement = &element;
+		else if (element.name == "face")
+			faceElement = &element;
+	}
+	if (!vertexElement || !faceElement || vertexElement->hasList())
+	{
+		std::cerr << "MeshImporter: PLY needs a vertex element without lists and a face element" << std::endl;
+		return false;
+	}
+	const PlyVertexMap map(*vertexElement);
+	if (map.position[0] < 0 || map.position[1] < 0 || map.position[2] < 0)
+	{
+		std::cerr << "MeshImporter: PLY vertices have no x, y and z" << std::endl;
+		return false;
+	}
+
+	VertexStreams& streams = mesh.streams;
+	const size_t vertexCount = vertexElement->count;
+	streams.positions.resize(vertexCount);
+	if (map.hasNormals())
+		streams.normals.resize(vertexCount);
+	if (map.hasTexCoords())
+		streams.texCoords.resize(vertexCount);
+
+	auto stepStart = Clock::now();
+	size_t offset = p - data;
+	bool ok = true;
+	for (const PlyElement& element : elements)
+	{
+		if (!ok)
+			break;
+		const size_t propertyCount = element.properties.size();
+		if (ascii)
+		{
+			// Find where the element's lines end, then parse them in chunks.
+			size_t elementEnd = offset;
+			for (size_t line = 0; line < element.count && elementEnd < size; ++line)
+				elementEnd = (size_t)(lineEnd(data + elementEnd, end) - data) + 1;
+			elementEnd = std::min(elementEnd, size);
+			const auto ranges = mSplitLines(data, offset, elementEnd, params.chunkBytes);
+			mStats.chunks += ranges.size();
+			offset = elementEnd;
+			if (&element != vertexElement && &element != faceElement)
+				continue;
+
+			std::vector<size_t> lineCounts(ranges.size(), 0);
+			std::vector<std::vector<uint32_t>> faceIndices(ranges.size());
+			std::atomic<size_t> badLines(0);
+			auto parseRange = [&](size_t r, size_t firstVertex) {
+				std::vector<double> values(propertyCount);
+				std::vector<uint32_t> polygon;
+				const char* s = data + ranges[r].first;
+				const char* rangeEnd = data + ranges[r].second;
+				size_t lines = 0, bad = 0;
+				while (s < rangeEnd)
+				{
+					const char* stop = lineEnd(s, rangeEnd);
+					bool lineOk = true;
+					polygon.clear();
+					for (size_t i = 0; i < propertyCount && lineOk; ++i)
+					{
+						const PlyProperty& property = element.properties[i];
+						float value = 0;
+						if (!property.list)
+						{
+							lineOk = parseFloat(s, stop, value);
+							values[i] = value;
+							continue;
+						}
+						int64_t items = 0;
+						lineOk = parseInt(s, stop, items) && items >= 0;
+						for (int64_t item = 0; item < items && lineOk; ++item)
+						{
+							int64_t index = 0;
+							lineOk = parseInt(s, stop, index) && index >= 0 && (size_t)index < vertexCount;
+							if (isFaceIndexList(property))
+								polygon.push_back((uint32_t)index);
+						}
+					}
+					if (&element == vertexElement && firstVertex != SIZE_MAX)
+					{
+						if (lineOk)
+							map.store(values.data(), firstVertex + lines, streams);
+					}
+					else if (lineOk)
+					{
+						fanTriangulate(polygon, faceIndices[r]);
+					}
+					bad += !lineOk;
+					++lines;
+					s = stop + 1;
+				}
+				lineCounts[r] = lines;
+				badLines += bad;
+			};
+			if (&element == vertexElement)
+			{
+				// Chunks need the number of lines before them to know their
+				// first vertex, so count lines first.
+				mPool.parallelFor(ranges.size(), 1, [&](size_t begin, size_t endRange) {
+					for (size_t r = begin; r < endRange; ++r)
+						lineCounts[r] = std::count(data + ranges[r].first, data + ranges[r].second, '\n') +
+							(ranges[r].second == size && data[size - 1] != '\n');
+				});
+				std::vector<size_t> firstVertex(ranges.size() + 1, 0);
+				for (size_t r = 0; r < ranges.size(); ++r)
+					firstVertex[r + 1] = firstVertex[r] + lineCounts[r];
+				mPool.parallelFor(ranges.size(), 1, [&](size_t begin, size_t endRange) {
+					for (size_t r = begin; r < endRange; ++r)
+						parseRange(r, firstVertex[r]);
+				});
+			}
+			else
+			{
+				mPool.parallelFor(ranges.size(), 1, [&](size_t begin, size_t endRange) {
+					for (size_t r = begin; r < endRange; ++r)
+						parseRange(r, SIZE_MAX);
+				});
+				size_t total = 0;
+				for (const auto& indices : faceIndices)
+					total += indices.size();
+				mesh.indices.reserve(total);
+				for (auto& indices : faceIndices)
+				{
+					mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+					indices = std::vector<uint32_t>();
+				}
+			}
+			mStats.skippedLines += badLines;
+			continue;
+		}
+
+		// Binary. Elements of fixed size are read in parallel blocks;
+		// elements with lists have to be walked in order.
+		if (!element.hasList())
+		{
+			const size_t stride = element.fixedBytes();
+			if (offset + stride * element.count > size)
+			{
+				ok = false;
+				break;
+			}
+			if (&element == vertexElement)
+			{
+				std::vector<size_t> propertyOffsets(propertyCount, 0);
+				for (size_t i = 1; i < propertyCount; ++i)
+					propertyOffsets[i] = propertyOffsets[i - 1] + plyTypeBytes(element.properties[i - 1].type);
+				const unsigned char* base = (const unsigned char*)data + offset;
+				mPool.parallelFor(element.count, 1 << 16, [&](size_t begin, size_t endVertex) {
+					std::vector<double> values(propertyCount);
+					for (size_t v = begin; v < endVertex; ++v)
+					{
+						for (size_t i = 0; i < propertyCount; ++i)
+							values[i] = readPly(element.properties[i].type, base + v * stride + propertyOffsets[i], bigEndian);
+						map.store(values.data(), v, streams);
+					}
+				});
+				mStats.chunks += (element.count + (1 << 16) - 1) >> 16;
+			}
+			offset += stride * element.count;
+			continue;
+		}
+
+		std::vector<uint32_t> polygon;
+		const bool faces = &element == faceElement;
+		for (size_t e = 0; e < element.count && ok; ++e)
+		{
+			polygon.clear();
+			for (const PlyProperty& property : element.properties)
+			{
+				if (!property.list)
+				{
+					offset += plyTypeBytes(property.type);
+					continue;
+				}
+				const size_t countBytes = plyTypeBytes(property.countType), itemBytes = plyTypeBytes(property.type);
+				if (offset + countBytes > size)
+				{
+					ok = false;
+					break;
+				}
+				const double items = readPly(property.countType, (const unsigned char*)data + offset, bigEndian);
+				offset += countBytes;
+				if (items < 0 || offset + (size_t)items * itemBytes > size)
+				{
+					ok = false;
+					break;
+				}
+				if (faces && isFaceIndexList(property))
+				{
+					for (size_t item = 0; item < (size_t)items; ++item)
+					{
+						const double index = readPly(property.type, (const unsigned char*)data + offset + item * itemBytes, bigEndian);
+						ok = ok && index >= 0 && (size_t)index < vertexCount;
+						polygon.push_back((uint32_t)index);
+					}
+				}
+				offset += (size_t)items * itemBytes;
+			}
+			if (faces && ok)
+				fanTriangulate(polygon, mesh.indices);
+		}
+		if (offset > size)
+			ok = false;
+	}
+	mStats.parseMs = elapsedMs(stepStart);
+	if (!ok || mesh.indices.empty())
+	{
+		std::cerr << "MeshImporter: PLY body is truncated, has indices out of range or holds no faces" << std::endl;
+		return false;
+	}
+
+	mStats.corners = mesh.indices.size();
+	if (streams.normals.empty() && params.generateNormals)
+	{
+		stepStart = Clock::now();
+		std::vector<int32_t> identity(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+			identity[v] = (int32_t)v;
+		mGenerateNormals(mesh, identity, vertexCount);
+		mStats.normalsMs = elapsedMs(stepStart);
+	}
+	mStats.vertices = vertexCount;
+	mStats.triangles = mesh.triangleCount();
+	mStats.totalMs = elapsedMs(start);
+	return true;
+}
+
+PackedVertices MeshImporter::pack(const Mesh& mesh, VertexEncoding position)
+{
+	const VertexStreams& streams = mesh.streams;
+	VertexLayout layout;
+	layout.add(VertexSemantic::Position, position);
+	if (!streams.texCoords.empty())
+	{
+		bool unit = true;
+		for (const glm::vec2& t : streams.texCoords)
+			unit = unit && t.x >= 0.f && t.x <= 1.f && t.y >= 0.f && t.y <= 1.f;
+		layout.add(VertexSemantic::TexCoord, unit ? VertexEncoding::Unorm16x2 : VertexEncoding::Half2);
+	}
+	if (!streams.normals.empty())
+		layout.add(VertexSemantic::Normal, VertexEncoding::Snorm10x3);
+	if (!streams.tangents.empty())
+		layout.add(VertexSemantic::Tangent, VertexEncoding::Snorm10x3);
+	return VertexPacker::pack(streams, layout);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "ThreadPool.h"
+#include "VertexLayout.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MeshImportParams
+{
+	// Merge OBJ face corners with the same position, texcoord and normal
+	// indices into one vertex. Without it every corner is its own vertex.
+	bool deduplicate = true;
+	// Area weighted smooth normals for files that have none.
+	bool generateNormals = true;
+	// Files are parsed in chunks of about this many bytes, split at line ends.
+	size_t chunkBytes = 1 << 20;
+};
+
+// Indexed triangles in the renderer's vertex streams. Tangents are left empty;
+// TangentGenerator fills them.
+struct Mesh
+{
+	VertexStreams streams;
+	std::vector<uint32_t> indices;
+
+	size_t triangleCount() const { return indices.size() / 3; }
+};
+
+// Loads Wavefront OBJ and PLY (ASCII, binary little and big endian) meshes.
+// The file is mapped and cut into chunks at line boundaries that are parsed on
+// the thread pool, each into its own arrays; these are concatenated once every
+// chunk's counts are known, which is also when OBJ's relative (negative)
+// indices are resolved. OBJ corners are then deduplicated in parallel: corners
+// are partitioned by the hash of their index triple and each partition gets
+// its own open addressing table, so no locks are needed, and vertices are
+// numbered in order of first use. Polygons are fan triangulated. Materials,
+// groups and smoothing groups are ignored.
+class MeshImporter
+{
+public:
+	struct Stats
+	{
+		size_t fileBytes = 0;
+		size_t chunks = 0;
+		size_t corners = 0;  // face corners read, 3 per triangle
+		size_t vertices = 0; // after deduplication
+		size_t triangles = 0;
+		size_t skippedLines = 0;
+		double parseMs = 0, mergeMs = 0, dedupMs = 0, normalsMs = 0, totalMs = 0;
+	};
+
+	explicit MeshImporter(ThreadPool& pool = ThreadPool::shared());
+
+	MeshImporter(MeshImporter const&) = delete;
+	void operator=(MeshImporter const&) = delete;
+
+	// Picks the parser from the extension, .obj or .ply. Returns false, with
+	// the reason on std::cerr, if the file cannot be read or parsed.
+	bool load(const std::string& path, Mesh& mesh, const MeshImportParams& params = MeshImportParams());
+
+	// Parse files already in memory.
+	bool loadObj(const char* data, size_t size, Mesh& mesh, const MeshImportParams& params = MeshImportParams());
+	bool loadPly(const char* data, size_t size, Mesh& mesh, const MeshImportParams& params = MeshImportParams());
+
+	// Of the last load.
+	const Stats& stats() const { return mStats; }
+
+	// Packs a mesh in the compact layout for the streams it has; texture
+	// coordinates outside [0, 1] are stored as halves instead of unorm16.
+	static PackedVertices pack(const Mesh& mesh, VertexEncoding position = VertexEncoding::Snorm16x3);
+
+private:
+	std::vector<std::pair<size_t, size_t>> mSplitLines(const char* data, size_t begin, size_t end, size_t chunkBytes) const;
+	// corners holds position, texcoord and normal indices for each corner,
+	// -1 where the face gave none.
+	void mDeduplicate(const std::vector<int32_t>& corners, const std::vector<glm::vec3>& positions,
+		const std::vector<glm::vec2>& texCoords, const std::vector<glm::vec3>& normals, bool deduplicate, Mesh& mesh,
+		std::vector<int32_t>& vertexPositions);
+	void mGenerateNormals(Mesh& mesh, const std::vector<int32_t>& vertexPositions, size_t positionCount);
+
+private:
+	ThreadPool& mPool;
+	Stats mStats;
+};
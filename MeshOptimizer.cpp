@@ -0,0 +1,498 @@
+#include "MeshOptimizer.h"
+#include "glm/gtx/transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	// Triangles around each vertex, in compressed rows: the triangles of
+	// vertex v are triangles[offsets[v], offsets[v] + counts[v]).
+	struct Adjacency
+	{
+		std::vector<uint32_t> offsets, counts, triangles;
+
+		Adjacency(const std::vector<uint32_t>& indices, size_t vertexCount)
+			: offsets(vertexCount + 1, 0), counts(vertexCount, 0), triangles(indices.size())
+		{
+			for (uint32_t index : indices)
+				++counts[index];
+			for (size_t v = 0; v < vertexCount; ++v)
+				offsets[v + 1] = offsets[v] + counts[v];
+			std::fill(counts.begin(), counts.end(), 0);
+			for (size_t i = 0; i < indices.size(); ++i)
+				triangles[offsets[indices[i]] + counts[indices[i]]++] = (uint32_t)(i / 3);
+		}
+
+		// Removes one occurrence of triangle from vertex's list.
+		void remove(uint32_t vertex, uint32_t triangle)
+		{
+			uint32_t* begin = &triangles[offsets[vertex]];
+			uint32_t* end = begin + counts[vertex];
+			uint32_t* found = std::find(begin, end, triangle);
+			if (found != end)
+			{
+				*found = end[-1];
+				--counts[vertex];
+			}
+		}
+	};
+
+	void tipsify(std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize)
+	{
+		// Fans around one vertex at a time. The next fan centre is the
+		// candidate that is still in the cache and will stay there while its
+		// remaining triangles are emitted; failing that, a recently used vertex
+		// with triangles left, or the next such vertex in order.
+		const size_t triangleCount = indices.size() / 3;
+		const Adjacency adjacency(indices, vertexCount);
+		std::vector<uint32_t> live(adjacency.counts.begin(), adjacency.counts.end());
+		std::vector<size_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> deadEnd, candidates, result;
+		result.reserve(indices.size());
+		deadEnd.reserve(indices.size());
+		size_t time = cacheSize + 1, cursor = 0;
+
+		int64_t fan = 0;
+		while (fan < (int64_t)vertexCount && live[fan] == 0)
+			++fan;
+		while (fan >= 0 && fan < (int64_t)vertexCount)
+		{
+			candidates.clear();
+			const uint32_t* begin = &adjacency.triangles[adjacency.offsets[fan]];
+			for (const uint32_t* t = begin; t != begin + adjacency.counts[fan]; ++t)
+			{
+				if (emitted[*t])
+					continue;
+				emitted[*t] = true;
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					const uint32_t v = indices[*t * 3 + corner];
+					result.push_back(v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					--live[v];
+					if (time - cacheTime[v] > (size_t)cacheSize)
+						cacheTime[v] = time++;
+				}
+			}
+
+			int64_t next = -1, bestPriority = -1;
+			for (uint32_t v : candidates)
+			{
+				if (live[v] == 0)
+					continue;
+				int64_t priority = 0;
+				if ((int64_t)(time - cacheTime[v]) + 2 * (int64_t)live[v] <= cacheSize)
+					priority = (int64_t)(time - cacheTime[v]);
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					next = v;
+				}
+			}
+			while (next < 0 && !deadEnd.empty())
+			{
+				const uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					next = v;
+			}
+			while (next < 0 && cursor < vertexCount)
+			{
+				if (live[cursor] > 0)
+					next = (int64_t)cursor;
+				++cursor;
+			}
+			fan = next;
+		}
+		indices.swap(result);
+	}
+
+	// Forsyth's scoring: the three most recent vertices score a flat 0.75 so
+	// the next triangle does not just reuse the last one's edge, older cache
+	// entries score less the older they are, and vertices with few triangles
+	// left get a boost so they are finished off rather than left stranded.
+	const int kForsythCacheSize = 32;
+
+	float forsythScore(int cachePosition, uint32_t remaining)
+	{
+		if (remaining == 0)
+			return -1.f;
+		float score = 0.f;
+		if (cachePosition >= 0)
+		{
+			score = cachePosition < 3 ? 0.75f
+				: std::pow(1.f - (float)(cachePosition - 3) / (kForsythCacheSize - 3), 1.5f);
+		}
+		return score + 2.f / std::sqrt((float)remaining);
+	}
+
+	void forsyth(std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		Adjacency adjacency(indices, vertexCount);
+		std::vector<float> vertexScore(vertexCount);
+		std::vector<bool> emitted(triangleCount, false);
+		for (size_t v = 0; v < vertexCount; ++v)
+			vertexScore[v] = forsythScore(-1, adjacency.counts[v]);
+
+		std::vector<uint32_t> cache, nextCache, result;
+		result.reserve(indices.size());
+		size_t cursor = 0;
+		int64_t best = -1;
+		for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+		{
+			// Nothing in the cache has triangles left: take the next unused
+			// triangle in input order.
+			if (best < 0)
+			{
+				while (emitted[cursor])
+					++cursor;
+				best = (int64_t)cursor;
+			}
+			const uint32_t* triangle = &indices[best * 3];
+			emitted[best] = true;
+			result.insert(result.end(), triangle, triangle + 3);
+
+			// The triangle's vertices move to the front of the LRU cache.
+			nextCache.clear();
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				if (std::find(nextCache.begin(), nextCache.end(), triangle[corner]) == nextCache.end())
+					nextCache.push_back(triangle[corner]);
+			}
+			for (uint32_t v : cache)
+			{
+				if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+					nextCache.push_back(v);
+			}
+			for (int corner = 0; corner < 3; ++corner)
+				adjacency.remove(triangle[corner], (uint32_t)best);
+			for (size_t i = kForsythCacheSize; i < nextCache.size(); ++i)
+				vertexScore[nextCache[i]] = forsythScore(-1, adjacency.counts[nextCache[i]]);
+			if (nextCache.size() > (size_t)kForsythCacheSize)
+				nextCache.resize(kForsythCacheSize);
+			for (size_t i = 0; i < nextCache.size(); ++i)
+				vertexScore[nextCache[i]] = forsythScore((int)i, adjacency.counts[nextCache[i]]);
+			cache.swap(nextCache);
+
+			// Only triangles around cached vertices changed score; the rest are
+			// left for when the cache runs dry.
+			best = -1;
+			float bestScore = -1.f;
+			for (uint32_t v : cache)
+			{
+				const uint32_t* begin = &adjacency.triangles[adjacency.offsets[v]];
+				for (const uint32_t* t = begin; t != begin + adjacency.counts[v]; ++t)
+				{
+					const uint32_t* corners = &indices[*t * 3];
+					const float score = vertexScore[corners[0]] + vertexScore[corners[1]] + vertexScore[corners[2]];
+					if (score > bestScore)
+					{
+						bestScore = score;
+						best = *t;
+					}
+				}
+			}
+		}
+		indices.swap(result);
+	}
+
+	// Simulates a FIFO cache; returns whether the vertex had to be transformed.
+	struct FifoCache
+	{
+		std::vector<size_t> stamps;
+		size_t time, size;
+
+		FifoCache(size_t count, size_t cacheSize)
+			: stamps(count, 0), time(cacheSize + 1), size(cacheSize)
+		{
+		}
+
+		bool miss(size_t index)
+		{
+			if (time - stamps[index] <= size)
+				return false;
+			stamps[index] = time++;
+			return true;
+		}
+
+		// Everything cached so far is treated as evicted.
+		void flush() { time += size + 1; }
+	};
+
+	glm::vec3 triangleCross(const std::vector<glm::vec3>& positions, const uint32_t* corners)
+	{
+		const glm::vec3& a = positions[corners[0]];
+		return glm::cross(positions[corners[1]] - a, positions[corners[2]] - a);
+	}
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, const MeshOptimizeParams& params)
+{
+	if (indices.size() < 3)
+		return;
+	indices.resize(indices.size() / 3 * 3);
+	if (params.algorithm == VertexCacheAlgorithm::Forsyth)
+		forsyth(indices, vertexCount);
+	else
+		tipsify(indices, vertexCount, std::max(params.cacheSize, 3));
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+	const MeshOptimizeParams& params)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Hard boundaries: triangles that miss on all three vertices start afresh
+	// anyway, so moving what follows them costs nothing.
+	FifoCache cache(positions.size(), std::max(params.cacheSize, 3));
+	std::vector<int> misses(triangleCount);
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		misses[t] = 0;
+		for (int corner = 0; corner < 3; ++corner)
+			misses[t] += cache.miss(indices[t * 3 + corner]);
+		if (t == 0 || misses[t] == 3)
+			hard.push_back(t);
+	}
+	hard.push_back(triangleCount);
+
+	// Soft boundaries: within a hard cluster, cut as soon as the part since
+	// the last cut, drawn from a cold cache, is within the threshold of the
+	// whole cluster's ACMR.
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); ++h)
+	{
+		const size_t begin = hard[h], end = hard[h + 1];
+		size_t clusterMisses = 0;
+		for (size_t t = begin; t < end; ++t)
+			clusterMisses += misses[t];
+		const float limit = params.overdrawThreshold * clusterMisses / (float)(end - begin);
+
+		cache.flush();
+		size_t runMisses = 0, runStart = begin;
+		clusters.push_back(begin);
+		for (size_t t = begin; t < end; ++t)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+				runMisses += cache.miss(indices[t * 3 + corner]);
+			if (t + 1 < end && runMisses <= limit * (t + 1 - runStart))
+			{
+				clusters.push_back(t + 1);
+				runStart = t + 1;
+				runMisses = 0;
+				cache.flush();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// Outward facing clusters first: the key is how far the cluster's
+	// centroid lies along its own normal from the mesh's centroid.
+	glm::vec3 meshCentroid(0.f);
+	float meshArea = 0.f;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const uint32_t* corners = &indices[t * 3];
+		const float area = glm::length(triangleCross(positions, corners));
+		meshCentroid += (positions[corners[0]] + positions[corners[1]] + positions[corners[2]]) * (area / 3.f);
+		meshArea += area;
+	}
+	meshCentroid /= std::max(meshArea, std::numeric_limits<float>::min());
+
+	const size_t clusterCount = clusters.size() - 1;
+	std::vector<float> keys(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		glm::vec3 centroid(0.f), normal(0.f);
+		float area = 0.f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+		{
+			const uint32_t* corners = &indices[t * 3];
+			const glm::vec3 cross = triangleCross(positions, corners);
+			const float triangleArea = glm::length(cross);
+			centroid += (positions[corners[0]] + positions[corners[1]] + positions[corners[2]]) * (triangleArea / 3.f);
+			normal += cross;
+			area += triangleArea;
+		}
+		centroid /= std::max(area, std::numeric_limits<float>::min());
+		const float length = glm::length(normal);
+		keys[c] = length > 0.f ? glm::dot(centroid - meshCentroid, normal / length) : 0.f;
+	}
+	std::vector<uint32_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c)
+		order[c] = (uint32_t)c;
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (uint32_t c : order)
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<uint32_t>& indices, VertexStreams& streams)
+{
+	const size_t vertexCount = streams.count();
+	std::vector<uint32_t> remap(vertexCount, ~0u);
+	uint32_t next = 0;
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == ~0u)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	auto permute = [&](auto& stream) {
+		if (stream.empty())
+			return;
+		typename std::remove_reference<decltype(stream)>::type reordered(next);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			if (remap[v] != ~0u)
+				reordered[remap[v]] = stream[v];
+		}
+		stream.swap(reordered);
+	};
+	permute(streams.positions);
+	permute(streams.texCoords);
+	permute(streams.normals);
+	permute(streams.tangents);
+}
+
+void MeshOptimizer::optimize(Mesh& mesh, const MeshOptimizeParams& params)
+{
+	optimizeVertexCache(mesh.indices, mesh.streams.count(), params);
+	optimizeOverdraw(mesh.indices, mesh.streams.positions, params);
+	optimizeVertexFetch(mesh.indices, mesh.streams);
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize)
+{
+	VertexCacheStats stats;
+	FifoCache cache(vertexCount, std::max(cacheSize, 1));
+	std::vector<bool> referenced(vertexCount, false);
+	size_t referencedCount = 0;
+	for (uint32_t index : indices)
+	{
+		stats.transformed += cache.miss(index);
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			++referencedCount;
+		}
+	}
+	stats.acmr = indices.size() >= 3 ? stats.transformed / (float)(indices.size() / 3) : 0.f;
+	stats.atvr = referencedCount ? stats.transformed / (float)referencedCount : 0.f;
+	return stats;
+}
+
+OverdrawStats MeshOptimizer::analyzeOverdraw(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+	int resolution)
+{
+	OverdrawStats stats;
+	if (positions.empty() || indices.size() < 3 || resolution <= 0)
+		return stats;
+
+	// Views look down -z after the rotation, with counter-clockwise front
+	// faces, as GL draws by default.
+	const float halfPi = 1.57079633f;
+	const glm::mat4 views[] = {
+		glm::mat4(1.f),
+		glm::rotate(2.f * halfPi, glm::vec3(0, 1, 0)),
+		glm::rotate(halfPi, glm::vec3(0, 1, 0)),
+		glm::rotate(-halfPi, glm::vec3(0, 1, 0)),
+		glm::rotate(halfPi, glm::vec3(1, 0, 0)),
+		glm::rotate(-halfPi, glm::vec3(1, 0, 0))
+	};
+	std::vector<glm::vec3> projected(positions.size());
+	std::vector<float> depth((size_t)resolution * resolution);
+	for (const glm::mat4& view : views)
+	{
+		glm::vec3 low(std::numeric_limits<float>::max()), high(-std::numeric_limits<float>::max());
+		for (size_t v = 0; v < positions.size(); ++v)
+		{
+			projected[v] = glm::vec3(view * glm::vec4(positions[v], 1.f));
+			low = glm::min(low, projected[v]);
+			high = glm::max(high, projected[v]);
+		}
+		const float scale = resolution / std::max(std::max(high.x - low.x, high.y - low.y), std::numeric_limits<float>::min());
+		for (glm::vec3& p : projected)
+			p = glm::vec3((p.x - low.x) * scale, (p.y - low.y) * scale, -p.z);
+
+		std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const glm::vec3& a = projected[indices[i]];
+			const glm::vec3& b = projected[indices[i + 1]];
+			const glm::vec3& c = projected[indices[i + 2]];
+			const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (area <= 0.f)
+				continue; // back facing or degenerate
+			const int x0 = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+			const int x1 = std::min(resolution - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+			const int y0 = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+			const int y1 = std::min(resolution - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+			for (int y = y0; y <= y1; ++y)
+			{
+				const float py = y + 0.5f;
+				for (int x = x0; x <= x1; ++x)
+				{
+					const float px = x + 0.5f;
+					const float w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+					const float w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+					const float w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+					if (w0 < 0.f || w1 < 0.f || w2 < 0.f)
+						continue;
+					const float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+					float& stored = depth[(size_t)y * resolution + x];
+					if (z < stored)
+					{
+						stored = z;
+						++stats.shaded;
+					}
+				}
+			}
+		}
+		for (float d : depth)
+			stats.covered += d != std::numeric_limits<float>::max();
+	}
+	stats.overdraw = stats.covered ? stats.shaded / (float)stats.covered : 0.f;
+	return stats;
+}
+
+VertexFetchStats MeshOptimizer::analyzeVertexFetch(const std::vector<uint32_t>& indices, size_t vertexCount, size_t vertexBytes,
+	size_t cacheBytes)
+{
+	// Only vertices the post-transform cache misses are fetched.
+	const size_t kLineBytes = 64;
+	VertexFetchStats stats;
+	if (vertexBytes == 0 || vertexCount == 0)
+		return stats;
+	FifoCache vertexCache(vertexCount, 16);
+	FifoCache lines((vertexCount * vertexBytes + kLineBytes - 1) / kLineBytes, std::max<size_t>(cacheBytes / kLineBytes, 1));
+	std::vector<bool> referenced(vertexCount, false);
+	size_t referencedCount = 0;
+	for (uint32_t index : indices)
+	{
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			++referencedCount;
+		}
+		if (!vertexCache.miss(index))
+			continue;
+		const size_t first = index * vertexBytes / kLineBytes, last = ((size_t)index + 1) * vertexBytes - 1;
+		for (size_t line = first; line <= last / kLineBytes; ++line)
+			stats.bytesFetched += lines.miss(line) ? kLineBytes : 0;
+	}
+	stats.overfetch = referencedCount ? stats.bytesFetched / (float)(referencedCount * vertexBytes) : 0.f;
+	return stats;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "MeshImporter.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+enum class VertexCacheAlgorithm
+{
+	Tipsify, // Sander et al. 2007: linear time, tuned for a FIFO of a given size
+	Forsyth  // Forsyth 2006: greedy by vertex scores in a simulated LRU, slower, often a little better
+};
+
+struct MeshOptimizeParams
+{
+	VertexCacheAlgorithm algorithm = VertexCacheAlgorithm::Tipsify;
+	// Post-transform cache entries the order is tuned for. Forsyth's scores
+	// are defined for an LRU of 32 whatever this says.
+	int cacheSize = 16;
+	// How much ACMR the overdraw pass may give up to sort clusters front to
+	// back, as a ratio; 1 keeps the vertex cache order's clusters as they are.
+	float overdrawThreshold = 1.05f;
+};
+
+struct VertexCacheStats
+{
+	size_t transformed = 0; // vertex shader invocations
+	float acmr = 0;         // average cache miss ratio: transformed per triangle, 0.5 at best, 3 at worst
+	float atvr = 0;         // average transform to vertex ratio: transformed per referenced vertex, 1 at best
+};
+
+struct OverdrawStats
+{
+	size_t covered = 0; // pixels covered at the end, over all views
+	size_t shaded = 0;  // pixels that passed the depth test when drawn
+	float overdraw = 0; // shaded per covered, 1 at best
+};
+
+struct VertexFetchStats
+{
+	size_t bytesFetched = 0; // cache lines read, in bytes
+	float overfetch = 0;     // fetched per vertex byte, 1 at best
+};
+
+// Reorders index and vertex buffers for the GPU's fixed function stages, on
+// the CPU, for any indexed triangle list: mSetupBuffers' streams or what
+// MeshImporter produces. The passes are meant to run in order:
+//  1. optimizeVertexCache reorders triangles so vertices are reused while
+//     they are still in the post-transform cache;
+//  2. optimizeOverdraw splits that order into clusters that cost little
+//     cache efficiency and sorts the clusters so outward facing ones, which
+//     tend to occlude the rest, are drawn first;
+//  3. optimizeVertexFetch renumbers vertices in the order the indices first
+//     use them, so attribute fetches walk memory forwards.
+// The analyze functions measure each against a simulated GPU.
+class MeshOptimizer
+{
+public:
+	static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount,
+		const MeshOptimizeParams& params = MeshOptimizeParams());
+
+	static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		const MeshOptimizeParams& params = MeshOptimizeParams());
+
+	// Renumbers the vertices in first use order and drops unreferenced ones.
+	// Every stream in streams is permuted alike.
+	static void optimizeVertexFetch(std::vector<uint32_t>& indices, VertexStreams& streams);
+
+	// All three passes.
+	static void optimize(Mesh& mesh, const MeshOptimizeParams& params = MeshOptimizeParams());
+
+	// A FIFO post-transform cache of cacheSize entries.
+	static VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = 16);
+
+	// Rasterizes the mesh with depth test and back face culling, orthographic
+	// along the six axis directions at resolution x resolution each.
+	static OverdrawStats analyzeOverdraw(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		int resolution = 256);
+
+	// Vertices of vertexBytes each read through a FIFO of 64 byte lines
+	// holding cacheBytes.
+	static VertexFetchStats analyzeVertexFetch(const std::vector<uint32_t>& indices, size_t vertexCount, size_t vertexBytes,
+		size_t cacheBytes = 16 << 10);
+};
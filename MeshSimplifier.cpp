@@ -0,0 +1,612 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	const int kMaxAttributes = 5; // two texture coordinates and three normal components
+	// Open edges and seams are held in place by planes through them, at this
+	// weight against the surface's own planes.
+	const float kBoundaryWeight = 10.f;
+
+	// p'Ap + 2b'p + c for a symmetric A, with w the weight summed into it.
+	// Doubles, as the terms cancel: in float, errors below about 1e-4 of the
+	// mesh's size all come out as 0 and cannot be ranked.
+	struct Quadric
+	{
+		double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+		double b0 = 0, b1 = 0, b2 = 0, c = 0, w = 0;
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a11 += q.a11; a22 += q.a22; a01 += q.a01; a02 += q.a02; a12 += q.a12;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c; w += q.w;
+		}
+
+		// Squared distance to the plane dot(n, p) + d = 0; n has unit length
+		// for geometry and is an attribute gradient for attribute quadrics.
+		void addPlane(const glm::dvec3& n, double d, double weight)
+		{
+			a00 += weight * n.x * n.x; a11 += weight * n.y * n.y; a22 += weight * n.z * n.z;
+			a01 += weight * n.x * n.y; a02 += weight * n.x * n.z; a12 += weight * n.y * n.z;
+			b0 += weight * n.x * d; b1 += weight * n.y * d; b2 += weight * n.z * d;
+			c += weight * d * d;
+		}
+
+		double evaluate(const glm::dvec3& p) const
+		{
+			return a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+				+ 2.f * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+				+ 2.f * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+		}
+	};
+
+	// Over the triangles around one vertex of the buffer, the summed squared
+	// difference between each attribute s_k and its linear fit across the
+	// triangle, dot(g_k, p) + d_k:
+	//   quadric(p) - 2 sum_k s_k (dot(gradient_k, p) + offset_k) + w sum_k s_k^2
+	// where gradient_k and offset_k are the weighted sums of g_k and d_k.
+	struct AttributeQuadric
+	{
+		Quadric quadric;
+		glm::dvec3 gradient[kMaxAttributes];
+		double offset[kMaxAttributes];
+
+		AttributeQuadric()
+		{
+			for (int k = 0; k < kMaxAttributes; ++k)
+			{
+				gradient[k] = glm::dvec3(0.0);
+				offset[k] = 0.0;
+			}
+		}
+
+		void add(const AttributeQuadric& q, int count)
+		{
+			quadric.add(q.quadric);
+			for (int k = 0; k < count; ++k)
+			{
+				gradient[k] += q.gradient[k];
+				offset[k] += q.offset[k];
+			}
+		}
+
+		double evaluate(const glm::dvec3& p, const float* attributes, int count) const
+		{
+			double error = quadric.evaluate(p);
+			for (int k = 0; k < count; ++k)
+				error += attributes[k] * (quadric.w * attributes[k] - 2.0 * (glm::dot(gradient[k], p) + offset[k]));
+			return error;
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from, to;
+		float cost;
+	};
+
+	uint64_t edgeKey(uint32_t a, uint32_t b)
+	{
+		return (uint64_t)a << 32 | b;
+	}
+
+	// The state of one simplification run, which reduce() can continue to
+	// lower targets. Vertices of the buffer are "wedges"; wedges at the same
+	// position share that position's representative, the lowest wedge index,
+	// which is what topology and geometric quadrics are kept for.
+	class Simplification
+	{
+	public:
+		Simplification(const std::vector<uint32_t>& indices, const VertexStreams& streams, const SimplifyParams& params);
+
+		void reduce(size_t targetTriangles);
+
+		const std::vector<uint32_t>& indices() const { return mIndices; }
+		size_t triangleCount() const { return mIndices.size() / 3; }
+		// Largest error so far, in object space units.
+		float error() const { return std::sqrt(mMaxCost) * mExtent; }
+
+	private:
+		void mClassify();
+		void mBuildQuadrics();
+		void mBuildAdjacency();
+		float mCost(uint32_t from, uint32_t to);
+		bool mMatchWedges(uint32_t from, uint32_t to, size_t& shared);
+		bool mFlips(uint32_t from, uint32_t to) const;
+		size_t mApplyCollapses(const std::vector<Collapse>& collapses, size_t budget);
+		void mRewriteIndices();
+
+		const float* mAttributesOf(uint32_t wedge) const { return &mAttributes[(size_t)wedge * mAttributeCount]; }
+		// Through this pass's collapses so far.
+		uint32_t mRepresentative(uint32_t wedge) const { return mWeld[mWedgeRemap[wedge]]; }
+
+	private:
+		std::vector<uint32_t> mIndices;
+		std::vector<glm::vec3> mPositions; // scaled into the unit cube
+		std::vector<float> mAttributes;     // mAttributeCount per wedge, weighted
+		int mAttributeCount = 0;
+		float mExtent = 1.f;
+		bool mLockBorders = true;
+		float mCostLimit = 0.f, mMaxCost = 0.f;
+
+		std::vector<uint32_t> mWeld;
+		std::vector<uint8_t> mBorder, mLocked; // per representative
+		std::vector<Quadric> mQuadrics;        // per representative
+		std::vector<AttributeQuadric> mAttributeQuadrics;
+
+		// Per pass: triangles around each representative, the vertices a
+		// collapse has touched, and where collapsed wedges went.
+		std::vector<uint32_t> mOffsets, mAdjacent, mCounts;
+		std::vector<uint8_t> mPassLocked;
+		std::vector<uint32_t> mWedgeRemap, mRemapped;
+		std::vector<std::pair<uint32_t, uint32_t>> mPartners; // from wedge, to wedge
+	};
+
+	Simplification::Simplification(const std::vector<uint32_t>& indices, const VertexStreams& streams, const SimplifyParams& params)
+		: mIndices(indices.begin(), indices.begin() + indices.size() / 3 * 3), mLockBorders(params.lockBorders)
+	{
+		const size_t vertexCount = streams.count();
+		glm::vec3 low(std::numeric_limits<float>::max()), high(-std::numeric_limits<float>::max());
+		for (const glm::vec3& p : streams.positions)
+		{
+			low = glm::min(low, p);
+			high = glm::max(high, p);
+		}
+		mExtent = vertexCount ? std::max(std::max(high.x - low.x, high.y - low.y), std::max(high.z - low.z, 1e-20f)) : 1.f;
+		mPositions.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+			mPositions[v] = (streams.positions[v] - low) / mExtent;
+		mCostLimit = params.maxError * params.maxError;
+
+		const bool texCoords = !streams.texCoords.empty() && params.texCoordWeight > 0.f;
+		const bool normals = !streams.normals.empty() && params.normalWeight > 0.f;
+		mAttributeCount = (texCoords ? 2 : 0) + (normals ? 3 : 0);
+		mAttributes.reserve(vertexCount * mAttributeCount);
+		for (size_t v = 0; v < vertexCount && mAttributeCount; ++v)
+		{
+			if (texCoords)
+			{
+				mAttributes.push_back(streams.texCoords[v].x * params.texCoordWeight);
+				mAttributes.push_back(streams.texCoords[v].y * params.texCoordWeight);
+			}
+			if (normals)
+			{
+				for (int c = 0; c < 3; ++c)
+					mAttributes.push_back(streams.normals[v][c] * params.normalWeight);
+			}
+		}
+
+		// Weld by exact position.
+		std::vector<uint32_t> order(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+			order[v] = (uint32_t)v;
+		const std::vector<glm::vec3>& source = streams.positions;
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			if (source[a].x != source[b].x)
+				return source[a].x < source[b].x;
+			if (source[a].y != source[b].y)
+				return source[a].y < source[b].y;
+			if (source[a].z != source[b].z)
+				return source[a].z < source[b].z;
+			return a < b;
+		});
+		mWeld.resize(vertexCount);
+		for (size_t begin = 0, end; begin < vertexCount; begin = end)
+		{
+			for (end = begin + 1; end < vertexCount && source[order[end]] == source[order[begin]]; ++end)
+				;
+			for (size_t i = begin; i < end; ++i)
+				mWeld[order[i]] = order[begin];
+		}
+
+		mWedgeRemap.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+			mWedgeRemap[v] = (uint32_t)v;
+		mPassLocked.assign(vertexCount, 0);
+		mClassify();
+		mBuildQuadrics();
+	}
+
+	void Simplification::mClassify()
+	{
+		// An edge without a twin among the wedges is open in the buffer; if it
+		// has one among the positions it is a seam, otherwise a border.
+		std::vector<uint64_t> wedgeEdges, positionEdges;
+		wedgeEdges.reserve(mIndices.size());
+		positionEdges.reserve(mIndices.size());
+		for (size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				const uint32_t a = mIndices[i + e], b = mIndices[i + (e + 1) % 3];
+				wedgeEdges.push_back(edgeKey(a, b));
+				positionEdges.push_back(edgeKey(mWeld[a], mWeld[b]));
+			}
+		}
+		std::sort(wedgeEdges.begin(), wedgeEdges.end());
+		std::sort(positionEdges.begin(), positionEdges.end());
+
+		mBorder.assign(mPositions.size(), 0);
+		for (size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				const uint32_t a = mIndices[i + e], b = mIndices[i + (e + 1) % 3];
+				if (!std::binary_search(positionEdges.begin(), positionEdges.end(), edgeKey(mWeld[b], mWeld[a])))
+					mBorder[mWeld[a]] = mBorder[mWeld[b]] = 1;
+			}
+		}
+		mLocked.assign(mPositions.size(), 0);
+		for (size_t v = 0; v < mPositions.size(); ++v)
+			mLocked[v] = mLockBorders && mBorder[v];
+
+		// Planes through open edges, perpendicular to their triangle, keep
+		// seams and sliding borders from wandering.
+		mQuadrics.assign(mPositions.size(), Quadric());
+		for (size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			const glm::vec3& p0 = mPositions[mIndices[i]];
+			const glm::vec3 normal = glm::cross(mPositions[mIndices[i + 1]] - p0, mPositions[mIndices[i + 2]] - p0);
+			const float length = glm::length(normal);
+			if (length == 0.f)
+				continue;
+			for (int e = 0; e < 3; ++e)
+			{
+				const uint32_t a = mIndices[i + e], b = mIndices[i + (e + 1) % 3];
+				if (std::binary_search(wedgeEdges.begin(), wedgeEdges.end(), edgeKey(b, a)))
+					continue;
+				const uint32_t ra = mWeld[a], rb = mWeld[b];
+				if (mLocked[ra] && mLocked[rb])
+					continue;
+				const glm::vec3 edge = mPositions[b] - mPositions[a];
+				const glm::vec3 across = glm::cross(edge, normal / length);
+				const float acrossLength = glm::length(across);
+				if (acrossLength == 0.f)
+					continue;
+				const glm::vec3 plane = across / acrossLength;
+				const float weight = glm::dot(edge, edge) * kBoundaryWeight;
+				mQuadrics[ra].addPlane(glm::dvec3(plane), -glm::dot(plane, mPositions[a]), weight);
+				mQuadrics[rb].addPlane(glm::dvec3(plane), -glm::dot(plane, mPositions[a]), weight);
+				mQuadrics[ra].w += weight;
+				mQuadrics[rb].w += weight;
+			}
+		}
+	}
+
+	void Simplification::mBuildQuadrics()
+	{
+		if (mAttributeCount)
+			mAttributeQuadrics.assign(mPositions.size(), AttributeQuadric());
+		for (size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			const uint32_t* corners = &mIndices[i];
+			const glm::vec3& p0 = mPositions[corners[0]];
+			const glm::vec3 e1 = mPositions[corners[1]] - p0, e2 = mPositions[corners[2]] - p0;
+			const glm::vec3 normal = glm::cross(e1, e2);
+			const float length = glm::length(normal);
+			if (length == 0.f)
+				continue;
+			const float area = length * 0.5f;
+			const glm::vec3 unit = normal / length;
+			for (int c = 0; c < 3; ++c)
+			{
+				Quadric& q = mQuadrics[mWeld[corners[c]]];
+				q.addPlane(glm::dvec3(unit), -glm::dot(unit, p0), area);
+				q.w += area;
+			}
+			if (!mAttributeCount)
+				continue;
+
+			// Each attribute's gradient across the triangle, in its plane:
+			// g = x e1 + y e2 with dot(g, e1) and dot(g, e2) the attribute's
+			// differences along the edges.
+			const float d11 = glm::dot(e1, e1), d12 = glm::dot(e1, e2), d22 = glm::dot(e2, e2);
+			const float determinant = d11 * d22 - d12 * d12;
+			if (determinant == 0.f)
+				continue;
+			AttributeQuadric q;
+			q.quadric.w = area;
+			for (int k = 0; k < mAttributeCount; ++k)
+			{
+				const float s0 = mAttributesOf(corners[0])[k];
+				const float delta1 = mAttributesOf(corners[1])[k] - s0, delta2 = mAttributesOf(corners[2])[k] - s0;
+				const float x = (d22 * delta1 - d12 * delta2) / determinant, y = (d11 * delta2 - d12 * delta1) / determinant;
+				const glm::dvec3 gradient = glm::dvec3(e1 * x + e2 * y);
+				const double offset = s0 - glm::dot(gradient, glm::dvec3(p0));
+				q.quadric.addPlane(gradient, offset, area);
+				q.gradient[k] = gradient * (double)area;
+				q.offset[k] = offset * area;
+			}
+			for (int c = 0; c < 3; ++c)
+				mAttributeQuadrics[corners[c]].add(q, mAttributeCount);
+		}
+	}
+
+	void Simplification::mBuildAdjacency()
+	{
+		const size_t vertexCount = mPositions.size();
+		mCounts.assign(vertexCount, 0);
+		mOffsets.assign(vertexCount + 1, 0);
+		for (uint32_t index : mIndices)
+			++mCounts[mWeld[index]];
+		for (size_t v = 0; v < vertexCount; ++v)
+			mOffsets[v + 1] = mOffsets[v] + mCounts[v];
+		mAdjacent.resize(mIndices.size());
+		std::fill(mCounts.begin(), mCounts.end(), 0);
+		for (size_t i = 0; i < mIndices.size(); ++i)
+		{
+			const uint32_t r = mWeld[mIndices[i]];
+			mAdjacent[mOffsets[r] + mCounts[r]++] = (uint32_t)(i / 3);
+		}
+	}
+
+	bool Simplification::mMatchWedges(uint32_t from, uint32_t to, size_t& shared)
+	{
+		// Every wedge of from that a triangle uses must go to the one wedge of
+		// to it shares a triangle with. A seam vertex collapsing across its
+		// seam, rather than along it, leaves a wedge without a partner.
+		mPartners.clear();
+		shared = 0;
+		size_t matched = 0;
+		for (uint32_t i = mOffsets[from]; i < mOffsets[from + 1]; ++i)
+		{
+			const uint32_t* corners = &mIndices[mAdjacent[i] * 3];
+			uint32_t fromWedge = ~0u, toWedge = ~0u;
+			for (int c = 0; c < 3; ++c)
+			{
+				const uint32_t wedge = mWedgeRemap[corners[c]];
+				if (mWeld[wedge] == from)
+					fromWedge = wedge;
+				else if (mWeld[wedge] == to)
+					toWedge = wedge;
+			}
+			if (fromWedge == ~0u)
+				continue;
+			auto partner = std::find_if(mPartners.begin(), mPartners.end(),
+				[&](const std::pair<uint32_t, uint32_t>& p) { return p.first == fromWedge; });
+			if (partner == mPartners.end())
+			{
+				mPartners.push_back(std::make_pair(fromWedge, toWedge));
+				partner = mPartners.end() - 1;
+			}
+			if (toWedge == ~0u)
+				continue;
+			++shared;
+			if (partner->second == ~0u)
+				partner->second = toWedge;
+			else if (partner->second != toWedge)
+				return false;
+		}
+		for (const std::pair<uint32_t, uint32_t>& partner : mPartners)
+			matched += partner.second != ~0u;
+		return shared > 0 && matched == mPartners.size();
+	}
+
+	float Simplification::mCost(uint32_t from, uint32_t to)
+	{
+		const float infinite = std::numeric_limits<float>::max();
+		if (mLocked[from] || (mBorder[from] && !mBorder[to]))
+			return infinite;
+		size_t shared = 0;
+		if (!mMatchWedges(from, to, shared) || (mBorder[from] && shared != 1))
+			return infinite;
+		const glm::dvec3 target(mPositions[to]);
+		double error = mQuadrics[from].evaluate(target);
+		for (const std::pair<uint32_t, uint32_t>& partner : mPartners)
+		{
+			if (mAttributeCount)
+				error += mAttributeQuadrics[partner.first].evaluate(target, mAttributesOf(partner.second), mAttributeCount);
+		}
+		return (float)(std::max(error, 0.0) / std::max(mQuadrics[from].w, 1e-30));
+	}
+
+	bool Simplification::mFlips(uint32_t from, uint32_t to) const
+	{
+		for (uint32_t i = mOffsets[from]; i < mOffsets[from + 1]; ++i)
+		{
+			const uint32_t* corners = &mIndices[mAdjacent[i] * 3];
+			uint32_t r[3];
+			for (int c = 0; c < 3; ++c)
+				r[c] = mRepresentative(corners[c]);
+			if (r[0] == r[1] || r[1] == r[2] || r[0] == r[2] || r[0] == to || r[1] == to || r[2] == to)
+				continue;
+			const glm::vec3 before = glm::cross(mPositions[r[1]] - mPositions[r[0]], mPositions[r[2]] - mPositions[r[0]]);
+			for (int c = 0; c < 3; ++c)
+				r[c] = r[c] == from ? to : r[c];
+			const glm::vec3 after = glm::cross(mPositions[r[1]] - mPositions[r[0]], mPositions[r[2]] - mPositions[r[0]]);
+			if (glm::dot(before, after) <= 1e-2f * glm::length(before) * glm::length(after))
+				return true;
+		}
+		return false;
+	}
+
+	size_t Simplification::mApplyCollapses(const std::vector<Collapse>& collapses, size_t budget)
+	{
+		// Stop the pass before the costs it ranked go stale. A collapse takes
+		// out two triangles, so about the budget/2th cheapest meets the target
+		// if nothing is blocked; past twice that, the cheap collapses left are
+		// mostly blocked by vertices already touched and the next pass ranks
+		// them again.
+		const size_t limitRank = std::min(collapses.size(), std::max<size_t>(budget, 1));
+		const float passLimit = std::min(mCostLimit, collapses[limitRank - 1].cost * 1.5f);
+		std::fill(mPassLocked.begin(), mPassLocked.end(), 0);
+		size_t removed = 0, applied = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (removed >= budget || (collapse.cost > passLimit && applied))
+				break;
+			if (mPassLocked[collapse.from] || mPassLocked[collapse.to])
+				continue;
+			size_t shared = 0;
+			if (!mMatchWedges(collapse.from, collapse.to, shared) || mFlips(collapse.from, collapse.to))
+				continue;
+			for (const std::pair<uint32_t, uint32_t>& partner : mPartners)
+			{
+				mWedgeRemap[partner.first] = partner.second;
+				mRemapped.push_back(partner.first);
+				if (mAttributeCount)
+					mAttributeQuadrics[partner.second].add(mAttributeQuadrics[partner.first], mAttributeCount);
+			}
+			mQuadrics[collapse.to].add(mQuadrics[collapse.from]);
+			mPassLocked[collapse.from] = mPassLocked[collapse.to] = 1;
+			mMaxCost = std::max(mMaxCost, collapse.cost);
+			removed += shared;
+			++applied;
+		}
+		return applied;
+	}
+
+	void Simplification::mRewriteIndices()
+	{
+		size_t written = 0;
+		for (size_t i = 0; i < mIndices.size(); i += 3)
+		{
+			const uint32_t a = mWedgeRemap[mIndices[i]], b = mWedgeRemap[mIndices[i + 1]], c = mWedgeRemap[mIndices[i + 2]];
+			if (mWeld[a] == mWeld[b] || mWeld[b] == mWeld[c] || mWeld[a] == mWeld[c])
+				continue;
+			mIndices[written++] = a;
+			mIndices[written++] = b;
+			mIndices[written++] = c;
+		}
+		mIndices.resize(written);
+		for (uint32_t wedge : mRemapped)
+			mWedgeRemap[wedge] = wedge;
+		mRemapped.clear();
+	}
+
+	void Simplification::reduce(size_t targetTriangles)
+	{
+		std::vector<Collapse> collapses;
+		while (triangleCount() > targetTriangles)
+		{
+			mBuildAdjacency();
+			collapses.clear();
+			for (size_t i = 0; i < mIndices.size(); i += 3)
+			{
+				for (int e = 0; e < 3; ++e)
+				{
+					// Interior edges appear twice, once each way; border edges
+					// once, in either direction.
+					const uint32_t a = mWeld[mIndices[i + e]], b = mWeld[mIndices[i + (e + 1) % 3]];
+					if (a > b && !(mBorder[a] && mBorder[b]))
+						continue;
+					const float forward = mCost(a, b), backward = mCost(b, a);
+					const Collapse collapse = forward <= backward ? Collapse{ a, b, forward } : Collapse{ b, a, backward };
+					if (collapse.cost <= mCostLimit)
+						collapses.push_back(collapse);
+				}
+			}
+			if (collapses.empty())
+				break;
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+			if (mApplyCollapses(collapses, triangleCount() - targetTriangles) == 0)
+				break;
+			mRewriteIndices();
+		}
+	}
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(const std::vector<uint32_t>& indices, const VertexStreams& streams,
+	size_t targetTriangles, const SimplifyParams& params, float* error)
+{
+	Simplification simplification(indices, streams, params);
+	simplification.reduce(targetTriangles);
+	if (error)
+		*error = simplification.error();
+	return simplification.indices();
+}
+
+MeshLods MeshSimplifier::buildLods(const Mesh& mesh, const LodParams& params)
+{
+	MeshLods lods;
+	const std::vector<glm::vec3>& positions = mesh.streams.positions;
+	if (positions.empty() || mesh.indices.size() < 3)
+		return lods;
+
+	// Ritter's bounding sphere.
+	auto farthest = [&](const glm::vec3& from) {
+		glm::vec3 best = from;
+		float bestDistance = -1.f;
+		for (const glm::vec3& p : positions)
+		{
+			const float distance = glm::dot(p - from, p - from);
+			if (distance > bestDistance)
+			{
+				bestDistance = distance;
+				best = p;
+			}
+		}
+		return best;
+	};
+	const glm::vec3 a = farthest(positions[0]), b = farthest(a);
+	lods.center = (a + b) * 0.5f;
+	lods.radius = glm::length(b - a) * 0.5f;
+	for (const glm::vec3& p : positions)
+	{
+		const float distance = glm::length(p - lods.center);
+		if (distance > lods.radius)
+		{
+			const float grown = (lods.radius + distance) * 0.5f;
+			lods.center += (p - lods.center) * ((grown - lods.radius) / distance);
+			lods.radius = grown;
+		}
+	}
+
+	MeshLod full;
+	full.indexCount = mesh.indices.size() / 3 * 3;
+	lods.levels.push_back(full);
+	lods.indices.assign(mesh.indices.begin(), mesh.indices.begin() + full.indexCount);
+
+	Simplification simplification(mesh.indices, mesh.streams, params.simplify);
+	size_t previous = full.indexCount / 3;
+	for (int level = 1; level < params.maxLevels; ++level)
+	{
+		const size_t target = (size_t)(previous * params.ratio);
+		if (target < params.minTriangles)
+			break;
+		simplification.reduce(target);
+		// Stuck against maxError or locked borders.
+		if (simplification.triangleCount() > previous - previous / 10)
+			break;
+		std::vector<uint32_t> indices = simplification.indices();
+		MeshOptimizer::optimizeVertexCache(indices, positions.size());
+		MeshLod lod;
+		lod.indexOffset = lods.indices.size();
+		lod.indexCount = indices.size();
+		lod.error = simplification.error();
+		lods.levels.push_back(lod);
+		lods.indices.insert(lods.indices.end(), indices.begin(), indices.end());
+		previous = simplification.triangleCount();
+	}
+	return lods;
+}
+
+size_t MeshLods::select(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float viewportHeight,
+	float pixelError) const
+{
+	if (levels.size() < 2)
+		return 0;
+	const glm::mat4 modelView = view * model;
+	const float scale = std::max(std::max(glm::length(glm::vec3(modelView[0])), glm::length(glm::vec3(modelView[1]))),
+		glm::length(glm::vec3(modelView[2])));
+
+	// Pixels per object space unit: projection[1][1] maps view space y to
+	// normalized device coordinates, over the viewport's half height, and
+	// perspective divides by the distance to the sphere's nearest point.
+	float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f * scale;
+	if (projection[2][3] != 0.f)
+	{
+		const float distance = -glm::vec3(modelView * glm::vec4(center, 1.f)).z - radius * scale;
+		if (distance <= 0.f)
+			return 0;
+		pixelsPerUnit /= distance;
+	}
+	size_t level = 0;
+	while (level + 1 < levels.size() && levels[level + 1].error * pixelsPerUnit <= pixelError)
+		++level;
+	return level;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "MeshImporter.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct SimplifyParams
+{
+	// Vertices on open edges stay where they are, so meshes that meet along
+	// their borders, such as terrain tiles or parts split for culling, do not
+	// open cracks. Otherwise border vertices may only slide along the border.
+	bool lockBorders = true;
+	// Attribute deviation against geometric deviation, which is measured in
+	// units of the mesh's largest extent: at weight 1 a texture coordinate
+	// off by 0.01 costs as much as the surface moving by 1% of the mesh.
+	float texCoordWeight = 1.f;
+	float normalWeight = 0.5f;
+	// Largest error allowed, in the same units as the weights. Simplification
+	// stops short of its target rather than exceed it.
+	float maxError = 1.f;
+};
+
+struct LodParams
+{
+	SimplifyParams simplify;
+	int maxLevels = 8;          // the full mesh included
+	float ratio = 0.5f;         // triangles of each level against the one before
+	size_t minTriangles = 64;   // no level is built below this
+};
+
+struct MeshLod
+{
+	size_t indexOffset = 0, indexCount = 0; // into MeshLods::indices
+	float error = 0.f;                      // in object space units; 0 for the full mesh
+};
+
+// Levels of detail that share the full mesh's vertices: simplification only
+// ever moves a vertex onto one of its neighbours, so every level indexes the
+// same vertex buffer and only the index range changes.
+struct MeshLods
+{
+	std::vector<MeshLod> levels; // finest first
+	std::vector<uint32_t> indices;
+	// Bounding sphere of the full mesh, in object space.
+	glm::vec3 center = glm::vec3(0.f);
+	float radius = 0.f;
+
+	// The coarsest level whose error, projected at the bounding sphere's
+	// nearest point, covers at most pixelError pixels of a viewport
+	// viewportHeight pixels high. Handles perspective and orthographic
+	// projections; inside the sphere the full mesh is picked.
+	size_t select(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float viewportHeight,
+		float pixelError = 1.f) const;
+};
+
+// Quadric error metric simplification (Garland and Heckbert) by half edge
+// collapses, in passes: each pass ranks every edge by the cost of collapsing
+// it in its cheaper direction and applies the cheapest, at most one per
+// vertex, until the pass reaches the target. Texture coordinates and normals
+// add attribute quadrics (Hoppe), kept per vertex of the buffer so seams keep
+// their attributes on both sides; a seam vertex only collapses along its seam.
+// Collapses that would flip a triangle are skipped.
+class MeshSimplifier
+{
+public:
+	// At most targetTriangles triangles, or as close as maxError allows. The
+	// indices reference the same vertices. error, if given, receives the
+	// result's error in object space units.
+	static std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices, const VertexStreams& streams,
+		size_t targetTriangles, const SimplifyParams& params = SimplifyParams(), float* error = nullptr);
+
+	// Levels from one simplification run, so every level's error is measured
+	// against the full mesh. Each level's indices are reordered for the
+	// vertex cache.
+	static MeshLods buildLods(const Mesh& mesh, const LodParams& params = LodParams());
+};
@@ -0,0 +1,350 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double msSince(Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	}
+
+	// Bounding sphere of the meshlet's vertices: Ritter's, from the two
+	// points farthest apart along a first guess, then grown to take in
+	// whatever is left outside.
+	void computeSphere(const MeshletMesh& result, const std::vector<glm::vec3>& positions, Meshlet& meshlet)
+	{
+		const uint32_t* vertices = &result.vertices[meshlet.vertexOffset];
+		auto farthest = [&](const glm::vec3& from) {
+			glm::vec3 best = from;
+			float bestDistance = -1.f;
+			for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			{
+				const float distance = glm::dot(positions[vertices[i]] - from, positions[vertices[i]] - from);
+				if (distance > bestDistance)
+				{
+					bestDistance = distance;
+					best = positions[vertices[i]];
+				}
+			}
+			return best;
+		};
+		const glm::vec3 a = farthest(positions[vertices[0]]), b = farthest(a);
+		glm::vec3 center = (a + b) * 0.5f;
+		float radius = glm::length(b - a) * 0.5f;
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+		{
+			const float distance = glm::length(positions[vertices[i]] - center);
+			if (distance > radius)
+			{
+				const float grown = (radius + distance) * 0.5f;
+				center += (positions[vertices[i]] - center) * ((grown - radius) / distance);
+				radius = grown;
+			}
+		}
+		meshlet.center = center;
+		meshlet.radius = radius;
+	}
+
+	// The cone around the average of the triangle normals that holds them
+	// all. Cones wider than about 84 degrees cull too rarely to be worth the
+	// test and keep coneCutoff at 1.
+	void computeCone(const std::vector<glm::vec3>& normals, const std::vector<uint32_t>& triangles, Meshlet& meshlet)
+	{
+		glm::vec3 sum(0.f);
+		for (uint32_t t : triangles)
+			sum += normals[t];
+		const float length = glm::length(sum);
+		meshlet.coneAxis = glm::vec3(0.f, 0.f, 1.f);
+		meshlet.coneCutoff = 1.f;
+		if (length < 1e-6f)
+			return;
+		const glm::vec3 axis = sum / length;
+		float minDot = 1.f;
+		for (uint32_t t : triangles)
+		{
+			if (normals[t] != glm::vec3(0.f))
+				minDot = std::min(minDot, glm::dot(normals[t], axis));
+		}
+		meshlet.coneAxis = axis;
+		if (minDot > 0.1f)
+			meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+	}
+}
+
+MeshletMesh MeshletBuilder::build(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+	const MeshletParams& params)
+{
+	const uint32_t maxVertices = (uint32_t)std::min<size_t>(std::max<size_t>(params.maxVertices, 3), 256);
+	const uint32_t maxTriangles = (uint32_t)std::max<size_t>(params.maxTriangles, 1);
+	const size_t triangleCount = indices.size() / 3, vertexCount = positions.size();
+	MeshletMesh result;
+	if (triangleCount == 0)
+		return result;
+
+	// Unused triangles around each vertex, in compressed rows; a triangle is
+	// swapped out of its vertices' rows once it joins a meshlet.
+	std::vector<uint32_t> offsets(vertexCount + 1, 0), live(vertexCount, 0), adjacent(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		++live[indices[i]];
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::fill(live.begin(), live.end(), 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		adjacent[offsets[indices[i]] + live[indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<glm::vec3> normals(triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const glm::vec3& a = positions[indices[t * 3]];
+		const glm::vec3 normal = glm::cross(positions[indices[t * 3 + 1]] - a, positions[indices[t * 3 + 2]] - a);
+		const float length = glm::length(normal);
+		normals[t] = length > 0.f ? normal / length : glm::vec3(0.f);
+	}
+
+	std::vector<bool> used(triangleCount, false);
+	std::vector<int16_t> slot(vertexCount, -1); // local index in the current meshlet
+	std::vector<uint32_t> meshletTriangles;
+	Meshlet meshlet;
+	glm::vec3 normalSum(0.f);
+	size_t cursor = 0;
+
+	auto finish = [&]() {
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			slot[result.vertices[meshlet.vertexOffset + i]] = -1;
+		computeSphere(result, positions, meshlet);
+		computeCone(normals, meshletTriangles, meshlet);
+		result.meshlets.push_back(meshlet);
+		meshlet = Meshlet();
+		meshlet.vertexOffset = (uint32_t)result.vertices.size();
+		meshlet.triangleOffset = (uint32_t)result.triangles.size();
+		meshletTriangles.clear();
+		normalSum = glm::vec3(0.f);
+	};
+
+	int64_t next = -1;
+	for (size_t added = 0; added < triangleCount; ++added)
+	{
+		if (next < 0)
+		{
+			while (used[cursor])
+				++cursor;
+			next = (int64_t)cursor;
+		}
+		const uint32_t t = (uint32_t)next;
+		used[t] = true;
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			const uint32_t v = indices[t * 3 + corner];
+			if (slot[v] < 0)
+			{
+				slot[v] = (int16_t)meshlet.vertexCount++;
+				result.vertices.push_back(v);
+			}
+			result.triangles.push_back((uint8_t)slot[v]);
+
+			uint32_t* begin = &adjacent[offsets[v]];
+			uint32_t* end = begin + live[v];
+			uint32_t* found = std::find(begin, end, t);
+			if (found != end)
+			{
+				*found = end[-1];
+				--live[v];
+			}
+		}
+		++meshlet.triangleCount;
+		meshletTriangles.push_back(t);
+		normalSum += normals[t];
+
+		// The best unused neighbour that still fits.
+		const float normalLength = glm::length(normalSum);
+		const glm::vec3 axis = normalLength > 0.f ? normalSum / normalLength : glm::vec3(0.f);
+		next = -1;
+		int64_t seed = -1;
+		float bestScore = 1e30f;
+		if (meshlet.triangleCount < maxTriangles)
+		{
+			for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			{
+				const uint32_t v = result.vertices[meshlet.vertexOffset + i];
+				for (const uint32_t* a = &adjacent[offsets[v]]; a != &adjacent[offsets[v]] + live[v]; ++a)
+				{
+					const uint32_t* corners = &indices[*a * 3];
+					const uint32_t extra = (slot[corners[0]] < 0) + (slot[corners[1]] < 0 && corners[1] != corners[0]) +
+						(slot[corners[2]] < 0 && corners[2] != corners[0] && corners[2] != corners[1]);
+					seed = *a;
+					if (meshlet.vertexCount + extra > maxVertices)
+						continue;
+					// A triangle that is the last one left around one of its
+					// vertices goes first: it closes a hole rather than
+					// leaving a vertex to be shared with a later meshlet.
+					const bool closes = live[corners[0]] == 1 || live[corners[1]] == 1 || live[corners[2]] == 1;
+					const float score = (closes ? 0.f : extra + 1.f) + params.coneWeight * 0.5f * (1.f - glm::dot(normals[*a], axis));
+					if (score < bestScore)
+					{
+						bestScore = score;
+						next = *a;
+					}
+				}
+			}
+		}
+		else if (meshlet.vertexCount > 0)
+		{
+			const uint32_t v = result.vertices[meshlet.vertexOffset + meshlet.vertexCount - 1];
+			if (live[v])
+				seed = adjacent[offsets[v]];
+		}
+		if (next < 0)
+		{
+			finish();
+			next = seed;
+		}
+	}
+	if (meshlet.triangleCount)
+		finish();
+	return result;
+}
+
+void MeshletCuller::setMesh(const MeshletMesh& mesh)
+{
+	mMesh = &mesh;
+	const size_t count = mesh.meshlets.size(), padded = (count + 3) & ~(size_t)3;
+	std::vector<float>* arrays[] = { &mCenterX, &mCenterY, &mCenterZ, &mRadius, &mAxisX, &mAxisY, &mAxisZ, &mCutoff };
+	for (std::vector<float>* array : arrays)
+		array->assign(padded, 0.f);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Meshlet& meshlet = mesh.meshlets[i];
+		mCenterX[i] = meshlet.center.x;
+		mCenterY[i] = meshlet.center.y;
+		mCenterZ[i] = meshlet.center.z;
+		mRadius[i] = meshlet.radius;
+		mAxisX[i] = meshlet.coneAxis.x;
+		mAxisY[i] = meshlet.coneAxis.y;
+		mAxisZ[i] = meshlet.coneAxis.z;
+		mCutoff[i] = meshlet.coneCutoff;
+	}
+	mResult.assign(padded, 0);
+	mStats = MeshletCullStats();
+}
+
+void MeshletCuller::mTestScalar(const glm::vec4 planes[6], const glm::vec3& eye, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		const glm::vec3 center(mCenterX[i], mCenterY[i], mCenterZ[i]);
+		bool outside = false;
+		for (int p = 0; p < 6; ++p)
+			outside |= glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -mRadius[i];
+		const glm::vec3 toCenter = center - eye;
+		const bool backfacing = glm::dot(toCenter, glm::vec3(mAxisX[i], mAxisY[i], mAxisZ[i])) >
+			mCutoff[i] * glm::length(toCenter) + mRadius[i];
+		mResult[i] = outside ? 2 : backfacing ? 1 : 0;
+	}
+}
+
+#ifdef SIMD_X86
+void MeshletCuller::mTestSse2(const glm::vec4 planes[6], const glm::vec3& eye, size_t end)
+{
+	const __m128 eyeX = _mm_set1_ps(eye.x), eyeY = _mm_set1_ps(eye.y), eyeZ = _mm_set1_ps(eye.z);
+	for (size_t i = 0; i < end; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&mCenterX[i]), y = _mm_loadu_ps(&mCenterY[i]), z = _mm_loadu_ps(&mCenterZ[i]);
+		const __m128 radius = _mm_loadu_ps(&mRadius[i]);
+		const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; ++p)
+		{
+			const __m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_mul_ps(y, _mm_set1_ps(planes[p].y))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+		}
+
+		const __m128 dx = _mm_sub_ps(x, eyeX), dy = _mm_sub_ps(y, eyeY), dz = _mm_sub_ps(z, eyeZ);
+		const __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&mAxisX[i])), _mm_mul_ps(dy, _mm_loadu_ps(&mAxisY[i]))),
+			_mm_mul_ps(dz, _mm_loadu_ps(&mAxisZ[i])));
+		const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		const __m128 backfacing = _mm_cmpgt_ps(along, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&mCutoff[i]), length), radius));
+
+		const int outsideBits = _mm_movemask_ps(outside), backfacingBits = _mm_movemask_ps(backfacing);
+		for (int lane = 0; lane < 4; ++lane)
+			mResult[i + lane] = (outsideBits >> lane & 1) ? 2 : (backfacingBits >> lane & 1) ? 1 : 0;
+	}
+}
+#endif
+
+size_t MeshletCuller::cull(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, std::vector<uint32_t>& indices,
+	SimdLevel level)
+{
+	if (!mMesh)
+		return 0;
+	Clock::time_point start = Clock::now();
+	const size_t count = mMesh->meshlets.size();
+	mStats = MeshletCullStats();
+	mStats.meshlets = count;
+	mStats.triangles = mMesh->triangleCount();
+
+	// Gribb and Hartmann: each clip plane is the fourth row of the matrix
+	// plus or minus one of the others, here in object space.
+	const glm::mat4 mvp = projection * view * model;
+	const glm::vec4 rows[4] = {
+		glm::vec4(mvp[0][0], mvp[1][0], mvp[2][0], mvp[3][0]),
+		glm::vec4(mvp[0][1], mvp[1][1], mvp[2][1], mvp[3][1]),
+		glm::vec4(mvp[0][2], mvp[1][2], mvp[2][2], mvp[3][2]),
+		glm::vec4(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3])
+	};
+	glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2], rows[3] - rows[2]
+	};
+	for (glm::vec4& plane : planes)
+	{
+		const float length = glm::length(glm::vec3(plane));
+		if (length > 0.f)
+			plane /= length;
+	}
+	const glm::vec3 eye = glm::vec3(glm::inverse(view * model) * glm::vec4(0.f, 0.f, 0.f, 1.f));
+
+#ifdef SIMD_X86
+	if (level >= SIMD_SSE2)
+		mTestSse2(planes, eye, mResult.size());
+	else
+#endif
+		mTestScalar(planes, eye, 0, count);
+	mStats.cullMs = msSince(start);
+
+	start = Clock::now();
+	if (indices.size() < mStats.triangles * 3)
+		indices.resize(mStats.triangles * 3);
+	uint32_t* out = indices.data();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Meshlet& meshlet = mMesh->meshlets[i];
+		if (mResult[i] == 2)
+		{
+			++mStats.outsideMeshlets;
+			mStats.outsideTriangles += meshlet.triangleCount;
+			continue;
+		}
+		if (mResult[i] == 1)
+		{
+			++mStats.backfacingMeshlets;
+			mStats.backfacingTriangles += meshlet.triangleCount;
+			continue;
+		}
+		const uint32_t* vertices = &mMesh->vertices[meshlet.vertexOffset];
+		const uint8_t* local = &mMesh->triangles[meshlet.triangleOffset];
+		for (uint32_t j = 0; j < meshlet.triangleCount * 3; ++j)
+			*out++ = vertices[local[j]];
+		++mStats.visibleMeshlets;
+		mStats.visibleTriangles += meshlet.triangleCount;
+	}
+	mStats.compactMs = msSince(start);
+	return out - indices.data();
+}
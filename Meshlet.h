@@ -0,0 +1,116 @@
+#pragma once
+#include "MeshImporter.h"
+#include "Simd.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct MeshletParams
+{
+	// Local indices are bytes, so at most 256 vertices. 64 and 124 fill a
+	// 128 byte aligned triangle block and suit NV and AMD mesh shader limits.
+	size_t maxVertices = 64;
+	size_t maxTriangles = 124;
+	// How much a triangle facing away from the meshlet's average normal costs
+	// next to one extra vertex, 0 to 1. Higher keeps normal cones tight so
+	// more meshlets cull as back facing, at the price of more meshlets.
+	float coneWeight = 0.5f;
+};
+
+// A run of triangles indexing at most MeshletParams::maxVertices vertices.
+// Triangles are three local indices into this meshlet's part of
+// MeshletMesh::vertices, which holds the mesh's own vertex indices.
+struct Meshlet
+{
+	uint32_t vertexOffset = 0, vertexCount = 0;
+	uint32_t triangleOffset = 0, triangleCount = 0; // triangleOffset counts bytes of MeshletMesh::triangles
+	// Bounding sphere, in the mesh's object space.
+	glm::vec3 center = glm::vec3(0.f);
+	float radius = 0.f;
+	// Every triangle normal is within the cone around axis. The meshlet faces
+	// away from a camera at eye when
+	//   dot(center - eye, axis) > coneCutoff * length(center - eye) + radius,
+	// coneCutoff being the sine of the cone's half angle; 1 when the cone is
+	// too wide to ever cull.
+	glm::vec3 coneAxis = glm::vec3(0.f, 0.f, 1.f);
+	float coneCutoff = 1.f;
+};
+
+struct MeshletMesh
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> vertices;
+	std::vector<uint8_t> triangles;
+
+	size_t triangleCount() const { return triangles.size() / 3; }
+};
+
+// Splits an indexed triangle list into meshlets. Each meshlet grows from a
+// seed triangle by adding, among the unused triangles that share a vertex
+// with it, one that uses up a vertex's last triangle, else the one that
+// brings the fewest new vertices, tie broken by how well its normal matches
+// the meshlet's. When no neighbour fits, a neighbour
+// that did not fit seeds the next meshlet, or failing that the next unused
+// triangle in index order. Run MeshOptimizer on the mesh first so index order
+// is local and meshlets come out compact.
+class MeshletBuilder
+{
+public:
+	static MeshletMesh build(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		const MeshletParams& params = MeshletParams());
+	static MeshletMesh build(const Mesh& mesh, const MeshletParams& params = MeshletParams())
+	{
+		return build(mesh.indices, mesh.streams.positions, params);
+	}
+};
+
+struct MeshletCullStats
+{
+	size_t meshlets = 0, triangles = 0;           // in the mesh
+	size_t backfacingMeshlets = 0, outsideMeshlets = 0;
+	size_t backfacingTriangles = 0, outsideTriangles = 0;
+	size_t visibleMeshlets = 0, visibleTriangles = 0; // submitted
+	double cullMs = 0, compactMs = 0;
+
+	float culledRatio() const { return triangles ? 1.f - visibleTriangles / (float)triangles : 0.f; }
+};
+
+// Culls a MeshletMesh against a view on the CPU, then writes the triangles of
+// the meshlets that survive into one index buffer for the frame. Tests run in
+// the mesh's object space: the frustum planes come from
+// projection * view * model and the eye from the inverse of view * model, so
+// any model transform works, non-uniform scale included. Meshlets are tested
+// four at a time with SSE2 from a structure of arrays built once.
+class MeshletCuller
+{
+public:
+	MeshletCuller() = default;
+	explicit MeshletCuller(const MeshletMesh& mesh) { setMesh(mesh); }
+
+	// The mesh must outlive the culler, or until the next setMesh.
+	void setMesh(const MeshletMesh& mesh);
+
+	// Fills indices with the visible triangles as the mesh's own vertex
+	// indices; it is only ever grown, to the mesh's triangle count. Returns
+	// the number of indices written.
+	size_t cull(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, std::vector<uint32_t>& indices,
+		SimdLevel level = detectSimdLevel());
+
+	// Of the last cull.
+	const MeshletCullStats& stats() const { return mStats; }
+
+private:
+	void mTestScalar(const glm::vec4 planes[6], const glm::vec3& eye, size_t begin, size_t end);
+#ifdef SIMD_X86
+	void mTestSse2(const glm::vec4 planes[6], const glm::vec3& eye, size_t end);
+#endif
+
+private:
+	const MeshletMesh* mMesh = nullptr;
+	// Structure of arrays, padded to a multiple of four.
+	std::vector<float> mCenterX, mCenterY, mCenterZ, mRadius, mAxisX, mAxisY, mAxisZ, mCutoff;
+	// Per meshlet: 0 visible, 1 back facing, 2 outside the frustum.
+	std::vector<uint8_t> mResult;
+	MeshletCullStats mStats;
+};
@@ -0,0 +1,524 @@
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	// sRGB transfer tables. The upper half of each table is an identity mapping
+	// used for the alpha channel, so one index offset selects the curve.
+	struct SrgbTables
+	{
+		float toLinear[512];
+		uint32_t fromLinear[2 * 4096];
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				float c = i / 255.f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				toLinear[256 + i] = c;
+			}
+			for (int i = 0; i < 4096; ++i)
+			{
+				float v = i / 4095.f;
+				float s = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.f / 2.4f) - 0.055f;
+				fromLinear[i] = (uint32_t)std::min(255, (int)(s * 255.f + 0.5f));
+				fromLinear[4096 + i] = (uint32_t)(int)(v * 255.f + 0.5f);
+			}
+		}
+	};
+
+	const SrgbTables& srgbTables()
+	{
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	int alphaChannel(int channels)
+	{
+		return (channels == 2 || channels == 4) ? channels - 1 : -1;
+	}
+
+	void rowScalar(const unsigned char* r0, const unsigned char* r1, unsigned char* out,
+		int srcWidth, int dstWidth, int channels, MipFilter filter, int xBegin)
+	{
+		const SrgbTables& t = srgbTables();
+		const int alpha = alphaChannel(channels);
+		if (filter == MipFilter::NormalMap && channels < 3)
+			filter = MipFilter::Linear;
+
+		for (int x = xBegin; x < dstWidth; ++x)
+		{
+			const int i0 = 2 * x * channels;
+			const int i1 = std::min(2 * x + 1, srcWidth - 1) * channels;
+			const unsigned char* a = r0 + i0;
+			const unsigned char* b = r0 + i1;
+			const unsigned char* c = r1 + i0;
+			const unsigned char* d = r1 + i1;
+			unsigned char* o = out + x * channels;
+
+			switch (filter)
+			{
+			case MipFilter::Linear:
+				for (int k = 0; k < channels; ++k)
+					o[k] = (unsigned char)((a[k] + b[k] + c[k] + d[k] + 2) >> 2);
+				break;
+
+			case MipFilter::Srgb:
+				for (int k = 0; k < channels; ++k)
+				{
+					const float* lut = t.toLinear + (k == alpha ? 256 : 0);
+					float sum = lut[a[k]] + lut[b[k]] + lut[c[k]] + lut[d[k]];
+					int idx = (int)(sum * 0.25f * 4095.f + 0.5f);
+					o[k] = (unsigned char)t.fromLinear[idx + (k == alpha ? 4096 : 0)];
+				}
+				break;
+
+			case MipFilter::NormalMap:
+			{
+				const float s = 2.f / 255.f;
+				float n[3];
+				for (int k = 0; k < 3; ++k)
+					n[k] = (a[k] * s + -1.f) + (b[k] * s + -1.f) + (c[k] * s + -1.f) + (d[k] * s + -1.f);
+				float len2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+				if (len2 > 0.f)
+				{
+					float len = std::sqrt(len2);
+					for (int k = 0; k < 3; ++k)
+						n[k] = n[k] / len;
+				}
+				else
+				{
+					n[0] = 0.f; n[1] = 0.f; n[2] = 1.f;
+				}
+				for (int k = 0; k < 3; ++k)
+					o[k] = (unsigned char)std::min(255, (int)(n[k] * 127.5f + 128.f));
+				for (int k = 3; k < channels; ++k)
+					o[k] = (unsigned char)((a[k] + b[k] + c[k] + d[k] + 2) >> 2);
+				break;
+			}
+			}
+		}
+	}
+
+#ifdef SIMD_X86
+	// The SIMD kernels below handle 4 channel rows with srcWidth >= 2, which
+	// guarantees both horizontal taps of every output pixel are in range. Each
+	// returns the first x it did not process.
+
+	int rowLinearSse2(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int dstWidth)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		int x = 0;
+		for (; x + 2 <= dstWidth; x += 2)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(r0 + x * 8));
+			__m128i b = _mm_loadu_si128((const __m128i*)(r1 + x * 8));
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			_mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(sum, sum));
+		}
+		return x;
+	}
+
+	inline __m128 srgbLoadSse2(const float* lut, const unsigned char* p)
+	{
+		return _mm_setr_ps(lut[p[0]], lut[p[1]], lut[p[2]], lut[256 + p[3]]);
+	}
+
+	int rowSrgbSse2(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int dstWidth)
+	{
+		const SrgbTables& t = srgbTables();
+		const __m128 quarter = _mm_set1_ps(0.25f);
+		const __m128 range = _mm_set1_ps(4095.f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		alignas(16) int idx[4];
+		for (int x = 0; x < dstWidth; ++x)
+		{
+			__m128 sum = _mm_add_ps(srgbLoadSse2(t.toLinear, r0 + x * 8), srgbLoadSse2(t.toLinear, r0 + x * 8 + 4));
+			sum = _mm_add_ps(sum, srgbLoadSse2(t.toLinear, r1 + x * 8));
+			sum = _mm_add_ps(sum, srgbLoadSse2(t.toLinear, r1 + x * 8 + 4));
+			__m128 scaled = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sum, quarter), range), half);
+			_mm_store_si128((__m128i*)idx, _mm_cvttps_epi32(scaled));
+			unsigned char* o = out + x * 4;
+			o[0] = (unsigned char)t.fromLinear[idx[0]];
+			o[1] = (unsigned char)t.fromLinear[idx[1]];
+			o[2] = (unsigned char)t.fromLinear[idx[2]];
+			o[3] = (unsigned char)t.fromLinear[4096 + idx[3]];
+		}
+		return dstWidth;
+	}
+
+	inline __m128 normalLoadSse2(const unsigned char* p, __m128 scale, __m128 bias)
+	{
+		int bits;
+		memcpy(&bits, p, 4);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero);
+		return _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), scale), bias);
+	}
+
+	int rowNormalSse2(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int dstWidth)
+	{
+		const float s = 2.f / 255.f;
+		const __m128 scale = _mm_setr_ps(s, s, s, 1.f);
+		const __m128 bias = _mm_setr_ps(-1.f, -1.f, -1.f, 0.f);
+		const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+		const __m128 wOne = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+		const __m128 encodeMul = _mm_setr_ps(127.5f, 127.5f, 127.5f, 0.25f);
+		const __m128 encodeAdd = _mm_setr_ps(128.f, 128.f, 128.f, 0.5f);
+		for (int x = 0; x < dstWidth; ++x)
+		{
+			__m128 sum = _mm_add_ps(normalLoadSse2(r0 + x * 8, scale, bias), normalLoadSse2(r0 + x * 8 + 4, scale, bias));
+			sum = _mm_add_ps(sum, normalLoadSse2(r1 + x * 8, scale, bias));
+			sum = _mm_add_ps(sum, normalLoadSse2(r1 + x * 8 + 4, scale, bias));
+
+			__m128 sq = _mm_mul_ps(sum, sum);
+			__m128 len2 = _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, 1)), _mm_shuffle_ps(sq, sq, 2));
+			__m128 n;
+			if (_mm_cvtss_f32(len2) > 0.f)
+			{
+				__m128 len = _mm_sqrt_ss(len2);
+				len = _mm_or_ps(_mm_and_ps(_mm_shuffle_ps(len, len, 0), xyzMask), wOne);
+				n = _mm_div_ps(sum, len);
+			}
+			else
+			{
+				n = _mm_or_ps(_mm_andnot_ps(xyzMask, sum), _mm_setr_ps(0.f, 0.f, 1.f, 0.f));
+			}
+			__m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(n, encodeMul), encodeAdd));
+			v = _mm_packs_epi32(v, v);
+			*(int*)(out + x * 4) = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+		}
+		return dstWidth;
+	}
+
+	SIMD_TARGET_AVX2 int rowLinearAvx2(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int dstWidth)
+	{
+		const __m256i two = _mm256_set1_epi16(2);
+		int x = 0;
+		for (; x + 4 <= dstWidth; x += 4)
+		{
+			__m256i a0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(r0 + x * 8)));
+			__m256i a1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(r0 + x * 8 + 16)));
+			__m256i b0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(r1 + x * 8)));
+			__m256i b1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(r1 + x * 8 + 16)));
+			__m256i s0 = _mm256_add_epi16(a0, b0);
+			__m256i s1 = _mm256_add_epi16(a1, b1);
+			// Quadwords hold outputs 0, 2, 1, 3 after the pairwise add.
+			__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(s0, s1), _mm256_unpackhi_epi64(s0, s1));
+			sum = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+			sum = _mm256_permute4x64_epi64(sum, _MM_SHUFFLE(3, 1, 2, 0));
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i*)(out + x * 4), _mm256_castsi256_si128(packed));
+		}
+		return x;
+	}
+
+	// Loads source pixels 0..3 of a pair of outputs and returns the even pixels
+	// in lo and the odd pixels in hi, one pixel per 128-bit lane.
+	SIMD_TARGET_AVX2 inline void splitPairsAvx2(const unsigned char* p, __m256i& lo, __m256i& hi)
+	{
+		const __m128i order = _mm_setr_epi8(0, 1, 2, 3, 8, 9, 10, 11, 4, 5, 6, 7, 12, 13, 14, 15);
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), order);
+		lo = _mm256_cvtepu8_epi32(v);
+		hi = _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8));
+	}
+
+	SIMD_TARGET_AVX2 int rowSrgbAvx2(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int dstWidth)
+	{
+		const SrgbTables& t = srgbTables();
+		const __m256i alphaOffset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+		const __m256i encodeOffset = _mm256_setr_epi32(0, 0, 0, 4096, 0, 0, 0, 4096);
+		const __m256i gatherBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m256i lanes = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+		const __m256 quarter = _mm256_set1_ps(0.25f);
+		const __m256 range = _mm256_set1_ps(4095.f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		int x = 0;
+		for (; x + 2 <= dstWidth; x += 2)
+		{
+			__m256i a0, a1, b0, b1;
+			splitPairsAvx2(r0 + x * 8, a0, a1);
+			splitPairsAvx2(r1 + x * 8, b0, b1);
+			__m256 sum = _mm256_add_ps(
+				_mm256_i32gather_ps(t.toLinear, _mm256_add_epi32(a0, alphaOffset), 4),
+				_mm256_i32gather_ps(t.toLinear, _mm256_add_epi32(a1, alphaOffset), 4));
+			sum = _mm256_add_ps(sum, _mm256_i32gather_ps(t.toLinear, _mm256_add_epi32(b0, alphaOffset), 4));
+			sum = _mm256_add_ps(sum, _mm256_i32gather_ps(t.toLinear, _mm256_add_epi32(b1, alphaOffset), 4));
+			__m256 scaled = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sum, quarter), range), half);
+			__m256i idx = _mm256_add_epi32(_mm256_cvttps_epi32(scaled), encodeOffset);
+			__m256i enc = _mm256_i32gather_epi32((const int*)t.fromLinear, idx, 4);
+			enc = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(enc, gatherBytes), lanes);
+			_mm_storel_epi64((__m128i*)(out + x * 4), _mm256_castsi256_si128(enc));
+		}
+		return x;
+	}
+
+	SIMD_TARGET_AVX2 int rowNormalAvx2(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int dstWidth)
+	{
+		const float s = 2.f / 255.f;
+		const __m256 scale = _mm256_setr_ps(s, s, s, 1.f, s, s, s, 1.f);
+		const __m256 bias = _mm256_setr_ps(-1.f, -1.f, -1.f, 0.f, -1.f, -1.f, -1.f, 0.f);
+		const __m256 xyzMask = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+		const __m256 wOne = _mm256_setr_ps(0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f);
+		const __m256 up = _mm256_setr_ps(0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f);
+		const __m256 encodeMul = _mm256_setr_ps(127.5f, 127.5f, 127.5f, 0.25f, 127.5f, 127.5f, 127.5f, 0.25f);
+		const __m256 encodeAdd = _mm256_setr_ps(128.f, 128.f, 128.f, 0.5f, 128.f, 128.f, 128.f, 0.5f);
+		const __m256i lanes = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+		int x = 0;
+		for (; x + 2 <= dstWidth; x += 2)
+		{
+			__m256i a0, a1, b0, b1;
+			splitPairsAvx2(r0 + x * 8, a0, a1);
+			splitPairsAvx2(r1 + x * 8, b0, b1);
+			__m256 sum = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(a0), scale), bias),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(a1), scale), bias));
+			sum = _mm256_add_ps(sum, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(b0), scale), bias));
+			sum = _mm256_add_ps(sum, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(b1), scale), bias));
+
+			__m256 sq = _mm256_mul_ps(sum, sum);
+			__m256 len2 = _mm256_add_ps(_mm256_add_ps(sq, _mm256_permute_ps(sq, _MM_SHUFFLE(1, 1, 1, 1))),
+				_mm256_permute_ps(sq, _MM_SHUFFLE(2, 2, 2, 2)));
+			len2 = _mm256_permute_ps(len2, _MM_SHUFFLE(0, 0, 0, 0));
+			__m256 len = _mm256_or_ps(_mm256_and_ps(_mm256_sqrt_ps(len2), xyzMask), wOne);
+			__m256 n = _mm256_div_ps(sum, len);
+			__m256 valid = _mm256_cmp_ps(len2, _mm256_setzero_ps(), _CMP_GT_OQ);
+			__m256 fallback = _mm256_or_ps(_mm256_andnot_ps(xyzMask, sum), up);
+			n = _mm256_blendv_ps(fallback, n, valid);
+
+			__m256i v = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(n, encodeMul), encodeAdd));
+			v = _mm256_packs_epi32(v, v);
+			v = _mm256_packus_epi16(v, v);
+			v = _mm256_permutevar8x32_epi32(v, lanes);
+			_mm_storel_epi64((__m128i*)(out + x * 4), _mm256_castsi256_si128(v));
+		}
+		return x;
+	}
+
+	int rowSimd(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int dstWidth,
+		MipFilter filter, SimdLevel level)
+	{
+		if (level >= SIMD_AVX2)
+		{
+			switch (filter)
+			{
+			case MipFilter::Linear: return rowLinearAvx2(r0, r1, out, dstWidth);
+			case MipFilter::Srgb: return rowSrgbAvx2(r0, r1, out, dstWidth);
+			case MipFilter::NormalMap: return rowNormalAvx2(r0, r1, out, dstWidth);
+			}
+		}
+		switch (filter)
+		{
+		case MipFilter::Linear: return rowLinearSse2(r0, r1, out, dstWidth);
+		case MipFilter::Srgb: return rowSrgbSse2(r0, r1, out, dstWidth);
+		case MipFilter::NormalMap: return rowNormalSse2(r0, r1, out, dstWidth);
+		}
+		return 0;
+	}
+#endif
+
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t filter;
+		uint32_t channels;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint32_t reserved;
+	};
+
+	const uint32_t kCacheVersion = 1;
+
+	template <class Chain>
+	void layoutLevels(Chain& chain, int width, int height, int count)
+	{
+		chain.levels.resize(count);
+		size_t offset = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			MipLevel& level = chain.levels[i];
+			level.width = width;
+			level.height = height;
+			level.offset = offset;
+			offset += (size_t)width * height * chain.channels;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		chain.data.resize(offset);
+	}
+}
+
+int MipGenerator::levelCount(int width, int height)
+{
+	int count = 1;
+	for (int size = std::max(width, height); size > 1; size /= 2)
+		++count;
+	return count;
+}
+
+void MipGenerator::downsample(const unsigned char* src, int srcWidth, int srcHeight,
+	unsigned char* dst, int dstWidth, int dstHeight, int channels,
+	MipFilter filter, int yBegin, int yEnd, SimdLevel level)
+{
+	const size_t srcPitch = (size_t)srcWidth * channels;
+	const size_t dstPitch = (size_t)dstWidth * channels;
+	yEnd = std::min(yEnd, dstHeight);
+	for (int y = yBegin; y < yEnd; ++y)
+	{
+		const unsigned char* r0 = src + 2 * y * srcPitch;
+		const unsigned char* r1 = src + std::min(2 * y + 1, srcHeight - 1) * srcPitch;
+		unsigned char* out = dst + y * dstPitch;
+		int x = 0;
+#ifdef SIMD_X86
+		if (channels == 4 && srcWidth >= 2 && level >= SIMD_SSE2)
+			x = rowSimd(r0, r1, out, dstWidth, filter, level);
+#endif
+		rowScalar(r0, r1, out, srcWidth, dstWidth, channels, filter, x);
+	}
+}
+
+MipChain MipGenerator::build(const unsigned char* pixels, int width, int height, int channels,
+	MipFilter filter, ThreadPool* pool, SimdLevel level)
+{
+	MipChain chain;
+	chain.channels = channels;
+	layoutLevels(chain, width, height, levelCount(width, height));
+	memcpy(chain.data.data(), pixels, chain.levelBytes(0));
+
+	for (size_t i = 1; i < chain.levels.size(); ++i)
+	{
+		const MipLevel& src = chain.levels[i - 1];
+		const MipLevel& dst = chain.levels[i];
+		const unsigned char* srcData = chain.levelData(i - 1);
+		unsigned char* dstData = chain.levelData(i);
+		auto rows = [&](size_t begin, size_t end)
+		{
+			downsample(srcData, src.width, src.height, dstData, dst.width, dst.height, channels,
+				filter, (int)begin, (int)end, level);
+		};
+		// Bands of roughly 64 KB of output keep small levels on one thread.
+		size_t grain = std::max<size_t>(1, 65536 / ((size_t)dst.width * channels));
+		if (pool)
+			pool->parallelFor(dst.height, grain, rows);
+		else
+			rows(0, dst.height);
+	}
+	return chain;
+}
+
+FloatMipChain MipGenerator::buildFloat(const float* pixels, int width, int height, int channels, ThreadPool* pool)
+{
+	FloatMipChain chain;
+	chain.channels = channels;
+	layoutLevels(chain, width, height, levelCount(width, height));
+	memcpy(chain.data.data(), pixels, (size_t)width * height * channels * sizeof(float));
+
+	for (size_t i = 1; i < chain.levels.size(); ++i)
+	{
+		const MipLevel& src = chain.levels[i - 1];
+		const MipLevel& dst = chain.levels[i];
+		const float* srcData = chain.levelData(i - 1);
+		float* dstData = chain.levelData(i);
+		auto rows = [&](size_t begin, size_t end)
+		{
+			for (int y = (int)begin; y < (int)end; ++y)
+			{
+				const float* r0 = srcData + (size_t)2 * y * src.width * channels;
+				const float* r1 = srcData + (size_t)std::min(2 * y + 1, src.height - 1) * src.width * channels;
+				float* out = dstData + (size_t)y * dst.width * channels;
+				for (int x = 0; x < dst.width; ++x)
+				{
+					const int i0 = 2 * x * channels;
+					const int i1 = std::min(2 * x + 1, src.width - 1) * channels;
+					for (int k = 0; k < channels; ++k)
+						out[x * channels + k] = (r0[i0 + k] + r0[i1 + k] + r1[i0 + k] + r1[i1 + k]) * 0.25f;
+				}
+			}
+		};
+		size_t grain = std::max<size_t>(1, 16384 / ((size_t)dst.width * channels));
+		if (pool)
+			pool->parallelFor(dst.height, grain, rows);
+		else
+			rows(0, dst.height);
+	}
+	return chain;
+}
+
+bool MipGenerator::loadCache(const std::string& path, uint64_t sourceHash, MipFilter filter, MipChain& chain)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	CacheHeader header;
+	if (!file.read((char*)&header, sizeof(header)))
+		return false;
+	if (memcmp(header.magic, "MIPC", 4) != 0 || header.version != kCacheVersion ||
+		header.sourceHash != sourceHash || header.filter != (uint32_t)filter ||
+		header.channels < 1 || header.channels > 4 ||
+		header.width < 1 || header.height < 1 || header.levelCount != (uint32_t)levelCount(header.width, header.height))
+		return false;
+
+	// The header is checked against the file's length before anything is
+	// allocated from it, so a corrupt size cannot ask for gigabytes.
+	uint64_t bytes = 0;
+	for (uint64_t width = header.width, height = header.height, level = 0; level < header.levelCount; ++level)
+	{
+		bytes += width * height * header.channels;
+		width = std::max<uint64_t>(1, width / 2);
+		height = std::max<uint64_t>(1, height / 2);
+	}
+	const std::streamoff dataStart = file.tellg();
+	file.seekg(0, std::ios::end);
+	const std::streamoff fileEnd = file.tellg();
+	if (dataStart < 0 || fileEnd < dataStart || (uint64_t)(fileEnd - dataStart) != bytes)
+		return false;
+	file.seekg(dataStart);
+
+	chain.channels = header.channels;
+	layoutLevels(chain, header.width, header.height, header.levelCount);
+	return (bool)file.read((char*)chain.data.data(), chain.data.size());
+}
+
+bool MipGenerator::saveCache(const std::string& path, uint64_t sourceHash, MipFilter filter, const MipChain& chain)
+{
+	CacheHeader header = {};
+	memcpy(header.magic, "MIPC", 4);
+	header.version = kCacheVersion;
+	header.sourceHash = sourceHash;
+	header.filter = (uint32_t)filter;
+	header.channels = chain.channels;
+	header.width = chain.levels[0].width;
+	header.height = chain.levels[0].height;
+	header.levelCount = (uint32_t)chain.levels.size();
+
+	// Written under a temporary name and renamed into place, so a reader never
+	// sees a valid header in front of texels still being written.
+	const std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)chain.data.data(), chain.data.size());
+		if (!file)
+			return false;
+	}
+	std::remove(path.c_str());
+	return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
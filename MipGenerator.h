@@ -0,0 +1,71 @@
+#pragma once
+#include "Simd.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+enum class MipFilter
+{
+	Linear,    // plain 2x2 box, for masks and other non-color data
+	Srgb,      // box filter in linear light, alpha averaged linearly
+	NormalMap  // averages decoded vectors and renormalizes them
+};
+
+struct MipLevel
+{
+	int width = 0, height = 0;
+	size_t offset = 0; // byte offset of the level inside MipChain::data
+};
+
+// A full mip chain stored back to back in a single allocation, level 0 first.
+struct MipChain
+{
+	int channels = 0;
+	std::vector<MipLevel> levels;
+	std::vector<unsigned char> data;
+
+	const unsigned char* levelData(size_t level) const { return data.data() + levels[level].offset; }
+	unsigned char* levelData(size_t level) { return data.data() + levels[level].offset; }
+	size_t levelBytes(size_t level) const { return (size_t)levels[level].width * levels[level].height * channels; }
+};
+
+// Float counterpart for HDR sources. MipLevel::offset counts floats.
+struct FloatMipChain
+{
+	int channels = 0;
+	std::vector<MipLevel> levels;
+	std::vector<float> data;
+
+	const float* levelData(size_t level) const { return data.data() + levels[level].offset; }
+	float* levelData(size_t level) { return data.data() + levels[level].offset; }
+};
+
+// Builds mip chains on the CPU. Each level is split into row bands that run on
+// the thread pool; the 4 channel kernels have SSE2 and AVX2 variants that produce
+// the same bytes as the scalar reference.
+class MipGenerator
+{
+public:
+	// pool may be null to build on the calling thread. level limits the
+	// instruction set, mainly so the benchmark can compare implementations.
+	static MipChain build(const unsigned char* pixels, int width, int height, int channels,
+		MipFilter filter, ThreadPool* pool, SimdLevel level = detectSimdLevel());
+
+	// Box filtered chain of linear float pixels, in row bands on the pool.
+	static FloatMipChain buildFloat(const float* pixels, int width, int height, int channels, ThreadPool* pool);
+
+	// Downsamples rows [yBegin, yEnd) of dst from src, where dst is src halved;
+	// rows past dstHeight are left alone.
+	static void downsample(const unsigned char* src, int srcWidth, int srcHeight,
+		unsigned char* dst, int dstWidth, int dstHeight, int channels,
+		MipFilter filter, int yBegin, int yEnd, SimdLevel level);
+
+	static int levelCount(int width, int height);
+
+	// On-disk cache of a built chain, keyed by a hash of the source file bytes.
+	static bool loadCache(const std::string& path, uint64_t sourceHash, MipFilter filter, MipChain& chain);
+	static bool saveCache(const std::string& path, uint64_t sourceHash, MipFilter filter, const MipChain& chain);
+};
@@ -0,0 +1,251 @@
+#include "OffsetAllocator.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// Both for value != 0.
+	int lowestBit(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long bit;
+		_BitScanForward(&bit, value);
+		return (int)bit;
+#else
+		return __builtin_ctz(value);
+#endif
+	}
+
+	int highestBit(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long bit;
+		_BitScanReverse(&bit, value);
+		return (int)bit;
+#else
+		return 31 - __builtin_clz(value);
+#endif
+	}
+
+	// Sizes below 8 have a bin each; above, a bin is the power of two and the
+	// three bits after the leading one, like a tiny float. A region goes in
+	// the bin its size rounds down to, a request looks from the bin its size
+	// rounds up to, so every region it finds there fits.
+	uint32_t binRoundDown(uint32_t size)
+	{
+		if (size < 8)
+			return size;
+		const int shift = highestBit(size) - 3;
+		return (uint32_t)(shift + 1) * 8 + ((size >> shift) & 7);
+	}
+
+	uint32_t binRoundUp(uint32_t size)
+	{
+		if (size < 8)
+			return size;
+		const int shift = highestBit(size) - 3;
+		const uint32_t bin = (uint32_t)(shift + 1) * 8 + ((size >> shift) & 7);
+		return (size & ((1u << shift) - 1)) ? bin + 1 : bin;
+	}
+}
+
+OffsetAllocator::OffsetAllocator(uint32_t size)
+{
+	reset(size);
+}
+
+void OffsetAllocator::reset(uint32_t size)
+{
+	mNodes.clear();
+	mUnusedNodes.clear();
+	std::fill(mBinHeads, mBinHeads + kBins, (uint32_t)kNoSpace);
+	memset(mLeafMasks, 0, sizeof(mLeafMasks));
+	mTopMask = 0;
+	mSize = size;
+	mFreeSpace = mFreeRegions = mAllocations = 0;
+	mLastNode = kNoSpace;
+	if (size > 0)
+		mInsertFree(0, size, kNoSpace, kNoSpace);
+}
+
+OffsetAllocator::Allocation OffsetAllocator::allocate(uint32_t size)
+{
+	size = std::max<uint32_t>(size, 1);
+	const uint32_t minBin = std::min<uint32_t>(binRoundUp(size), kBins - 1);
+
+	// The first bin at or after minBin that holds a region: within minBin's
+	// top bin first, then the next top bin with anything in it.
+	uint32_t index = kNoSpace;
+	const uint32_t top = minBin / kLeafBins;
+	const uint32_t leafMask = mLeafMasks[top] & (0xffu << (minBin % kLeafBins));
+	const uint32_t topMask = top + 1 < (uint32_t)kTopBins ? mTopMask & (0xffffffffu << (top + 1)) : 0;
+	if (leafMask)
+		index = mBinHeads[top * kLeafBins + lowestBit(leafMask)];
+	else if (topMask)
+	{
+		const uint32_t nextTop = (uint32_t)lowestBit(topMask);
+		index = mBinHeads[nextTop * kLeafBins + lowestBit(mLeafMasks[nextTop])];
+	}
+	else
+	{
+		// Only the bin below, whose regions may or may not fit, is left;
+		// worth a look when the space is nearly full.
+		for (uint32_t node = mBinHeads[binRoundDown(size)]; node != kNoSpace && index == kNoSpace; node = mNodes[node].binNext)
+		{
+			if (mNodes[node].size >= size)
+				index = node;
+		}
+		if (index == kNoSpace)
+			return Allocation();
+	}
+
+	mRemoveFree(index);
+	Node& node = mNodes[index];
+	const uint32_t remainder = node.size - size;
+	node.size = size;
+	node.used = true;
+	++mAllocations;
+	Allocation allocation;
+	allocation.offset = node.offset;
+	allocation.node = index;
+	if (remainder > 0)
+		mInsertFree(node.offset + size, remainder, index, node.neighborNext);
+	return allocation;
+}
+
+void OffsetAllocator::free(const Allocation& allocation)
+{
+	if (allocation.node >= mNodes.size() || !mNodes[allocation.node].used)
+		return;
+	const Node node = mNodes[allocation.node];
+	mUnusedNodes.push_back(allocation.node);
+	--mAllocations;
+
+	// Swallow free neighbours, then file the merged region as one.
+	uint32_t offset = node.offset, size = node.size;
+	uint32_t prev = node.neighborPrev, next = node.neighborNext;
+	if (prev != kNoSpace && !mNodes[prev].used)
+	{
+		offset = mNodes[prev].offset;
+		size += mNodes[prev].size;
+		mRemoveFree(prev);
+		mUnusedNodes.push_back(prev);
+		prev = mNodes[prev].neighborPrev;
+	}
+	if (next != kNoSpace && !mNodes[next].used)
+	{
+		size += mNodes[next].size;
+		mRemoveFree(next);
+		mUnusedNodes.push_back(next);
+		next = mNodes[next].neighborNext;
+	}
+	mInsertFree(offset, size, prev, next);
+}
+
+void OffsetAllocator::grow(uint32_t size)
+{
+	if (size <= mSize)
+		return;
+	const uint32_t extra = size - mSize;
+	mSize = size;
+	if (mLastNode != kNoSpace && !mNodes[mLastNode].used)
+	{
+		const Node last = mNodes[mLastNode];
+		mRemoveFree(mLastNode);
+		mUnusedNodes.push_back(mLastNode);
+		mInsertFree(last.offset, last.size + extra, last.neighborPrev, kNoSpace);
+	}
+	else
+		mInsertFree(size - extra, extra, mLastNode, kNoSpace);
+}
+
+uint32_t OffsetAllocator::allocationSize(const Allocation& allocation) const
+{
+	if (allocation.node >= mNodes.size() || !mNodes[allocation.node].used)
+		return 0;
+	return mNodes[allocation.node].size;
+}
+
+OffsetAllocator::Report OffsetAllocator::report() const
+{
+	Report report;
+	report.size = mSize;
+	report.freeSpace = mFreeSpace;
+	report.freeRegions = mFreeRegions;
+	report.allocations = mAllocations;
+	// The largest region is in the highest bin that holds any.
+	if (mTopMask)
+	{
+		const int top = highestBit(mTopMask);
+		const int bin = top * kLeafBins + highestBit(mLeafMasks[top]);
+		for (uint32_t node = mBinHeads[bin]; node != kNoSpace; node = mNodes[node].binNext)
+			report.largestFree = std::max(report.largestFree, mNodes[node].size);
+	}
+	return report;
+}
+
+uint32_t OffsetAllocator::mInsertFree(uint32_t offset, uint32_t size, uint32_t neighborPrev, uint32_t neighborNext)
+{
+	const uint32_t index = mNewNode();
+	Node& node = mNodes[index];
+	node.offset = offset;
+	node.size = size;
+	node.used = false;
+	node.neighborPrev = neighborPrev;
+	node.neighborNext = neighborNext;
+	if (neighborPrev != kNoSpace)
+		mNodes[neighborPrev].neighborNext = index;
+	if (neighborNext != kNoSpace)
+		mNodes[neighborNext].neighborPrev = index;
+	else
+		mLastNode = index;
+
+	const uint32_t bin = binRoundDown(size);
+	node.binPrev = kNoSpace;
+	node.binNext = mBinHeads[bin];
+	if (node.binNext != kNoSpace)
+		mNodes[node.binNext].binPrev = index;
+	mBinHeads[bin] = index;
+	mLeafMasks[bin / kLeafBins] |= (uint8_t)(1u << (bin % kLeafBins));
+	mTopMask |= 1u << (bin / kLeafBins);
+	mFreeSpace += size;
+	++mFreeRegions;
+	return index;
+}
+
+void OffsetAllocator::mRemoveFree(uint32_t index)
+{
+	const Node& node = mNodes[index];
+	const uint32_t bin = binRoundDown(node.size);
+	if (node.binPrev != kNoSpace)
+		mNodes[node.binPrev].binNext = node.binNext;
+	else
+		mBinHeads[bin] = node.binNext;
+	if (node.binNext != kNoSpace)
+		mNodes[node.binNext].binPrev = node.binPrev;
+	if (mBinHeads[bin] == kNoSpace)
+	{
+		mLeafMasks[bin / kLeafBins] &= (uint8_t)~(1u << (bin % kLeafBins));
+		if (!mLeafMasks[bin / kLeafBins])
+			mTopMask &= ~(1u << (bin / kLeafBins));
+	}
+	mFreeSpace -= node.size;
+	--mFreeRegions;
+}
+
+uint32_t OffsetAllocator::mNewNode()
+{
+	if (!mUnusedNodes.empty())
+	{
+		const uint32_t index = mUnusedNodes.back();
+		mUnusedNodes.pop_back();
+		return index;
+	}
+	mNodes.emplace_back();
+	return (uint32_t)(mNodes.size() - 1);
+}
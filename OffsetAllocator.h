@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Hands out ranges of a space of fixed size, in whatever unit the caller
+// counts (vertices, 4 byte words), in the manner of a TLSF allocator. Free
+// regions sit in bins by size, eight per power of two, with a bit per bin
+// saying whether it holds any, so allocating and freeing take a few bit scans
+// and never walk a list. A request is served from the first non-empty bin
+// whose regions are all large enough, splitting off what it does not use,
+// and only when there is none from a region in the bin below that happens to
+// fit. Freed ranges merge with free neighbours. CPU only and not thread safe.
+class OffsetAllocator
+{
+public:
+	static const uint32_t kNoSpace = 0xffffffff;
+
+	struct Allocation
+	{
+		uint32_t offset = kNoSpace;
+		uint32_t node = kNoSpace; // what free() needs back
+	};
+
+	struct Report
+	{
+		uint32_t size = 0;
+		uint32_t freeSpace = 0, largestFree = 0;
+		uint32_t freeRegions = 0, allocations = 0;
+
+		// 0 while the free space is one region, towards 1 as it splinters
+		// into regions too small for what is asked of them.
+		float fragmentation() const { return freeSpace ? 1.f - (float)largestFree / (float)freeSpace : 0.f; }
+	};
+
+	explicit OffsetAllocator(uint32_t size = 0);
+
+	// Forgets every allocation; the whole space is free again.
+	void reset(uint32_t size);
+
+	// offset kNoSpace if no free region is large enough. size 0 is served
+	// as 1.
+	Allocation allocate(uint32_t size);
+	void free(const Allocation& allocation);
+
+	// Adds space at the end, merged with a free region there.
+	void grow(uint32_t size);
+
+	uint32_t size() const { return mSize; }
+	uint32_t allocationSize(const Allocation& allocation) const;
+	Report report() const;
+
+private:
+	struct Node
+	{
+		uint32_t offset = 0, size = 0;
+		uint32_t binPrev = kNoSpace, binNext = kNoSpace;     // free regions in the same bin
+		uint32_t neighborPrev = kNoSpace, neighborNext = kNoSpace; // by address
+		bool used = false;
+	};
+
+	static const int kLeafBins = 8, kTopBins = 32, kBins = kLeafBins * kTopBins;
+
+	uint32_t mInsertFree(uint32_t offset, uint32_t size, uint32_t neighborPrev, uint32_t neighborNext);
+	void mRemoveFree(uint32_t node);
+	uint32_t mNewNode();
+
+private:
+	std::vector<Node> mNodes;
+	std::vector<uint32_t> mUnusedNodes;
+	uint32_t mBinHeads[kBins];
+	uint32_t mTopMask = 0;          // bit per top bin with any region
+	uint8_t mLeafMasks[kTopBins];   // bit per bin within a top bin
+	uint32_t mSize = 0, mFreeSpace = 0, mFreeRegions = 0, mAllocations = 0;
+	uint32_t mLastNode = kNoSpace;  // at the highest offset
+};
@@ -0,0 +1,47 @@
+#include "Simd.h"
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	SimdLevel queryCpu()
+	{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return SIMD_SSE2;
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool f16c = (info[2] & (1 << 29)) != 0;
+		if (!osxsave || !avx || !f16c || (_xgetbv(0) & 6) != 6)
+			return SIMD_SSE2;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) ? SIMD_AVX2 : SIMD_SSE2;
+#elif defined(SIMD_X86)
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c") ? SIMD_AVX2 : SIMD_SSE2;
+#else
+		return SIMD_SCALAR;
+#endif
+	}
+}
+
+SimdLevel detectSimdLevel()
+{
+	static const SimdLevel level = queryCpu();
+	return level;
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_SSE2: return "SSE2";
+	case SIMD_AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
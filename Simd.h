@@ -0,0 +1,38 @@
+#pragma once
+
+// Instruction set selection for the CPU side kernels. SSE2 is always present on
+// x64; AVX2 is detected at runtime and its kernels are compiled per function so
+// the rest of the project keeps the default code generation flags.
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(SIMD_X86) && !defined(_MSC_VER)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_F16C __attribute__((target("avx2,f16c")))
+#else
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_F16C
+#endif
+
+// For small kernels called from a hot loop that the compiler would otherwise
+// leave as calls, passing their registers through memory.
+#ifdef _MSC_VER
+#define SIMD_INLINE __forceinline
+#else
+#define SIMD_INLINE inline __attribute__((always_inline))
+#endif
+
+enum SimdLevel
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE2 = 1,
+	SIMD_AVX2 = 2  // with F16C, which every AVX2 CPU has
+};
+
+// Highest level supported by the running CPU.
+SimdLevel detectSimdLevel();
+
+const char* simdLevelName(SimdLevel level);
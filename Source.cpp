@@ -5,8 +5,29 @@
 #include "glm/gtc/quaternion.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
-
+#include "Benchmarks.h"
+#include "AssetIO.h"
+#include "GltfModel.h"
+#include "GeometryArena.h"
+#include "IndexBuffer.h"
+#include "MeshContainer.h"
+#include "MeshCooker.h"
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "TangentGenerator.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "TextureResidency.h"
+#include "TextureStreamer.h"
+#include "VertexLayout.h"
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <limits>
+#include <string>
 #include <vector>
 
 struct ViewMatrix
@@ -50,6 +71,14 @@ public:
 	void handleMouseMove(double xpos, double ypos);
 	void handleMouseButton(int button, int action, int mods);
 
+	// Texel bytes uploaded per frame for textures loaded without a cooked container.
+	void setTextureUploadBudget(size_t bytes) { mStreamer.setUploadBudget(bytes); }
+	// A .glb drawn in the middle of the room, loaded by init().
+	void setModelPath(const std::string& path) { mModelPath = path; }
+	// An OBJ or PLY drawn in the middle of the room as meshlets, culled on the
+	// CPU every frame. Loaded by init().
+	void setMeshPath(const std::string& path) { mMeshPath = path; }
+
 private:
 	OglRenderer();
 
@@ -59,6 +88,11 @@ private:
 	void mSetupGLSLProgram();
 	void mSetupBuffers();
 	void mLoadTextures();
+	void mLoadModel();
+	void mDrawModel();
+	void mLoadMesh();
+	void mDrawMesh();
+	TextureResidency::Handle mAddTexture(TextureLoader& loader, TextureLoader::Ticket ticket, const TextureSampling& sampling);
 	void mSetupRenderTarget();
 
 private:
@@ -71,10 +105,28 @@ private:
 
 	GLuint mViewMatrixUniformIdx = ~0, mLightUniformIdx = ~0;
 
-	GLuint  mvao = ~0;
-	GLuint mVtxBuffer = ~0, mTexCoordBuffer = ~0, mNormBuffer = ~0, mTangBuffer = ~0;
-	GLuint mDiffuseTexID = ~0, mNormalMapTexID = ~0;
-	int mNumElements = 0;
+	GeometryArena mSceneGeometry; // see mSetupBuffers
+	GeometryArena::Handle mQuad = GeometryArena::kInvalid;
+	TextureResidency mResidency;
+	TextureStreamer mStreamer;
+	TextureResidency::Handle mDiffuseTex = TextureResidency::kInvalid, mNormalMapTex = TextureResidency::kInvalid;
+	GLuint mRoomSampler = 0; // shared by both, see TextureCache::sampler
+	PackedIndices mQuadIndices; // as stored for mQuad
+	std::string mModelPath;
+	GltfModel mModel;
+	glm::mat4 mModelFit; // scales and moves the model into the room
+	std::string mMeshPath;
+	MeshLods mMeshLods;
+	std::vector<MeshletMesh> mMeshlets;      // per level of detail
+	std::vector<MeshletCuller> mMeshletCullers;
+	std::vector<uint32_t> mMeshletIndices; // this frame's visible triangles
+	size_t mMeshLod = ~(size_t)0;          // last printed
+	GeometryArena mMeshGeometry; // cooked meshes, in their layout
+	GeometryArena::Handle mMesh = GeometryArena::kInvalid; // every level as cooked, drawn when nothing is culled
+	GLuint mMeshIndexBuffer = 0;
+	std::vector<std::vector<IndexChunk>> mMeshLodChunks; // per level
+	glm::mat4 mMeshFit, mMeshDecode;
+	size_t mMeshVisibleTriangles = ~(size_t)0; // last printed
 
 	ViewMatrix mViewMat;
 	LightInfo mLightInfo;
@@ -92,9 +144,23 @@ private:
 
 
 
-int main()
+int main(int argc, char** argv)
 {
+	if (argc > 1 && std::string(argv[1]) == "--bench")
+		return runBenchmarks(argc - 2, argv + 2);
+
+	setJpegDecodePool(&ThreadPool::shared());
 	OglRenderer& renderer = OglRenderer::getInstance();
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string option = argv[i];
+		if (option == "--upload-budget-kb")
+			renderer.setTextureUploadBudget((size_t)std::stoul(argv[i + 1]) << 10);
+		else if (option == "--gltf")
+			renderer.setModelPath(argv[i + 1]);
+		else if (option == "--mesh")
+			renderer.setMeshPath(argv[i + 1]);
+	}
 
 	renderer.init();
 	renderer.run();
@@ -173,6 +239,16 @@ void OglRenderer::run()
 
 
 		mGlDraw();
+		const TextureResidency::Stats& stats = mResidency.stats();
+		if (stats.uploadedLevels || stats.evictedLevels)
+			mResidency.printStats(std::cout);
+		const TextureStreamer::FrameStats& frame = mStreamer.lastFrame();
+		if (frame.uploadedBytes)
+			std::cout << "Texture streaming: " << frame.uploadedBytes / 1024 << " KB in " << frame.slices << " slices, stalled "
+				<< frame.stallMs << " ms, " << frame.queuedBytes / 1024 << " KB to go" << std::endl;
+		// Keep drawing while finer mips or streamed texels are still on their way.
+		if (stats.pendingRequests || mStreamer.pending())
+			glfwPostEmptyEvent();
 
 		glfwSwapBuffers(window);
 		glfwWaitEvents();
@@ -181,6 +257,13 @@ void OglRenderer::run()
 
 void OglRenderer::cleanup()
 {
+	mStreamer.printStats(std::cout);
+	mStreamer.clear();
+	mResidency.clear();
+	mModel.release();
+	mSceneGeometry.release();
+	mMeshGeometry.release();
+	glDeleteBuffers(1, &mMeshIndexBuffer);
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
@@ -232,10 +315,14 @@ void OglRenderer::mGlInit()
 	glBufferData(GL_UNIFORM_BUFFER, sizeof(mLightInfo), &mLightInfo, GL_STATIC_DRAW);
 
 	mLoadTextures();
+	mLoadModel();
+	mLoadMesh();
 }
 
 void OglRenderer::mGlDraw()
 {
+	mResidency.beginFrame();
+
 	if (mViewportDirty == true)
 	{
 		mViewMat.projection = glm::perspective(glm::radians(30.f), (float)mViewportSize.x / mViewportSize.y, 0.001f, 1000.f);
@@ -257,6 +344,7 @@ void OglRenderer::mGlDraw()
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 	glEnable(GL_MULTISAMPLE);
+	glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
 
 	glUseProgram(mPrg0ID);
 	glBindBufferBase(GL_UNIFORM_BUFFER, 0, mViewMatrixUniformIdx);
@@ -282,8 +370,8 @@ void OglRenderer::mGlDraw()
 	glUniform1f(6, shininess);
 	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(mViewMat.view * xform)));
 	glUniformMatrix3fv(7, 1, GL_FALSE, &normalMatrix[0][0]);
-	glBindVertexArray(mvao);
-	glDrawElements(GL_TRIANGLES, mNumElements, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(mSceneGeometry.vertexArray());
+	mSceneGeometry.draw(mQuad, mQuadIndices.mode, mQuadIndices.chunks);
 
 	// right wall
 	Ka = glm::vec3(1);
@@ -301,7 +389,7 @@ void OglRenderer::mGlDraw()
 	glUniform1f(6, shininess);
 	normalMatrix = glm::transpose(glm::inverse(glm::mat3(mViewMat.view * xform)));
 	glUniformMatrix3fv(7, 1, GL_FALSE, &normalMatrix[0][0]);
-	glDrawElements(GL_TRIANGLES, mNumElements, GL_UNSIGNED_INT, 0);
+	mSceneGeometry.draw(mQuad, mQuadIndices.mode, mQuadIndices.chunks);
 
 	// left wall
 	xform = glm::rotate(glm::radians(-90.f), glm::vec3(0, 1, 0.0));
@@ -316,7 +404,7 @@ void OglRenderer::mGlDraw()
 	glUniform1f(6, shininess);
 	normalMatrix = glm::transpose(glm::inverse(glm::mat3(mViewMat.view * xform)));
 	glUniformMatrix3fv(7, 1, GL_FALSE, &normalMatrix[0][0]);
-	glDrawElements(GL_TRIANGLES, mNumElements, GL_UNSIGNED_INT, 0);
+	mSceneGeometry.draw(mQuad, mQuadIndices.mode, mQuadIndices.chunks);
 
 	// back wall
 	xform = glm::rotate(glm::radians(180.f), glm::vec3(0, 1, 0));
@@ -331,7 +419,7 @@ void OglRenderer::mGlDraw()
 	glUniform1f(6, shininess);
 	normalMatrix = glm::transpose(glm::inverse(glm::mat3(mViewMat.view * xform)));
 	glUniformMatrix3fv(7, 1, GL_FALSE, &normalMatrix[0][0]);
-	glDrawElements(GL_TRIANGLES, mNumElements, GL_UNSIGNED_INT, 0);
+	mSceneGeometry.draw(mQuad, mQuadIndices.mode, mQuadIndices.chunks);
 
 	glUseProgram(mPrg1ID);
 
@@ -347,19 +435,32 @@ void OglRenderer::mGlDraw()
 	glUniform3fv(4, 1, &Kd[0]);
 	glUniform3fv(5, 1, &Ks[0]);
 	glUniform1f(6, shininess);
+	// The unit quad from mSetupBuffers, with the textures mapped across it once.
+	const glm::mat4 mvp = mViewMat.viewprojection * xform;
+	const glm::vec3 quadMin(-0.5f, -0.5f, 0.f), quadMax(0.5f, 0.5f, 0.f);
+	mResidency.noteUse(mDiffuseTex, mvp, quadMin, quadMax, mViewportSize);
+	mResidency.noteUse(mNormalMapTex, mvp, quadMin, quadMax, mViewportSize);
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, mDiffuseTexID);
+	glBindTexture(GL_TEXTURE_2D, mResidency.texture(mDiffuseTex));
+	glBindSampler(0, mRoomSampler);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, mNormalMapTexID);
+	glBindTexture(GL_TEXTURE_2D, mResidency.texture(mNormalMapTex));
+	glBindSampler(1, mRoomSampler);
 	normalMatrix = glm::transpose(glm::inverse(glm::mat3(mViewMat.view * xform)));
 	glUniformMatrix3fv(7, 1, GL_FALSE, &normalMatrix[0][0]);
-	glDrawElements(GL_TRIANGLES, mNumElements, GL_UNSIGNED_INT, 0);
+	mSceneGeometry.draw(mQuad, mQuadIndices.mode, mQuadIndices.chunks);
+
+	mDrawModel();
+	mDrawMesh();
 
 	glBindVertexArray(0);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	glBlitNamedFramebuffer(mFBO, 0, 0, 0, mViewportSize.x, mViewportSize.y, 0, 0, mViewportSize.x, mViewportSize.y, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+
+	mResidency.update();
+	mStreamer.update();
 }
 
 void OglRenderer::mSetupGLSLProgram()
@@ -369,7 +470,7 @@ void OglRenderer::mSetupGLSLProgram()
 layout (location = 0) in vec3 inVert; \n\
 layout (location = 1) in vec2 inTexCoord; \n\
 layout (location = 2) in vec3 inNorm;\n\
-layout (location = 3) in vec3 inTang;\n\
+layout (location = 3) in vec4 inTang;\n\
 layout (std140, binding = 0) uniform ViewMatrix \n\
 {\n\
 	mat4 view, projection, viewprojection; \n\
@@ -398,12 +499,12 @@ void main() \n\
 	vs_out.texCoord = inTexCoord; \n\
 	vs_out.pos = vec3( viewmatrix.view * modelMatrix * vec4(inVert, 1.0)); \n\
 	vs_out.normal = normalize(normalMatrix * inNorm);\n\
-	vs_out.tangent = normalize(normalMatrix * inTang);\n\
-	vec3 binormal = normalize(cross(vs_out.tangent, vs_out.normal));\n\
+	vs_out.tangent = normalize(normalMatrix * inTang.xyz);\n\
+	vec3 binormal = cross(vs_out.normal, vs_out.tangent) * inTang.w;\n\
 	mat3 tangentSpaceMat = mat3(\n\
-		vs_out.tangent.x, vs_out.normal.x, binormal.x,\n\
-		vs_out.tangent.y, vs_out.normal.y, binormal.y,\n\
-		vs_out.tangent.z, vs_out.normal.z, binormal.z\n\
+		vs_out.tangent.x, binormal.x, vs_out.normal.x,\n\
+		vs_out.tangent.y, binormal.y, vs_out.normal.y,\n\
+		vs_out.tangent.z, binormal.z, vs_out.normal.z\n\
 		);\n\
 	vs_out.lightpos = tangentSpaceMat * (vec3(viewmatrix.view * vec4(lightInfo.lightDir.xyz , 1)) - vs_out.pos);\n\
 	vs_out.viewDir = tangentSpaceMat * vec3(-vs_out.pos);\n\
@@ -499,6 +600,11 @@ layout (binding = 0) uniform sampler2D diffuseTexture;\n\
 layout (binding = 1) uniform sampler2D bumpTexture;\n\
 layout (location = 7) uniform mat3 normalMatrix = mat3(1.f); \n\
 out vec4 outColor; \n\
+vec3 decode_normal(in vec4 texel)\n\
+{\n\
+	vec2 xy = 2 * texel.xy - 1;\n\
+	return vec3(xy, sqrt(max(1 - dot(xy, xy), 0.0)));\n\
+}\n\
 vec3 eval_lights_bump(in vec3 normal, in vec3 in_diffColor)\n\
 {\n\
 	vec3 n = normalize(normal);\n\
@@ -527,7 +633,7 @@ void main() \n\
 	if ((settings & LIGHT_ON) != 0)\n\
 	{\
 		if ((settings & BUMP_ON) != 0) \n\
-			outColor = vec4(eval_lights_bump(vec3(2 * texture(bumpTexture, fs_in.texCoord) - 1), outColor.rgb), 1);\n\
+			outColor = vec4(eval_lights_bump(decode_normal(texture(bumpTexture, fs_in.texCoord)), outColor.rgb), 1);\n\
 		else \n\
 			outColor = vec4(eval_lights(), 1) * outColor;\n\
 	}\
@@ -585,97 +691,323 @@ void main() \n\
 
 void OglRenderer::mSetupBuffers()
 {
-	std::vector<glm::vec3> vtx = {
+	Mesh mesh;
+	VertexStreams& streams = mesh.streams;
+	streams.positions = {
 		glm::vec3(-0.5, 0.5, 0.0),
 		glm::vec3(0.5, 0.5, 0.0),
 		glm::vec3(0.5, -0.5, 0.0),
 		glm::vec3(-0.5, -0.5, 0.0)
 	};
 
-	std::vector<unsigned int> idx = {
+	mesh.indices = {
 		0, 3, 2, 0, 2, 1
 	};
 
-	std::vector<glm::vec2> texCoord = {
+	streams.texCoords = {
 		glm::vec2(0, 1),
 		glm::vec2(1, 1),
 		glm::vec2(1, 0),
 		glm::vec2(0, 0)
 	};
 
-	std::vector<glm::vec3> norm = {
+	streams.normals = {
 		glm::vec3(0, 0, 1),
 		glm::vec3(0, 0, 1),
 		glm::vec3(0, 0, 1),
 		glm::vec3(0, 0, 1)
 	};
 
-	std::vector<glm::vec3> tang = {
-		glm::vec3(1, 0, 0),
-		glm::vec3(1, 0, 0),
-		glm::vec3(1, 0, 0),
-		glm::vec3(1, 0, 0)
-	};
-	mNumElements = (int)idx.size();
-
-	glGenVertexArrays(1, &mvao);
-	glBindVertexArray(mvao);
-
-	glGenBuffers(1, &mVtxBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, mVtxBuffer);
-	glBufferData(GL_ARRAY_BUFFER, vtx.size() * sizeof(glm::vec3), vtx.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-
-	glGenBuffers(1, &mTexCoordBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, mTexCoordBuffer);
-	glBufferData(GL_ARRAY_BUFFER, texCoord.size() * sizeof(glm::vec2), texCoord.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(1);
-
-	glGenBuffers(1, &mNormBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, mNormBuffer);
-	glBufferData(GL_ARRAY_BUFFER, norm.size() * sizeof(glm::vec3), norm.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(2);
-
-	glGenBuffers(1, &mTangBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, mTangBuffer);
-	glBufferData(GL_ARRAY_BUFFER, tang.size() * sizeof(glm::vec3), tang.data(), GL_STATIC_DRAW);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(3);
-
-	GLuint ebo;
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(unsigned int), idx.data(), GL_STATIC_DRAW);
-
+	TangentGenerator tangents;
+	tangents.generate(mesh);
+
+	const VertexCacheStats before = MeshOptimizer::analyzeVertexCache(mesh.indices, streams.count());
+	MeshOptimizer::optimize(mesh);
+	const VertexCacheStats after = MeshOptimizer::analyzeVertexCache(mesh.indices, streams.count());
+	std::cout << "Mesh optimizer: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+	// The narrowest indices that reach the vertices, as a strip if that is
+	// shorter.
+	IndexPackParams indexParams;
+	indexParams.strips = true;
+	mQuadIndices = IndexPacker::pack(mesh.indices, streams.count(), indexParams);
+	std::cout << "Index buffer: " << mQuadIndices.data.size() << " bytes, " << mQuadIndices.count() << " "
+		<< mQuadIndices.indexBytes * 8 << " bit indices as " << (mQuadIndices.mode == GL_TRIANGLE_STRIP ? "strips" : "a list")
+		<< " in " << mQuadIndices.chunks.size() << " draw(s); was " << mesh.indices.size() * sizeof(uint32_t) << " bytes of 32 bit indices"
+		<< std::endl;
+
+	// One interleaved stream. Half positions stay in object space, so the
+	// model matrices need no decode transform.
+	const PackedVertices vertices = VertexPacker::pack(streams, VertexLayout::compact(VertexEncoding::Half3));
+	const VertexQuantizationError error = VertexPacker::measure(streams, vertices);
+	std::cout << "Vertex layout: " << vertices.layout.describe() << ", was " << VertexLayout::floats().stride()
+		<< " bytes in four streams; max position error " << error.position << ", normal " << error.normalDegrees << " degrees" << std::endl;
+
+	// Everything drawn in this layout shares one arena; the room is the only
+	// mesh in it so far.
+	GeometryArenaParams arenaParams;
+	arenaParams.vertexCapacity = 1024;
+	arenaParams.indexCapacity = 16 * 1024;
+	mSceneGeometry.create(vertices.layout, arenaParams);
+	mQuad = mSceneGeometry.add(vertices.data.data(), vertices.count, mQuadIndices.data.data(), mQuadIndices.count(), mQuadIndices.indexBytes);
 }
 
 void OglRenderer::mLoadTextures()
 {
-	int width, height, nchannels;
-	unsigned char* data = stbi_load("textures/green_grass.jpg", &width, &height, &nchannels, 0);
-	glGenTextures(1, &mDiffuseTexID);
-	glBindTexture(GL_TEXTURE_2D, mDiffuseTexID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	stbi_image_free(data);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	data = nullptr; width = 0, height = 0, nchannels = 0;
-	data = stbi_load("textures/green_grass_normalmap.png", &width, &height, &nchannels, 0);
-	glGenTextures(1, &mNormalMapTexID);
-	glBindTexture(GL_TEXTURE_2D, mNormalMapTexID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-	stbi_image_free(data);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	TextureLoader loader;
+	TextureLoadParams params;
+	params.mips = true;
+	params.compress = true;
+	params.cook = true;
+
+	params.usage = TextureUsage::Color;
+	auto diffuse = loader.request("textures/green_grass.jpg", params);
+	params.usage = TextureUsage::Normal;
+	auto normalMap = loader.request("textures/green_grass_normalmap.png", params);
+
+	TextureSampling sampling;
+	sampling.minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	sampling.magFilter = GL_LINEAR;
+	sampling.wrap = GL_REPEAT;
+	mDiffuseTex = mAddTexture(loader, diffuse, sampling);
+	mNormalMapTex = mAddTexture(loader, normalMap, sampling);
+	mRoomSampler = TextureCache::shared().sampler(sampling);
+
+	loader.printTimingReport(std::cout);
+	AssetIO::shared().printStats(std::cout);
+	TextureCache::shared().printStats(std::cout);
+	mResidency.printStats(std::cout);
+}
+
+// Fits a box into a unit box standing on the floor.
+static glm::mat4 fitIntoRoom(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	const glm::vec3 extent = boundsMax - boundsMin;
+	const float scale = 1.f / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+	const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	return glm::translate(glm::vec3(0.f, extent.y * scale * 0.5f, 0.f)) * glm::scale(glm::vec3(scale)) * glm::translate(-center);
+}
+
+void OglRenderer::mLoadModel()
+{
+	if (mModelPath.empty() || !mModel.load(mModelPath) || !mModel.upload(&mStreamer))
+		return;
+	mModel.printStats(std::cout);
+
+	glm::vec3 boundsMin, boundsMax;
+	mModelFit = mModel.bounds(boundsMin, boundsMax) ? fitIntoRoom(boundsMin, boundsMax) : glm::mat4(1.f);
+}
+
+void OglRenderer::mDrawModel()
+{
+	if (!mModel.buffer())
+		return;
+
+	// Attributes a primitive does not have read these instead.
+	glVertexAttrib2f((GLuint)VertexSemantic::TexCoord, 0.f, 0.f);
+	glVertexAttrib3f((GLuint)VertexSemantic::Normal, 0.f, 0.f, 1.f);
+	glVertexAttrib4f((GLuint)VertexSemantic::Tangent, 1.f, 0.f, 0.f, 1.f);
+
+	const GltfMaterial defaultMaterial;
+	const glm::vec4 white(1.f);
+	for (const GltfInstance& instance : mModel.instances())
+	{
+		const glm::mat4 xform = mModelFit * instance.transform;
+		const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(mViewMat.view * xform)));
+		const GltfMesh& mesh = mModel.meshes()[instance.mesh];
+		for (size_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+		{
+			const GltfPrimitive& primitive = mModel.primitives()[p];
+			if (!primitive.vao)
+				continue;
+			const GltfMaterial& material = primitive.material >= 0 ? mModel.materials()[primitive.material] : defaultMaterial;
+			const GLuint diffuse = material.diffuseImage >= 0 ? mModel.images()[material.diffuseImage].texture : 0;
+			const GLuint normalMap = material.normalImage >= 0 ? mModel.images()[material.normalImage].texture : 0;
+			const bool textured = diffuse && primitive.has(VertexSemantic::TexCoord);
+			const bool bump = textured && normalMap && primitive.has(VertexSemantic::Tangent);
+
+			// Kd carries the base color, so the flat color stays white.
+			glUseProgram(textured ? mPrg1ID : mPrg0ID);
+			glUniformMatrix4fv(0, 1, GL_FALSE, &xform[0][0]);
+			glUniform4fv(1, 1, &white[0]);
+			glUniform1i(2, mSettings | (bump ? BUMP_ON : 0));
+			glUniform3fv(3, 1, &material.Ka[0]);
+			glUniform3fv(4, 1, &material.Kd[0]);
+			glUniform3fv(5, 1, &material.Ks[0]);
+			glUniform1f(6, material.shininess);
+			glUniformMatrix3fv(7, 1, GL_FALSE, &normalMatrix[0][0]);
+			if (textured)
+			{
+				glBindTextureUnit(0, diffuse);
+				glBindTextureUnit(1, normalMap);
+				glBindSampler(0, material.diffuseSampler);
+				glBindSampler(1, material.normalSampler);
+			}
+			if (material.doubleSided)
+				glDisable(GL_CULL_FACE);
+
+			glBindVertexArray(primitive.vao);
+			if (primitive.indexType)
+				glDrawElements(primitive.mode, primitive.count, primitive.indexType, (const void*)primitive.indexOffset);
+			else
+				glDrawArrays(primitive.mode, 0, primitive.count);
+
+			if (material.doubleSided)
+				glEnable(GL_CULL_FACE);
+		}
+	}
+}
+
+void OglRenderer::mLoadMesh()
+{
+	// Cooked once into <path>.omesh; later runs map that and upload from it.
+	MeshCooker cooker;
+	MeshContainer container;
+	if (mMeshPath.empty() || !cooker.load(mMeshPath, container) || container.submeshCount() == 0)
+		return;
+	const MeshCooker::Stats& cookStats = cooker.stats();
+	std::cout << "Mesh cache: " << (cookStats.cooked ? "cooked " : "loaded ") << MeshCooker::cookedPath(mMeshPath) << ", "
+		<< cookStats.containerBytes / 1024 << " KB; check " << cookStats.checkMs << " ms" << (cookStats.hashChecked ? " (hashed)" : "")
+		<< ", cook " << cookStats.cookMs << " ms" << std::endl;
+
+	// Every level indexes the same vertices, so one vertex buffer serves all
+	// of them and each level only brings its own meshlets.
+	const MeshContainer::Submesh& submesh = container.submesh(0);
+	mMeshLods = submesh.lods;
+	mMeshlets.clear();
+	for (size_t level = 0; level < mMeshLods.levels.size(); ++level)
+	{
+		mMeshlets.push_back(container.meshlets(0, level));
+		std::cout << "LOD " << level << ": " << mMeshLods.levels[level].indexCount / 3 << " triangles, error "
+			<< mMeshLods.levels[level].error << ", " << mMeshlets.back().meshlets.size() << " meshlets" << std::endl;
+	}
+	// The cullers point into mMeshlets, so only once it has stopped growing.
+	mMeshletCullers.assign(mMeshlets.size(), MeshletCuller());
+	for (size_t level = 0; level < mMeshlets.size(); ++level)
+		mMeshletCullers[level].setMesh(mMeshlets[level]);
+
+	mMeshFit = fitIntoRoom(submesh.boundsMin, submesh.boundsMax);
+	mMeshDecode = container.decodeTransform();
+	// Cooked meshes share an arena sized for the first of them; more grow it.
+	const auto uploadStart = std::chrono::steady_clock::now();
+	std::vector<unsigned char> vertexScratch, indexScratch;
+	const unsigned char* vertices = container.vertexData(vertexScratch);
+	const unsigned char* indices = container.indexData(indexScratch);
+	if (!vertices || !indices)
+	{
+		std::cerr << "Mesh: " << mMeshPath << " does not decode" << std::endl;
+		mMeshLods = MeshLods();
+		return;
+	}
+	if (!mMeshGeometry.isCreated())
+	{
+		GeometryArenaParams arenaParams;
+		arenaParams.vertexCapacity = std::max(arenaParams.vertexCapacity, container.vertexCount());
+		arenaParams.indexCapacity = std::max(arenaParams.indexCapacity, container.indexCount() * container.indexBytes());
+		mMeshGeometry.create(container.layout(), arenaParams);
+	}
+	mMesh = mMeshGeometry.add(vertices, container.vertexCount(), indices, container.indexCount(), container.indexBytes());
+	if (mMesh == GeometryArena::kInvalid)
+	{
+		mMeshLods = MeshLods();
+		return;
+	}
+	const size_t rawBytes = container.vertexCount() * container.layout().stride() + container.indexCount() * container.indexBytes();
+	const size_t storedBytes = container.storedVertexBytes() + container.storedIndexBytes();
+	std::cout << "Mesh geometry: " << storedBytes / 1024 << " KB stored for " << rawBytes / 1024 << " KB ("
+		<< (container.compression() == MeshCompression::Codec ? "MeshCodec, " : "plain, ") << 100.0 * storedBytes / std::max<size_t>(rawBytes, 1)
+		<< "%), " << (container.compression() == MeshCompression::Codec ? "decoded and " : "")
+		<< "uploaded in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count()
+		<< " ms" << std::endl;
+	mMeshGeometry.printStats(std::cout);
+	mMeshLodChunks = submesh.chunks;
+	size_t chunkCount = 0;
+	for (const std::vector<IndexChunk>& chunks : mMeshLodChunks)
+		chunkCount += chunks.size();
+	std::cout << "Mesh indices: " << container.indexCount() * container.indexBytes() / 1024 << " KB of " << container.indexBytes() * 8
+		<< " bit indices in " << chunkCount << " draws over " << mMeshLodChunks.size() << " levels; "
+		<< container.indexCount() * sizeof(uint32_t) / 1024 << " KB at 32 bits" << std::endl;
+	// Rewritten every frame with the meshlets that survive culling.
+	const size_t fullCount = mMeshLods.levels.empty() ? 0 : mMeshLods.levels[0].indexCount;
+	glCreateBuffers(1, &mMeshIndexBuffer);
+	glNamedBufferStorage(mMeshIndexBuffer, std::max<size_t>(fullCount, 1) * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+void OglRenderer::mDrawMesh()
+{
+	if (mMesh == GeometryArena::kInvalid || mMeshLods.levels.empty())
+		return;
+
+	const size_t lod = mMeshLods.select(mMeshFit, mViewMat.view, mViewMat.projection, (float)mViewportSize.y);
+	if (lod != mMeshLod)
+	{
+		std::cout << "Mesh LOD " << lod << ": " << mMeshLods.levels[lod].indexCount / 3 << " triangles" << std::endl;
+		mMeshLod = lod;
+	}
+	// With nothing culled, or no meshlets to cull, the level's cooked indices
+	// are drawn as they are and nothing is uploaded.
+	const MeshLod& level = mMeshLods.levels[lod];
+	size_t count = level.indexCount;
+	bool culled = false;
+	if (!mMeshlets[lod].meshlets.empty())
+	{
+		MeshletCuller& culler = mMeshletCullers[lod];
+		count = culler.cull(mMeshFit, mViewMat.view, mViewMat.projection, mMeshletIndices);
+		const MeshletCullStats& stats = culler.stats();
+		if (stats.visibleTriangles != mMeshVisibleTriangles)
+		{
+			std::cout << "Meshlet culling: " << stats.visibleTriangles << " of " << stats.triangles << " triangles drawn, "
+				<< stats.backfacingTriangles << " back facing, " << stats.outsideTriangles << " outside the frustum; "
+				<< stats.cullMs + stats.compactMs << " ms" << std::endl;
+			mMeshVisibleTriangles = stats.visibleTriangles;
+		}
+		culled = stats.visibleTriangles < stats.triangles;
+		if (culled && count > 0)
+			glNamedBufferSubData(mMeshIndexBuffer, 0, count * sizeof(uint32_t), mMeshletIndices.data());
+	}
+	if (count == 0)
+		return;
+
+	const glm::mat4 xform = mMeshFit * mMeshDecode;
+	const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(mViewMat.view * mMeshFit)));
+	const glm::vec4 color(0.7f, 0.7f, 0.75f, 1.f);
+	const glm::vec3 Ka(0.1f), Kd(0.7f), Ks(0.3f);
+	glUseProgram(mPrg0ID);
+	glUniformMatrix4fv(0, 1, GL_FALSE, &xform[0][0]);
+	glUniform4fv(1, 1, &color[0]);
+	glUniform1i(2, mSettings);
+	glUniform3fv(3, 1, &Ka[0]);
+	glUniform3fv(4, 1, &Kd[0]);
+	glUniform3fv(5, 1, &Ks[0]);
+	glUniform1f(6, 60.f);
+	glUniformMatrix3fv(7, 1, GL_FALSE, &normalMatrix[0][0]);
+	const GLuint vertexArray = mMeshGeometry.vertexArray();
+	glBindVertexArray(vertexArray);
+	if (culled)
+	{
+		// The visible triangles index the mesh's own vertices too, but come
+		// from their own buffer for the one draw.
+		glVertexArrayElementBuffer(vertexArray, mMeshIndexBuffer);
+		glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)count, GL_UNSIGNED_INT, 0, (GLint)mMeshGeometry.range(mMesh).baseVertex);
+		glVertexArrayElementBuffer(vertexArray, mMeshGeometry.indexBuffer());
+	}
+	else
+		mMeshGeometry.draw(mMesh, GL_TRIANGLES, mMeshLodChunks[lod]);
+}
+
+TextureResidency::Handle OglRenderer::mAddTexture(TextureLoader& loader, TextureLoader::Ticket ticket, const TextureSampling& sampling)
+{
+	// Cooking leaves a container behind that the residency manager streams
+	// from. Without one the whole chain stays resident, its texels streamed in
+	// over the next frames.
+	const TextureLoader::Image& image = loader.wait(ticket);
+	TextureResidency::Handle handle = mResidency.add(TextureLoader::cookedPath(image.path), sampling);
+	if (handle != TextureResidency::kInvalid)
+		return handle;
+
+	const size_t bytes = image.compressed() ? image.blocks.data.size() : image.isHdr() ? image.hdr.data.size() : image.chain.data.size();
+	// The texture may be shared through the cache, so its sampling comes from
+	// mRoomSampler rather than its own parameters.
+	return mResidency.adopt(loader.upload(ticket, &mStreamer), bytes);
 }
 
 void OglRenderer::mSetupRenderTarget()
@@ -0,0 +1,329 @@
+#include "TangentGenerator.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const size_t kTriangleBlock = 1 << 14;
+	const size_t kVertexBlock = 1 << 15;
+
+	double msSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// MikkTSpace's NotZero.
+	bool notZero(float value)
+	{
+		return std::fabs(value) > FLT_MIN;
+	}
+
+	glm::vec3 normalizeOrZero(const glm::vec3& v)
+	{
+		const float length = std::sqrt(glm::dot(v, v));
+		return length > FLT_MIN ? v / length : glm::vec3(0.f);
+	}
+
+	// Angle weighted corner tangents of triangles [begin, end) into
+	// corners[3 * t + k], and each triangle's bitangent sign into signs: 1, -1,
+	// 0 for no UV area, or 0 with zero corners for a zero length edge.
+	void cornersScalar(const uint32_t* indices, const VertexStreams& streams, size_t begin, size_t end,
+		glm::vec3* corners, int8_t* signs)
+	{
+		for (size_t t = begin; t < end; ++t)
+		{
+			const uint32_t* triangle = &indices[t * 3];
+			const glm::vec3 p[3] = { streams.positions[triangle[0]], streams.positions[triangle[1]], streams.positions[triangle[2]] };
+			const glm::vec2 uv[3] = { streams.texCoords[triangle[0]], streams.texCoords[triangle[1]], streams.texCoords[triangle[2]] };
+			const glm::vec3 d1 = p[1] - p[0], d2 = p[2] - p[0], d3 = p[2] - p[1];
+			if (!(glm::dot(d1, d1) > 0.f && glm::dot(d2, d2) > 0.f && glm::dot(d3, d3) > 0.f))
+			{
+				signs[t] = 0;
+				corners[t * 3] = corners[t * 3 + 1] = corners[t * 3 + 2] = glm::vec3(0.f);
+				continue;
+			}
+			const glm::vec2 t21 = uv[1] - uv[0], t31 = uv[2] - uv[0];
+			const float area = t21.x * t31.y - t21.y * t31.x;
+			signs[t] = area > FLT_MIN ? 1 : area < -FLT_MIN ? -1 : 0;
+			// Twice the UV area times dP/du; the sign makes it dP/du's direction.
+			glm::vec3 tangent = t31.y * d1 - t21.y * d2;
+			if (signs[t] < 0)
+				tangent = -tangent;
+
+			for (int k = 0; k < 3; ++k)
+			{
+				const glm::vec3& n = streams.normals[triangle[k]];
+				const glm::vec3 projected = normalizeOrZero(tangent - glm::dot(n, tangent) * n);
+				glm::vec3 toPrevious = p[(k + 2) % 3] - p[k], toNext = p[(k + 1) % 3] - p[k];
+				toPrevious = normalizeOrZero(toPrevious - glm::dot(n, toPrevious) * n);
+				toNext = normalizeOrZero(toNext - glm::dot(n, toNext) * n);
+				const float angle = std::acos(glm::clamp(glm::dot(toPrevious, toNext), -1.f, 1.f));
+				corners[t * 3 + k] = projected * angle;
+			}
+		}
+	}
+
+#ifdef SIMD_X86
+	__m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+	}
+
+	// v - dot(n, v) n, normalized, or zero where that is shorter than FLT_MIN.
+	void projectNormalize(__m128& x, __m128& y, __m128& z, __m128 nx, __m128 ny, __m128 nz)
+	{
+		const __m128 along = dot3(nx, ny, nz, x, y, z);
+		x = _mm_sub_ps(x, _mm_mul_ps(along, nx));
+		y = _mm_sub_ps(y, _mm_mul_ps(along, ny));
+		z = _mm_sub_ps(z, _mm_mul_ps(along, nz));
+		const __m128 length = _mm_sqrt_ps(dot3(x, y, z, x, y, z));
+		const __m128 valid = _mm_cmpgt_ps(length, _mm_set1_ps(FLT_MIN));
+		const __m128 divisor = _mm_max_ps(length, _mm_set1_ps(FLT_MIN));
+		x = _mm_and_ps(valid, _mm_div_ps(x, divisor));
+		y = _mm_and_ps(valid, _mm_div_ps(y, divisor));
+		z = _mm_and_ps(valid, _mm_div_ps(z, divisor));
+	}
+
+	// acos on [-1, 1] as sqrt(1 - |x|) times a polynomial in |x| (Abramowitz
+	// and Stegun 4.4.46, error under 2e-8), reflected for negative x.
+	__m128 acosSse2(__m128 x)
+	{
+		const __m128 ax = _mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+		const float coefficients[] = { -0.0012624911f, 0.0066700901f, -0.0170881256f, 0.0308918810f, -0.0501743046f,
+			0.0889789874f, -0.2145988016f, 1.5707963050f };
+		__m128 polynomial = _mm_set1_ps(coefficients[0]);
+		for (int i = 1; i < 8; ++i)
+			polynomial = _mm_add_ps(_mm_mul_ps(polynomial, ax), _mm_set1_ps(coefficients[i]));
+		const __m128 angle = _mm_mul_ps(_mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.f), ax), _mm_setzero_ps())), polynomial);
+		const __m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+		return _mm_or_ps(_mm_andnot_ps(negative, angle), _mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(3.14159265f), angle)));
+	}
+
+	// cornersScalar, four triangles at a time: corners are gathered into
+	// structures of arrays, and the results scattered back.
+	void cornersSse2(const uint32_t* indices, const VertexStreams& streams, size_t begin, size_t end,
+		glm::vec3* corners, int8_t* signs)
+	{
+		size_t t = begin;
+		for (; t + 4 <= end; t += 4)
+		{
+			alignas(16) float px[3][4], py[3][4], pz[3][4], nx[3][4], ny[3][4], nz[3][4], u[3][4], v[3][4];
+			for (int j = 0; j < 4; ++j)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					const uint32_t index = indices[(t + j) * 3 + k];
+					const glm::vec3& p = streams.positions[index];
+					const glm::vec3& n = streams.normals[index];
+					const glm::vec2& uv = streams.texCoords[index];
+					px[k][j] = p.x, py[k][j] = p.y, pz[k][j] = p.z;
+					nx[k][j] = n.x, ny[k][j] = n.y, nz[k][j] = n.z;
+					u[k][j] = uv.x, v[k][j] = uv.y;
+				}
+			}
+			__m128 x[3], y[3], z[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				x[k] = _mm_load_ps(px[k]);
+				y[k] = _mm_load_ps(py[k]);
+				z[k] = _mm_load_ps(pz[k]);
+			}
+			const __m128 d1x = _mm_sub_ps(x[1], x[0]), d1y = _mm_sub_ps(y[1], y[0]), d1z = _mm_sub_ps(z[1], z[0]);
+			const __m128 d2x = _mm_sub_ps(x[2], x[0]), d2y = _mm_sub_ps(y[2], y[0]), d2z = _mm_sub_ps(z[2], z[0]);
+			const __m128 d3x = _mm_sub_ps(x[2], x[1]), d3y = _mm_sub_ps(y[2], y[1]), d3z = _mm_sub_ps(z[2], z[1]);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 valid = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(dot3(d1x, d1y, d1z, d1x, d1y, d1z), zero),
+				_mm_cmpgt_ps(dot3(d2x, d2y, d2z, d2x, d2y, d2z), zero)), _mm_cmpgt_ps(dot3(d3x, d3y, d3z, d3x, d3y, d3z), zero));
+
+			const __m128 u0 = _mm_load_ps(u[0]), v0 = _mm_load_ps(v[0]);
+			const __m128 t21u = _mm_sub_ps(_mm_load_ps(u[1]), u0), t21v = _mm_sub_ps(_mm_load_ps(v[1]), v0);
+			const __m128 t31u = _mm_sub_ps(_mm_load_ps(u[2]), u0), t31v = _mm_sub_ps(_mm_load_ps(v[2]), v0);
+			const __m128 area = _mm_sub_ps(_mm_mul_ps(t21u, t31v), _mm_mul_ps(t21v, t31u));
+			const __m128 positive = _mm_and_ps(valid, _mm_cmpgt_ps(area, _mm_set1_ps(FLT_MIN)));
+			const __m128 negative = _mm_and_ps(valid, _mm_cmplt_ps(area, _mm_set1_ps(-FLT_MIN)));
+			const int positiveBits = _mm_movemask_ps(positive), negativeBits = _mm_movemask_ps(negative);
+			for (int j = 0; j < 4; ++j)
+				signs[t + j] = (int8_t)(((positiveBits >> j) & 1) - ((negativeBits >> j) & 1));
+
+			const __m128 flip = _mm_and_ps(negative, _mm_set1_ps(-0.f));
+			const __m128 tx = _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(t31v, d1x), _mm_mul_ps(t21v, d2x)), flip);
+			const __m128 ty = _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(t31v, d1y), _mm_mul_ps(t21v, d2y)), flip);
+			const __m128 tz = _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(t31v, d1z), _mm_mul_ps(t21v, d2z)), flip);
+
+			alignas(16) float cx[3][4], cy[3][4], cz[3][4];
+			for (int k = 0; k < 3; ++k)
+			{
+				const __m128 nxk = _mm_load_ps(nx[k]), nyk = _mm_load_ps(ny[k]), nzk = _mm_load_ps(nz[k]);
+				__m128 projectedX = tx, projectedY = ty, projectedZ = tz;
+				projectNormalize(projectedX, projectedY, projectedZ, nxk, nyk, nzk);
+				const int previous = (k + 2) % 3, next = (k + 1) % 3;
+				__m128 previousX = _mm_sub_ps(x[previous], x[k]), previousY = _mm_sub_ps(y[previous], y[k]), previousZ = _mm_sub_ps(z[previous], z[k]);
+				__m128 nextX = _mm_sub_ps(x[next], x[k]), nextY = _mm_sub_ps(y[next], y[k]), nextZ = _mm_sub_ps(z[next], z[k]);
+				projectNormalize(previousX, previousY, previousZ, nxk, nyk, nzk);
+				projectNormalize(nextX, nextY, nextZ, nxk, nyk, nzk);
+				const __m128 cosine = _mm_min_ps(_mm_max_ps(dot3(previousX, previousY, previousZ, nextX, nextY, nextZ),
+					_mm_set1_ps(-1.f)), _mm_set1_ps(1.f));
+				const __m128 angle = _mm_and_ps(valid, acosSse2(cosine));
+				_mm_store_ps(cx[k], _mm_mul_ps(projectedX, angle));
+				_mm_store_ps(cy[k], _mm_mul_ps(projectedY, angle));
+				_mm_store_ps(cz[k], _mm_mul_ps(projectedZ, angle));
+			}
+			for (int j = 0; j < 4; ++j)
+			{
+				for (int k = 0; k < 3; ++k)
+					corners[(t + j) * 3 + k] = glm::vec3(cx[k][j], cy[k][j], cz[k][j]);
+			}
+		}
+		cornersScalar(indices, streams, t, end, corners, signs);
+	}
+#endif
+
+	// Normalized, or for a vertex no corner contributed to, some direction
+	// perpendicular to its normal.
+	glm::vec4 finishTangent(const glm::vec3& sum, const glm::vec3& normal, float sign)
+	{
+		if (notZero(glm::length(sum)))
+			return glm::vec4(glm::normalize(sum), sign);
+		const glm::vec3 axis = std::fabs(normal.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+		const glm::vec3 tangent = normalizeOrZero(axis - glm::dot(axis, normal) * normal);
+		return glm::vec4(notZero(glm::length(tangent)) ? tangent : glm::vec3(1.f, 0.f, 0.f), sign);
+	}
+}
+
+TangentGenerator::TangentGenerator(ThreadPool& pool)
+	: mPool(pool)
+{
+}
+
+bool TangentGenerator::generate(Mesh& mesh, SimdLevel level)
+{
+	mStats = Stats();
+	VertexStreams& streams = mesh.streams;
+	const size_t vertexCount = streams.count();
+	if (streams.texCoords.size() != vertexCount || streams.normals.size() != vertexCount)
+	{
+		std::cerr << "TangentGenerator: tangents need texture coordinates and normals" << std::endl;
+		return false;
+	}
+	if (mesh.indices.size() % 3 != 0)
+	{
+		std::cerr << "TangentGenerator: index count " << mesh.indices.size() << " is not a multiple of 3" << std::endl;
+		return false;
+	}
+	const auto start = Clock::now();
+	const size_t triangles = mesh.triangleCount();
+	mStats.triangles = triangles;
+
+	std::vector<glm::vec3> corners(mesh.indices.size());
+	std::vector<int8_t> signs(triangles);
+	const size_t triangleBlocks = (triangles + kTriangleBlock - 1) / kTriangleBlock;
+	std::vector<size_t> blockDegenerate(triangleBlocks, 0);
+	mPool.parallelFor(triangleBlocks, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b)
+		{
+			const size_t first = b * kTriangleBlock, last = std::min(triangles, first + kTriangleBlock);
+#ifdef SIMD_X86
+			if (level >= SIMD_SSE2)
+				cornersSse2(mesh.indices.data(), streams, first, last, corners.data(), signs.data());
+			else
+#endif
+				cornersScalar(mesh.indices.data(), streams, first, last, corners.data(), signs.data());
+			for (size_t t = first; t < last; ++t)
+				blockDegenerate[b] += signs[t] == 0;
+		}
+	});
+	for (size_t count : blockDegenerate)
+		mStats.degenerateTriangles += count;
+	mStats.cornersMs = msSince(start);
+
+	// Corners sorted by vertex, by counting.
+	const auto verticesStart = Clock::now();
+	std::vector<uint32_t> firstCorner(vertexCount + 1, 0), cornersByVertex(mesh.indices.size());
+	for (uint32_t index : mesh.indices)
+		++firstCorner[index + 1];
+	for (size_t v = 0; v < vertexCount; ++v)
+		firstCorner[v + 1] += firstCorner[v];
+	{
+		std::vector<uint32_t> cursor(firstCorner.begin(), firstCorner.end() - 1);
+		for (size_t i = 0; i < mesh.indices.size(); ++i)
+			cornersByVertex[cursor[mesh.indices[i]]++] = (uint32_t)i;
+	}
+
+	// A vertex keeps the sign of its first corner that has one. Copies for
+	// the other sign are numbered in vertex order, so the result does not
+	// depend on the threads.
+	const size_t vertexBlocks = (vertexCount + kVertexBlock - 1) / kVertexBlock;
+	std::vector<uint8_t> kept(vertexCount); // bit 0: keeps -1, bit 1: split
+	std::vector<size_t> blockSplits(vertexBlocks + 1, 0);
+	mPool.parallelFor(vertexBlocks, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b)
+		{
+			for (size_t v = b * kVertexBlock; v < std::min(vertexCount, (b + 1) * kVertexBlock); ++v)
+			{
+				int first = 0;
+				bool split = false;
+				for (uint32_t c = firstCorner[v]; c < firstCorner[v + 1]; ++c)
+				{
+					const int sign = signs[cornersByVertex[c] / 3];
+					if (first == 0)
+						first = sign;
+					else if (sign != 0 && sign != first)
+						split = true;
+				}
+				kept[v] = (uint8_t)((first < 0 ? 1 : 0) | (split ? 2 : 0));
+				blockSplits[b + 1] += split;
+			}
+		}
+	});
+	for (size_t b = 0; b < vertexBlocks; ++b)
+		blockSplits[b + 1] += blockSplits[b];
+	mStats.splitVertices = blockSplits[vertexBlocks];
+
+	const size_t total = vertexCount + mStats.splitVertices;
+	streams.positions.resize(total);
+	streams.texCoords.resize(total);
+	streams.normals.resize(total);
+	streams.tangents.resize(total);
+	mPool.parallelFor(vertexBlocks, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b)
+		{
+			size_t copy = vertexCount + blockSplits[b];
+			for (size_t v = b * kVertexBlock; v < std::min(vertexCount, (b + 1) * kVertexBlock); ++v)
+			{
+				const int keep = (kept[v] & 1) ? -1 : 1;
+				glm::vec3 keptSum(0.f), otherSum(0.f);
+				for (uint32_t c = firstCorner[v]; c < firstCorner[v + 1]; ++c)
+				{
+					const uint32_t corner = cornersByVertex[c];
+					if (signs[corner / 3] == -keep)
+						otherSum += corners[corner];
+					else
+						keptSum += corners[corner];
+				}
+				streams.tangents[v] = finishTangent(keptSum, streams.normals[v], (float)keep);
+				if (!(kept[v] & 2))
+					continue;
+				streams.positions[copy] = streams.positions[v];
+				streams.texCoords[copy] = streams.texCoords[v];
+				streams.normals[copy] = streams.normals[v];
+				streams.tangents[copy] = finishTangent(otherSum, streams.normals[v], (float)-keep);
+				for (uint32_t c = firstCorner[v]; c < firstCorner[v + 1]; ++c)
+				{
+					const uint32_t corner = cornersByVertex[c];
+					if (signs[corner / 3] == -keep)
+						mesh.indices[corner] = (uint32_t)copy;
+				}
+				++copy;
+			}
+		}
+	});
+	mStats.verticesMs = msSince(verticesStart);
+	mStats.totalMs = msSince(start);
+	return true;
+}
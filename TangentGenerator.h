@@ -0,0 +1,55 @@
+#pragma once
+#include "MeshImporter.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+// Per vertex tangent frames for normal mapping, computed the way MikkTSpace
+// (Mikkelsen 2008) does, so normal maps baked by tools that use it shade
+// without seams:
+//  - each triangle's tangent is its dP/du, flipped on triangles whose UVs are
+//    mirrored, and its bitangent sign is the sign of its UV area;
+//  - at each corner that tangent is projected into the plane of the vertex
+//    normal, normalized and weighted by the corner's angle in that plane;
+//  - a vertex sums the corners of triangles of the same sign. A vertex shared
+//    by mirrored and unmirrored triangles is split in two, appended after the
+//    existing vertices, with the second sign's triangles moved to the copy.
+// Triangles with no UV area join whichever sign their vertex keeps; ones with
+// a zero length edge are left out. MikkTSpace welds vertices by value and
+// groups corners by connectivity; here vertices are taken as given, as
+// MeshImporter has deduplicated them, and a vertex shared by two fans of the
+// same sign gets one tangent for both. A vertex with no usable corner gets an
+// arbitrary tangent perpendicular to its normal rather than MikkTSpace's zero.
+//
+// Corners are computed in parallel over blocks of triangles, four triangles
+// at a time with SSE2, and vertices in parallel over blocks of vertices from a
+// corner list sorted by vertex.
+class TangentGenerator
+{
+public:
+	struct Stats
+	{
+		size_t triangles = 0;
+		size_t degenerateTriangles = 0; // no UV area or a zero length edge
+		size_t splitVertices = 0;       // copies appended for a second bitangent sign
+		double cornersMs = 0, verticesMs = 0, totalMs = 0;
+	};
+
+	explicit TangentGenerator(ThreadPool& pool = ThreadPool::shared());
+
+	TangentGenerator(TangentGenerator const&) = delete;
+	void operator=(TangentGenerator const&) = delete;
+
+	// Fills mesh.streams.tangents, w holding the bitangent sign: the shader's
+	// bitangent is cross(normal, tangent.xyz) * tangent.w. Needs unit normals
+	// and texture coordinates; returns false, with the reason on std::cerr,
+	// without them. May append vertices, see above, so run it before
+	// MeshOptimizer.
+	bool generate(Mesh& mesh, SimdLevel level = detectSimdLevel());
+
+	// Of the last generate.
+	const Stats& stats() const { return mStats; }
+
+private:
+	ThreadPool& mPool;
+	Stats mStats;
+};
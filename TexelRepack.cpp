@@ -0,0 +1,215 @@
+#include "TexelRepack.h"
+#include "ThreadPool.h"
+
+#include <cstring>
+
+int usageChannels(TextureUsage usage)
+{
+	switch (usage)
+	{
+	case TextureUsage::Mask: return 1;
+	case TextureUsage::Color:
+	case TextureUsage::Normal:
+	case TextureUsage::Hdr: return 4;
+	default: return 0;
+	}
+}
+
+int usageUploadChannels(TextureUsage usage)
+{
+	return usage == TextureUsage::Normal ? 2 : usageChannels(usage);
+}
+
+MipFilter usageMipFilter(TextureUsage usage)
+{
+	switch (usage)
+	{
+	case TextureUsage::Normal: return MipFilter::NormalMap;
+	case TextureUsage::Mask:
+	case TextureUsage::Hdr: return MipFilter::Linear;
+	default: return MipFilter::Srgb;
+	}
+}
+
+const char* usageName(TextureUsage usage)
+{
+	switch (usage)
+	{
+	case TextureUsage::Color: return "color";
+	case TextureUsage::Normal: return "normal";
+	case TextureUsage::Mask: return "mask";
+	case TextureUsage::Hdr: return "hdr";
+	default: return "unspecified";
+	}
+}
+
+namespace
+{
+	void repackScalar(const unsigned char* src, int srcChannels, unsigned char* dst, int dstChannels, size_t pixels)
+	{
+		const bool widenGrey = srcChannels <= 2 && dstChannels >= 3;
+		for (size_t i = 0; i < pixels; ++i, src += srcChannels, dst += dstChannels)
+		{
+			if (widenGrey)
+			{
+				dst[0] = dst[1] = dst[2] = src[0];
+				if (dstChannels == 4)
+					dst[3] = srcChannels == 2 ? src[1] : 255;
+				continue;
+			}
+			for (int c = 0; c < dstChannels; ++c)
+				dst[c] = c < srcChannels ? src[c] : c == 3 ? 255 : 0;
+		}
+	}
+
+#ifdef SIMD_X86
+	// Each kernel handles whole groups of 16 pixels and returns the first pixel
+	// it did not process.
+
+	size_t rgbaToRSse2(const unsigned char* src, unsigned char* dst, size_t pixels)
+	{
+		const __m128i low = _mm_set1_epi32(0xff);
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16)
+		{
+			const __m128i* in = (const __m128i*)(src + i * 4);
+			__m128i ab = _mm_packs_epi32(_mm_and_si128(_mm_loadu_si128(in), low), _mm_and_si128(_mm_loadu_si128(in + 1), low));
+			__m128i cd = _mm_packs_epi32(_mm_and_si128(_mm_loadu_si128(in + 2), low), _mm_and_si128(_mm_loadu_si128(in + 3), low));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(ab, cd));
+		}
+		return i;
+	}
+
+	// Sign extending the low half of every pixel lets the signed pack keep its
+	// bit pattern.
+	inline __m128i lowHalfSse2(__m128i v)
+	{
+		return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+	}
+
+	size_t rgbaToRgSse2(const unsigned char* src, unsigned char* dst, size_t pixels)
+	{
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16)
+		{
+			const __m128i* in = (const __m128i*)(src + i * 4);
+			__m128i* out = (__m128i*)(dst + i * 2);
+			_mm_storeu_si128(out, _mm_packs_epi32(lowHalfSse2(_mm_loadu_si128(in)), lowHalfSse2(_mm_loadu_si128(in + 1))));
+			_mm_storeu_si128(out + 1, _mm_packs_epi32(lowHalfSse2(_mm_loadu_si128(in + 2)), lowHalfSse2(_mm_loadu_si128(in + 3))));
+		}
+		return i;
+	}
+
+	size_t greyToRgbaSse2(const unsigned char* src, unsigned char* dst, size_t pixels)
+	{
+		const __m128i opaque = _mm_set1_epi8((char)0xff);
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16)
+		{
+			__m128i g = _mm_loadu_si128((const __m128i*)(src + i));
+			__m128i gg0 = _mm_unpacklo_epi8(g, g), gg1 = _mm_unpackhi_epi8(g, g);
+			__m128i ga0 = _mm_unpacklo_epi8(g, opaque), ga1 = _mm_unpackhi_epi8(g, opaque);
+			__m128i* out = (__m128i*)(dst + i * 4);
+			_mm_storeu_si128(out, _mm_unpacklo_epi16(gg0, ga0));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(gg0, ga0));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(gg1, ga1));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(gg1, ga1));
+		}
+		return i;
+	}
+
+	size_t greyAlphaToRgbaSse2(const unsigned char* src, unsigned char* dst, size_t pixels)
+	{
+		const __m128i low = _mm_set1_epi16(0xff);
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16)
+		{
+			__m128i* out = (__m128i*)(dst + i * 4);
+			for (int half = 0; half < 2; ++half)
+			{
+				__m128i ga = _mm_loadu_si128((const __m128i*)(src + i * 2) + half);
+				__m128i g = _mm_and_si128(ga, low);
+				__m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+				_mm_storeu_si128(out + half * 2, _mm_unpacklo_epi16(gg, ga));
+				_mm_storeu_si128(out + half * 2 + 1, _mm_unpackhi_epi16(gg, ga));
+			}
+		}
+		return i;
+	}
+
+	// Four 16 byte loads cover 16 RGB pixels but the last one reads 4 bytes
+	// past them, so two pixels are always left for the scalar tail.
+	SIMD_TARGET_AVX2 size_t rgbToRgbaSsse3(const unsigned char* src, unsigned char* dst, size_t pixels)
+	{
+		const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+		size_t i = 0;
+		for (; i + 18 <= pixels; i += 16)
+		{
+			const unsigned char* in = src + i * 3;
+			__m128i* out = (__m128i*)(dst + i * 4);
+			for (int quarter = 0; quarter < 4; ++quarter)
+			{
+				__m128i rgb = _mm_loadu_si128((const __m128i*)(in + quarter * 12));
+				_mm_storeu_si128(out + quarter, _mm_or_si128(_mm_shuffle_epi8(rgb, spread), opaque));
+			}
+		}
+		return i;
+	}
+
+	size_t repackSimd(const unsigned char* src, int srcChannels, unsigned char* dst, int dstChannels,
+		size_t pixels, SimdLevel level)
+	{
+		if (srcChannels == 4 && dstChannels == 1)
+			return rgbaToRSse2(src, dst, pixels);
+		if (srcChannels == 4 && dstChannels == 2)
+			return rgbaToRgSse2(src, dst, pixels);
+		if (srcChannels == 1 && dstChannels == 4)
+			return greyToRgbaSse2(src, dst, pixels);
+		if (srcChannels == 2 && dstChannels == 4)
+			return greyAlphaToRgbaSse2(src, dst, pixels);
+		if (srcChannels == 3 && dstChannels == 4 && level >= SIMD_AVX2)
+			return rgbToRgbaSsse3(src, dst, pixels);
+		return 0;
+	}
+#endif
+}
+
+void TexelRepack::repack(const unsigned char* src, int srcChannels, unsigned char* dst, int dstChannels,
+	size_t pixels, SimdLevel level)
+{
+	if (srcChannels == dstChannels)
+	{
+		memcpy(dst, src, pixels * srcChannels);
+		return;
+	}
+	size_t done = 0;
+#ifdef SIMD_X86
+	if (level >= SIMD_SSE2)
+		done = repackSimd(src, srcChannels, dst, dstChannels, pixels, level);
+#endif
+	repackScalar(src + done * srcChannels, srcChannels, dst + done * dstChannels, dstChannels, pixels - done);
+}
+
+MipChain TexelRepack::repack(const MipChain& chain, int channels, ThreadPool* pool, SimdLevel level)
+{
+	// Levels are back to back with the same channel count, so the whole chain
+	// converts as one run of pixels and every offset scales with it.
+	MipChain result;
+	result.channels = channels;
+	result.levels = chain.levels;
+	for (MipLevel& mip : result.levels)
+		mip.offset = mip.offset / chain.channels * channels;
+	const size_t pixels = chain.data.size() / chain.channels;
+	result.data.resize(pixels * channels);
+
+	auto band = [&](size_t begin, size_t end) {
+		repack(chain.data.data() + begin * chain.channels, chain.channels, result.data.data() + begin * channels, channels,
+			end - begin, level);
+	};
+	if (pool)
+		pool->parallelFor(pixels, 1 << 16, band);
+	else
+		band(0, pixels);
+	return result;
+}
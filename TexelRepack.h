@@ -0,0 +1,41 @@
+#pragma once
+#include "MipGenerator.h"
+#include "Simd.h"
+
+#include <cstddef>
+
+class ThreadPool;
+
+// What a texture is sampled for. The usage decides the channels kept, the mip
+// filter and, when compressing, the block format.
+enum class TextureUsage
+{
+	Unspecified, // keep TextureLoadParams::desiredChannels and mipFilter
+	Color,       // RGBA8 with sRGB mips; BC1 or BC3 when compressed
+	Normal,      // RG8 tangent space X and Y, the shader rebuilds Z; BC5 when compressed
+	Mask,        // R8 with linear mips, never compressed
+	Hdr          // decoded as float, RGBA16F or R11G11B10F with linear mips; see HalfFloat
+};
+
+// Channels mips are built with. Normal maps keep 4 until after filtering, as
+// the normal filter needs Z; see usageUploadChannels.
+int usageChannels(TextureUsage usage);
+// Channels of the uploaded texture when it is not block compressed.
+int usageUploadChannels(TextureUsage usage);
+MipFilter usageMipFilter(TextureUsage usage);
+const char* usageName(TextureUsage usage);
+
+// Converts 8-bit pixels between 1 to 4 channels. Widening grey (1 or 2
+// channels) to 3 or 4 replicates it into RGB; a missing alpha becomes 255.
+// Narrowing keeps the leading channels. RGBA to RG or R and grey to RGBA have
+// SSE2 kernels, RGB to RGBA an SSSE3 shuffle taken at the AVX2 level; all
+// produce the same bytes as the scalar path.
+class TexelRepack
+{
+public:
+	static void repack(const unsigned char* src, int srcChannels, unsigned char* dst, int dstChannels,
+		size_t pixels, SimdLevel level = detectSimdLevel());
+
+	// Repacks every level of a chain, in bands on the pool if one is given.
+	static MipChain repack(const MipChain& chain, int channels, ThreadPool* pool, SimdLevel level = detectSimdLevel());
+};
@@ -0,0 +1,123 @@
+#include "TextureCache.h"
+
+#include <iomanip>
+#include <iostream>
+
+TextureCache& TextureCache::shared()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+bool TextureCache::contains(uint64_t key) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mTextures.count(key) != 0;
+}
+
+GLuint TextureCache::acquire(uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	++mStats.lookups;
+	auto found = mTextures.find(key);
+	if (found == mTextures.end())
+		return 0;
+	Item& item = mItems[found->second];
+	++item.references;
+	++mStats.hits;
+	++mStats.references;
+	mStats.bytesShared += item.bytes;
+	return found->second;
+}
+
+GLuint TextureCache::insert(uint64_t key, GLuint texture, size_t bytes)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	auto found = mTextures.find(key);
+	if (found != mTextures.end())
+	{
+		Item& item = mItems[found->second];
+		++item.references;
+		++mStats.references;
+		mStats.bytesShared += item.bytes;
+		const GLuint existing = found->second;
+		lock.unlock();
+		glDeleteTextures(1, &texture);
+		return existing;
+	}
+	mTextures[key] = texture;
+	mItems[texture] = Item{ key, bytes, 1 };
+	++mStats.textures;
+	++mStats.references;
+	mStats.bytes += bytes;
+	return texture;
+}
+
+bool TextureCache::retain(GLuint texture)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto found = mItems.find(texture);
+	if (found == mItems.end())
+		return false;
+	++found->second.references;
+	++mStats.references;
+	return true;
+}
+
+void TextureCache::release(GLuint texture)
+{
+	if (!texture)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto found = mItems.find(texture);
+		if (found != mItems.end())
+		{
+			--mStats.references;
+			if (--found->second.references > 0)
+				return;
+			--mStats.textures;
+			mStats.bytes -= found->second.bytes;
+			mTextures.erase(found->second.key);
+			mItems.erase(found);
+		}
+	}
+	glDeleteTextures(1, &texture);
+}
+
+GLuint TextureCache::sampler(const TextureSampling& sampling)
+{
+	for (const auto& entry : mSamplers)
+		if (entry.first == sampling)
+			return entry.second;
+	GLuint sampler = 0;
+	glCreateSamplers(1, &sampler);
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, sampling.minFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, sampling.magFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, sampling.wrap);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, sampling.wrap);
+	mSamplers.push_back(std::make_pair(sampling, sampler));
+	return sampler;
+}
+
+void TextureCache::noteDecodeSkipped()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	++mStats.decodesSkipped;
+}
+
+TextureCache::Stats TextureCache::stats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void TextureCache::printStats(std::ostream& out) const
+{
+	const Stats s = stats();
+	out << std::fixed << std::setprecision(1)
+		<< "Texture cache: " << s.hits << " of " << s.lookups << " lookups hit (" << s.hitRate() * 100.0 << "%), "
+		<< s.textures << " textures with " << s.references << " references, " << s.bytes / 1024 << " KB held, "
+		<< s.bytesShared / 1024 << " KB shared, " << s.decodesSkipped << " decodes skipped" << std::endl;
+	out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "gl_core_4_5.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// How a texture is filtered and wrapped; the same mode applies to both axes.
+struct TextureSampling
+{
+	GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	GLint magFilter = GL_LINEAR;
+	GLint wrap = GL_REPEAT;
+
+	bool operator==(const TextureSampling& other) const
+	{
+		return minFilter == other.minFilter && magFilter == other.magFilter && wrap == other.wrap;
+	}
+};
+
+// Shares GL textures between everything that loads the same image. Textures are
+// keyed by a 64-bit hash of the source file's bytes and the parameters that
+// shaped the texels (see TextureLoader::cacheKey), and reference counted: each
+// acquire() or insert() hands out one reference that release() gives back. The
+// map is guarded by a mutex so loader threads can check for a key while the GL
+// thread uploads, but GL objects are only created and deleted on the GL thread.
+// Textures still held at exit are left to the context's teardown.
+// Cached textures keep GL's default sampling state, since users sharing one may
+// want different filters and wrap modes: each binds a sampler() object to the
+// texture's unit instead.
+class TextureCache
+{
+public:
+	struct Stats
+	{
+		size_t lookups = 0;
+		size_t hits = 0;
+		size_t textures = 0;    // distinct GL textures held
+		size_t references = 0;  // outstanding references to them
+		size_t bytes = 0;       // texel bytes held
+		size_t bytesShared = 0; // texel bytes hits did not have to upload again
+		size_t decodesSkipped = 0;
+
+		double hitRate() const { return lookups ? (double)hits / lookups : 0.0; }
+	};
+
+	TextureCache() = default;
+
+	TextureCache(TextureCache const&) = delete;
+	void operator=(TextureCache const&) = delete;
+
+	static TextureCache& shared();
+
+	// True if a texture for key is held. Does not count as a lookup.
+	bool contains(uint64_t key) const;
+
+	// Adds a reference to the texture for key and returns it, or 0 if there is
+	// none. Counts towards the hit rate.
+	GLuint acquire(uint64_t key);
+
+	// GL thread only. Takes ownership of a freshly uploaded texture with one
+	// reference. If another caller inserted the same key first, texture is
+	// deleted and a reference to theirs is returned instead.
+	GLuint insert(uint64_t key, GLuint texture, size_t bytes);
+
+	// Adds a reference to a texture the cache holds, so work still pending on
+	// it can keep it alive. Returns false for textures it does not hold.
+	bool retain(GLuint texture);
+
+	// GL thread only. Drops a reference and deletes the texture with the last
+	// one. Textures the cache does not hold are deleted straight away.
+	void release(GLuint texture);
+
+	// GL thread only. A sampler object with the given filters and wrap mode,
+	// created on first use and shared by everyone asking for the same state.
+	// Samplers live as long as the cache.
+	GLuint sampler(const TextureSampling& sampling);
+
+	// Loaders report work skipped because the key was already held.
+	void noteDecodeSkipped();
+
+	Stats stats() const;
+	void printStats(std::ostream& out) const;
+
+private:
+	struct Item
+	{
+		uint64_t key;
+		size_t bytes;
+		size_t references;
+	};
+
+	mutable std::mutex mMutex;
+	std::unordered_map<uint64_t, GLuint> mTextures;
+	std::unordered_map<GLuint, Item> mItems;
+	std::vector<std::pair<TextureSampling, GLuint>> mSamplers; // GL thread only, a handful at most
+	Stats mStats;
+};
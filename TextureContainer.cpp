@@ -0,0 +1,370 @@
+#include "TextureContainer.h"
+#define STB_DEFINE
+#include "stb.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+namespace
+{
+	const char kMagic[8] = { '\xab', 'O', 'T', 'E', 'X', '1', '\xbb', '\n' };
+	const uint32_t kVersion = 2;
+
+	// EXT_texture_compression_s3tc is not part of the core profile header.
+	const GLenum kCompressedRgbDxt1 = 0x83F0;
+	const GLenum kCompressedRgbaDxt5 = 0x83F3;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint32_t supercompression;
+		uint64_t sourceSize;
+		uint64_t sourceTime;
+		uint64_t sourceHash;
+	};
+
+	struct FileLevel
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint64_t uncompressedSize;
+	};
+
+	// stb_compress and stb_decompress keep their state in globals.
+	std::mutex& stbMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	size_t align16(size_t value)
+	{
+		return (value + 15) & ~(size_t)15;
+	}
+
+	bool writeLevels(const std::string& path, TexelFormat format, const std::vector<MipLevel>& levels,
+		const unsigned char* data, Supercompression supercompression, uint64_t sourceSize, uint64_t sourceTime, uint64_t sourceHash)
+	{
+		if (levels.empty())
+			return false;
+
+		std::vector<std::vector<unsigned char>> packed(levels.size());
+		std::vector<FileLevel> index(levels.size());
+		size_t offset = align16(sizeof(FileHeader) + sizeof(FileLevel) * levels.size());
+		for (size_t i = 0; i < levels.size(); ++i)
+		{
+			const size_t bytes = texelFormatLevelBytes(format, levels[i].width, levels[i].height);
+			const unsigned char* src = data + levels[i].offset;
+			index[i].uncompressedSize = bytes;
+			if (supercompression == Supercompression::Stb)
+			{
+				packed[i].resize(bytes + 512 + bytes / 4);
+				std::lock_guard<std::mutex> lock(stbMutex());
+				packed[i].resize(stb_compress(packed[i].data(), (stb_uchar*)src, (stb_uint)bytes));
+			}
+			else
+			{
+				packed[i].assign(src, src + bytes);
+			}
+			index[i].offset = offset;
+			index[i].size = packed[i].size();
+			offset = align16(offset + packed[i].size());
+		}
+
+		FileHeader header = {};
+		memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version = kVersion;
+		header.format = (uint32_t)format;
+		header.width = levels[0].width;
+		header.height = levels[0].height;
+		header.levelCount = (uint32_t)levels.size();
+		header.supercompression = (uint32_t)supercompression;
+		header.sourceSize = sourceSize;
+		header.sourceTime = sourceTime;
+		header.sourceHash = sourceHash;
+
+		// Write to a temporary name first so a crash never leaves a truncated
+		// container that passes header validation.
+		const std::string tmpPath = path + ".tmp";
+		{
+			std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+			if (!file)
+				return false;
+			file.write((const char*)&header, sizeof(header));
+			file.write((const char*)index.data(), sizeof(FileLevel) * index.size());
+			const char padding[16] = {};
+			size_t written = sizeof(header) + sizeof(FileLevel) * index.size();
+			for (size_t i = 0; i < levels.size(); ++i)
+			{
+				file.write(padding, index[i].offset - written);
+				file.write((const char*)packed[i].data(), packed[i].size());
+				written = index[i].offset + packed[i].size();
+			}
+			if (!file)
+				return false;
+		}
+		std::remove(path.c_str());
+		return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+}
+
+TexelFormat texelFormatForChannels(int channels)
+{
+	switch (channels)
+	{
+	case 1: return TexelFormat::R8;
+	case 2: return TexelFormat::RG8;
+	case 3: return TexelFormat::RGB8;
+	default: return TexelFormat::RGBA8;
+	}
+}
+
+TexelFormat texelFormatForBlocks(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1: return TexelFormat::BC1;
+	case BlockFormat::BC3: return TexelFormat::BC3;
+	default: return TexelFormat::BC5;
+	}
+}
+
+TexelFormat texelFormatForHdr(HdrFormat format)
+{
+	return format == HdrFormat::RGBA16F ? TexelFormat::RGBA16F : TexelFormat::R11G11B10F;
+}
+
+GlTexelFormat glTexelFormat(TexelFormat format)
+{
+	switch (format)
+	{
+	case TexelFormat::R8: return { GL_R8, GL_RED, GL_UNSIGNED_BYTE, false };
+	case TexelFormat::RG8: return { GL_RG8, GL_RG, GL_UNSIGNED_BYTE, false };
+	case TexelFormat::RGB8: return { GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, false };
+	case TexelFormat::RGBA8: return { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, false };
+	case TexelFormat::BC1: return { kCompressedRgbDxt1, 0, 0, true };
+	case TexelFormat::BC3: return { kCompressedRgbaDxt5, 0, 0, true };
+	case TexelFormat::BC5: return { GL_COMPRESSED_RG_RGTC2, 0, 0, true };
+	case TexelFormat::RGBA16F: return { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, false };
+	case TexelFormat::R11G11B10F: return { GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, false };
+	}
+	return { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, false };
+}
+
+const char* texelFormatName(TexelFormat format)
+{
+	switch (format)
+	{
+	case TexelFormat::R8: return "R8";
+	case TexelFormat::RG8: return "RG8";
+	case TexelFormat::RGB8: return "RGB8";
+	case TexelFormat::RGBA8: return "RGBA8";
+	case TexelFormat::BC1: return "BC1";
+	case TexelFormat::BC3: return "BC3";
+	case TexelFormat::BC5: return "BC5";
+	case TexelFormat::RGBA16F: return "RGBA16F";
+	case TexelFormat::R11G11B10F: return "RG11B10F";
+	}
+	return "?";
+}
+
+GLint glUnpackAlignment(const void* pixels, size_t rowBytes)
+{
+	const size_t bits = (size_t)pixels | rowBytes;
+	return bits % 8 == 0 ? 8 : bits % 4 == 0 ? 4 : bits % 2 == 0 ? 2 : 1;
+}
+
+size_t texelFormatLevelBytes(TexelFormat format, int width, int height)
+{
+	switch (format)
+	{
+	case TexelFormat::R8: return (size_t)width * height;
+	case TexelFormat::RG8: return (size_t)width * height * 2;
+	case TexelFormat::RGB8: return (size_t)width * height * 3;
+	case TexelFormat::RGBA8: return (size_t)width * height * 4;
+	case TexelFormat::BC1: return BlockCompressor::imageBytes(BlockFormat::BC1, width, height);
+	case TexelFormat::BC3: return BlockCompressor::imageBytes(BlockFormat::BC3, width, height);
+	case TexelFormat::BC5: return BlockCompressor::imageBytes(BlockFormat::BC5, width, height);
+	case TexelFormat::RGBA16F: return (size_t)width * height * 8;
+	case TexelFormat::R11G11B10F: return (size_t)width * height * 4;
+	}
+	return 0;
+}
+
+TexelBlock texelBlock(TexelFormat format)
+{
+	switch (format)
+	{
+	case TexelFormat::R8: return { 1, 1 };
+	case TexelFormat::RG8: return { 1, 2 };
+	case TexelFormat::RGB8: return { 1, 3 };
+	case TexelFormat::RGBA8: return { 1, 4 };
+	case TexelFormat::BC1: return { 4, 8 };
+	case TexelFormat::BC3: return { 4, 16 };
+	case TexelFormat::BC5: return { 4, 16 };
+	case TexelFormat::RGBA16F: return { 1, 8 };
+	case TexelFormat::R11G11B10F: return { 1, 4 };
+	}
+	return { 1, 4 };
+}
+
+bool TextureContainer::open(const std::string& path)
+{
+	close();
+	if (!mFile.open(path))
+		return false;
+
+	const unsigned char* base = mFile.data();
+	const size_t fileSize = mFile.size();
+	FileHeader header;
+	if (fileSize < sizeof(header))
+	{
+		close();
+		return false;
+	}
+	memcpy(&header, base, sizeof(header));
+
+	const bool knownFormat = header.format >= (uint32_t)TexelFormat::R8 && header.format <= (uint32_t)TexelFormat::R11G11B10F;
+	if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || !knownFormat ||
+		header.supercompression > (uint32_t)Supercompression::Stb || header.width == 0 || header.height == 0 ||
+		(header.levelCount != 1 && header.levelCount != (uint32_t)MipGenerator::levelCount(header.width, header.height)))
+	{
+		close();
+		return false;
+	}
+
+	const size_t indexEnd = sizeof(header) + sizeof(FileLevel) * header.levelCount;
+	if (fileSize < indexEnd)
+	{
+		close();
+		return false;
+	}
+
+	mFormat = (TexelFormat)header.format;
+	mSupercompression = (Supercompression)header.supercompression;
+	mSourceSize = header.sourceSize;
+	mSourceTime = header.sourceTime;
+	mSourceHash = header.sourceHash;
+	mLevels.resize(header.levelCount);
+
+	int width = header.width, height = header.height;
+	for (size_t i = 0; i < mLevels.size(); ++i)
+	{
+		FileLevel entry;
+		memcpy(&entry, base + sizeof(header) + sizeof(FileLevel) * i, sizeof(entry));
+		const size_t expected = texelFormatLevelBytes(mFormat, width, height);
+		const bool sizeOk = mSupercompression == Supercompression::None ? entry.size == expected : entry.size > 0;
+		if (entry.offset < indexEnd || entry.offset > fileSize || entry.size > fileSize - entry.offset ||
+			entry.uncompressedSize != expected || !sizeOk)
+		{
+			close();
+			return false;
+		}
+
+		Level& level = mLevels[i];
+		level.width = width;
+		level.height = height;
+		level.data = base + entry.offset;
+		level.size = (size_t)entry.size;
+		level.uncompressedSize = (size_t)entry.uncompressedSize;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	return true;
+}
+
+void TextureContainer::close()
+{
+	mFile.close();
+	mLevels.clear();
+}
+
+bool TextureContainer::matchesSource(uint64_t size, uint64_t modifiedTime) const
+{
+	return mSourceSize == size && mSourceTime == modifiedTime;
+}
+
+const unsigned char* TextureContainer::levelTexels(size_t index, std::vector<unsigned char>& scratch) const
+{
+	const Level& level = mLevels[index];
+	if (mSupercompression == Supercompression::None)
+		return level.data;
+
+	scratch.resize(level.uncompressedSize);
+	std::lock_guard<std::mutex> lock(stbMutex());
+	if (level.size < 16 || stb_decompress_length((stb_uchar*)level.data) != level.uncompressedSize ||
+		stb_decompress(scratch.data(), (stb_uchar*)level.data, (stb_uint)level.size) != level.uncompressedSize)
+		return nullptr;
+	return scratch.data();
+}
+
+void TextureContainer::prefetch(size_t first, size_t end) const
+{
+	// Levels are stored finest first, so the range is contiguous in the file.
+	if (first >= end || end > mLevels.size())
+		return;
+	const size_t begin = (size_t)(mLevels[first].data - mFile.data());
+	const size_t last = (size_t)(mLevels[end - 1].data - mFile.data()) + mLevels[end - 1].size;
+	mFile.prefetch(begin, last - begin);
+}
+
+GLuint TextureContainer::upload() const
+{
+	if (!isOpen())
+		return 0;
+
+	const GlTexelFormat gl = glTexelFormat(mFormat);
+	GLuint texID = 0;
+	glGenTextures(1, &texID);
+	glBindTexture(GL_TEXTURE_2D, texID);
+	glTexStorage2D(GL_TEXTURE_2D, (GLsizei)mLevels.size(), gl.internalFormat, width(), height());
+
+	std::vector<unsigned char> scratch;
+	for (size_t i = 0; i < mLevels.size(); ++i)
+	{
+		const Level& level = mLevels[i];
+		const unsigned char* pixels = levelTexels(i, scratch);
+		if (!pixels)
+			continue;
+
+		if (gl.compressed)
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, gl.internalFormat,
+				(GLsizei)level.uncompressedSize, pixels);
+		else
+		{
+			glPixelStorei(GL_UNPACK_ALIGNMENT, glUnpackAlignment(pixels, level.uncompressedSize / level.height));
+			glTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, gl.format, gl.type, pixels);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return texID;
+}
+
+bool TextureContainer::write(const std::string& path, const MipChain& chain, Supercompression supercompression,
+	uint64_t sourceSize, uint64_t sourceTime, uint64_t sourceHash)
+{
+	return writeLevels(path, texelFormatForChannels(chain.channels), chain.levels, chain.data.data(),
+		supercompression, sourceSize, sourceTime, sourceHash);
+}
+
+bool TextureContainer::write(const std::string& path, const CompressedChain& chain, Supercompression supercompression,
+	uint64_t sourceSize, uint64_t sourceTime, uint64_t sourceHash)
+{
+	return writeLevels(path, texelFormatForBlocks(chain.format), chain.levels, chain.data.data(),
+		supercompression, sourceSize, sourceTime, sourceHash);
+}
+
+bool TextureContainer::write(const std::string& path, const HdrChain& chain, Supercompression supercompression,
+	uint64_t sourceSize, uint64_t sourceTime, uint64_t sourceHash)
+{
+	return writeLevels(path, texelFormatForHdr(chain.format), chain.levels, chain.data.data(),
+		supercompression, sourceSize, sourceTime, sourceHash);
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "BlockCompressor.h"
+#include "HalfFloat.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TexelFormat : uint32_t
+{
+	R8 = 1,
+	RG8,
+	RGB8,
+	RGBA8,
+	BC1,
+	BC3,
+	BC5,
+	RGBA16F,
+	R11G11B10F
+};
+
+struct GlTexelFormat
+{
+	GLenum internalFormat; // sized, for glTexStorage2D
+	GLenum format, type;   // unused for compressed formats
+	bool compressed;
+};
+
+// Smallest unit of a format's storage: a texel for plain formats, a 4x4 block
+// for BCn. Sub-rectangle copies have to move whole units.
+struct TexelBlock
+{
+	int size;     // texels per side
+	size_t bytes;
+};
+
+TexelFormat texelFormatForChannels(int channels);
+TexelFormat texelFormatForBlocks(BlockFormat format);
+TexelFormat texelFormatForHdr(HdrFormat format);
+GlTexelFormat glTexelFormat(TexelFormat format);
+const char* texelFormatName(TexelFormat format);
+// Largest GL_UNPACK_ALIGNMENT that rows of rowBytes starting at pixels satisfy,
+// so drivers can take their aligned copy path instead of repacking rows.
+GLint glUnpackAlignment(const void* pixels, size_t rowBytes);
+size_t texelFormatLevelBytes(TexelFormat format, int width, int height);
+TexelBlock texelBlock(TexelFormat format);
+
+enum class Supercompression : uint32_t
+{
+	None = 0,
+	Stb = 1 // stb_compress from stb.h, per level
+};
+
+// Cooked texture file (.otex): a fixed header, one index entry per mip level and
+// the level payloads, 16 byte aligned. Loading maps the file and validates only
+// the header and level index; pixel pages are first touched by the upload,
+// which hands pointers into the mapping straight to glTexSubImage2D.
+class TextureContainer
+{
+public:
+	struct Level
+	{
+		int width = 0, height = 0;
+		const unsigned char* data = nullptr; // inside the mapping
+		size_t size = 0;                     // stored bytes
+		size_t uncompressedSize = 0;         // bytes after undoing supercompression
+	};
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return mFile.isOpen(); }
+	TexelFormat format() const { return mFormat; }
+	Supercompression supercompression() const { return mSupercompression; }
+	int width() const { return mLevels.empty() ? 0 : mLevels[0].width; }
+	int height() const { return mLevels.empty() ? 0 : mLevels[0].height; }
+	size_t levelCount() const { return mLevels.size(); }
+	size_t fileSize() const { return mFile.size(); }
+	const Level& level(size_t index) const { return mLevels[index]; }
+
+	// True if the container was cooked from a source with this size and time.
+	bool matchesSource(uint64_t size, uint64_t modifiedTime) const;
+	// hash64 of the source file's bytes, 0 if the writer did not know it.
+	uint64_t sourceHash() const { return mSourceHash; }
+
+	// Returns the level's texels, pointing into the mapping when the level is
+	// stored plainly or into scratch after undoing supercompression. Null if
+	// the payload does not decompress to the expected size.
+	const unsigned char* levelTexels(size_t index, std::vector<unsigned char>& scratch) const;
+
+	// Starts reading the stored bytes of levels [first, end) ahead of use.
+	void prefetch(size_t first, size_t end) const;
+
+	// GL thread only. Creates an immutable GL_TEXTURE_2D with every level.
+	GLuint upload() const;
+
+	static bool write(const std::string& path, const MipChain& chain, Supercompression supercompression,
+		uint64_t sourceSize, uint64_t sourceTime, uint64_t sourceHash = 0);
+	static bool write(const std::string& path, const CompressedChain& chain, Supercompression supercompression,
+		uint64_t sourceSize, uint64_t sourceTime, uint64_t sourceHash = 0);
+	static bool write(const std::string& path, const HdrChain& chain, Supercompression supercompression,
+		uint64_t sourceSize, uint64_t sourceTime, uint64_t sourceHash = 0);
+
+private:
+	MappedFile mFile;
+	TexelFormat mFormat = TexelFormat::RGBA8;
+	Supercompression mSupercompression = Supercompression::None;
+	uint64_t mSourceSize = 0, mSourceTime = 0, mSourceHash = 0;
+	std::vector<Level> mLevels;
+};
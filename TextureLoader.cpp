@@ -0,0 +1,504 @@
+#include "TextureLoader.h"
+#include "Hash.h"
+#include "TextureCache.h"
+#include "stb_image.h"
+
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double elapsedMs(Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	}
+
+	// Everything an upload reads from, shared with a TextureStreamer until its
+	// last slice is issued.
+	struct UploadSource
+	{
+		MipChain chain;
+		CompressedChain blocks;
+		HdrChain hdr;
+		std::unique_ptr<TextureContainer> container;
+		std::vector<std::vector<unsigned char>> scratch; // per level, for supercompressed containers
+	};
+
+	BlockFormat chooseBlockFormat(const MipChain& chain, MipFilter filter)
+	{
+		if (filter == MipFilter::NormalMap)
+			return BlockFormat::BC5;
+		const unsigned char* pixels = chain.levelData(0);
+		const size_t count = (size_t)chain.levels[0].width * chain.levels[0].height;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (pixels[i * 4 + 3] != 255)
+				return BlockFormat::BC3;
+		}
+		return BlockFormat::BC1;
+	}
+
+	void stbParallelFor(void* user, int count, void (*task)(void*, int), void* context)
+	{
+		static_cast<ThreadPool*>(user)->parallelFor((size_t)count, 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				task(context, (int)i);
+		});
+	}
+}
+
+void setJpegDecodePool(ThreadPool* pool)
+{
+	stbi_set_jpeg_parallel_for(pool ? stbParallelFor : nullptr, pool);
+}
+
+TextureLoader::TextureLoader(ThreadPool& pool, AssetIO& io)
+	: mPool(pool)
+	, mIO(io)
+	, mStart(Clock::now())
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	for (auto& entry : mEntries)
+	{
+		if (entry->done.valid())
+			entry->done.wait();
+	}
+}
+
+TextureLoader::Ticket TextureLoader::request(const std::string& path, const TextureLoadParams& params)
+{
+	std::unique_ptr<Entry> entry(new Entry);
+	entry->image.path = path;
+	entry->params = params;
+	if (params.usage != TextureUsage::Unspecified)
+	{
+		entry->params.desiredChannels = usageChannels(params.usage);
+		entry->params.mipFilter = usageMipFilter(params.usage);
+	}
+	entry->ticket = entry->owner = mEntries.size();
+	// Put the read in flight now unless a cooked container will probably
+	// replace it; the decode task only waits for it.
+	uint64_t cookedSize = 0, cookedTime = 0;
+	if (!params.cook || !MappedFile::stat(cookedPath(path), cookedSize, cookedTime))
+	{
+		entry->read = mIO.read(path);
+		entry->reading = true;
+	}
+	Entry* raw = entry.get();
+	entry->done = mPool.submit([this, raw]() { mReadAndDecode(*raw); });
+	mEntries.push_back(std::move(entry));
+	return mEntries.size() - 1;
+}
+
+TextureLoader::Ticket TextureLoader::request(const std::string& name, const unsigned char* data, size_t size,
+	const TextureLoadParams& params)
+{
+	std::unique_ptr<Entry> entry(new Entry);
+	entry->image.path = name;
+	entry->params = params;
+	entry->params.cook = false;
+	if (params.usage != TextureUsage::Unspecified)
+	{
+		entry->params.desiredChannels = usageChannels(params.usage);
+		entry->params.mipFilter = usageMipFilter(params.usage);
+	}
+	entry->ticket = entry->owner = mEntries.size();
+	entry->memory = data;
+	entry->memorySize = size;
+	Entry* raw = entry.get();
+	entry->done = mPool.submit([this, raw]() { mReadAndDecode(*raw); });
+	mEntries.push_back(std::move(entry));
+	return mEntries.size() - 1;
+}
+
+void TextureLoader::mReadAndDecode(Entry& entry)
+{
+	const TextureLoadParams& params = entry.params;
+	auto start = Clock::now();
+	uint64_t sourceSize = 0, sourceTime = 0;
+	const bool haveSource = MappedFile::stat(entry.image.path, sourceSize, sourceTime);
+	const std::string containerPath = cookedPath(entry.image.path);
+	if (params.cook)
+	{
+		std::unique_ptr<TextureContainer> container(new TextureContainer);
+		if (container->open(containerPath) && (!haveSource || container->matchesSource(sourceSize, sourceTime)))
+		{
+			entry.timing.fileBytes = container->fileSize();
+			entry.sourceHash = container->sourceHash();
+			entry.key = entry.sourceHash ? cacheKey(entry.sourceHash, params) : 0;
+			entry.image.container = std::move(container);
+			entry.timing.cooked = true;
+			entry.timing.readMs = elapsedMs(start);
+			if (entry.reading)
+				mIO.release(entry.read);
+			return;
+		}
+	}
+
+	const unsigned char* bytes = entry.memory;
+	size_t size = entry.memorySize;
+	if (!bytes)
+	{
+		if (!entry.reading)
+		{
+			entry.read = mIO.read(entry.image.path);
+			entry.reading = true;
+		}
+		const AssetBuffer& source = mIO.wait(entry.read);
+		entry.timing.readMs = mIO.latencyMs(entry.read);
+		if (!source.valid())
+		{
+			std::cerr << "TextureLoader: could not read " << entry.image.path << std::endl;
+			return;
+		}
+		bytes = source.data();
+		size = source.size();
+	}
+	entry.timing.fileBytes = size;
+
+	entry.sourceHash = hash64(bytes, size);
+	entry.key = cacheKey(entry.sourceHash, params);
+	bool decoded = false;
+	if (mClaim(entry))
+		decoded = mDecode(entry, bytes, size);
+	else
+		TextureCache::shared().noteDecodeSkipped();
+	if (entry.reading)
+		mIO.release(entry.read);
+	if (!decoded)
+		return;
+
+	mCompress(entry);
+	mRepack(entry);
+
+	if (params.cook)
+	{
+		const Supercompression supercompression = params.supercompress ? Supercompression::Stb : Supercompression::None;
+		bool written = entry.image.compressed()
+			? TextureContainer::write(containerPath, entry.image.blocks, supercompression, sourceSize, sourceTime, entry.sourceHash)
+			: entry.image.isHdr()
+			? TextureContainer::write(containerPath, entry.image.hdr, supercompression, sourceSize, sourceTime, entry.sourceHash)
+			: TextureContainer::write(containerPath, entry.image.chain, supercompression, sourceSize, sourceTime, entry.sourceHash);
+		if (!written)
+			std::cerr << "TextureLoader: could not write " << containerPath << std::endl;
+	}
+}
+
+uint64_t TextureLoader::cacheKey(uint64_t sourceHash, const TextureLoadParams& params)
+{
+	const int32_t shape[] = { params.desiredChannels, params.mips ? 1 : 0, params.mips ? (int32_t)params.mipFilter : -1,
+		params.compress ? 1 : 0, (int32_t)params.usage, params.packedHdr ? 1 : 0 };
+	const uint64_t key = hash64(shape, sizeof(shape), sourceHash);
+	return key ? key : 1;
+}
+
+bool TextureLoader::mClaim(Entry& entry)
+{
+	// A texture already in the cache, or a request earlier in this loader
+	// decoding the same key, makes this one an alias: upload() hands out the
+	// other's texture and nothing is decoded here.
+	if (TextureCache::shared().contains(entry.key))
+		return false;
+	std::lock_guard<std::mutex> lock(mClaimsMutex);
+	auto claim = mClaims.emplace(entry.key, entry.ticket);
+	entry.owner = claim.first->second;
+	return claim.second;
+}
+
+bool TextureLoader::mDecode(Entry& entry, const unsigned char* bytes, size_t size)
+{
+	const TextureLoadParams& params = entry.params;
+	if (params.usage == TextureUsage::Hdr)
+		return mDecodeHdr(entry, bytes, size);
+
+	auto start = Clock::now();
+	const std::string cachePath = entry.image.path + ".mipcache";
+	const uint64_t sourceHash = entry.sourceHash;
+	const bool mipCache = params.mips && !entry.memory;
+	if (mipCache)
+	{
+		if (MipGenerator::loadCache(cachePath, sourceHash, params.mipFilter, entry.image.chain) &&
+			(params.desiredChannels == 0 || entry.image.chain.channels == params.desiredChannels))
+		{
+			entry.timing.cached = true;
+			entry.timing.decodeMs = elapsedMs(start);
+			return true;
+		}
+		entry.image.chain = MipChain();
+	}
+
+	// With a usage stb_image keeps the file's channels and the repack below
+	// converts them, which is much faster than stb_image's per pixel loop.
+	const bool repack = params.usage != TextureUsage::Unspecified;
+	start = Clock::now();
+	int width = 0, height = 0, nchannels = 0;
+	stbi_uc* pixels = stbi_load_from_memory(bytes, (int)size,
+		&width, &height, &nchannels, repack ? 0 : params.desiredChannels);
+	entry.timing.decodeMs = elapsedMs(start);
+	if (!pixels)
+	{
+		std::cerr << "TextureLoader: failed to decode " << entry.image.path << ": " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+	const int channels = params.desiredChannels ? params.desiredChannels : nchannels;
+	const unsigned char* texels = pixels;
+	std::vector<unsigned char> repacked;
+	if (repack && nchannels != channels)
+	{
+		start = Clock::now();
+		const size_t count = (size_t)width * height;
+		repacked.resize(count * channels);
+		TexelRepack::repack(pixels, nchannels, repacked.data(), channels, count);
+		texels = repacked.data();
+		entry.timing.repackMs = elapsedMs(start);
+	}
+
+	start = Clock::now();
+	MipChain& chain = entry.image.chain;
+	if (params.mips)
+	{
+		chain = MipGenerator::build(texels, width, height, channels, params.mipFilter, &mPool);
+		if (mipCache)
+			MipGenerator::saveCache(cachePath, sourceHash, params.mipFilter, chain);
+	}
+	else
+	{
+		chain.channels = channels;
+		chain.levels.resize(1);
+		chain.levels[0].width = width;
+		chain.levels[0].height = height;
+		chain.data.assign(texels, texels + chain.levelBytes(0));
+	}
+	entry.timing.mipMs = elapsedMs(start);
+	stbi_image_free(pixels);
+	return true;
+}
+
+bool TextureLoader::mDecodeHdr(Entry& entry, const unsigned char* data, size_t size)
+{
+	// 16-bit files are taken as linear data and scaled to [0, 1]. stb_image
+	// linearizes 8-bit files itself when asked for floats, and .hdr files
+	// already are. HDR chains skip the mip cache.
+	const TextureLoadParams& params = entry.params;
+	auto start = Clock::now();
+	int width = 0, height = 0, nchannels = 0;
+	std::vector<float> wide;
+	float* floats = nullptr;
+	const float* texels = nullptr;
+	if (stbi_is_16_bit_from_memory(data, (int)size))
+	{
+		if (stbi_us* shorts = stbi_load_16_from_memory(data, (int)size, &width, &height, &nchannels, 4))
+		{
+			wide.resize((size_t)width * height * 4);
+			for (size_t i = 0; i < wide.size(); ++i)
+				wide[i] = shorts[i] * (1.f / 65535.f);
+			stbi_image_free(shorts);
+			texels = wide.data();
+		}
+	}
+	else
+	{
+		texels = floats = stbi_loadf_from_memory(data, (int)size, &width, &height, &nchannels, 4);
+	}
+	entry.timing.decodeMs = elapsedMs(start);
+	if (!texels)
+	{
+		std::cerr << "TextureLoader: failed to decode " << entry.image.path << ": " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+
+	start = Clock::now();
+	FloatMipChain chain;
+	if (params.mips)
+	{
+		chain = MipGenerator::buildFloat(texels, width, height, 4, &mPool);
+	}
+	else
+	{
+		chain.channels = 4;
+		chain.levels.resize(1);
+		chain.levels[0].width = width;
+		chain.levels[0].height = height;
+		chain.data.assign(texels, texels + (size_t)width * height * 4);
+	}
+	stbi_image_free(floats);
+	wide = std::vector<float>();
+	entry.timing.mipMs = elapsedMs(start);
+
+	start = Clock::now();
+	entry.image.hdr = HalfFloat::pack(chain, params.packedHdr ? HdrFormat::R11G11B10F : HdrFormat::RGBA16F, &mPool);
+	entry.timing.repackMs = elapsedMs(start);
+	return true;
+}
+
+void TextureLoader::mCompress(Entry& entry)
+{
+	MipChain& chain = entry.image.chain;
+	if (!entry.params.compress || chain.channels != 4)
+		return;
+
+	auto start = Clock::now();
+	BlockFormat format = chooseBlockFormat(chain, entry.params.mipFilter);
+	entry.image.blocks = BlockCompressor::compress(chain, format, &mPool);
+	chain = MipChain();
+	entry.timing.compressMs = elapsedMs(start);
+}
+
+void TextureLoader::mRepack(Entry& entry)
+{
+	MipChain& chain = entry.image.chain;
+	const int channels = usageUploadChannels(entry.params.usage);
+	if (chain.levels.empty() || channels == 0 || chain.channels == channels)
+		return;
+
+	auto start = Clock::now();
+	chain = TexelRepack::repack(chain, channels, &mPool);
+	entry.timing.repackMs += elapsedMs(start);
+}
+
+const TextureLoader::Image& TextureLoader::wait(Ticket ticket)
+{
+	Entry& entry = *mEntries[ticket];
+	if (entry.done.valid())
+		entry.done.get();
+	return entry.image;
+}
+
+GLuint TextureLoader::upload(Ticket ticket, TextureStreamer* streamer)
+{
+	wait(ticket);
+	Entry& entry = *mEntries[ticket];
+	Image& image = entry.image;
+	TextureCache& cache = TextureCache::shared();
+	if (entry.key)
+	{
+		if (GLuint shared = cache.acquire(entry.key))
+		{
+			// Set unless an alias already had this request upload its texels.
+			entry.timing.shared = entry.timing.uploadMs == 0;
+			image.chain = MipChain();
+			image.blocks = CompressedChain();
+			image.hdr = HdrChain();
+			image.container.reset();
+			return shared;
+		}
+	}
+	if (!image.valid())
+	{
+		// An alias whose owner has not been uploaded yet, or failed.
+		if (entry.owner == ticket)
+			return 0;
+		entry.timing.shared = true;
+		return upload(entry.owner, streamer);
+	}
+
+	// The texels move out of the image, which frees them once uploaded or,
+	// when streaming, once the streamer has issued the last slice.
+	auto start = Clock::now();
+	std::shared_ptr<UploadSource> source = std::make_shared<UploadSource>();
+	source->chain = std::move(image.chain);
+	source->blocks = std::move(image.blocks);
+	source->hdr = std::move(image.hdr);
+	source->container = std::move(image.container);
+	image.chain = MipChain();
+	image.blocks = CompressedChain();
+	image.hdr = HdrChain();
+
+	// Immutable storage in the chain's own sized format, so the driver never
+	// has to convert texels, and the widest unpack alignment each level allows.
+	const TextureContainer* container = source->container.get();
+	const bool compressed = !source->blocks.levels.empty(), hdr = !source->hdr.levels.empty();
+	std::vector<MipLevel> levels = compressed ? source->blocks.levels : hdr ? source->hdr.levels : source->chain.levels;
+	TexelFormat format = compressed ? texelFormatForBlocks(source->blocks.format)
+		: hdr ? texelFormatForHdr(source->hdr.format) : texelFormatForChannels(source->chain.channels);
+	size_t bytes = compressed ? source->blocks.data.size() : hdr ? source->hdr.data.size() : source->chain.data.size();
+	if (container)
+	{
+		format = container->format();
+		levels.resize(container->levelCount());
+		source->scratch.resize(levels.size());
+		bytes = 0;
+		for (size_t level = 0; level < levels.size(); ++level)
+		{
+			levels[level].width = container->level(level).width;
+			levels[level].height = container->level(level).height;
+			bytes += container->level(level).uncompressedSize;
+		}
+	}
+
+	const GlTexelFormat gl = glTexelFormat(format);
+	GLuint texID = 0;
+	glGenTextures(1, &texID);
+	glBindTexture(GL_TEXTURE_2D, texID);
+	glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), gl.internalFormat, levels[0].width, levels[0].height);
+	if (entry.key)
+	{
+		const GLuint held = cache.insert(entry.key, texID, bytes);
+		if (held != texID)
+			return held;
+	}
+
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		const MipLevel& mip = levels[level];
+		const unsigned char* pixels = container ? container->levelTexels(level, source->scratch[level])
+			: compressed ? source->blocks.levelData(level) : hdr ? source->hdr.levelData(level) : source->chain.levelData(level);
+		if (!pixels)
+			continue;
+		if (streamer)
+		{
+			streamer->queue(texID, format, (int)level, mip.width, mip.height, pixels, source);
+		}
+		else if (gl.compressed)
+		{
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, mip.width, mip.height, gl.internalFormat,
+				(GLsizei)texelFormatLevelBytes(format, mip.width, mip.height), pixels);
+		}
+		else
+		{
+			glPixelStorei(GL_UNPACK_ALIGNMENT, glUnpackAlignment(pixels, texelFormatLevelBytes(format, mip.width, 1)));
+			glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, mip.width, mip.height, gl.format, gl.type, pixels);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	entry.timing.uploadMs = elapsedMs(start);
+	entry.timing.streamed = streamer != nullptr;
+	entry.timing.format = format;
+	entry.timing.gpuBytes = bytes;
+	return texID;
+}
+
+void TextureLoader::printTimingReport(std::ostream& out) const
+{
+	Timing total;
+	out << "Texture load timing (ms)" << std::endl;
+	out << std::setw(10) << "read" << std::setw(10) << "decode" << std::setw(10) << "repack" << std::setw(10) << "mips" << std::setw(10) << "encode"
+		<< std::setw(10) << "upload" << std::setw(12) << "KB" << std::setw(8) << "format" << std::setw(12) << "VRAM KB" << "  file" << std::endl;
+	out << std::fixed << std::setprecision(2);
+	for (auto& entry : mEntries)
+	{
+		const Timing& t = entry->timing;
+		out << std::setw(10) << t.readMs << std::setw(10) << t.decodeMs << std::setw(10) << t.repackMs << std::setw(10) << t.mipMs << std::setw(10) << t.compressMs
+			<< std::setw(10) << t.uploadMs << std::setw(12) << t.fileBytes / 1024 << std::setw(8) << (t.gpuBytes ? texelFormatName(t.format) : "-")
+			<< std::setw(12) << t.gpuBytes / 1024 << "  " << entry->image.path << (t.shared ? " (shared)" : t.cooked ? " (cooked)" : t.cached ? " (mip cache)" : "")
+			<< (t.streamed ? " (streamed)" : "") << std::endl;
+		total.readMs += t.readMs;
+		total.decodeMs += t.decodeMs;
+		total.repackMs += t.repackMs;
+		total.mipMs += t.mipMs;
+		total.compressMs += t.compressMs;
+		total.uploadMs += t.uploadMs;
+		total.fileBytes += t.fileBytes;
+		total.gpuBytes += t.gpuBytes;
+	}
+	out << std::setw(10) << total.readMs << std::setw(10) << total.decodeMs << std::setw(10) << total.repackMs << std::setw(10) << total.mipMs << std::setw(10) << total.compressMs
+		<< std::setw(10) << total.uploadMs << std::setw(12) << total.fileBytes / 1024 << std::setw(8) << "" << std::setw(12) << total.gpuBytes / 1024
+		<< "  total (" << mEntries.size() << " textures)" << std::endl;
+	out << "Wall time " << elapsedMs(mStart) << " ms on " << mPool.size() << " worker threads" << std::endl;
+	out.unsetf(std::ios::floatfield);
+}
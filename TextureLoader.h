@@ -0,0 +1,152 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "AssetIO.h"
+#include "BlockCompressor.h"
+#include "MipGenerator.h"
+#include "TexelRepack.h"
+#include "TextureContainer.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <future>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TextureLoadParams
+{
+	// Picks the uploaded format and overrides desiredChannels and mipFilter.
+	// Pixels are decoded with the file's channels and repacked with SIMD.
+	TextureUsage usage = TextureUsage::Unspecified;
+	int desiredChannels = 0; // as for stbi_load, 0 keeps the file's channels
+	bool mips = false;
+	MipFilter mipFilter = MipFilter::Srgb;
+	// Block compress for upload: BC5 for normal maps, BC3 when any texel has
+	// alpha below 255, BC1 otherwise. Needs 4 channel pixels.
+	bool compress = false;
+	// Keep the finished chain in <path>.otex and map it on later runs, as long
+	// as the source file's size and time are unchanged.
+	bool cook = false;
+	bool supercompress = false;
+	// Hdr usage: R11G11B10F instead of RGBA16F, half the memory and no alpha.
+	bool packedHdr = false;
+};
+
+// Routes stb_image's JPEG restart-interval decoding through pool, or back to a
+// single thread for nullptr. The setting is global to stb_image and not
+// synchronized, so set it once at startup, before any decode runs.
+void setJpegDecodePool(ThreadPool* pool);
+
+// Reads image files through AssetIO, starting every read as soon as it is
+// requested, and decodes them on the thread pool. Only finished pixel buffers
+// reach the GL thread, which uploads them through upload(). Mip chains are built
+// on the pool as well and cached next to the source file as <path>.mipcache, so
+// later runs skip both the decode and the filtering. Cooked textures skip the
+// whole pipeline and upload straight from a mapped TextureContainer. Uploads go
+// through TextureCache::shared(), so requests for the same file with the same
+// parameters share one GL texture and only the first of them is decoded.
+class TextureLoader
+{
+public:
+	typedef size_t Ticket;
+
+	struct Image
+	{
+		std::string path;
+		MipChain chain; // empty if loading failed, released after upload
+		CompressedChain blocks; // filled instead of chain when compressing
+		HdrChain hdr; // filled instead of chain for the Hdr usage
+		std::unique_ptr<TextureContainer> container; // set instead of all three for cooked files
+
+		bool compressed() const { return !blocks.levels.empty(); }
+		bool isHdr() const { return !hdr.levels.empty(); }
+		bool valid() const { return !chain.levels.empty() || compressed() || isHdr() || container; }
+		int width() const { return container ? container->width() : compressed() ? blocks.levels[0].width : isHdr() ? hdr.levels[0].width : chain.levels[0].width; }
+		int height() const { return container ? container->height() : compressed() ? blocks.levels[0].height : isHdr() ? hdr.levels[0].height : chain.levels[0].height; }
+		int channels() const { return chain.channels; }
+	};
+
+	struct Timing
+	{
+		size_t fileBytes = 0;
+		double readMs = 0, decodeMs = 0, repackMs = 0, mipMs = 0, compressMs = 0, uploadMs = 0;
+		TexelFormat format = TexelFormat::RGBA8; // as uploaded
+		size_t gpuBytes = 0;                     // texel bytes of every uploaded level
+		bool cached = false; // mips came from the mip cache
+		bool cooked = false; // uploaded from a cooked container
+		bool shared = false; // got a texture already in the TextureCache
+		bool streamed = false; // texels queued on a TextureStreamer
+	};
+
+	explicit TextureLoader(ThreadPool& pool = ThreadPool::shared(), AssetIO& io = AssetIO::shared());
+	~TextureLoader();
+
+	TextureLoader(TextureLoader const&) = delete;
+	void operator=(TextureLoader const&) = delete;
+
+	// Queues a file for reading, decoding and optional mip generation.
+	Ticket request(const std::string& path, const TextureLoadParams& params = TextureLoadParams());
+
+	// Queues an encoded image already in memory, such as one embedded in a
+	// .glb, which must stay valid until wait() returns. name only labels it in
+	// reports. There is no file to cook or keep a mip cache beside, so
+	// params.cook is ignored and mips, if asked for, are built every time.
+	Ticket request(const std::string& name, const unsigned char* data, size_t size,
+		const TextureLoadParams& params = TextureLoadParams());
+
+	// Blocks until the request is decoded.
+	const Image& wait(Ticket ticket);
+
+	// GL thread only. Waits for the request, creates a GL_TEXTURE_2D holding
+	// every level of its chain, and frees the CPU copy. Returns 0 on failure.
+	// The texture is a TextureCache reference: give it back with
+	// TextureCache::shared().release() rather than deleting it. With a
+	// streamer only the storage is created here; the texels follow over the
+	// next frames' TextureStreamer::update() calls.
+	GLuint upload(Ticket ticket, TextureStreamer* streamer = nullptr);
+
+	void printTimingReport(std::ostream& out) const;
+
+	// Where request() keeps the cooked container for path.
+	static std::string cookedPath(const std::string& path) { return path + ".otex"; }
+
+	// TextureCache key for a source file with hash64 sourceHash loaded with
+	// params. Only the parameters that change the uploaded texels take part.
+	static uint64_t cacheKey(uint64_t sourceHash, const TextureLoadParams& params);
+
+private:
+	struct Entry
+	{
+		Image image;
+		Timing timing;
+		TextureLoadParams params;
+		std::future<void> done;
+		Ticket ticket = 0;
+		Ticket owner = 0;       // request decoding the same key, ticket itself if none
+		uint64_t sourceHash = 0;
+		uint64_t key = 0;       // 0 until the source is read
+		const unsigned char* memory = nullptr; // set instead of a read for in-memory images
+		size_t memorySize = 0;
+		AssetIO::Request read = 0;
+		bool reading = false;   // read was submitted
+	};
+
+	void mReadAndDecode(Entry& entry);
+	bool mClaim(Entry& entry);
+	bool mDecode(Entry& entry, const unsigned char* bytes, size_t size);
+	bool mDecodeHdr(Entry& entry, const unsigned char* data, size_t size);
+	void mCompress(Entry& entry);
+	void mRepack(Entry& entry);
+
+private:
+	ThreadPool& mPool;
+	AssetIO& mIO;
+	std::vector<std::unique_ptr<Entry>> mEntries;
+	std::mutex mClaimsMutex;
+	std::unordered_map<uint64_t, Ticket> mClaims; // key to the request decoding it
+	std::chrono::steady_clock::time_point mStart;
+};
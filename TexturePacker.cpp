@@ -0,0 +1,452 @@
+#include "TexturePacker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	const uint32_t kPackVersion = 1;
+
+	struct PackHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t arrayCount;
+		uint32_t textureCount;
+	};
+
+	struct PackArrayHeader
+	{
+		uint32_t format;
+		uint32_t layers;
+		uint32_t atlas;
+		uint32_t levelCount;
+		uint32_t width;
+		uint32_t height;
+		uint64_t dataSize;
+	};
+
+	struct PackTextureRecord
+	{
+		int32_t array;
+		int32_t layer;
+		int32_t x, y, width, height;
+		float uvRect[4];
+		uint32_t nameLength;
+	};
+
+	// A packer input seen through its format, levels and bytes.
+	struct Source
+	{
+		TexelFormat format;
+		const std::vector<MipLevel>* levels;
+		const unsigned char* data;
+	};
+
+	Source describe(const TexturePacker::Input& input)
+	{
+		if (input.blocks)
+			return { texelFormatForBlocks(input.blocks->format), &input.blocks->levels, input.blocks->data.data() };
+		return { texelFormatForChannels(input.chain->channels), &input.chain->levels, input.chain->data.data() };
+	}
+
+	int alignUp(int value, int alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	int log2Floor(int value)
+	{
+		int result = 0;
+		while (value > 1)
+		{
+			value >>= 1;
+			++result;
+		}
+		return result;
+	}
+
+	void layoutArray(PackedArray& array, int width, int height, int levelCount)
+	{
+		array.levels.resize(levelCount);
+		size_t offset = 0;
+		for (int level = 0; level < levelCount; ++level)
+		{
+			array.levels[level].width = width;
+			array.levels[level].height = height;
+			array.levels[level].offset = offset;
+			offset += array.layerBytes(level) * array.layers;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		array.data.assign(offset, 0);
+	}
+
+	// Copies a level into a layer in whole texels or blocks, repeating the
+	// edge units pad times on every side. Positions and sizes are in units.
+	void copyPadded(unsigned char* dst, int dstColumns, int dstX, int dstY,
+		const unsigned char* src, int srcColumns, int srcRows, int pad, size_t unitBytes)
+	{
+		const size_t srcRowBytes = (size_t)srcColumns * unitBytes;
+		for (int row = -pad; row < srcRows + pad; ++row)
+		{
+			const unsigned char* srcRow = src + (size_t)std::min(std::max(row, 0), srcRows - 1) * srcRowBytes;
+			unsigned char* out = dst + ((size_t)(dstY + row) * dstColumns + dstX - pad) * unitBytes;
+			for (int i = 0; i < pad; ++i, out += unitBytes)
+				memcpy(out, srcRow, unitBytes);
+			memcpy(out, srcRow, srcRowBytes);
+			out += srcRowBytes;
+			for (int i = 0; i < pad; ++i, out += unitBytes)
+				memcpy(out, srcRow + srcRowBytes - unitBytes, unitBytes);
+		}
+	}
+
+	int unitsFor(int texels, const TexelBlock& block)
+	{
+		return (texels + block.size - 1) / block.size;
+	}
+}
+
+const char* const TexturePacker::kGlsl =
+	"vec4 packedTexture(sampler2DArray array, vec4 uvRect, float layer, vec2 uv)\n"
+	"{\n"
+	"	vec2 scaled = uv * uvRect.zw;\n"
+	"	return textureGrad(array, vec3(uvRect.xy + fract(uv) * uvRect.zw, layer), dFdx(scaled), dFdy(scaled));\n"
+	"}\n";
+
+SkylinePacker::SkylinePacker(int width, int height)
+	: mWidth(width)
+	, mHeight(height)
+{
+	mSkyline.push_back({ 0, 0, width });
+}
+
+int SkylinePacker::mFit(size_t index, int width, int height) const
+{
+	const int x = mSkyline[index].x;
+	if (x + width > mWidth)
+		return -1;
+	int y = 0, remaining = width;
+	for (size_t i = index; remaining > 0; ++i)
+	{
+		y = std::max(y, mSkyline[i].y);
+		if (y + height > mHeight)
+			return -1;
+		remaining -= mSkyline[i].width;
+	}
+	return y;
+}
+
+bool SkylinePacker::insert(int width, int height, int& x, int& y)
+{
+	size_t best = mSkyline.size();
+	int bestY = mHeight;
+	for (size_t i = 0; i < mSkyline.size(); ++i)
+	{
+		const int fit = mFit(i, width, height);
+		if (fit >= 0 && fit < bestY)
+		{
+			best = i;
+			bestY = fit;
+		}
+	}
+	if (best == mSkyline.size())
+		return false;
+
+	x = mSkyline[best].x;
+	y = bestY;
+	mSkyline.insert(mSkyline.begin() + best, { x, y + height, width });
+
+	// Trim the segments now under the new one.
+	for (size_t i = best + 1; i < mSkyline.size();)
+	{
+		const int overlap = x + width - mSkyline[i].x;
+		if (overlap <= 0)
+			break;
+		if (overlap < mSkyline[i].width)
+		{
+			mSkyline[i].x += overlap;
+			mSkyline[i].width -= overlap;
+			break;
+		}
+		mSkyline.erase(mSkyline.begin() + i);
+	}
+	for (size_t i = 0; i + 1 < mSkyline.size();)
+	{
+		if (mSkyline[i].y == mSkyline[i + 1].y)
+		{
+			mSkyline[i].width += mSkyline[i + 1].width;
+			mSkyline.erase(mSkyline.begin() + i + 1);
+		}
+		else
+		{
+			++i;
+		}
+	}
+	mUsedArea += (size_t)width * height;
+	return true;
+}
+
+GLuint PackedArray::upload() const
+{
+	const GlTexelFormat gl = glTexelFormat(format);
+	GLuint texID = 0;
+	glGenTextures(1, &texID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texID);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, (GLsizei)levels.size(), gl.internalFormat, width(), height(), layers);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		const MipLevel& mip = levels[level];
+		if (gl.compressed)
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, 0, mip.width, mip.height, layers,
+				gl.internalFormat, (GLsizei)(layerBytes(level) * layers), layerData(level, 0));
+		else
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, 0, mip.width, mip.height, layers,
+				gl.format, gl.type, layerData(level, 0));
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// Atlas entries repeat through packedTexture(), never through the sampler.
+	const GLint wrap = atlas ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+	return texID;
+}
+
+int PackedTextureSet::find(const std::string& name) const
+{
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		if (textures[i].name == name)
+			return (int)i;
+	}
+	return -1;
+}
+
+bool PackedTextureSet::write(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	PackHeader header = {};
+	memcpy(header.magic, "OPAK", 4);
+	header.version = kPackVersion;
+	header.arrayCount = (uint32_t)arrays.size();
+	header.textureCount = (uint32_t)textures.size();
+	file.write((const char*)&header, sizeof(header));
+	for (const PackedArray& array : arrays)
+	{
+		PackArrayHeader entry = {};
+		entry.format = (uint32_t)array.format;
+		entry.layers = (uint32_t)array.layers;
+		entry.atlas = array.atlas ? 1 : 0;
+		entry.levelCount = (uint32_t)array.levels.size();
+		entry.width = (uint32_t)array.width();
+		entry.height = (uint32_t)array.height();
+		entry.dataSize = array.data.size();
+		file.write((const char*)&entry, sizeof(entry));
+	}
+	for (const PackedTexture& texture : textures)
+	{
+		PackTextureRecord record = {};
+		record.array = texture.array;
+		record.layer = texture.layer;
+		record.x = texture.x;
+		record.y = texture.y;
+		record.width = texture.width;
+		record.height = texture.height;
+		memcpy(record.uvRect, &texture.uvRect[0], sizeof(record.uvRect));
+		record.nameLength = (uint32_t)texture.name.size();
+		file.write((const char*)&record, sizeof(record));
+		file.write(texture.name.data(), texture.name.size());
+	}
+	for (const PackedArray& array : arrays)
+		file.write((const char*)array.data.data(), array.data.size());
+	return (bool)file;
+}
+
+bool PackedTextureSet::read(const std::string& path)
+{
+	arrays.clear();
+	textures.clear();
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	PackHeader header;
+	if (!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, "OPAK", 4) != 0 || header.version != kPackVersion)
+		return false;
+
+	arrays.resize(header.arrayCount);
+	for (PackedArray& array : arrays)
+	{
+		PackArrayHeader entry;
+		if (!file.read((char*)&entry, sizeof(entry)) ||
+			entry.format < (uint32_t)TexelFormat::R8 || entry.format > (uint32_t)TexelFormat::BC5 ||
+			entry.width == 0 || entry.height == 0 || entry.layers == 0 ||
+			entry.levelCount == 0 || entry.levelCount > (uint32_t)MipGenerator::levelCount(entry.width, entry.height))
+			return false;
+		array.format = (TexelFormat)entry.format;
+		array.layers = (int)entry.layers;
+		array.atlas = entry.atlas != 0;
+		layoutArray(array, (int)entry.width, (int)entry.height, (int)entry.levelCount);
+		if (array.data.size() != entry.dataSize)
+			return false;
+	}
+
+	textures.resize(header.textureCount);
+	for (PackedTexture& texture : textures)
+	{
+		PackTextureRecord record;
+		if (!file.read((char*)&record, sizeof(record)) || record.array < -1 || record.array >= (int32_t)arrays.size() ||
+			record.nameLength > 4096)
+			return false;
+		texture.array = record.array;
+		texture.layer = record.layer;
+		texture.x = record.x;
+		texture.y = record.y;
+		texture.width = record.width;
+		texture.height = record.height;
+		texture.uvRect = glm::vec4(record.uvRect[0], record.uvRect[1], record.uvRect[2], record.uvRect[3]);
+		texture.name.resize(record.nameLength);
+		if (!file.read(&texture.name[0], record.nameLength))
+			return false;
+	}
+	for (PackedArray& array : arrays)
+	{
+		if (!file.read((char*)array.data.data(), array.data.size()))
+			return false;
+	}
+	return true;
+}
+
+PackedTextureSet TexturePacker::pack(const std::vector<Input>& inputs, const TexturePackParams& params)
+{
+	PackedTextureSet set;
+	set.textures.resize(inputs.size());
+	for (size_t i = 0; i < inputs.size(); ++i)
+		set.textures[i].name = inputs[i].name;
+
+	// Whole layer textures, one array per format and size.
+	std::vector<std::vector<size_t>> layered;
+	// Atlas candidates, one list per format.
+	std::vector<std::vector<size_t>> atlased;
+	auto sameGroup = [&](size_t a, size_t b, bool size) {
+		const Source sa = describe(inputs[a]), sb = describe(inputs[b]);
+		return sa.format == sb.format && (!size || ((*sa.levels)[0].width == (*sb.levels)[0].width &&
+			(*sa.levels)[0].height == (*sb.levels)[0].height && sa.levels->size() == sb.levels->size()));
+	};
+	auto addToGroup = [&](std::vector<std::vector<size_t>>& groups, size_t index, bool size) {
+		for (auto& group : groups)
+		{
+			if (sameGroup(group[0], index, size))
+			{
+				group.push_back(index);
+				return;
+			}
+		}
+		groups.push_back(std::vector<size_t>(1, index));
+	};
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		const Source source = describe(inputs[i]);
+		if (source.levels->empty())
+			continue;
+		const MipLevel& top = (*source.levels)[0];
+		const bool large = top.width * 2 > params.layerSize || top.height * 2 > params.layerSize;
+		addToGroup(large ? layered : atlased, i, large);
+	}
+
+	for (const auto& group : layered)
+	{
+		const Source first = describe(inputs[group[0]]);
+		PackedArray array;
+		array.format = first.format;
+		array.layers = (int)group.size();
+		layoutArray(array, (*first.levels)[0].width, (*first.levels)[0].height, (int)first.levels->size());
+		for (size_t layer = 0; layer < group.size(); ++layer)
+		{
+			const Source source = describe(inputs[group[layer]]);
+			for (size_t level = 0; level < array.levels.size(); ++level)
+				memcpy(array.layerData(level, (int)layer), source.data + (*source.levels)[level].offset, array.layerBytes(level));
+			PackedTexture& texture = set.textures[group[layer]];
+			texture.array = (int)set.arrays.size();
+			texture.layer = (int)layer;
+			texture.width = array.width();
+			texture.height = array.height();
+		}
+		set.arrays.push_back(std::move(array));
+	}
+
+	for (auto group : atlased)
+	{
+		const TexelFormat format = describe(inputs[group[0]]).format;
+		const TexelBlock block = texelBlock(format);
+		const int pad = std::max(params.padding, block.size);
+
+		// Largest first keeps the skyline flat.
+		std::sort(group.begin(), group.end(), [&](size_t a, size_t b) {
+			const MipLevel& la = (*describe(inputs[a]).levels)[0];
+			const MipLevel& lb = (*describe(inputs[b]).levels)[0];
+			if (la.height != lb.height)
+				return la.height > lb.height;
+			return la.width > lb.width;
+		});
+
+		std::vector<SkylinePacker> layers;
+		int levelCount = log2Floor(pad / block.size) + 1;
+		levelCount = std::min(levelCount, MipGenerator::levelCount(params.layerSize, params.layerSize));
+		for (size_t index : group)
+		{
+			const Source source = describe(inputs[index]);
+			const MipLevel& top = (*source.levels)[0];
+			const int cellWidth = alignUp(top.width, pad) + 2 * pad;
+			const int cellHeight = alignUp(top.height, pad) + 2 * pad;
+			int x = 0, y = 0;
+			size_t layer = 0;
+			while (layer < layers.size() && !layers[layer].insert(cellWidth, cellHeight, x, y))
+				++layer;
+			if (layer == layers.size())
+			{
+				layers.push_back(SkylinePacker(params.layerSize, params.layerSize));
+				layers.back().insert(cellWidth, cellHeight, x, y);
+			}
+			levelCount = std::min(levelCount, (int)source.levels->size());
+
+			PackedTexture& texture = set.textures[index];
+			texture.array = (int)set.arrays.size();
+			texture.layer = (int)layer;
+			texture.x = x + pad;
+			texture.y = y + pad;
+			texture.width = top.width;
+			texture.height = top.height;
+			const float scale = 1.f / params.layerSize;
+			texture.uvRect = glm::vec4(texture.x * scale, texture.y * scale, texture.width * scale, texture.height * scale);
+		}
+
+		PackedArray array;
+		array.format = format;
+		array.layers = (int)layers.size();
+		array.atlas = true;
+		layoutArray(array, params.layerSize, params.layerSize, levelCount);
+		for (size_t index : group)
+		{
+			const Source source = describe(inputs[index]);
+			const PackedTexture& texture = set.textures[index];
+			for (int level = 0; level < levelCount; ++level)
+			{
+				const MipLevel& mip = (*source.levels)[level];
+				copyPadded(array.layerData(level, texture.layer), unitsFor(array.levels[level].width, block),
+					(texture.x >> level) / block.size, (texture.y >> level) / block.size,
+					source.data + mip.offset, unitsFor(mip.width, block), unitsFor(mip.height, block),
+					(pad >> level) / block.size, block.bytes);
+			}
+		}
+		set.arrays.push_back(std::move(array));
+	}
+	return set;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "BlockCompressor.h"
+#include "MipGenerator.h"
+#include "TextureContainer.h"
+#include "glm/glm.hpp"
+
+#include <string>
+#include <vector>
+
+// Bottom-left skyline packing of rectangles into one fixed size bin.
+class SkylinePacker
+{
+public:
+	SkylinePacker(int width, int height);
+
+	// Finds the lowest position the rectangle fits at, leftmost on ties.
+	bool insert(int width, int height, int& x, int& y);
+
+	double occupancy() const { return (double)mUsedArea / ((double)mWidth * mHeight); }
+
+private:
+	struct Segment
+	{
+		int x, y, width;
+	};
+
+	int mFit(size_t index, int width, int height) const;
+
+private:
+	int mWidth, mHeight;
+	size_t mUsedArea = 0;
+	std::vector<Segment> mSkyline;
+};
+
+struct TexturePackParams
+{
+	int layerSize = 2048;
+	// Edge texels repeated around every atlas entry, a power of two. Entries
+	// start on multiples of it, so mip level k still has padding >> k texels
+	// around them; atlases keep the levels where that is at least one texel
+	// (one block for BCn).
+	int padding = 8;
+};
+
+// One texture inside a PackedTextureSet.
+struct PackedTexture
+{
+	std::string name;
+	int array = -1; // index into PackedTextureSet::arrays, -1 if not packed
+	int layer = 0;
+	int x = 0, y = 0, width = 0, height = 0; // level 0 texels inside the layer
+	glm::vec4 uvRect = glm::vec4(0, 0, 1, 1);  // offset.xy and scale.zw inside the layer
+};
+
+// A GL_TEXTURE_2D_ARRAY worth of texels. levels[k].offset is where level k
+// starts in data; its layers follow each other.
+struct PackedArray
+{
+	TexelFormat format = TexelFormat::RGBA8;
+	int layers = 0;
+	bool atlas = false; // layers are shared by several textures
+	std::vector<MipLevel> levels;
+	std::vector<unsigned char> data;
+
+	int width() const { return levels[0].width; }
+	int height() const { return levels[0].height; }
+	size_t layerBytes(size_t level) const { return texelFormatLevelBytes(format, levels[level].width, levels[level].height); }
+	unsigned char* layerData(size_t level, int layer) { return data.data() + levels[level].offset + layerBytes(level) * layer; }
+	const unsigned char* layerData(size_t level, int layer) const { return data.data() + levels[level].offset + layerBytes(level) * layer; }
+
+	// GL thread only. Creates an immutable GL_TEXTURE_2D_ARRAY with every
+	// level and layer.
+	GLuint upload() const;
+};
+
+struct PackedTextureSet
+{
+	std::vector<PackedArray> arrays;
+	std::vector<PackedTexture> textures;
+
+	// Index into textures, or -1.
+	int find(const std::string& name) const;
+
+	// Packed sets can be built offline and loaded as they are.
+	bool write(const std::string& path) const;
+	bool read(const std::string& path);
+};
+
+// Groups textures by format so a draw can reach many of them through one
+// bound array. Textures at least half a layer wide or tall get whole layers of
+// an array holding only their size, with their full mip chain. Smaller ones
+// are skyline packed, largest first, into atlas layers of layerSize.
+class TexturePacker
+{
+public:
+	struct Input
+	{
+		std::string name;
+		const MipChain* chain = nullptr;           // either this
+		const CompressedChain* blocks = nullptr;   // or this
+	};
+
+	static PackedTextureSet pack(const std::vector<Input>& inputs, const TexturePackParams& params = TexturePackParams());
+
+	// GLSL declaring packedTexture(array, uvRect, layer, uv), which samples a
+	// packed texture with uv repeating inside its rectangle.
+	static const char* const kGlsl;
+};
@@ -0,0 +1,360 @@
+#include "TextureResidency.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+TextureResidency::TextureResidency(const ResidencyParams& params)
+	: mParams(params)
+{
+	mStats.budgetBytes = params.budgetBytes;
+}
+
+TextureResidency::Handle TextureResidency::add(const std::string& containerPath, const TextureSampling& sampling)
+{
+	std::unique_ptr<Texture> texture(new Texture);
+	if (!texture->container.open(containerPath))
+		return kInvalid;
+
+	const TextureContainer& container = texture->container;
+	if (container.sourceHash())
+	{
+		for (size_t i = 0; i < mTextures.size(); ++i)
+		{
+			Texture& other = *mTextures[i];
+			if (other.streamed() && other.container.sourceHash() == container.sourceHash() &&
+				other.container.format() == container.format() && other.container.levelCount() == container.levelCount() &&
+				other.sampling == sampling)
+			{
+				++other.references;
+				++mStats.references;
+				return i;
+			}
+		}
+	}
+
+	const int count = (int)container.levelCount();
+	int tail = count - 1;
+	while (tail > 0 && std::max(container.level(tail - 1).width, container.level(tail - 1).height) <= mParams.tailSize)
+		--tail;
+	texture->sampling = sampling;
+	texture->tailLevel = tail;
+	texture->wantedLevel = tail;
+	texture->residentLevel = count;
+	mSetResidentLevel(*texture, tail);
+
+	mTextures.push_back(std::move(texture));
+	++mStats.textures;
+	++mStats.references;
+	return mTextures.size() - 1;
+}
+
+TextureResidency::Handle TextureResidency::adopt(GLuint id, size_t bytes)
+{
+	for (size_t i = 0; i < mTextures.size(); ++i)
+	{
+		if (id && mTextures[i]->id == id && !mTextures[i]->streamed())
+		{
+			++mTextures[i]->references;
+			++mStats.references;
+			return i;
+		}
+	}
+
+	std::unique_ptr<Texture> texture(new Texture);
+	texture->id = id;
+	texture->adoptedBytes = bytes;
+	mStats.residentBytes += bytes;
+	mTextures.push_back(std::move(texture));
+	++mStats.textures;
+	++mStats.references;
+	return mTextures.size() - 1;
+}
+
+void TextureResidency::release(Handle handle)
+{
+	if (handle >= mTextures.size() || mTextures[handle]->references == 0)
+		return;
+	Texture& texture = *mTextures[handle];
+	--mStats.references;
+	if (texture.references > 1)
+	{
+		--texture.references;
+		if (!texture.streamed())
+			TextureCache::shared().release(texture.id);
+		return;
+	}
+	--mStats.textures;
+	if (texture.streamed())
+		mStats.residentBytes -= mLevelBytes(texture, texture.residentLevel, (int)texture.container.levelCount());
+	else
+		mStats.residentBytes -= texture.adoptedBytes;
+	mFree(texture);
+}
+
+void TextureResidency::clear()
+{
+	for (auto& texture : mTextures)
+		mFree(*texture);
+	mTextures.clear();
+	mStats = Stats();
+	mStats.budgetBytes = mParams.budgetBytes;
+}
+
+void TextureResidency::beginFrame()
+{
+	++mFrame;
+	for (auto& texture : mTextures)
+		texture->wantedLevel = texture->tailLevel;
+	mStats.pendingRequests = 0;
+	mStats.uploadedLevels = mStats.uploadedBytes = 0;
+	mStats.evictedLevels = mStats.evictedBytes = 0;
+}
+
+float TextureResidency::projectedPixels(const glm::mat4& modelViewProjection,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::ivec2& viewport)
+{
+	glm::vec4 clip[8];
+	unsigned outsideAll = 0x3f;
+	bool crossesNear = false;
+	for (int i = 0; i < 8; ++i)
+	{
+		const glm::vec3 corner(i & 1 ? boundsMax.x : boundsMin.x, i & 2 ? boundsMax.y : boundsMin.y, i & 4 ? boundsMax.z : boundsMin.z);
+		const glm::vec4 p = modelViewProjection * glm::vec4(corner, 1.f);
+		unsigned outside = 0;
+		outside |= p.x < -p.w ? 1 : 0;
+		outside |= p.x > p.w ? 2 : 0;
+		outside |= p.y < -p.w ? 4 : 0;
+		outside |= p.y > p.w ? 8 : 0;
+		outside |= p.z < -p.w ? 16 : 0;
+		outside |= p.z > p.w ? 32 : 0;
+		outsideAll &= outside;
+		crossesNear |= p.w <= 1e-6f;
+		clip[i] = p;
+	}
+	if (outsideAll)
+		return -1.f;
+	if (crossesNear)
+		return (float)viewport.x * viewport.y;
+
+	glm::vec2 lo(1e30f), hi(-1e30f);
+	for (const glm::vec4& p : clip)
+	{
+		const glm::vec2 ndc = glm::vec2(p) / p.w;
+		lo = glm::min(lo, ndc);
+		hi = glm::max(hi, ndc);
+	}
+	// The box is not clipped to the screen: a texture half off screen still
+	// needs the texel density of its whole projection.
+	return (hi.x - lo.x) * 0.5f * viewport.x * (hi.y - lo.y) * 0.5f * viewport.y;
+}
+
+void TextureResidency::noteUse(Handle handle, const glm::mat4& modelViewProjection,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::ivec2& viewport)
+{
+	Texture& texture = *mTextures[handle];
+	if (!texture.streamed())
+		return;
+	const float pixels = projectedPixels(modelViewProjection, boundsMin, boundsMax, viewport);
+	if (pixels < 0.f)
+		return;
+
+	// Each level quarters the texel count, so the level whose texels match the
+	// covered pixels one to one is half the log2 of their ratio.
+	const TextureContainer::Level& top = texture.container.level(0);
+	const float texels = (float)top.width * top.height;
+	const float lod = 0.5f * std::log2(texels / std::max(pixels, 1.f)) + mParams.lodBias;
+	const int level = std::min(std::max((int)std::floor(lod), 0), texture.tailLevel);
+	texture.wantedLevel = std::min(texture.wantedLevel, level);
+	texture.lastUsedFrame = mFrame;
+}
+
+void TextureResidency::update()
+{
+	std::vector<Texture*> requests;
+	for (auto& texture : mTextures)
+	{
+		if (texture->streamed() && texture->wantedLevel < texture->residentLevel)
+			requests.push_back(texture.get());
+	}
+	// The blurriest textures first, then the cheapest.
+	std::sort(requests.begin(), requests.end(), [this](const Texture* a, const Texture* b) {
+		const int missingA = a->residentLevel - a->wantedLevel, missingB = b->residentLevel - b->wantedLevel;
+		if (missingA != missingB)
+			return missingA > missingB;
+		return mLevelBytes(*a, a->wantedLevel, a->residentLevel) < mLevelBytes(*b, b->wantedLevel, b->residentLevel);
+	});
+
+	size_t uploaded = 0;
+	for (Texture* texture : requests)
+	{
+		// Stay within the frame's upload allowance, except that the first
+		// request may always bring in one level so large levels still arrive.
+		int target = texture->wantedLevel;
+		while (target < texture->residentLevel &&
+			uploaded + mLevelBytes(*texture, target, texture->residentLevel) > mParams.uploadBytesPerFrame &&
+			!(uploaded == 0 && target == texture->residentLevel - 1))
+			++target;
+		while (target < texture->residentLevel && !mMakeRoom(mLevelBytes(*texture, target, texture->residentLevel), texture))
+			++target;
+
+		if (target < texture->residentLevel)
+		{
+			uploaded += mLevelBytes(*texture, target, texture->residentLevel);
+			mSetResidentLevel(*texture, target);
+		}
+		if (texture->wantedLevel < texture->residentLevel)
+		{
+			++mStats.pendingRequests;
+			texture->container.prefetch(texture->wantedLevel, texture->residentLevel);
+		}
+	}
+}
+
+GLuint TextureResidency::texture(Handle handle) const
+{
+	return handle < mTextures.size() ? mTextures[handle]->id : 0;
+}
+
+int TextureResidency::residentLevel(Handle handle) const
+{
+	return mTextures[handle]->residentLevel;
+}
+
+void TextureResidency::printStats(std::ostream& out) const
+{
+	out << std::fixed << std::setprecision(2)
+		<< "Texture residency: " << mStats.residentBytes / 1048576.0 << " of " << mStats.budgetBytes / 1048576.0 << " MB in "
+		<< mStats.textures << " textures, " << mStats.pendingRequests << " pending, uploaded " << mStats.uploadedLevels
+		<< " levels (" << mStats.uploadedBytes / 1024 << " KB), evicted " << mStats.evictedLevels
+		<< " levels (" << mStats.evictedBytes / 1024 << " KB)" << std::endl;
+	out.unsetf(std::ios::floatfield);
+}
+
+void TextureResidency::mFree(Texture& texture)
+{
+	if (texture.streamed())
+	{
+		glDeleteTextures(1, &texture.id);
+		texture.container.close();
+	}
+	else
+	{
+		for (size_t i = 0; i < texture.references; ++i)
+			TextureCache::shared().release(texture.id);
+	}
+	texture.id = 0;
+	texture.references = 0;
+}
+
+size_t TextureResidency::mLevelBytes(const Texture& texture, int first, int end) const
+{
+	size_t bytes = 0;
+	for (int i = first; i < end; ++i)
+		bytes += texture.container.level(i).uncompressedSize;
+	return bytes;
+}
+
+bool TextureResidency::mMakeRoom(size_t bytes, const Texture* requester)
+{
+	// A texture drawn this frame only gives up levels finer than it asked
+	// for; the others can go back down to their tail.
+	auto floorLevel = [this](const Texture& texture) {
+		return texture.lastUsedFrame == mFrame ? std::min(texture.wantedLevel, texture.tailLevel) : texture.tailLevel;
+	};
+
+	size_t evictable = 0;
+	std::vector<Texture*> victims;
+	for (auto& texture : mTextures)
+	{
+		if (texture.get() == requester || !texture->streamed() || texture->residentLevel >= floorLevel(*texture))
+			continue;
+		evictable += mLevelBytes(*texture, texture->residentLevel, floorLevel(*texture));
+		victims.push_back(texture.get());
+	}
+	if (mStats.residentBytes + bytes <= mParams.budgetBytes)
+		return true;
+	if (mStats.residentBytes + bytes > mParams.budgetBytes + evictable)
+		return false;
+
+	// Least recently used first, and among equals the one holding the finest
+	// level.
+	std::sort(victims.begin(), victims.end(), [](const Texture* a, const Texture* b) {
+		if (a->lastUsedFrame != b->lastUsedFrame)
+			return a->lastUsedFrame < b->lastUsedFrame;
+		return a->residentLevel < b->residentLevel;
+	});
+	for (Texture* victim : victims)
+	{
+		const int floor = floorLevel(*victim);
+		int level = victim->residentLevel;
+		size_t freed = 0;
+		while (level < floor && mStats.residentBytes - freed + bytes > mParams.budgetBytes)
+			freed += victim->container.level(level++).uncompressedSize;
+		mSetResidentLevel(*victim, level);
+		if (mStats.residentBytes + bytes <= mParams.budgetBytes)
+			return true;
+	}
+	return mStats.residentBytes + bytes <= mParams.budgetBytes;
+}
+
+void TextureResidency::mSetResidentLevel(Texture& texture, int level)
+{
+	const TextureContainer& container = texture.container;
+	const int count = (int)container.levelCount();
+	if (level == texture.residentLevel)
+		return;
+
+	const GlTexelFormat gl = glTexelFormat(container.format());
+	const TextureContainer::Level& top = container.level(level);
+	GLuint id = 0;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexStorage2D(GL_TEXTURE_2D, count - level, gl.internalFormat, top.width, top.height);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	std::vector<unsigned char> scratch;
+	for (int i = level; i < count; ++i)
+	{
+		const TextureContainer::Level& src = container.level(i);
+		if (texture.id && i >= texture.residentLevel)
+		{
+			glCopyImageSubData(texture.id, GL_TEXTURE_2D, i - texture.residentLevel, 0, 0, 0,
+				id, GL_TEXTURE_2D, i - level, 0, 0, 0, src.width, src.height, 1);
+			continue;
+		}
+
+		const unsigned char* pixels = container.levelTexels(i, scratch);
+		if (!pixels)
+			continue;
+		if (gl.compressed)
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, i - level, 0, 0, src.width, src.height, gl.internalFormat,
+				(GLsizei)src.uncompressedSize, pixels);
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, i - level, 0, 0, src.width, src.height, gl.format, gl.type, pixels);
+		++mStats.uploadedLevels;
+		mStats.uploadedBytes += src.uncompressedSize;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture.sampling.minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texture.sampling.magFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture.sampling.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture.sampling.wrap);
+
+	if (texture.id)
+		glDeleteTextures(1, &texture.id);
+	if (level > texture.residentLevel)
+	{
+		mStats.evictedLevels += level - texture.residentLevel;
+		mStats.evictedBytes += mLevelBytes(texture, texture.residentLevel, level);
+		mStats.residentBytes -= mLevelBytes(texture, texture.residentLevel, level);
+	}
+	else
+	{
+		mStats.residentBytes += mLevelBytes(texture, level, std::min(texture.residentLevel, count));
+	}
+	texture.id = id;
+	texture.residentLevel = level;
+}
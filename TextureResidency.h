@@ -0,0 +1,119 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "TextureCache.h"
+#include "TextureContainer.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ResidencyParams
+{
+	size_t budgetBytes = 64 << 20;         // VRAM the streamed textures may occupy
+	size_t uploadBytesPerFrame = 8 << 20;  // texel bytes streamed in per update()
+	int tailSize = 64;    // levels no larger than this are always resident
+	float lodBias = 0.f;  // added to the computed level, positive is coarser
+};
+
+// Keeps cooked textures in VRAM under a byte budget. Every texture always holds
+// its coarse tail; finer levels are streamed in from the mapped container when
+// a draw's screen footprint asks for them and dropped again, finest first, from
+// the least recently used textures when the budget runs out. A texture's
+// resident levels live in one immutable GL texture, so changing them swaps in a
+// new texture object: the levels both have in common are copied on the GPU and
+// only the new ones are read from the file. Callers must fetch texture() after
+// update() rather than keep the id. Handles are reference counted: adding a
+// container cooked from the same source with the same sampling, or adopting a
+// texture already tracked, returns the existing handle.
+class TextureResidency
+{
+public:
+	typedef size_t Handle;
+	static const Handle kInvalid = ~(size_t)0;
+
+	struct Stats
+	{
+		size_t budgetBytes = 0;
+		size_t residentBytes = 0;
+		size_t textures = 0;
+		size_t references = 0; // handles given out, at least textures
+		// Per frame, reset by beginFrame().
+		size_t pendingRequests = 0; // textures still coarser than their draws need
+		size_t uploadedLevels = 0, uploadedBytes = 0;
+		size_t evictedLevels = 0, evictedBytes = 0;
+	};
+
+	explicit TextureResidency(const ResidencyParams& params = ResidencyParams());
+
+	TextureResidency(TextureResidency const&) = delete;
+	void operator=(TextureResidency const&) = delete;
+
+	// GL thread only. Maps a cooked container and uploads its tail. Returns
+	// kInvalid if the file is missing or not a valid container.
+	Handle add(const std::string& containerPath, const TextureSampling& sampling = TextureSampling());
+
+	// GL thread only. Tracks a texture created elsewhere; it counts towards the
+	// resident bytes but is never streamed or evicted. Each reference to an
+	// adopted texture is given back through TextureCache::shared().release(),
+	// so adopt what TextureLoader::upload() returns once per call.
+	Handle adopt(GLuint texture, size_t bytes);
+
+	// GL thread only. Drops one reference to the handle and frees the texture
+	// with the last one. The handle stays invalid afterwards.
+	void release(Handle handle);
+
+	// GL thread only. Frees every texture.
+	void clear();
+
+	// Starts a frame: forgets the previous frame's requests and counters.
+	void beginFrame();
+
+	// Records a draw using the texture. bounds are the object space box of the
+	// mesh the texture is mapped across once; the projected box decides how
+	// many texels land on each pixel and so the finest level worth having.
+	void noteUse(Handle handle, const glm::mat4& modelViewProjection,
+		const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::ivec2& viewport);
+
+	// GL thread only. Evicts and streams towards this frame's requests.
+	void update();
+
+	GLuint texture(Handle handle) const;
+	int residentLevel(Handle handle) const;
+	const Stats& stats() const { return mStats; }
+	void printStats(std::ostream& out) const;
+
+	// Screen area in pixels covered by the projected box, or -1 if the box is
+	// off screen. Boxes crossing the near plane report the whole viewport.
+	static float projectedPixels(const glm::mat4& modelViewProjection,
+		const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::ivec2& viewport);
+
+private:
+	struct Texture
+	{
+		TextureContainer container; // closed for adopted textures
+		TextureSampling sampling;
+		GLuint id = 0;
+		size_t adoptedBytes = 0;
+		int residentLevel = 0; // levels [residentLevel, levelCount) are in id
+		int tailLevel = 0;     // finest level that is never evicted
+		int wantedLevel = 0;   // finest level this frame's draws asked for
+		uint64_t lastUsedFrame = 0;
+		size_t references = 1;
+
+		bool streamed() const { return container.isOpen(); }
+	};
+
+	size_t mLevelBytes(const Texture& texture, int first, int end) const;
+	void mFree(Texture& texture);
+	bool mMakeRoom(size_t bytes, const Texture* requester);
+	void mSetResidentLevel(Texture& texture, int level);
+
+private:
+	ResidencyParams mParams;
+	std::vector<std::unique_ptr<Texture>> mTextures;
+	uint64_t mFrame = 1;
+	Stats mStats;
+};
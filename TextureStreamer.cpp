@@ -0,0 +1,262 @@
+#include "TextureStreamer.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	size_t align16(size_t value)
+	{
+		return (value + 15) & ~(size_t)15;
+	}
+}
+
+TextureStreamer::TextureStreamer(const TextureStreamParams& params)
+	: mParams(params)
+{
+}
+
+void TextureStreamer::queue(GLuint texture, TexelFormat format, int level, int width, int height, const unsigned char* texels,
+	std::shared_ptr<const void> keepAlive)
+{
+	if (!texture || !texels || width <= 0 || height <= 0)
+		return;
+	Job job;
+	job.texture = texture;
+	job.format = format;
+	job.level = level;
+	job.width = width;
+	job.height = height;
+	job.texels = texels;
+	job.keepAlive = std::move(keepAlive);
+	mJobs.push_back(std::move(job));
+	mQueuedBytes += texelFormatLevelBytes(format, width, height);
+
+	Pending& pending = mTextures[texture];
+	if (pending.jobs++ == 0)
+		pending.retained = TextureCache::shared().retain(texture);
+}
+
+void TextureStreamer::cancel(GLuint texture)
+{
+	auto found = mTextures.find(texture);
+	if (found == mTextures.end())
+		return;
+	for (auto job = mJobs.begin(); job != mJobs.end();)
+	{
+		if (job->texture != texture)
+		{
+			++job;
+			continue;
+		}
+		const TexelBlock block = texelBlock(job->format);
+		const int doneRows = job->row / block.size;
+		mQueuedBytes -= texelFormatLevelBytes(job->format, job->width, job->height) -
+			texelFormatLevelBytes(job->format, job->width, block.size) * doneRows;
+		job = mJobs.erase(job);
+	}
+	const bool retained = found->second.retained;
+	mTextures.erase(found);
+	if (retained)
+		TextureCache::shared().release(texture);
+}
+
+bool TextureStreamer::mCreateRing()
+{
+	// Entry points GL 4.4 added are null on older contexts.
+	if (!glBufferStorage)
+		return false;
+	mSectionBytes = mParams.ringBytes / kFramesInFlight & ~(size_t)15;
+	if (mSectionBytes == 0)
+		return false;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr size = (GLsizeiptr)(mSectionBytes * kFramesInFlight);
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+	mMapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!mMapped)
+	{
+		glDeleteBuffers(1, &mBuffer);
+		mBuffer = 0;
+		return false;
+	}
+	return true;
+}
+
+void TextureStreamer::mWaitSection(int section)
+{
+	GLsync& fence = mFences[section];
+	if (!fence)
+		return;
+	auto start = Clock::now();
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	while (status == GL_TIMEOUT_EXPIRED)
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	mFrame.stallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+size_t TextureStreamer::mSlice(Job& job, size_t room, bool staged, size_t offset)
+{
+	// Whole block rows only: BCn sub-images have to start and end on blocks.
+	const TexelBlock block = texelBlock(job.format);
+	const size_t rowBytes = texelFormatLevelBytes(job.format, job.width, block.size);
+	const size_t rowsLeft = (size_t)(job.height - job.row + block.size - 1) / block.size;
+	size_t rows = std::min(rowsLeft, room / rowBytes);
+	if (rows == 0)
+		return 0;
+
+	const size_t bytes = rows * rowBytes;
+	const unsigned char* source = job.texels + (size_t)(job.row / block.size) * rowBytes;
+	const void* pixels = source;
+	if (staged)
+	{
+		memcpy(mMapped + offset, source, bytes);
+		pixels = (const void*)(uintptr_t)offset;
+	}
+	else if (mMapped)
+	{
+		// A row wider than a ring section goes straight from client memory.
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	const GlTexelFormat gl = glTexelFormat(job.format);
+	const int height = std::min((int)rows * block.size, job.height - job.row);
+	if (gl.compressed)
+	{
+		glCompressedTextureSubImage2D(job.texture, job.level, 0, job.row, job.width, height, gl.internalFormat,
+			(GLsizei)bytes, pixels);
+	}
+	else
+	{
+		glPixelStorei(GL_UNPACK_ALIGNMENT, glUnpackAlignment(pixels, rowBytes));
+		glTextureSubImage2D(job.texture, job.level, 0, job.row, job.width, height, gl.format, gl.type, pixels);
+	}
+	if (mMapped && !staged)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+
+	job.row += height;
+	mQueuedBytes -= bytes;
+	++mFrame.slices;
+	mFrame.uploadedBytes += bytes;
+	return bytes;
+}
+
+void TextureStreamer::mFinishJob(const Job& job)
+{
+	auto found = mTextures.find(job.texture);
+	if (--found->second.jobs > 0)
+		return;
+	const bool retained = found->second.retained;
+	mTextures.erase(found);
+	++mStats.texturesCompleted;
+	if (retained)
+		TextureCache::shared().release(job.texture);
+}
+
+void TextureStreamer::update()
+{
+	mFrame = FrameStats();
+	if (mJobs.empty())
+		return;
+	if (!mBuffer && !mRingFailed && !mCreateRing())
+	{
+		// Still spread over frames, just without the asynchronous copy.
+		std::cerr << "TextureStreamer: persistent mapping unavailable, uploading from client memory" << std::endl;
+		mRingFailed = true;
+	}
+
+	const size_t budget = mMapped ? std::min(mParams.uploadBytesPerFrame, mSectionBytes) : mParams.uploadBytesPerFrame;
+	const size_t base = mSectionBytes * mSection;
+	size_t used = 0; // of the section; slices start 16 byte aligned
+	if (mMapped)
+	{
+		mWaitSection(mSection);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+	}
+	while (!mJobs.empty() && mFrame.uploadedBytes < budget && (!mMapped || used < mSectionBytes))
+	{
+		Job& job = mJobs.front();
+		const size_t room = std::min(budget - mFrame.uploadedBytes, mMapped ? mSectionBytes - used : budget);
+		size_t bytes = mSlice(job, room, mMapped != nullptr, base + used);
+		// Always make progress: a frame with nothing sent yet takes one block
+		// row even when it alone is over the budget or the section.
+		if (bytes == 0 && mFrame.uploadedBytes == 0)
+			bytes = mSlice(job, texelFormatLevelBytes(job.format, job.width, texelBlock(job.format).size), false, 0);
+		if (bytes == 0)
+			break;
+		used = align16(used + bytes);
+		if (job.row >= job.height)
+		{
+			mFinishJob(job);
+			mJobs.pop_front();
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (mMapped)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		mFences[mSection] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mSection = (mSection + 1) % kFramesInFlight;
+	}
+
+	mFrame.queuedBytes = mQueuedBytes;
+	++mStats.frames;
+	mStats.uploadedBytes += mFrame.uploadedBytes;
+	mStats.slices += mFrame.slices;
+	mStats.maxFrameBytes = std::max(mStats.maxFrameBytes, mFrame.uploadedBytes);
+	mStats.stallMs += mFrame.stallMs;
+	mStats.maxStallMs = std::max(mStats.maxStallMs, mFrame.stallMs);
+}
+
+void TextureStreamer::finish()
+{
+	const size_t budget = mParams.uploadBytesPerFrame;
+	mParams.uploadBytesPerFrame = ~(size_t)0;
+	while (pending())
+		update();
+	mParams.uploadBytesPerFrame = budget;
+}
+
+void TextureStreamer::clear()
+{
+	while (!mTextures.empty())
+		cancel(mTextures.begin()->first);
+	for (GLsync& fence : mFences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+	if (mBuffer)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &mBuffer);
+	}
+	mBuffer = 0;
+	mMapped = nullptr;
+	mSection = 0;
+	mQueuedBytes = 0;
+}
+
+void TextureStreamer::printStats(std::ostream& out) const
+{
+	out << std::fixed << std::setprecision(2)
+		<< "Texture streaming: " << mStats.uploadedBytes / 1024 << " KB in " << mStats.slices << " slices over " << mStats.frames
+		<< " frames (budget " << mParams.uploadBytesPerFrame / 1024 << " KB, peak " << mStats.maxFrameBytes / 1024 << " KB per frame), stalled "
+		<< mStats.stallMs << " ms (max " << mStats.maxStallMs << " ms), " << mStats.texturesCompleted << " textures done, "
+		<< mQueuedBytes / 1024 << " KB queued" << std::endl;
+	out.unsetf(std::ios::floatfield);
+}
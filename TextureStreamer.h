@@ -0,0 +1,119 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "TextureContainer.h"
+
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <unordered_map>
+
+struct TextureStreamParams
+{
+	size_t ringBytes = 24 << 20;          // persistently mapped staging memory, split between frames in flight
+	size_t uploadBytesPerFrame = 4 << 20; // texel bytes copied per update(), capped at one ring section
+};
+
+// Fills textures over several frames through a persistently mapped
+// GL_PIXEL_UNPACK_BUFFER ring, so a large image never stalls a frame while the
+// driver copies it. The ring has one section per frame in flight; update()
+// copies rows into the next section up to the frame's byte budget, issues the
+// sub-image uploads from buffer offsets and fences the section. The section is
+// written again only once its fence has signalled, and any time spent waiting
+// for that is the frame's stall time. Levels are split into slices of whole
+// rows, or whole block rows for BCn, so even a single large level is spread
+// over as many frames as the budget needs. Textures are sampled with whatever
+// has arrived so far until pending() turns false.
+class TextureStreamer
+{
+public:
+	struct FrameStats
+	{
+		size_t uploadedBytes = 0;
+		size_t slices = 0;
+		double stallMs = 0;     // waiting on the fence of the section reused
+		size_t queuedBytes = 0; // still to upload after the frame
+	};
+
+	struct Stats
+	{
+		size_t frames = 0;          // update() calls that uploaded anything
+		size_t uploadedBytes = 0;
+		size_t slices = 0;
+		size_t texturesCompleted = 0;
+		size_t maxFrameBytes = 0;
+		double stallMs = 0, maxStallMs = 0;
+	};
+
+	static const int kFramesInFlight = 3;
+
+	explicit TextureStreamer(const TextureStreamParams& params = TextureStreamParams());
+
+	TextureStreamer(TextureStreamer const&) = delete;
+	void operator=(TextureStreamer const&) = delete;
+
+	// GL thread only. Queues a level of texture, whose storage must already
+	// exist. texels stay valid for as long as keepAlive is held. Textures held
+	// by TextureCache::shared() are retained until their last slice is issued;
+	// any other texture must be cancel()ed before it is deleted.
+	void queue(GLuint texture, TexelFormat format, int level, int width, int height, const unsigned char* texels,
+		std::shared_ptr<const void> keepAlive);
+
+	// GL thread only. Drops every slice not yet issued for texture.
+	void cancel(GLuint texture);
+
+	// GL thread only, once per frame. Streams up to the frame budget.
+	void update();
+
+	// GL thread only. Issues everything still queued, ignoring the budget.
+	void finish();
+
+	// GL thread only. Drops the queue and frees the ring.
+	void clear();
+
+	bool pending() const { return !mJobs.empty(); }
+	bool pending(GLuint texture) const { return mTextures.count(texture) != 0; }
+
+	size_t uploadBudget() const { return mParams.uploadBytesPerFrame; }
+	void setUploadBudget(size_t bytes) { mParams.uploadBytesPerFrame = bytes; }
+
+	const FrameStats& lastFrame() const { return mFrame; }
+	const Stats& stats() const { return mStats; }
+	void printStats(std::ostream& out) const;
+
+private:
+	struct Job
+	{
+		GLuint texture;
+		TexelFormat format;
+		int level, width, height;
+		int row = 0; // first texel row not uploaded yet
+		const unsigned char* texels;
+		std::shared_ptr<const void> keepAlive;
+	};
+
+	struct Pending
+	{
+		size_t jobs = 0;
+		bool retained = false;
+	};
+
+	bool mCreateRing();
+	void mWaitSection(int section);
+	size_t mSlice(Job& job, size_t room, bool staged, size_t offset);
+	void mFinishJob(const Job& job);
+
+private:
+	TextureStreamParams mParams;
+	GLuint mBuffer = 0;
+	unsigned char* mMapped = nullptr;
+	size_t mSectionBytes = 0;
+	GLsync mFences[kFramesInFlight] = {};
+	int mSection = 0;
+	bool mRingFailed = false;
+	std::deque<Job> mJobs;
+	std::unordered_map<GLuint, Pending> mTextures;
+	size_t mQueuedBytes = 0;
+	FrameStats mFrame;
+	Stats mStats;
+};
@@ -0,0 +1,102 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned numThreads)
+{
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned i = 0; i < numThreads; ++i)
+		mWorkers.emplace_back([this]() { mWorkerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mCondition.notify_all();
+	for (auto& worker : mWorkers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool instance;
+	return instance;
+}
+
+void ThreadPool::mEnqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTasks.push(std::move(task));
+	}
+	mCondition.notify_one();
+}
+
+void ThreadPool::mWorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCondition.wait(lock, [this]() { return mStopping || !mTasks.empty(); });
+			if (mStopping && mTasks.empty())
+				return;
+			task = std::move(mTasks.front());
+			mTasks.pop();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+	if (count == 0)
+		return;
+	grain = std::max<size_t>(grain, 1);
+	const size_t numChunks = (count + grain - 1) / grain;
+	if (numChunks == 1)
+	{
+		fn(0, count);
+		return;
+	}
+
+	// Chunks are claimed through a shared counter, so helpers that start late
+	// simply find nothing left to do and the caller never waits on a queued task.
+	struct Shared
+	{
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<Shared>();
+
+	auto work = [state, count, grain, numChunks, &fn]()
+	{
+		size_t chunk;
+		while ((chunk = state->next.fetch_add(1)) < numChunks)
+		{
+			const size_t begin = chunk * grain;
+			fn(begin, std::min(count, begin + grain));
+			if (state->done.fetch_add(1) + 1 == numChunks)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	const size_t helpers = std::min<size_t>(mWorkers.size(), numChunks - 1);
+	for (size_t i = 0; i < helpers; ++i)
+		mEnqueue(work);
+	work();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state, numChunks]() { return state->done.load() == numChunks; });
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads used for asset decoding and other CPU side
+// preprocessing that should stay off the GL thread.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned numThreads = 0);
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const&) = delete;
+	void operator=(ThreadPool const&) = delete;
+
+	static ThreadPool& shared();
+
+	template <class F>
+	auto submit(F&& fn) -> std::future<decltype(fn())>
+	{
+		using Result = decltype(fn());
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(fn));
+		std::future<Result> result = task->get_future();
+		mEnqueue([task]() { (*task)(); });
+		return result;
+	}
+
+	// Splits [0, count) into chunks of at most grain items and runs fn(begin, end)
+	// on every chunk. The calling thread takes part in the work, so it is safe to
+	// call from inside a task running on the pool.
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+	unsigned size() const { return (unsigned)mWorkers.size(); }
+
+private:
+	void mEnqueue(std::function<void()> task);
+	void mWorkerLoop();
+
+private:
+	std::vector<std::thread> mWorkers;
+	std::queue<std::function<void()>> mTasks;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStopping = false;
+};
@@ -0,0 +1,362 @@
+#include "VertexLayout.h"
+#include "HalfFloat.h"
+#include "glm/gtc/packing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	struct GlVertexFormat
+	{
+		GLint size;
+		GLenum type;
+		GLboolean normalized;
+	};
+
+	GlVertexFormat glVertexFormat(VertexEncoding encoding)
+	{
+		switch (encoding)
+		{
+		case VertexEncoding::Float2: return { 2, GL_FLOAT, GL_FALSE };
+		case VertexEncoding::Float3: return { 3, GL_FLOAT, GL_FALSE };
+		case VertexEncoding::Half2: return { 2, GL_HALF_FLOAT, GL_FALSE };
+		case VertexEncoding::Half3: return { 3, GL_HALF_FLOAT, GL_FALSE };
+		case VertexEncoding::Unorm16x2: return { 2, GL_UNSIGNED_SHORT, GL_TRUE };
+		case VertexEncoding::Snorm16x3: return { 3, GL_SHORT, GL_TRUE };
+		default: return { 4, GL_INT_2_10_10_10_REV, GL_TRUE };
+		}
+	}
+
+	void encode(VertexEncoding encoding, const glm::vec4& value, unsigned char* dst)
+	{
+		switch (encoding)
+		{
+		case VertexEncoding::Float2:
+		case VertexEncoding::Float3:
+			memcpy(dst, &value[0], vertexEncodingBytes(encoding));
+			break;
+		case VertexEncoding::Half2:
+		case VertexEncoding::Half3:
+		{
+			uint16_t halves[4];
+			const glm::vec4 padded(value.x, value.y, encoding == VertexEncoding::Half3 ? value.z : 0.f, 0.f);
+			HalfFloat::fromFloat(&padded[0], halves, 4, SIMD_SCALAR);
+			memcpy(dst, halves, vertexEncodingBytes(encoding));
+			break;
+		}
+		case VertexEncoding::Unorm16x2:
+		{
+			const uint32_t packed = glm::packUnorm2x16(glm::vec2(value));
+			memcpy(dst, &packed, 4);
+			break;
+		}
+		case VertexEncoding::Snorm16x3:
+		{
+			const uint64_t packed = glm::packSnorm4x16(glm::vec4(glm::vec3(value), 0.f));
+			memcpy(dst, &packed, 8);
+			break;
+		}
+		case VertexEncoding::Snorm10x3:
+		{
+			const uint32_t packed = glm::packSnorm3x10_1x2(value);
+			memcpy(dst, &packed, 4);
+			break;
+		}
+		}
+	}
+
+	glm::vec4 decode(VertexEncoding encoding, const unsigned char* src)
+	{
+		glm::vec4 value(0.f);
+		switch (encoding)
+		{
+		case VertexEncoding::Float2:
+		case VertexEncoding::Float3:
+			memcpy(&value[0], src, vertexEncodingBytes(encoding));
+			break;
+		case VertexEncoding::Half2:
+		case VertexEncoding::Half3:
+		{
+			uint16_t halves[4] = {};
+			memcpy(halves, src, vertexEncodingBytes(encoding));
+			HalfFloat::toFloat(halves, &value[0], 4);
+			break;
+		}
+		case VertexEncoding::Unorm16x2:
+		{
+			uint32_t packed;
+			memcpy(&packed, src, 4);
+			value = glm::vec4(glm::unpackUnorm2x16(packed), 0.f, 0.f);
+			break;
+		}
+		case VertexEncoding::Snorm16x3:
+		{
+			uint64_t packed;
+			memcpy(&packed, src, 8);
+			value = glm::unpackSnorm4x16(packed);
+			break;
+		}
+		case VertexEncoding::Snorm10x3:
+		{
+			uint32_t packed;
+			memcpy(&packed, src, 4);
+			value = glm::unpackSnorm3x10_1x2(packed);
+			break;
+		}
+		}
+		return value;
+	}
+
+	float degreesBetween(const glm::vec3& a, const glm::vec3& b)
+	{
+		// atan2 stays accurate for the tiny angles quantization produces,
+		// where acos of a dot product rounds to whole hundredths of a degree.
+		return glm::degrees(std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+	}
+}
+
+size_t vertexEncodingBytes(VertexEncoding encoding)
+{
+	switch (encoding)
+	{
+	case VertexEncoding::Float2: return 8;
+	case VertexEncoding::Float3: return 12;
+	case VertexEncoding::Half3:
+	case VertexEncoding::Snorm16x3: return 8;
+	default: return 4;
+	}
+}
+
+const char* vertexEncodingName(VertexEncoding encoding)
+{
+	switch (encoding)
+	{
+	case VertexEncoding::Float2: return "float2";
+	case VertexEncoding::Float3: return "float3";
+	case VertexEncoding::Half2: return "half2";
+	case VertexEncoding::Half3: return "half3";
+	case VertexEncoding::Unorm16x2: return "unorm16x2";
+	case VertexEncoding::Snorm16x3: return "snorm16x3";
+	default: return "snorm10x3";
+	}
+}
+
+const char* vertexSemanticName(VertexSemantic semantic)
+{
+	switch (semantic)
+	{
+	case VertexSemantic::Position: return "position";
+	case VertexSemantic::TexCoord: return "texcoord";
+	case VertexSemantic::Normal: return "normal";
+	default: return "tangent";
+	}
+}
+
+VertexLayout& VertexLayout::add(VertexSemantic semantic, VertexEncoding encoding)
+{
+	mAttributes.push_back({ semantic, encoding, mStride });
+	mStride += vertexEncodingBytes(encoding);
+	return *this;
+}
+
+const VertexLayout::Attribute* VertexLayout::find(VertexSemantic semantic) const
+{
+	for (const Attribute& attribute : mAttributes)
+	{
+		if (attribute.semantic == semantic)
+			return &attribute;
+	}
+	return nullptr;
+}
+
+void VertexLayout::apply(GLuint buffer, GLuint binding) const
+{
+	for (const Attribute& attribute : mAttributes)
+	{
+		const GLuint location = (GLuint)attribute.semantic;
+		const GlVertexFormat format = glVertexFormat(attribute.encoding);
+		glVertexAttribFormat(location, format.size, format.type, format.normalized, (GLuint)attribute.offset);
+		glVertexAttribBinding(location, binding);
+		glEnableVertexAttribArray(location);
+	}
+	glBindVertexBuffer(binding, buffer, 0, (GLsizei)mStride);
+}
+
+std::string VertexLayout::describe() const
+{
+	std::ostringstream out;
+	for (size_t i = 0; i < mAttributes.size(); ++i)
+		out << (i ? ", " : "") << vertexSemanticName(mAttributes[i].semantic) << " " << vertexEncodingName(mAttributes[i].encoding);
+	out << " (" << mStride << " bytes)";
+	return out.str();
+}
+
+VertexLayout VertexLayout::floats()
+{
+	VertexLayout layout;
+	layout.add(VertexSemantic::Position, VertexEncoding::Float3)
+		.add(VertexSemantic::TexCoord, VertexEncoding::Float2)
+		.add(VertexSemantic::Normal, VertexEncoding::Float3)
+		.add(VertexSemantic::Tangent, VertexEncoding::Float3);
+	return layout;
+}
+
+VertexLayout VertexLayout::compact(VertexEncoding position)
+{
+	VertexLayout layout;
+	layout.add(VertexSemantic::Position, position)
+		.add(VertexSemantic::TexCoord, VertexEncoding::Unorm16x2)
+		.add(VertexSemantic::Normal, VertexEncoding::Snorm10x3)
+		.add(VertexSemantic::Tangent, VertexEncoding::Snorm10x3);
+	return layout;
+}
+
+glm::mat4 PackedVertices::decodeTransform() const
+{
+	glm::mat4 transform(1.f);
+	transform[0][0] = positionScale.x;
+	transform[1][1] = positionScale.y;
+	transform[2][2] = positionScale.z;
+	transform[3] = glm::vec4(positionOffset, 1.f);
+	return transform;
+}
+
+PackedVertices VertexPacker::pack(const VertexStreams& streams, const VertexLayout& layout)
+{
+	PackedVertices packed;
+	const size_t count = streams.count();
+	for (const VertexLayout::Attribute& attribute : layout.attributes())
+	{
+		const size_t size = attribute.semantic == VertexSemantic::Position ? streams.positions.size()
+			: attribute.semantic == VertexSemantic::TexCoord ? streams.texCoords.size()
+			: attribute.semantic == VertexSemantic::Normal ? streams.normals.size() : streams.tangents.size();
+		if (size != count)
+		{
+			std::cerr << "VertexPacker: " << vertexSemanticName(attribute.semantic) << " has " << size << " entries for "
+				<< count << " vertices" << std::endl;
+			return packed;
+		}
+	}
+
+	const VertexLayout::Attribute* position = layout.find(VertexSemantic::Position);
+	if (position && position->encoding == VertexEncoding::Snorm16x3 && count)
+	{
+		glm::vec3 low = streams.positions[0], high = low;
+		for (const glm::vec3& p : streams.positions)
+		{
+			low = glm::min(low, p);
+			high = glm::max(high, p);
+		}
+		packed.positionOffset = (low + high) * 0.5f;
+		packed.positionScale = (high - low) * 0.5f;
+		// A flat axis stores 0 whatever the scale; keep it invertible.
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (packed.positionScale[axis] <= 0.f)
+				packed.positionScale[axis] = 1.f;
+		}
+	}
+
+	const size_t stride = layout.stride();
+	packed.layout = layout;
+	packed.count = count;
+	packed.data.resize(count * stride);
+	bool clamped = false;
+	for (size_t i = 0; i < count; ++i)
+	{
+		unsigned char* vertex = packed.data.data() + i * stride;
+		for (const VertexLayout::Attribute& attribute : layout.attributes())
+		{
+			glm::vec4 value;
+			switch (attribute.semantic)
+			{
+			case VertexSemantic::Position:
+				value = glm::vec4((streams.positions[i] - packed.positionOffset) / packed.positionScale, 0.f);
+				break;
+			case VertexSemantic::TexCoord:
+				value = glm::vec4(streams.texCoords[i], 0.f, 0.f);
+				if (attribute.encoding == VertexEncoding::Unorm16x2)
+					clamped = clamped || glm::any(glm::lessThan(streams.texCoords[i], glm::vec2(0.f))) ||
+						glm::any(glm::greaterThan(streams.texCoords[i], glm::vec2(1.f)));
+				break;
+			case VertexSemantic::Normal:
+				value = glm::vec4(glm::normalize(streams.normals[i]), 0.f);
+				break;
+			case VertexSemantic::Tangent:
+				value = glm::vec4(glm::normalize(glm::vec3(streams.tangents[i])), streams.tangents[i].w < 0.f ? -1.f : 1.f);
+				break;
+			}
+			encode(attribute.encoding, value, vertex + attribute.offset);
+		}
+	}
+	if (clamped)
+		std::cerr << "VertexPacker: texture coordinates outside [0, 1] were clamped to fit unorm16x2" << std::endl;
+	return packed;
+}
+
+VertexStreams VertexPacker::unpack(const PackedVertices& packed)
+{
+	VertexStreams streams;
+	const VertexLayout& layout = packed.layout;
+	for (const VertexLayout::Attribute& attribute : layout.attributes())
+	{
+		for (size_t i = 0; i < packed.count; ++i)
+		{
+			const glm::vec4 value = decode(attribute.encoding, packed.data.data() + i * layout.stride() + attribute.offset);
+			switch (attribute.semantic)
+			{
+			case VertexSemantic::Position:
+				streams.positions.push_back(packed.positionOffset + glm::vec3(value) * packed.positionScale);
+				break;
+			case VertexSemantic::TexCoord:
+				streams.texCoords.push_back(glm::vec2(value));
+				break;
+			case VertexSemantic::Normal:
+				streams.normals.push_back(glm::vec3(value));
+				break;
+			case VertexSemantic::Tangent:
+				// Float encodings carry no sign; those tangents are taken as right handed.
+				streams.tangents.push_back(glm::vec4(glm::vec3(value),
+					attribute.encoding == VertexEncoding::Snorm10x3 && value.w < 0.f ? -1.f : 1.f));
+				break;
+			}
+		}
+	}
+	return streams;
+}
+
+VertexQuantizationError VertexPacker::measure(const VertexStreams& streams, const PackedVertices& packed)
+{
+	VertexQuantizationError error;
+	const VertexStreams decoded = unpack(packed);
+	glm::vec3 low(0.f), high(0.f);
+	if (!streams.positions.empty())
+		low = high = streams.positions[0];
+	for (const glm::vec3& p : streams.positions)
+	{
+		low = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+
+	for (size_t i = 0; i < decoded.positions.size(); ++i)
+		error.position = std::max(error.position, glm::distance(decoded.positions[i], streams.positions[i]));
+	const float diagonal = glm::distance(low, high);
+	error.positionRelative = diagonal > 0.f ? error.position / diagonal : 0.f;
+	for (size_t i = 0; i < decoded.texCoords.size(); ++i)
+	{
+		const glm::vec2 delta = glm::abs(decoded.texCoords[i] - streams.texCoords[i]);
+		error.texCoord = std::max(error.texCoord, std::max(delta.x, delta.y));
+	}
+	for (size_t i = 0; i < decoded.normals.size(); ++i)
+		error.normalDegrees = std::max(error.normalDegrees, degreesBetween(decoded.normals[i], streams.normals[i]));
+	for (size_t i = 0; i < decoded.tangents.size(); ++i)
+	{
+		error.tangentDegrees = std::max(error.tangentDegrees, degreesBetween(glm::vec3(decoded.tangents[i]), glm::vec3(streams.tangents[i])));
+		error.tangentSignFlips += (decoded.tangents[i].w < 0.f) != (streams.tangents[i].w < 0.f);
+	}
+	return error;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Vertex inputs the shaders read; the value is the attribute location.
+enum class VertexSemantic : GLuint
+{
+	Position = 0,
+	TexCoord = 1,
+	Normal = 2,
+	Tangent = 3
+};
+
+// How one attribute is stored. Every encoding is a multiple of 4 bytes, so
+// attributes stay aligned without padding between them.
+enum class VertexEncoding
+{
+	Float2,    // 8 bytes
+	Float3,    // 12 bytes
+	Half2,     // 4 bytes
+	Half3,     // 8 bytes, the fourth half is padding
+	Unorm16x2, // 4 bytes, [0, 1]; texture coordinates outside it clamp
+	Snorm16x3, // 8 bytes, positions relative to the mesh bounds, see PackedVertices
+	Snorm10x3  // 4 bytes, GL_INT_2_10_10_10_REV unit vectors, the 2 bit field holds the tangent's bitangent sign
+};
+
+size_t vertexEncodingBytes(VertexEncoding encoding);
+const char* vertexEncodingName(VertexEncoding encoding);
+const char* vertexSemanticName(VertexSemantic semantic);
+
+// Describes one interleaved vertex stream: which attributes it holds, in
+// what encoding and at what offset. apply() turns it into vertex attribute
+// formats, so buffers are never described by hand.
+class VertexLayout
+{
+public:
+	struct Attribute
+	{
+		VertexSemantic semantic;
+		VertexEncoding encoding;
+		size_t offset;
+	};
+
+	// Appends an attribute after the ones already added.
+	VertexLayout& add(VertexSemantic semantic, VertexEncoding encoding);
+
+	const std::vector<Attribute>& attributes() const { return mAttributes; }
+	const Attribute* find(VertexSemantic semantic) const;
+	size_t stride() const { return mStride; }
+
+	// GL thread only. Sets up the attributes on the bound vertex array and
+	// binds buffer to binding with this layout's stride.
+	void apply(GLuint buffer, GLuint binding = 0) const;
+
+	// For example "position half3, texcoord unorm16x2 (12 bytes)".
+	std::string describe() const;
+
+	// Position, texture coordinate, normal and tangent as plain floats.
+	static VertexLayout floats();
+	// The same attributes packed: position half3 or snorm16x3, texcoord
+	// unorm16x2, normal and tangent snorm10x3.
+	static VertexLayout compact(VertexEncoding position = VertexEncoding::Snorm16x3);
+
+private:
+	std::vector<Attribute> mAttributes;
+	size_t mStride = 0;
+};
+
+// Unpacked vertex attributes, one vector per semantic. Missing ones are left
+// empty; present ones hold one entry per vertex.
+struct VertexStreams
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texCoords;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec4> tangents; // w is the bitangent sign, +1 or -1
+
+	size_t count() const { return positions.size(); }
+};
+
+struct PackedVertices
+{
+	VertexLayout layout;
+	std::vector<unsigned char> data;
+	size_t count = 0;
+	// Snorm16x3 positions store (position - positionOffset) / positionScale;
+	// other encodings leave offset 0 and scale 1.
+	glm::vec3 positionOffset = glm::vec3(0.f), positionScale = glm::vec3(1.f);
+
+	// Maps stored positions back to object space. Multiply the model matrix by
+	// it rather than decoding in the shader.
+	glm::mat4 decodeTransform() const;
+};
+
+// Worst case differences between streams and what their packed form decodes to.
+struct VertexQuantizationError
+{
+	float position = 0;         // object space distance
+	float positionRelative = 0; // position over the bounds' diagonal
+	float texCoord = 0;         // in UV units
+	float normalDegrees = 0;
+	float tangentDegrees = 0;
+	size_t tangentSignFlips = 0;
+};
+
+class VertexPacker
+{
+public:
+	// Packs the attributes the layout names, which streams must provide.
+	static PackedVertices pack(const VertexStreams& streams, const VertexLayout& layout);
+
+	// Decodes back to floats, positions in object space.
+	static VertexStreams unpack(const PackedVertices& packed);
+
+	static VertexQuantizationError measure(const VertexStreams& streams, const PackedVertices& packed);
+};
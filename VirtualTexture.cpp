@@ -0,0 +1,504 @@
+#include "VirtualTexture.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	int wrapIndex(int index, int count)
+	{
+		index %= count;
+		return index < 0 ? index + count : index;
+	}
+
+	bool isPowerOfTwo(int value)
+	{
+		return value > 0 && (value & (value - 1)) == 0;
+	}
+}
+
+const char* const VirtualTexture::kGlsl =
+	"layout (location = VT_LOCATION) uniform vec4 vtInfo; // width, height, tile size, level count\n"
+	"layout (location = VT_LOCATION + 1) uniform vec4 vtPhysicalInfo; // slot size, border, 1 / physical size\n"
+	"layout (binding = VT_PAGE_TABLE_BINDING) uniform usampler2D vtPageTable;\n"
+	"layout (binding = VT_PHYSICAL_BINDING) uniform sampler2D vtPhysical;\n"
+	"float vtLevel(vec2 uv)\n"
+	"{\n"
+	"	vec2 texel = uv * vtInfo.xy;\n"
+	"	vec2 dx = dFdx(texel), dy = dFdy(texel);\n"
+	"	return clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, vtInfo.w - 1.0);\n"
+	"}\n"
+	"ivec2 vtPages(int level)\n"
+	"{\n"
+	"	return max(ivec2(vtInfo.xy / vtInfo.z) >> level, ivec2(1));\n"
+	"}\n"
+	"ivec2 vtPage(vec2 uv, int level)\n"
+	"{\n"
+	"	ivec2 pages = vtPages(level);\n"
+	"	return min(ivec2(fract(uv) * vec2(pages)), pages - 1);\n"
+	"}\n"
+	"vec4 vtSample(vec2 uv)\n"
+	"{\n"
+	"	int level = int(vtLevel(uv));\n"
+	"	uvec4 entry = texelFetch(vtPageTable, vtPage(uv, level), level);\n"
+	"	vec2 inPage = fract(fract(uv) * vec2(vtPages(int(entry.b))));\n"
+	"	vec2 texel = vec2(entry.rg) * vtPhysicalInfo.x + vtPhysicalInfo.y + inPage * vtInfo.z;\n"
+	"	return textureLod(vtPhysical, texel * vtPhysicalInfo.zw, 0.0);\n"
+	"}\n"
+	"uint vtFeedback(vec2 uv)\n"
+	"{\n"
+	"	int level = int(vtLevel(uv));\n"
+	"	uvec2 page = uvec2(vtPage(uv, level));\n"
+	"	return page.x | page.y << 12 | uint(level) << 24;\n"
+	"}\n";
+
+VirtualLayout::VirtualLayout(int width, int height, int tileSize)
+	: width(width)
+	, height(height)
+	, tileSize(tileSize)
+{
+	levelCount = 1;
+	while (pagesX(levelCount - 1) > 1 || pagesY(levelCount - 1) > 1)
+		++levelCount;
+}
+
+bool VirtualLayout::contains(uint32_t page) const
+{
+	const int level = pageLevel(page);
+	return level < levelCount && pageX(page) < pagesX(level) && pageY(page) < pagesY(level);
+}
+
+void FeedbackAnalyzer::reduce(const uint32_t* feedback, size_t count, const VirtualLayout& layout, std::vector<PageRequest>& requests)
+{
+	std::vector<uint32_t> sorted(feedback, feedback + count);
+	std::sort(sorted.begin(), sorted.end());
+	requests.clear();
+	for (size_t i = 0; i < sorted.size();)
+	{
+		size_t end = i + 1;
+		while (end < sorted.size() && sorted[end] == sorted[i])
+			++end;
+		if (sorted[i] != kNoPage && layout.contains(sorted[i]))
+			requests.push_back({ sorted[i], (uint32_t)(end - i) });
+		i = end;
+	}
+}
+
+TileCache::TileCache(int slotCount)
+	: mSlots(slotCount)
+{
+	for (int i = 0; i < slotCount; ++i)
+		mPushBack(i);
+}
+
+int TileCache::find(uint32_t page) const
+{
+	auto found = mPages.find(page);
+	return found == mPages.end() ? -1 : found->second;
+}
+
+void TileCache::touch(int slot, uint64_t frame)
+{
+	mSlots[slot].lastUsed = frame;
+	if (mSlots[slot].pinned)
+		return;
+	mUnlink(slot);
+	mPushBack(slot);
+}
+
+int TileCache::allocate(uint32_t page, uint64_t frame, uint32_t& evicted)
+{
+	const int slot = mHead;
+	evicted = kNoPage;
+	if (slot < 0 || (mSlots[slot].page != kNoPage && mSlots[slot].lastUsed == frame))
+		return -1;
+
+	Slot& entry = mSlots[slot];
+	if (entry.page != kNoPage)
+	{
+		evicted = entry.page;
+		mPages.erase(entry.page);
+		if (entry.ready)
+			--mResident;
+	}
+	entry.page = page;
+	entry.ready = false;
+	mPages[page] = slot;
+	touch(slot, frame);
+	return slot;
+}
+
+void TileCache::markReady(int slot)
+{
+	if (!mSlots[slot].ready)
+	{
+		mSlots[slot].ready = true;
+		++mResident;
+	}
+}
+
+void TileCache::pin(int slot)
+{
+	if (!mSlots[slot].pinned)
+	{
+		mUnlink(slot);
+		mSlots[slot].pinned = true;
+	}
+}
+
+void TileCache::mUnlink(int slot)
+{
+	Slot& entry = mSlots[slot];
+	if (entry.prev >= 0)
+		mSlots[entry.prev].next = entry.next;
+	else
+		mHead = entry.next;
+	if (entry.next >= 0)
+		mSlots[entry.next].prev = entry.prev;
+	else
+		mTail = entry.prev;
+	entry.prev = entry.next = -1;
+}
+
+void TileCache::mPushBack(int slot)
+{
+	Slot& entry = mSlots[slot];
+	entry.prev = mTail;
+	entry.next = -1;
+	if (mTail >= 0)
+		mSlots[mTail].next = slot;
+	else
+		mHead = slot;
+	mTail = slot;
+}
+
+PageTable::PageTable(const VirtualLayout& layout, int slotsPerRow)
+	: mLayout(layout)
+	, mSlotsPerRow(slotsPerRow)
+	, mLevels(layout.levelCount)
+{
+	for (int level = 0; level < layout.levelCount; ++level)
+		mLevels[level].resize((size_t)layout.pagesX(level) * layout.pagesY(level));
+}
+
+void PageTable::rebuild(const TileCache& cache)
+{
+	// Ready pages stamp their own entry (alpha 255, never zero), then every
+	// unset entry copies its parent's, coarse to fine.
+	for (auto& level : mLevels)
+		std::fill(level.begin(), level.end(), 0u);
+	for (int slot = 0; slot < cache.slotCount(); ++slot)
+	{
+		const uint32_t page = cache.page(slot);
+		if (!cache.ready(slot) || !mLayout.contains(page))
+			continue;
+		const int level = pageLevel(page);
+		mLevels[level][(size_t)pageY(page) * mLayout.pagesX(level) + pageX(page)] =
+			(uint32_t)(slot % mSlotsPerRow) | (uint32_t)(slot / mSlotsPerRow) << 8 | (uint32_t)level << 16 | 0xffu << 24;
+	}
+	for (int level = mLayout.levelCount - 2; level >= 0; --level)
+	{
+		const int pagesX = mLayout.pagesX(level), pagesY = mLayout.pagesY(level);
+		const int parentPagesX = mLayout.pagesX(level + 1);
+		uint32_t* entries = mLevels[level].data();
+		const uint32_t* parents = mLevels[level + 1].data();
+		for (int y = 0; y < pagesY; ++y)
+		{
+			for (int x = 0; x < pagesX; ++x)
+			{
+				uint32_t& entry = entries[(size_t)y * pagesX + x];
+				if (!entry)
+					entry = parents[(size_t)(y / 2) * parentPagesX + x / 2];
+			}
+		}
+	}
+}
+
+VirtualTexture::VirtualTexture(ThreadPool& pool)
+	: mPool(pool)
+{
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	for (auto& load : mLoads)
+		load.wait();
+}
+
+bool VirtualTexture::open(const std::string& containerPath, const VirtualTextureParams& params)
+{
+	release();
+	mParams = params;
+	if (!mContainer.open(containerPath))
+	{
+		std::cerr << "VirtualTexture: could not open " << containerPath << std::endl;
+		return false;
+	}
+	const int size = mContainer.width();
+	if (mContainer.supercompression() != Supercompression::None || mContainer.height() != size ||
+		!isPowerOfTwo(size) || !isPowerOfTwo(params.tileSize) || size < params.tileSize || size / params.tileSize > 4096)
+	{
+		std::cerr << "VirtualTexture: " << containerPath << " is not a square, uncompressed power of two texture" << std::endl;
+		mContainer.close();
+		return false;
+	}
+	mLayout = VirtualLayout(size, size, params.tileSize);
+	if ((int)mContainer.levelCount() < mLayout.levelCount)
+	{
+		std::cerr << "VirtualTexture: " << containerPath << " has too few mip levels" << std::endl;
+		mContainer.close();
+		return false;
+	}
+
+	const int unit = texelBlock(mContainer.format()).size;
+	mParams.border = (params.border + unit - 1) / unit * unit;
+	mCache = TileCache(params.slotsPerRow * params.slotsPerRow);
+	mPageTable = PageTable(mLayout, params.slotsPerRow);
+	mFrame = 1;
+	mStats = Stats();
+
+	const GlTexelFormat gl = glTexelFormat(mContainer.format());
+	const int physicalSize = params.slotsPerRow * (params.tileSize + 2 * mParams.border);
+	glGenTextures(1, &mPhysicalTex);
+	glBindTexture(GL_TEXTURE_2D, mPhysicalTex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, gl.internalFormat, physicalSize, physicalSize);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &mPageTableTex);
+	glBindTexture(GL_TEXTURE_2D, mPageTableTex);
+	glTexStorage2D(GL_TEXTURE_2D, mLayout.levelCount, GL_RGBA8UI, mLayout.pagesX(0), mLayout.pagesY(0));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenBuffers(2, mFeedbackPbo);
+
+	// The single coarsest page is the fallback for everything else.
+	LoadedTile root;
+	root.page = packPage(mLayout.levelCount - 1, 0, 0);
+	uint32_t evicted = kNoPage;
+	root.slot = mCache.allocate(root.page, mFrame, evicted);
+	mCache.pin(root.slot);
+	mLoadTile(root.page, root.texels);
+	mUpload(root);
+	mCache.markReady(root.slot);
+	mPageTableDirty = true;
+	update();
+	return true;
+}
+
+void VirtualTexture::release()
+{
+	for (auto& load : mLoads)
+		load.wait();
+	mLoads.clear();
+	mLoaded.clear();
+	if (mPhysicalTex)
+		glDeleteTextures(1, &mPhysicalTex);
+	if (mPageTableTex)
+		glDeleteTextures(1, &mPageTableTex);
+	if (mFeedbackPbo[0])
+		glDeleteBuffers(2, mFeedbackPbo);
+	mPhysicalTex = mPageTableTex = 0;
+	mFeedbackPbo[0] = mFeedbackPbo[1] = 0;
+	mFeedbackCount[0] = mFeedbackCount[1] = 0;
+	mContainer.close();
+}
+
+void VirtualTexture::requestPages(const uint32_t* feedback, size_t count)
+{
+	if (!mContainer.isOpen())
+		return;
+	++mFrame;
+	mStats.requestedPages = mStats.missingPages = mStats.loadedPages = mStats.evictedPages = 0;
+
+	FeedbackAnalyzer::reduce(feedback, count, mLayout, mRequests);
+	mStats.requestedPages = mRequests.size();
+
+	// Pages already loaded or on their way only need their recency updated.
+	size_t missing = 0;
+	for (const PageRequest& request : mRequests)
+	{
+		const int slot = mCache.find(request.page);
+		if (slot >= 0)
+			mCache.touch(slot, mFrame);
+		else
+			mRequests[missing++] = request;
+	}
+	mRequests.resize(missing);
+	FeedbackAnalyzer::prioritize(mRequests, mLayout, [this](uint32_t page) {
+		const int slot = mCache.find(page);
+		if (slot < 0)
+			return false;
+		mCache.touch(slot, mFrame);
+		return true;
+	});
+	mStats.missingPages = mRequests.size();
+
+	for (const PageRequest& request : mRequests)
+	{
+		if ((int)mLoads.size() >= mParams.maxLoadsInFlight)
+			break;
+		uint32_t evicted = kNoPage;
+		const int slot = mCache.allocate(request.page, mFrame, evicted);
+		if (slot < 0)
+			break;
+		if (evicted != kNoPage)
+		{
+			++mStats.evictedPages;
+			mPageTableDirty = true;
+		}
+		mLoad(request.page, slot);
+	}
+	mStats.loadsInFlight = mLoads.size();
+}
+
+void VirtualTexture::collectFeedback(GLuint framebuffer, int width, int height)
+{
+	if (!mContainer.isOpen())
+		return;
+
+	// The other PBO was filled a frame ago, so mapping it should not stall.
+	const int previous = mFeedbackIndex ^ 1;
+	if (mFeedbackCount[previous])
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, mFeedbackPbo[previous]);
+		const void* ids = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, mFeedbackCount[previous] * sizeof(uint32_t), GL_MAP_READ_BIT);
+		if (ids)
+			requestPages((const uint32_t*)ids, mFeedbackCount[previous]);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		mFeedbackCount[previous] = 0;
+	}
+
+	const size_t count = (size_t)width * height;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, mFeedbackPbo[mFeedbackIndex]);
+	glBufferData(GL_PIXEL_PACK_BUFFER, count * sizeof(uint32_t), nullptr, GL_STREAM_READ);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadPixels(0, 0, width, height, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	mFeedbackCount[mFeedbackIndex] = count;
+	mFeedbackIndex = previous;
+}
+
+void VirtualTexture::update()
+{
+	if (!mContainer.isOpen())
+		return;
+
+	std::vector<LoadedTile> loaded;
+	{
+		std::lock_guard<std::mutex> lock(mLoadedMutex);
+		const size_t count = std::min(mLoaded.size(), (size_t)mParams.maxUploadsPerFrame);
+		loaded.assign(std::make_move_iterator(mLoaded.begin()), std::make_move_iterator(mLoaded.begin() + count));
+		mLoaded.erase(mLoaded.begin(), mLoaded.begin() + count);
+	}
+	for (const LoadedTile& tile : loaded)
+	{
+		// The slot may have been handed to another page while loading.
+		if (mCache.find(tile.page) != tile.slot || mCache.ready(tile.slot))
+			continue;
+		mUpload(tile);
+		mCache.markReady(tile.slot);
+		mPageTableDirty = true;
+		++mStats.loadedPages;
+	}
+
+	mLoads.erase(std::remove_if(mLoads.begin(), mLoads.end(), [](std::future<void>& load) {
+		return load.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), mLoads.end());
+	mStats.loadsInFlight = mLoads.size();
+	mStats.residentPages = (size_t)mCache.residentCount();
+
+	if (!mPageTableDirty)
+		return;
+	mPageTable.rebuild(mCache);
+	glBindTexture(GL_TEXTURE_2D, mPageTableTex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (int level = 0; level < mLayout.levelCount; ++level)
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, mLayout.pagesX(level), mLayout.pagesY(level),
+			GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, mPageTable.level(level));
+	mPageTableDirty = false;
+}
+
+void VirtualTexture::bind(GLuint pageTableUnit, GLuint physicalUnit, GLint firstLocation) const
+{
+	glActiveTexture(GL_TEXTURE0 + pageTableUnit);
+	glBindTexture(GL_TEXTURE_2D, mPageTableTex);
+	glActiveTexture(GL_TEXTURE0 + physicalUnit);
+	glBindTexture(GL_TEXTURE_2D, mPhysicalTex);
+
+	const int slotSize = mParams.tileSize + 2 * mParams.border;
+	const float physicalSize = (float)(mParams.slotsPerRow * slotSize);
+	glUniform4f(firstLocation, (float)mLayout.width, (float)mLayout.height, (float)mLayout.tileSize, (float)mLayout.levelCount);
+	glUniform4f(firstLocation + 1, (float)slotSize, (float)mParams.border, 1.f / physicalSize, 1.f / physicalSize);
+}
+
+void VirtualTexture::printStats(std::ostream& out) const
+{
+	out << "Virtual texture: " << mStats.residentPages << " of " << mCache.slotCount() << " slots resident, "
+		<< mStats.requestedPages << " pages requested, " << mStats.missingPages << " missing, "
+		<< mStats.loadedPages << " loaded, " << mStats.evictedPages << " evicted, "
+		<< mStats.loadsInFlight << " loads in flight" << std::endl;
+}
+
+void VirtualTexture::mLoad(uint32_t page, int slot)
+{
+	mLoads.push_back(mPool.submit([this, page, slot]() {
+		LoadedTile tile;
+		tile.page = page;
+		tile.slot = slot;
+		mLoadTile(page, tile.texels);
+		std::lock_guard<std::mutex> lock(mLoadedMutex);
+		mLoaded.push_back(std::move(tile));
+	}));
+}
+
+void VirtualTexture::mLoadTile(uint32_t page, std::vector<unsigned char>& texels) const
+{
+	// Copies the tile plus its border out of the mapped level, wrapping at
+	// the level edges like GL_REPEAT.
+	const TexelBlock block = texelBlock(mContainer.format());
+	const TextureContainer::Level& level = mContainer.level(pageLevel(page));
+	const int levelColumns = (level.width + block.size - 1) / block.size;
+	const int levelRows = (level.height + block.size - 1) / block.size;
+	const int tileElements = mParams.tileSize / block.size;
+	const int borderElements = mParams.border / block.size;
+	const int slotElements = tileElements + 2 * borderElements;
+	const size_t rowBytes = (size_t)levelColumns * block.bytes;
+
+	texels.resize((size_t)slotElements * slotElements * block.bytes);
+	unsigned char* dst = texels.data();
+	const int firstColumn = wrapIndex(pageX(page) * tileElements - borderElements, levelColumns);
+	for (int row = 0; row < slotElements; ++row)
+	{
+		const int srcRow = wrapIndex(pageY(page) * tileElements - borderElements + row, levelRows);
+		const unsigned char* src = level.data + srcRow * rowBytes;
+		int column = firstColumn, remaining = slotElements;
+		while (remaining > 0)
+		{
+			const int run = std::min(remaining, levelColumns - column);
+			memcpy(dst, src + column * block.bytes, run * block.bytes);
+			dst += run * block.bytes;
+			remaining -= run;
+			column = 0;
+		}
+	}
+}
+
+void VirtualTexture::mUpload(const LoadedTile& tile)
+{
+	const GlTexelFormat gl = glTexelFormat(mContainer.format());
+	const int slotSize = mParams.tileSize + 2 * mParams.border;
+	const int x = tile.slot % mParams.slotsPerRow * slotSize;
+	const int y = tile.slot / mParams.slotsPerRow * slotSize;
+	glBindTexture(GL_TEXTURE_2D, mPhysicalTex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (gl.compressed)
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, slotSize, slotSize, gl.internalFormat, (GLsizei)tile.texels.size(), tile.texels.data());
+	else
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, slotSize, slotSize, gl.format, gl.type, tile.texels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
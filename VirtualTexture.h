@@ -0,0 +1,264 @@
+#pragma once
+#include "gl_core_4_5.h"
+#include "TextureContainer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A virtual page is one tile of one mip level, packed as x in bits 0-11, y in
+// bits 12-23 and the level in bits 24-27. The feedback pass writes the same
+// packing, and kNoPage where nothing virtual textured was drawn.
+const uint32_t kNoPage = 0xffffffff;
+
+inline uint32_t packPage(int level, int x, int y) { return (uint32_t)x | (uint32_t)y << 12 | (uint32_t)level << 24; }
+inline int pageLevel(uint32_t page) { return (int)(page >> 24 & 15); }
+inline int pageX(uint32_t page) { return (int)(page & 0xfff); }
+inline int pageY(uint32_t page) { return (int)(page >> 12 & 0xfff); }
+inline uint32_t parentPage(uint32_t page) { return packPage(pageLevel(page) + 1, pageX(page) / 2, pageY(page) / 2); }
+
+// Page grid of a virtual texture. Levels stop at the first one that fits in a
+// single tile, so the coarsest level always has exactly one page.
+struct VirtualLayout
+{
+	int width = 0, height = 0; // level 0 texels, power of two multiples of tileSize
+	int tileSize = 128;
+	int levelCount = 0;
+
+	VirtualLayout() = default;
+	VirtualLayout(int width, int height, int tileSize);
+
+	int pagesX(int level) const { return std::max(1, (width / tileSize) >> level); }
+	int pagesY(int level) const { return std::max(1, (height / tileSize) >> level); }
+	bool contains(uint32_t page) const;
+};
+
+struct PageRequest
+{
+	uint32_t page;
+	uint32_t pixels; // feedback texels that asked for it
+};
+
+// Turns a feedback buffer into the distinct pages it names. CPU only.
+class FeedbackAnalyzer
+{
+public:
+	// Sorts a copy of the buffer and collapses runs, so requests come out in
+	// page order with kNoPage and pages outside layout dropped.
+	static void reduce(const uint32_t* feedback, size_t count, const VirtualLayout& layout, std::vector<PageRequest>& requests);
+
+	// Adds every missing ancestor of the requests (they are the fallbacks
+	// shown until the page itself arrives) and orders the result coarse level
+	// first, then by pixel count. resident says whether a page is loaded.
+	template <class Resident>
+	static void prioritize(std::vector<PageRequest>& requests, const VirtualLayout& layout, Resident resident);
+};
+
+// Fixed set of physical tile slots with least recently used replacement. CPU
+// only; VirtualTexture mirrors it into the physical texture.
+class TileCache
+{
+public:
+	explicit TileCache(int slotCount = 0);
+
+	int slotCount() const { return (int)mSlots.size(); }
+	int residentCount() const { return mResident; }
+
+	// Slot holding or loading page, or -1.
+	int find(uint32_t page) const;
+	bool ready(int slot) const { return mSlots[slot].ready; }
+	uint32_t page(int slot) const { return mSlots[slot].page; }
+
+	// Marks the slot as used in frame, moving it to the back of the queue.
+	void touch(int slot, uint64_t frame);
+
+	// Reuses the least recently used slot for page unless it was used in
+	// frame or is pinned; returns -1 then. evicted receives the page the slot
+	// held, or kNoPage. The slot is not ready until markReady().
+	int allocate(uint32_t page, uint64_t frame, uint32_t& evicted);
+	void markReady(int slot);
+
+	// Pinned slots are never reused, used for the coarsest level.
+	void pin(int slot);
+
+private:
+	struct Slot
+	{
+		uint32_t page = kNoPage;
+		uint64_t lastUsed = 0;
+		int prev = -1, next = -1; // recency list, head is least recent
+		bool ready = false;
+		bool pinned = false;
+	};
+
+	void mUnlink(int slot);
+	void mPushBack(int slot);
+
+private:
+	std::vector<Slot> mSlots;
+	std::unordered_map<uint32_t, int> mPages;
+	int mHead = -1, mTail = -1;
+	int mResident = 0;
+};
+
+// CPU copy of the page table texture: per level and page, the slot of the
+// finest ready page covering it as RGBA8UI (slot x, slot y, page level, 255).
+class PageTable
+{
+public:
+	PageTable() = default;
+	PageTable(const VirtualLayout& layout, int slotsPerRow);
+
+	// Recomputes every entry from the cache, coarsest level first so each page
+	// can inherit its parent's entry. Pages nothing covers get 0.
+	void rebuild(const TileCache& cache);
+
+	const uint32_t* level(int index) const { return mLevels[index].data(); }
+
+private:
+	VirtualLayout mLayout;
+	int mSlotsPerRow = 1;
+	std::vector<std::vector<uint32_t>> mLevels;
+};
+
+struct VirtualTextureParams
+{
+	int tileSize = 128;
+	int border = 4;          // texels copied around each tile for bilinear filtering
+	int slotsPerRow = 32;    // physical texture is slotsPerRow^2 tiles
+	int maxLoadsInFlight = 32;
+	int maxUploadsPerFrame = 16;
+};
+
+// Streams tiles of a large cooked texture into a physical tile texture. The
+// draw writes the pages it samples into a low resolution R32UI feedback
+// target; collectFeedback() reads it back a frame later through a PBO, and
+// the reduced, prioritized requests are loaded on the thread pool straight
+// from the mapped container. update() uploads finished tiles and the page
+// table on the GL thread. The container must be square, a power of two
+// multiple of the tile size and stored without supercompression.
+class VirtualTexture
+{
+public:
+	struct Stats
+	{
+		size_t residentPages = 0;
+		size_t loadsInFlight = 0;
+		// Per frame.
+		size_t requestedPages = 0;
+		size_t missingPages = 0;
+		size_t loadedPages = 0;
+		size_t evictedPages = 0;
+	};
+
+	explicit VirtualTexture(ThreadPool& pool = ThreadPool::shared());
+	~VirtualTexture();
+
+	VirtualTexture(VirtualTexture const&) = delete;
+	void operator=(VirtualTexture const&) = delete;
+
+	// GL thread only. Maps the container, creates the physical and page table
+	// textures and loads the coarsest level, which stays resident.
+	bool open(const std::string& containerPath, const VirtualTextureParams& params = VirtualTextureParams());
+
+	// GL thread only. Waits for outstanding loads and frees the GL objects.
+	void release();
+
+	// Queues loads for the pages named in a feedback buffer.
+	void requestPages(const uint32_t* feedback, size_t count);
+
+	// GL thread only. Starts reading the feedback target bound to framebuffer
+	// into a PBO and hands the previous frame's buffer to requestPages().
+	void collectFeedback(GLuint framebuffer, int width, int height);
+
+	// GL thread only. Uploads finished tiles and the page table.
+	void update();
+
+	// Binds the page table and physical textures to the given units and sets
+	// the kGlsl uniforms starting at firstLocation on the current program.
+	void bind(GLuint pageTableUnit, GLuint physicalUnit, GLint firstLocation) const;
+
+	const VirtualLayout& layout() const { return mLayout; }
+	const Stats& stats() const { return mStats; }
+	void printStats(std::ostream& out) const;
+
+	// GLSL declaring vtSample(uv) and vtFeedback(uv). The including shader
+	// defines VT_LOCATION (first of two uniform locations) and
+	// VT_PAGE_TABLE_BINDING and VT_PHYSICAL_BINDING (texture units).
+	static const char* const kGlsl;
+
+private:
+	struct LoadedTile
+	{
+		uint32_t page;
+		int slot;
+		std::vector<unsigned char> texels;
+	};
+
+	void mLoad(uint32_t page, int slot);
+	void mLoadTile(uint32_t page, std::vector<unsigned char>& texels) const;
+	void mUpload(const LoadedTile& tile);
+
+private:
+	ThreadPool& mPool;
+	VirtualTextureParams mParams;
+	TextureContainer mContainer;
+	VirtualLayout mLayout;
+	TileCache mCache;
+	PageTable mPageTable;
+	bool mPageTableDirty = false;
+	uint64_t mFrame = 0;
+
+	GLuint mPhysicalTex = 0, mPageTableTex = 0;
+	GLuint mFeedbackPbo[2] = { 0, 0 };
+	size_t mFeedbackCount[2] = { 0, 0 }; // texels read into each PBO
+	int mFeedbackIndex = 0;             // PBO the next read goes to
+
+	std::vector<PageRequest> mRequests;
+	std::vector<std::future<void>> mLoads;
+	std::mutex mLoadedMutex;
+	std::vector<LoadedTile> mLoaded;
+	Stats mStats;
+};
+
+template <class Resident>
+void FeedbackAnalyzer::prioritize(std::vector<PageRequest>& requests, const VirtualLayout& layout, Resident resident)
+{
+	std::unordered_map<uint32_t, size_t> index;
+	for (size_t i = 0; i < requests.size(); ++i)
+		index[requests[i].page] = i;
+	const size_t count = requests.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const PageRequest request = requests[i];
+		for (uint32_t page = request.page; pageLevel(page) + 1 < layout.levelCount;)
+		{
+			page = parentPage(page);
+			if (resident(page))
+				break;
+			auto found = index.find(page);
+			if (found == index.end())
+			{
+				index[page] = requests.size();
+				requests.push_back({ page, request.pixels });
+			}
+			else
+			{
+				requests[found->second].pixels += request.pixels;
+			}
+		}
+	}
+	std::sort(requests.begin(), requests.end(), [](const PageRequest& a, const PageRequest& b) {
+		if (pageLevel(a.page) != pageLevel(b.page))
+			return pageLevel(a.page) > pageLevel(b.page);
+		if (a.pixels != b.pixels)
+			return a.pixels > b.pixels;
+		return a.page < b.page;
+	});
+}
@@ -491,6 +491,21 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// JPEG scans with restart markers (DRI) can have their restart intervals
+// entropy decoded in parallel. The callback must run task(task_context, i)
+// for every i in [0, count) and return once all of them have finished; the
+// tasks write disjoint blocks, so any order or thread is fine. Only images
+// loaded from memory take this path. Pass NULL to decode serially again.
+typedef void stbi_parallel_for(void *user, int count, void (*task)(void *task_context, int index), void *task_context);
+STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for *parallel_for, void *user);
+
+// caps the optimized decode paths: 0 = the generic C code (including the
+// one-symbol-at-a-time inflate), 1 = SSE2 or NEON, 2 = AVX2 (the default, if
+// the CPU has it). covers the JPEG IDCT (SSE2 only), colour and upsampling
+// kernels, PNG unfiltering and the multi-symbol inflate loop. For benchmarking only, since
+// it is a global and applies to every thread.
+STBIDEF void stbi_set_simd_limit(int limit);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -610,12 +625,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -741,6 +758,40 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 JPEG kernels, selected at runtime next to the SSE2 ones. MSVC accepts
+// the intrinsics without /arch:AVX2; GCC and Clang need a per-function target.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG)
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7) return 0;
+   __cpuid(info, 1);
+   if ((info[2] & (1 << 27)) == 0) return 0; // OSXSAVE
+   if ((_xgetbv(0) & 6) != 6) return 0;      // OS saves XMM and YMM state
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+}
+#else
+#include <cpuid.h>
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   unsigned int a, b, c, d, xcr0_lo, xcr0_hi;
+   if (!__get_cpuid(1, &a, &b, &c, &d) || (c & (1u << 27)) == 0) return 0;
+   __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+   if ((xcr0_lo & 6) != 6) return 0;
+   if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return 0;
+   return (b & (1u << 5)) != 0;
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -1058,6 +1109,12 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
 static int stbi__vertically_flip_on_load_global = 0;
+static int stbi__simd_limit = 2;
+
+STBIDEF void stbi_set_simd_limit(int limit)
+{
+   stbi__simd_limit = limit;
+}
 
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 {
@@ -2872,128 +2929,193 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// number of units the restart interval counts down for this scan: single
+// blocks for non-interleaved scans, MCUs for interleaved ones
+static int stbi__jpeg_scan_units(stbi__jpeg *z)
 {
-   stbi__jpeg_reset(z);
-   if (!z->progressive) {
-      if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      // number of blocks to do just depends on how many actual "pixels" this
+      // component has, independent of interleaved MCU blocking and such
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// decode one unit of the scan, in trivial scanline order
+static int stbi__jpeg_decode_unit(stbi__jpeg *z, int unit, short data[64])
+{
+   int k,x,y;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int w = (z->img_comp[n].x+7) >> 3;
+      int i = unit % w, j = unit / w;
+      int ha = z->img_comp[n].ha;
+      if (!z->progressive) {
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+      } else {
+         short *coeff = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+         if (z->spec_start == 0) {
+            if (!stbi__jpeg_decode_block_prog_dc(z, coeff, &z->huff_dc[z->img_comp[n].hd], n))
+               return 0;
+         } else {
+            if (!stbi__jpeg_decode_block_prog_ac(z, coeff, &z->huff_ac[ha], z->fast_ac[ha]))
+               return 0;
+         }
+      }
+      return 1;
+   }
+
+   // scan an interleaved mcu... process scan_n components in order
+   for (k=0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      int i = unit % z->img_mcu_x, j = unit / z->img_mcu_x;
+      // scan out an mcu's worth of this component; that's just determined
+      // by the basic H and V specified for the component
+      for (y=0; y < z->img_comp[n].v; ++y) {
+         for (x=0; x < z->img_comp[n].h; ++x) {
+            int x2 = (i*z->img_comp[n].h + x);
+            int y2 = (j*z->img_comp[n].v + y);
+            if (!z->progressive) {
                int ha = z->img_comp[n].ha;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
-         }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
+               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2*8+x2*8, z->img_comp[n].w2, data);
+            } else {
+               short *coeff = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
+               if (!stbi__jpeg_decode_block_prog_dc(z, coeff, &z->huff_dc[z->img_comp[n].hd], n))
+                  return 0;
             }
          }
-         return 1;
       }
-   } else {
-      if (z->scan_n == 1) {
-         int i,j;
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               if (z->spec_start == 0) {
-                  if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
-                     return 0;
-               } else {
-                  int ha = z->img_comp[n].ha;
-                  if (!stbi__jpeg_decode_block_prog_ac(z, data, &z->huff_ac[ha], z->fast_ac[ha]))
-                     return 0;
-               }
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
-         }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x);
-                        int y2 = (j*z->img_comp[n].v + y);
-                        short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
-                        if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
-                           return 0;
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
+   }
+   return 1;
+}
+
+static stbi_parallel_for *stbi__jpeg_parallel_for_fn;
+static void *stbi__jpeg_parallel_for_user;
+
+STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for *parallel_for, void *user)
+{
+   stbi__jpeg_parallel_for_fn = parallel_for;
+   stbi__jpeg_parallel_for_user = user;
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **starts;   // first entropy-coded byte of every restart interval
+   stbi_uc *end;       // end of the input buffer
+   int intervals, per_task, units;
+   volatile int failed;
+} stbi__jpeg_intervals;
+
+// decodes a run of restart intervals with a private copy of the decoder
+// state. the huffman and dequant tables are shared read-only through the
+// copy; component buffers are shared, but every unit writes its own blocks.
+static void stbi__jpeg_decode_intervals(void *task_context, int index)
+{
+   stbi__jpeg_intervals *iv = (stbi__jpeg_intervals *) task_context;
+   stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   stbi__context s;
+   int first = index * iv->per_task;
+   int last = first + iv->per_task < iv->intervals ? first + iv->per_task : iv->intervals;
+   int r, unit;
+   STBI_SIMD_ALIGN(short, data[64]);
+   if (!z) { iv->failed = 1; return; }
+   *z = *iv->z;
+   s = *iv->z->s;
+   z->s = &s;
+   for (r = first; r < last && !iv->failed; ++r) {
+      int unit_end = (r+1) * z->restart_interval < iv->units ? (r+1) * z->restart_interval : iv->units;
+      s.img_buffer = iv->starts[r];
+      s.img_buffer_end = r+1 < iv->intervals ? iv->starts[r+1] : iv->end;
+      stbi__jpeg_reset(z);
+      for (unit = r * z->restart_interval; unit < unit_end; ++unit) {
+         if (!stbi__jpeg_decode_unit(z, unit, data)) {
+            iv->failed = 1;
+            break;
          }
-         return 1;
       }
    }
+   STBI_FREE(z);
+}
+
+// decodes the scan's restart intervals through the parallel-for callback.
+// returns -1 without consuming input if the scan can't be split, i.e. the
+// data is not in memory or the restart markers are not where the interval
+// says they should be; the serial decoder then handles it as before.
+static int stbi__parse_entropy_coded_data_parallel(stbi__jpeg *z)
+{
+   stbi__jpeg_intervals iv;
+   stbi_uc *p = z->s->img_buffer;
+   stbi_uc *end = z->s->img_buffer_end;
+   int k = 1, tasks;
+
+   iv.units = stbi__jpeg_scan_units(z);
+   iv.intervals = (iv.units + z->restart_interval - 1) / z->restart_interval;
+   if (iv.intervals < 2 || z->s->read_from_callbacks)
+      return -1;
+   iv.starts = (stbi_uc **) stbi__malloc(sizeof(stbi_uc *) * iv.intervals);
+   if (!iv.starts)
+      return -1;
+
+   // find the restart markers; 0xff00 is a stuffed 0xff and 0xffff is fill
+   iv.starts[0] = p;
+   while (p + 1 < end) {
+      if (p[0] != 0xff) { ++p; continue; }
+      if (p[1] == 0x00) { p += 2; continue; }
+      if (p[1] == 0xff) { ++p; continue; }
+      if (!STBI__RESTART(p[1]) || k == iv.intervals) break;
+      iv.starts[k++] = p + 2;
+      p += 2;
+   }
+   if (k != iv.intervals) {
+      STBI_FREE(iv.starts);
+      return -1;
+   }
+
+   iv.z = z;
+   iv.end = end;
+   iv.failed = 0;
+   iv.per_task = (iv.intervals + 63) / 64;
+   tasks = (iv.intervals + iv.per_task - 1) / iv.per_task;
+   stbi__jpeg_parallel_for_fn(stbi__jpeg_parallel_for_user, tasks, stbi__jpeg_decode_intervals, &iv);
+   STBI_FREE(iv.starts);
+   if (iv.failed)
+      return stbi__err("bad restart interval", "Corrupt JPEG");
+
+   // leave the stream where the serial decoder would: just before the
+   // marker that ends the scan
+   stbi__jpeg_reset(z);
+   z->s->img_buffer = p;
+   return 1;
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+   int unit, units;
+   STBI_SIMD_ALIGN(short, data[64]);
+   if (z->restart_interval && stbi__jpeg_parallel_for_fn) {
+      int r = stbi__parse_entropy_coded_data_parallel(z);
+      if (r >= 0) return r;
+   }
+
+   stbi__jpeg_reset(z);
+   units = stbi__jpeg_scan_units(z);
+   for (unit = 0; unit < units; ++unit) {
+      if (!stbi__jpeg_decode_unit(z, unit, data)) return 0;
+      // every block (non-interleaved) or MCU (interleaved) counts down the
+      // restart interval
+      if (--z->todo <= 0) {
+         if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+         // if it's NOT a restart, then just bail, so we get corrupt data
+         // rather than no data
+         if (!STBI__RESTART(z->marker)) return 1;
+         stbi__jpeg_reset(z);
+      }
+   }
+   return 1;
 }
 
 static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
@@ -3542,6 +3664,76 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// same filter as stbi__resample_row_hv_2_simd, 16 input pixels at a time
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // "prev" and "next" are curr shifted by one pixel across the 128-bit
+      // lane boundary, with the neighbours outside this group inserted.
+      __m256i lo_in = _mm256_permute2x128_si256(curr, curr, 0x08); // 0 | curr.lo
+      __m256i hi_in = _mm256_permute2x128_si256(curr, curr, 0x81); // curr.hi | 0
+      __m256i prv0 = _mm256_alignr_epi8(curr, lo_in, 14);
+      __m256i nxt0 = _mm256_alignr_epi8(hi_in, curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, (short) t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, (short) (3*in_near[i+16] + in_far[i+16]), 15);
+
+      // horizontal filter, polyphase:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, then undo scaling. the per-lane
+      // unpacks and pack leave the 32 output bytes in order.
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3716,6 +3908,68 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// same arithmetic as the sse2 path of stbi__YCbCr_to_RGB_simd, 16 pixels at a time
+static STBI__AVX2_TARGET void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m256i signflip  = _mm256_set1_epi16((short) 0x8000);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load, widen to short and left-shift by 8 (y gets 128 in the low byte)
+         __m256i y_bytes  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (y+i)));
+         __m256i cr_bytes = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcr+i)));
+         __m256i cb_bytes = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcb+i)));
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(y_bytes, 8), y_bias);
+         __m256i crw = _mm256_xor_si256(_mm256_slli_epi16(cr_bytes, 8), signflip); // -128
+         __m256i cbw = _mm256_xor_si256(_mm256_slli_epi16(cb_bytes, 8), signflip); // -128
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte, set up for transpose
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+         // transpose to interleave channels; each lane holds 8 pixels
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   // the sse2 kernel and generic code handle the tail
+   stbi__YCbCr_to_RGB_simd(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3724,17 +3978,26 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
 #ifdef STBI_SSE2
-   if (stbi__sse2_available()) {
+   if (stbi__simd_limit >= 1 && stbi__sse2_available()) {
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__simd_limit >= 2 && stbi__avx2_available()) {
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
-   j->idct_block_kernel = stbi__idct_simd;
-   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-   j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+   if (stbi__simd_limit >= 1) {
+      j->idct_block_kernel = stbi__idct_simd;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+   }
 #endif
 }
 
@@ -3980,6 +4243,11 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// literal/length table of the multi-symbol decoder; an entry resolves one
+// code of up to this many bits, or two literals whose codes fit together
+#define STBI__ZMULTI_BITS 11
+#define STBI__ZMULTI_MASK ((1 << STBI__ZMULTI_BITS) - 1)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4074,6 +4342,11 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+
+   // multi-symbol literal/length table, rebuilt for every huffman block:
+   // bits 0-4 code bits consumed, 5-6 literal count (0 = not in table,
+   // 1 = one symbol, 2 = two literals), 8-16 first symbol, 17-24 second
+   stbi__uint32 z_length_multi[1 << STBI__ZMULTI_BITS];
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4182,11 +4455,183 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+static void stbi__zbuild_length_multi(stbi__zbuf *a)
+{
+   stbi__zhuffman *z = &a->z_length;
+   stbi__uint32 *t = a->z_length_multi;
+   int s,k,j;
+
+   // single symbols, from the canonical code ranges of each length
+   memset(t, 0, sizeof(a->z_length_multi));
+   for (s=1; s <= STBI__ZMULTI_BITS; ++s) {
+      int count = (z->maxcode[s] >> (16-s)) - z->firstcode[s];
+      for (k=0; k < count; ++k) {
+         stbi__uint32 entry = (stbi__uint32) s | (1 << 5) | ((stbi__uint32) z->value[z->firstsymbol[s] + k] << 8);
+         for (j = stbi__bit_reverse(z->firstcode[s] + k, s); j < (1 << STBI__ZMULTI_BITS); j += 1 << s)
+            t[j] = entry;
+      }
+   }
+
+   // pair literals whose codes fit in the table together. the entry for the
+   // bits after the first code sits at a lower index, so walking down reads
+   // it before it is itself paired.
+   for (j = (1 << STBI__ZMULTI_BITS) - 1; j >= 0; --j) {
+      stbi__uint32 first = t[j], second;
+      int len1 = first & 31, sym1 = (first >> 8) & 511;
+      if (!first || sym1 >= 256) continue;
+      second = t[j >> len1];
+      if (((second >> 5) & 3) == 1 && ((second >> 8) & 511) < 256 && len1 + (int) (second & 31) <= STBI__ZMULTI_BITS)
+         t[j] = (stbi__uint32) (len1 + (second & 31)) | (2 << 5) | ((stbi__uint32) sym1 << 8) | (((second >> 8) & 255) << 17);
+   }
+}
+
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET)
+   stbi__uint64 v;
+   memcpy(&v, p, 8); // little endian
+   return v;
+#else
+   return (stbi__uint64) p[0]       | ((stbi__uint64) p[1] << 8)  | ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24) |
+         ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+#endif
+}
+
+// stbi__zhuffman_decode_slowpath on a 64-bit bit buffer
+static int stbi__zhuffman_decode64(stbi__zhuffman *z, stbi__uint64 *bits, int *num_bits)
+{
+   int b,s,k;
+   k = stbi__bit_reverse((int) (*bits & 0xffff), 16);
+   for (s=STBI__ZFAST_BITS+1; ; ++s)
+      if (k < z->maxcode[s])
+         break;
+   if (s >= 16) return -1; // invalid code!
+   b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
+   if (b >= (int) sizeof (z->size)) return -1;
+   if (z->size[b] != s) return -1;
+   *bits >>= s;
+   *num_bits -= s;
+   return z->value[b];
+}
+
+// inner loop of stbi__parse_huffman_block for when at least 8 input bytes and
+// a maximal match (plus copy slack) of output space remain. keeps a 64-bit
+// bit buffer that is refilled once per symbol without branches, which covers
+// the longest length/distance pair, and emits two literals per table hit when
+// their codes are short. returns 1 at end of block, 0 on error and -1 when
+// it ran out of room; unused whole bytes go back to the input either way.
+static int stbi__parse_huffman_block_fast(stbi__zbuf *a, char **pzout)
+{
+   char *zout = *pzout;
+   stbi_uc *in = a->zbuffer;
+   stbi__uint64 bits = a->code_buffer;
+   int num_bits = a->num_bits;
+   int result = -1;
+
+   while (a->zbuffer_end - in >= 8 && a->zout_end - zout >= 258 + 8) {
+      stbi__uint32 e;
+      int z,len,dist;
+      stbi_uc *p;
+
+      bits |= stbi__zload64(in) << num_bits;
+      in += (63 - num_bits) >> 3;
+      num_bits |= 56;
+
+      e = a->z_length_multi[bits & STBI__ZMULTI_MASK];
+      if (((e >> 5) & 3) == 2) {
+         zout[0] = (char) (e >> 8);
+         zout[1] = (char) (e >> 17);
+         zout += 2;
+         bits >>= e & 31;
+         num_bits -= e & 31;
+         continue;
+      }
+      if (e) {
+         z = (e >> 8) & 511;
+         bits >>= e & 31;
+         num_bits -= e & 31;
+      } else {
+         z = stbi__zhuffman_decode64(&a->z_length, &bits, &num_bits);
+         if (z < 0) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      }
+      if (z < 256) {
+         *zout++ = (char) z;
+         continue;
+      }
+      if (z == 256) {
+         result = 1;
+         break;
+      }
+      if (z >= 286) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+
+      z -= 257;
+      len = stbi__zlength_base[z];
+      if (stbi__zlength_extra[z]) {
+         len += (int) (bits & ((1 << stbi__zlength_extra[z]) - 1));
+         bits >>= stbi__zlength_extra[z];
+         num_bits -= stbi__zlength_extra[z];
+      }
+      e = a->z_distance.fast[bits & STBI__ZFAST_MASK];
+      if (e) {
+         z = e & 511;
+         bits >>= e >> 9;
+         num_bits -= e >> 9;
+      } else {
+         z = stbi__zhuffman_decode64(&a->z_distance, &bits, &num_bits);
+         if (z < 0) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      }
+      dist = stbi__zdist_base[z];
+      if (stbi__zdist_extra[z]) {
+         dist += (int) (bits & ((1 << stbi__zdist_extra[z]) - 1));
+         bits >>= stbi__zdist_extra[z];
+         num_bits -= stbi__zdist_extra[z];
+      }
+      if (dist == 0 || zout - a->zout_start < dist) { result = stbi__err("bad dist","Corrupt PNG"); break; }
+
+      p = (stbi_uc *) (zout - dist);
+      if (dist >= 8) {
+         // 8 byte chunks may run up to 7 bytes past the match; the room
+         // check above leaves space for that
+         char *end = zout + len;
+         do {
+            memcpy(zout, p, 8);
+            zout += 8;
+            p += 8;
+         } while (zout < end);
+         zout = end;
+      } else if (dist == 1) {
+         memset(zout, *p, len);
+         zout += len;
+      } else {
+         do *zout++ = *p++; while (--len);
+      }
+   }
+
+   in -= num_bits >> 3;
+   num_bits &= 7;
+   a->zbuffer = in;
+   a->code_buffer = (stbi__uint32) (bits & ((1u << num_bits) - 1));
+   a->num_bits = num_bits;
+   *pzout = zout;
+   return result;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
+   int fast = stbi__simd_limit >= 1;
+   if (fast)
+      stbi__zbuild_length_multi(a);
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      if (fast && a->zbuffer_end - a->zbuffer >= 8 && a->zout_end - zout >= 258 + 8) {
+         int r = stbi__parse_huffman_block_fast(a, &zout);
+         if (r >= 0) {
+            a->zout = zout;
+            return r;
+         }
+      }
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4535,6 +4980,124 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+stbi_inline static __m128i stbi__png_load4(const stbi_uc *p)
+{
+   int v;
+   memcpy(&v, p, 4);
+   return _mm_cvtsi32_si128(v);
+}
+
+// p = a + b - c, so |p-a| = |b-c|, |p-b| = |a-c| and |p-c| is their signed
+// sum; ties prefer a, then b
+stbi_inline static __m128i stbi__paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a16 = _mm_unpacklo_epi8(a, zero);
+   __m128i b16 = _mm_unpacklo_epi8(b, zero);
+   __m128i c16 = _mm_unpacklo_epi8(c, zero);
+   __m128i pa = _mm_sub_epi16(b16, c16);
+   __m128i pb = _mm_sub_epi16(a16, c16);
+   __m128i pc = _mm_add_epi16(pa, pb);
+   __m128i smallest, use_a, use_b, nearest;
+   pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+   pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+   pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+   smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+   use_a = _mm_cmpeq_epi16(smallest, pa);
+   use_b = _mm_cmpeq_epi16(smallest, pb);
+   nearest = _mm_or_si128(_mm_and_si128(use_b, b16), _mm_andnot_si128(use_b, c16));
+   nearest = _mm_or_si128(_mm_and_si128(use_a, a16), _mm_andnot_si128(use_a, nearest));
+   return _mm_packus_epi16(nearest, nearest);
+}
+
+// unfilters one row of 8-bit pixels with bpp (3 or 4) bytes each in raw and
+// out_bpp in cur and prior; out_bpp is either bpp or 4 for bpp 3, which also
+// sets alpha to 255. pixels are processed in the low 4 bytes of a register
+// (extra lanes are don't-care), Sub with 4 bytes per pixel four pixels at a
+// time as a prefix sum, Up and None as plain byte streams. prior must allow
+// reading one byte past the row; the first row passes zeros, which turns
+// Avg and Paeth into their first-row forms. matches the generic loop in
+// stbi__create_png_image_raw.
+static void stbi__png_unfilter_row_sse2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int filter, int bpp, int out_bpp, int width)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i one = _mm_set1_epi8(1);
+   __m128i alpha = _mm_cvtsi32_si128(out_bpp > bpp ? (int) 0xff000000 : 0);
+   __m128i a = zero, c = zero; // pixels left of the current one in cur and prior
+   int i = 0;
+
+   if (bpp == out_bpp && (filter == STBI__F_none || filter == STBI__F_up)) {
+      int n = width * bpp, k = 0;
+      if (filter == STBI__F_none) {
+         memcpy(cur, raw, n);
+         return;
+      }
+      for (; k + 16 <= n; k += 16)
+         _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(_mm_loadu_si128((const __m128i *) (raw + k)), _mm_loadu_si128((const __m128i *) (prior + k))));
+      for (; k < n; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return;
+   }
+
+   if (filter == STBI__F_sub && bpp == 4 && out_bpp == 4) {
+      for (; i + 4 <= width; i += 4) {
+         __m128i x = _mm_loadu_si128((const __m128i *) (raw + i*4));
+         x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+         x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+         x = _mm_add_epi8(x, a);
+         _mm_storeu_si128((__m128i *) (cur + i*4), x);
+         a = _mm_shuffle_epi32(x, 0xff);
+      }
+   }
+
+   // the last pixel may end the buffers, so it moves exactly bpp/out_bpp
+   // bytes; the others read and write 4 and let the next pixel overwrite
+   #define STBI__PNG_PIXELS(op) \
+      for (; i < width; ++i) { \
+         __m128i x, b = stbi__png_load4(prior + i*out_bpp); \
+         if (i + 1 < width) { \
+            x = stbi__png_load4(raw + i*bpp); \
+         } else { \
+            int v = 0; \
+            memcpy(&v, raw + i*bpp, bpp); \
+            x = _mm_cvtsi32_si128(v); \
+         } \
+         op; \
+         x = _mm_or_si128(x, alpha); \
+         if (i + 1 < width || out_bpp == 4) { \
+            int v = _mm_cvtsi128_si32(x); \
+            memcpy(cur + i*out_bpp, &v, 4); \
+         } else { \
+            int v = _mm_cvtsi128_si32(x); \
+            memcpy(cur + i*out_bpp, &v, 3); \
+         } \
+         a = x; \
+         c = b; \
+      }
+
+   switch (filter) {
+      case STBI__F_none:
+         STBI__PNG_PIXELS((void) 0)
+         break;
+      case STBI__F_sub:
+         STBI__PNG_PIXELS(x = _mm_add_epi8(x, a))
+         break;
+      case STBI__F_up:
+         STBI__PNG_PIXELS(x = _mm_add_epi8(x, b))
+         break;
+      case STBI__F_avg:
+         // floor((a+b)/2) from the rounding-up average
+         STBI__PNG_PIXELS(x = _mm_add_epi8(x, _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one))))
+         break;
+      case STBI__F_paeth:
+         STBI__PNG_PIXELS(x = _mm_add_epi8(x, stbi__paeth_sse2(a, b, c)))
+         break;
+   }
+   #undef STBI__PNG_PIXELS
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4562,6 +5125,28 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    // so just check for raw_len < img_len always.
    if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
 
+#ifdef STBI_SSE2
+   // 8-bit RGB and RGBA, optionally gaining alpha, take the sse2 row filters
+   if (depth == 8 && (img_n == 3 || img_n == 4) && (out_n == img_n || out_n == 4) &&
+       stbi__simd_limit >= 1 && stbi__sse2_available()) {
+      stbi_uc *zero = (stbi_uc *) stbi__malloc_mad2(x, out_n, 4);
+      if (!zero) return stbi__err("outofmem", "Out of memory");
+      memset(zero, 0, x*out_n + 4);
+      for (j=0; j < y; ++j) {
+         stbi_uc *cur = a->out + stride*j;
+         int filter = *raw++;
+         if (filter > 4) {
+            STBI_FREE(zero);
+            return stbi__err("invalid filter","Corrupt PNG");
+         }
+         stbi__png_unfilter_row_sse2(cur, j ? cur - stride : zero, raw, filter, img_n, out_n, x);
+         raw += img_width_bytes;
+      }
+      STBI_FREE(zero);
+      return 1;
+   }
+#endif
+
    for (j=0; j < y; ++j) {
       stbi_uc *cur = a->out + stride*j;
       stbi_uc *prior;